@@ -28,6 +28,16 @@ SOURCES += main.cpp\
         prism_qthreads.cpp \
     ../src/configure.cpp \
     ../src/WorkDispatcher.cpp \
+    ../src/ThreadPool.cpp \
+    ../src/ExecutionPolicy.cpp \
+    ../src/FFTBackend.cpp \
+    ../src/Instrumentation.cpp \
+    ../src/PerfCounters.cpp \
+    ../src/ResourcePlanner.cpp \
+    ../src/Autotuner.cpp \
+    ../src/SimulationResults.cpp \
+    ../src/SimulationProgress.cpp \
+    ../src/StageCache.cpp \
     ../src/Multislice_entry.cpp \
     ../src/Multislice_calcOutput.cpp \
     ../src/PRISM_entry.cpp \
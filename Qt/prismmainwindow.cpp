@@ -1821,7 +1821,7 @@ void PRISMMainWindow::updateOutputImage(){
             QMutexLocker gatekeeper(&outputLock);
 
             // create new empty image with appropriate dimensions
-            outputImage = QImage(output.get_dimk(), output.get_dimj(), QImage::Format_ARGB32);
+            outputImage = QImage(output.get_dimj(), output.get_dimk(), QImage::Format_ARGB32);
             }
             // update sliders to match dimensions of output, which also triggers a redraw of the image
             this->ui->slider_angmin->setMinimum(0);
@@ -1844,11 +1844,12 @@ void PRISMMainWindow::updateOutputFloatImage(){
         // integrate image into the float array, then convert to uchar
         size_t min_layer = this->ui->slider_angmin->value();
         size_t max_layer = this->ui->slider_angmax->value();
-        outputImage_float = Prismatic::zeros_ND<2, PRISMATIC_FLOAT_PRECISION>({{output.get_dimk(), output.get_dimj()}});
-        for (auto j = 0; j < output.get_dimk(); ++j){
-            for (auto i = 0; i < output.get_dimj(); ++i){
+        // output is stored as [layer, x, y, detector]
+        outputImage_float = Prismatic::zeros_ND<2, PRISMATIC_FLOAT_PRECISION>({{output.get_dimj(), output.get_dimk()}});
+        for (auto j = 0; j < output.get_dimj(); ++j){
+            for (auto i = 0; i < output.get_dimk(); ++i){
                  for (auto k = min_layer; k <= max_layer; ++k){
-                    outputImage_float.at(j,i) += output.at(0, j, i, k);
+                    outputImage_float.at(j,i) += output.at(0, i, j, k);
                 }
             }
         }
@@ -1870,8 +1871,8 @@ void PRISMMainWindow::updateOutputDisplay(){
 //    if (outputReady){
     if (checkoutputArrayExists()){
         QMutexLocker gatekeeper(&outputLock);
-            for (auto j = 0; j < output.get_dimk(); ++j){
-                for (auto i = 0; i < output.get_dimj(); ++i){
+            for (auto j = 0; j < output.get_dimj(); ++j){
+                for (auto i = 0; i < output.get_dimk(); ++i){
 //                    uchar val = getUcharFromFloat(outputImage_float.at(j,i),
 //                                                  contrast_outputMin,
 //                                                  contrast_outputMax);
@@ -2069,8 +2070,8 @@ void PRISMMainWindow::updateAlphaMax(){
     PRISMATIC_FLOAT_PRECISION f_x = 4 * meta->interpolationFactorX;
     PRISMATIC_FLOAT_PRECISION f_y = 4 * meta->interpolationFactorY;
     Array1D<size_t> imageSize({{(size_t)(meta->cellDim[1] * meta->tileY), (size_t)(meta->cellDim[2] * meta->tileX)}}, {{2}});
-    imageSize[0] = (size_t)std::max((PRISMATIC_FLOAT_PRECISION)4.0,  (PRISMATIC_FLOAT_PRECISION)(f_y * round(((PRISMATIC_FLOAT_PRECISION)imageSize[0]) / meta->realspacePixelSize[0] / f_y)));
-    imageSize[1] = (size_t)std::max((PRISMATIC_FLOAT_PRECISION)4.0,  (PRISMATIC_FLOAT_PRECISION)(f_x * round(((PRISMATIC_FLOAT_PRECISION)imageSize[1]) / meta->realspacePixelSize[1] / f_x)));
+    imageSize[0] = simulationGridSize((PRISMATIC_FLOAT_PRECISION)imageSize[0], meta->realspacePixelSize[0], f_y, meta->fftFriendlyGrid);
+    imageSize[1] = simulationGridSize((PRISMATIC_FLOAT_PRECISION)imageSize[1], meta->realspacePixelSize[1], f_x, meta->fftFriendlyGrid);
 
     long long ncx = (size_t) floor((PRISMATIC_FLOAT_PRECISION) imageSize[1] / 2);
     PRISMATIC_FLOAT_PRECISION dpx = 1.0 / ((PRISMATIC_FLOAT_PRECISION)imageSize[1] * meta->realspacePixelSize[1]);
@@ -0,0 +1,446 @@
+// Copyright Alan (AJ) Pryor, Jr. 2017
+// Transcribed from MATLAB code by Colin Ophus
+// Prismatic is distributed under the GNU General Public License (GPL)
+// If you use Prismatic, we kindly ask that you cite the following papers:
+
+// 1. Ophus, C.: A fast image simulation algorithm for scanning
+//    transmission electron microscopy. Advanced Structural and
+//    Chemical Imaging 3(1), 13 (2017)
+
+// 2. Pryor, Jr., A., Ophus, C., and Miao, J.: A Streaming Multi-GPU
+//    Implementation of Image Simulation Algorithms for Scanning
+//	  Transmission Electron Microscopy. arXiv:1706.08563 (2017)
+
+// prismatic-bench: reproducible timings of the individual simulation stages. Every benchmark does its
+// setup untimed, runs once to warm up (FFTW plans, caches, thread pool) and then reports the median of
+// the timed repetitions together with the throughput in the natural unit of the stage
+
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <algorithm>
+#include <functional>
+#include <thread>
+#include <cstdio>
+#include <cmath>
+#include "params.h"
+#include "configure.h"
+#include "meta.h"
+#include "ArrayND.h"
+#include "atom.h"
+#include "fileIO.h"
+#include "projectedPotential.h"
+#include "PRISM01_calcPotential.h"
+#include "PRISM02_calcSMatrix.h"
+#include "PRISM03_calcOutput.h"
+#include "Multislice_calcOutput.h"
+#include "ThreadPool.h"
+#include "FFTBackend.h"
+#include "H5Cpp.h"
+
+using namespace Prismatic;
+
+namespace
+{
+struct BenchOptions
+{
+	size_t numThreads = std::max(1u, std::thread::hardware_concurrency());
+	size_t repeats = 5;
+	size_t tile = 3;				   // unit cell tiling of the structure for the stage benchmarks
+	size_t syntheticAtoms = 200000; // atoms in the synthetic xyz file used for readAtoms_xyz
+	PRISMATIC_FLOAT_PRECISION pixelSize = 0.1;
+	PRISMATIC_FLOAT_PRECISION probeStep = 0.25;
+	std::string structure = "../SI100.XYZ";
+	std::string workDir = ".";
+	std::string filter = "";
+	FFTBackendType fftBackend = FFTBackendType::FFTW;
+	bool verbose = false;
+};
+
+struct BenchResult
+{
+	std::string name;
+	std::string problem;  // description of the problem size
+	double seconds;		  // median time of one repetition
+	double work;		  // work items per repetition
+	std::string unit;	  // name of the work items, e.g. probes
+	double bytes;		  // bytes moved per repetition, 0 if not meaningful
+};
+
+class SilenceOutput
+{
+	// the stages report progress on cout; swallow it while benchmarking unless -v was given
+public:
+	SilenceOutput(bool active) : old(nullptr)
+	{
+		if (active)
+			old = std::cout.rdbuf(sink.rdbuf());
+	}
+	~SilenceOutput()
+	{
+		if (old)
+			std::cout.rdbuf(old);
+	}
+
+private:
+	std::ostringstream sink;
+	std::streambuf *old;
+};
+
+double medianTime(const BenchOptions &opts, const std::function<void()> &setup, const std::function<void()> &body)
+{
+	//one untimed warm up run, then the median over the repetitions. setup runs untimed before every run
+	std::vector<double> times;
+	for (auto r = 0; r <= opts.repeats; ++r)
+	{
+		setup();
+		auto start = std::chrono::steady_clock::now();
+		body();
+		auto stop = std::chrono::steady_clock::now();
+		if (r > 0)
+			times.push_back(std::chrono::duration<double>(stop - start).count());
+	}
+	std::sort(times.begin(), times.end());
+	return times[times.size() / 2];
+}
+
+std::string tempFile(const BenchOptions &opts, const std::string &name)
+{
+	return opts.workDir + "/prismatic_bench_" + name;
+}
+
+Metadata<PRISMATIC_FLOAT_PRECISION> benchMeta(const BenchOptions &opts, const Algorithm algorithm, const bool potential3D)
+{
+	//deterministic settings: no thermal displacements, fixed seed, no file output besides the 3D stack
+	Metadata<PRISMATIC_FLOAT_PRECISION> meta;
+	meta.filenameAtoms = opts.structure;
+	meta.filenameOutput = tempFile(opts, "output.h5");
+	meta.algorithm = algorithm;
+	meta.potential3D = potential3D;
+	meta.includeThermalEffects = false;
+	meta.randomSeed = 11111;
+	meta.numThreads = opts.numThreads;
+	meta.numGPUs = 0;
+	meta.fftBackend = opts.fftBackend;
+	meta.tileX = meta.tileY = meta.tileZ = opts.tile;
+	meta.realspacePixelSize[0] = meta.realspacePixelSize[1] = opts.pixelSize;
+	meta.probeStepX = meta.probeStepY = opts.probeStep;
+	return meta;
+}
+
+void openOutput(Parameters<PRISMATIC_FLOAT_PRECISION> &pars)
+{
+	//select the CPU implementations of the stages and create the output file, as the entry points do
+	configure(pars.meta);
+	pars.outputFile = H5::H5File(pars.meta.filenameOutput.c_str(), H5F_ACC_TRUNC);
+	setupOutputFile(pars);
+}
+
+std::string cellString(const Parameters<PRISMATIC_FLOAT_PRECISION> &pars)
+{
+	std::stringstream ss;
+	ss << pars.atoms.size() << " atoms, " << pars.imageSize[1] << "x" << pars.imageSize[0] << " px";
+	return ss.str();
+}
+
+void writeSyntheticXYZ(const std::string &filename, const size_t numAtoms)
+{
+	//gold fcc lattice filling a cube, in the format read by readAtoms_xyz
+	const double a = 4.08;
+	const double basis[4][3] = {{0, 0, 0}, {0.5, 0.5, 0}, {0.5, 0, 0.5}, {0, 0.5, 0.5}};
+	const size_t n = (size_t)std::ceil(std::cbrt(numAtoms / 4.0));
+	std::ofstream f(filename);
+	f << "synthetic Au fcc for prismatic-bench\n";
+	f << std::fixed << std::setprecision(4) << n * a << " " << n * a << " " << n * a << "\n";
+	size_t count = 0;
+	for (auto k = 0; k < n && count < numAtoms; ++k)
+		for (auto j = 0; j < n && count < numAtoms; ++j)
+			for (auto i = 0; i < n && count < numAtoms; ++i)
+				for (auto b = 0; b < 4 && count < numAtoms; ++b, ++count)
+					f << 79 << " " << (i + basis[b][0]) * a << " " << (j + basis[b][1]) * a << " " << (k + basis[b][2]) * a << " 1.0 0.085\n";
+	f << "-1\n";
+}
+
+size_t fileSize(const std::string &filename)
+{
+	std::ifstream f(filename, std::ios::binary | std::ios::ate);
+	return f ? (size_t)f.tellg() : 0;
+}
+
+BenchResult bench_projPot(const BenchOptions &opts)
+{
+	//lookup tables as built by fetch_potentials, one per element for a range of elements
+	const PRISMATIC_FLOAT_PRECISION potBound = 3.0;
+	const size_t leng = (size_t)std::ceil(potBound / opts.pixelSize);
+	Array1D<PRISMATIC_FLOAT_PRECISION> xr = zeros_ND<1, PRISMATIC_FLOAT_PRECISION>({{2 * leng + 1}});
+	for (auto i = 0; i < xr.size(); ++i)
+		xr[i] = ((PRISMATIC_FLOAT_PRECISION)i - leng) * opts.pixelSize;
+	const size_t numZ = 20;
+	double seconds = medianTime(opts, [] {}, [&] {
+		for (size_t Z = 1; Z <= numZ; ++Z)
+			projPot(Z * 4, xr, xr);
+	});
+	std::stringstream ss;
+	ss << numZ << " tables of " << xr.size() << "x" << xr.size() << " px";
+	return BenchResult{"projPot", ss.str(), seconds, (double)numZ, "tables", 0};
+}
+
+BenchResult bench_readAtoms(const BenchOptions &opts, const std::string &name, const std::string &filename)
+{
+	size_t numAtoms = 0;
+	double seconds = medianTime(opts, [] {}, [&] { numAtoms = readAtoms_xyz(filename).size(); });
+	std::stringstream ss;
+	ss << numAtoms << " atoms";
+	return BenchResult{name, ss.str(), seconds, (double)numAtoms, "atoms", (double)fileSize(filename)};
+}
+
+BenchResult bench_potential(const BenchOptions &opts, const bool potential3D)
+{
+	Parameters<PRISMATIC_FLOAT_PRECISION> pars(benchMeta(opts, Algorithm::PRISM, potential3D));
+	double seconds = medianTime(opts, [] {}, [&] { PRISM01_calcPotential(pars); });
+	std::string name = potential3D ? "generateProjectedPotentials3D" : "generateProjectedPotentials";
+	return BenchResult{name, cellString(pars), seconds, (double)pars.atoms.size(), "atoms", 0};
+}
+
+BenchResult bench_Scompact(const BenchOptions &opts)
+{
+	//the full PRISM02 stage once sets up the beams, after which the compact S-matrix fill is timed alone
+	Parameters<PRISMATIC_FLOAT_PRECISION> pars(benchMeta(opts, Algorithm::PRISM, false));
+	openOutput(pars);
+	PRISM01_calcPotential(pars);
+	PRISM02_calcSMatrix(pars);
+	double seconds = medianTime(opts, [] {}, [&] { fill_Scompact_CPUOnly(pars); });
+	pars.outputFile.close();
+	std::stringstream ss;
+	ss << pars.numberBeams << " beams, " << pars.imageSize[1] << "x" << pars.imageSize[0] << "x" << pars.pot.get_dimk() << " px";
+	return BenchResult{"fill_Scompact_CPUOnly", ss.str(), seconds, (double)pars.numberBeams, "beams", 0};
+}
+
+BenchResult bench_PRISMOutput(const BenchOptions &opts)
+{
+	//probes of buildSignal_CPU, driven by the threaded PRISM03 loop; the output is reset between runs
+	Parameters<PRISMATIC_FLOAT_PRECISION> pars(benchMeta(opts, Algorithm::PRISM, false));
+	openOutput(pars);
+	PRISM01_calcPotential(pars);
+	PRISM02_calcSMatrix(pars);
+	PRISM03_calcOutput(pars);
+	double seconds = medianTime(opts, [&] { std::fill(pars.output.begin(), pars.output.end(), 0); },
+									[&] { buildPRISMOutput_CPUOnly(pars); });
+	pars.outputFile.close();
+	std::stringstream ss;
+	ss << pars.numProbes << " probes, " << pars.numberBeams << " beams, " << pars.imageSizeReduce[1] << "x" << pars.imageSizeReduce[0] << " px";
+	return BenchResult{"buildSignal_CPU", ss.str(), seconds, (double)pars.numProbes, "probes", 0};
+}
+
+BenchResult bench_multislice(const BenchOptions &opts)
+{
+	//probes of getMultisliceProbe_CPU_batch, driven by the threaded multislice loop
+	Parameters<PRISMATIC_FLOAT_PRECISION> pars(benchMeta(opts, Algorithm::Multislice, false));
+	openOutput(pars);
+	PRISM01_calcPotential(pars);
+	Multislice_calcOutput(pars);
+	double seconds = medianTime(opts, [&] { std::fill(pars.output.begin(), pars.output.end(), 0); },
+									[&] { buildMultisliceOutput_CPUOnly(pars); });
+	pars.outputFile.close();
+	std::stringstream ss;
+	ss << pars.numProbes << " probes, " << pars.psiProbeInit.get_dimi() << "x" << pars.psiProbeInit.get_dimj() << "x" << pars.numPlanes << " px";
+	return BenchResult{"getMultisliceProbe_CPU_batch", ss.str(), seconds, (double)pars.numProbes, "probes", 0};
+}
+
+BenchResult bench_writeDatacube4D(const BenchOptions &opts)
+{
+	//one diffraction pattern per probe position into a chunked 4D dataset laid out like setup4DOutput's.
+	//writeDatacube4D reads back and accumulates every pattern, so each pattern moves twice
+	const size_t numXprobes = 32, numYprobes = 32, nq = 128;
+	Parameters<PRISMATIC_FLOAT_PRECISION> pars;
+	pars.outputFile = H5::H5File(tempFile(opts, "4D.h5").c_str(), H5F_ACC_TRUNC);
+	{
+		H5::Group group = pars.outputFile.createGroup("bench");
+		hsize_t data_dims[4] = {numXprobes, numYprobes, nq, nq};
+		hsize_t chunkDims[4] = {1, 1, nq, nq};
+		H5::DSetCreatPropList plist;
+		plist.setChunk(4, chunkDims);
+		H5::DataSpace mspace(4, data_dims);
+		H5::DataSet data = group.createDataSet("data", PFP_TYPE, mspace, plist);
+	}
+
+	Array2D<PRISMATIC_FLOAT_PRECISION> pattern = ones_ND<2, PRISMATIC_FLOAT_PRECISION>({{nq, nq}});
+	Array2D<PRISMATIC_FLOAT_PRECISION> readBuffer = zeros_ND<2, PRISMATIC_FLOAT_PRECISION>({{nq, nq}});
+	hsize_t mdims[4] = {1, 1, nq, nq};
+	double seconds = medianTime(opts, [] {}, [&] {
+		for (hsize_t ax = 0; ax < numXprobes; ++ax)
+		{
+			for (hsize_t ay = 0; ay < numYprobes; ++ay)
+			{
+				hsize_t offset[4] = {ax, ay, 0, 0};
+				writeDatacube4D(pars, &pattern[0], &readBuffer[0], mdims, offset, 1, "bench");
+			}
+		}
+	});
+	pars.outputFile.close();
+	std::remove(tempFile(opts, "4D.h5").c_str());
+
+	std::stringstream ss;
+	ss << numXprobes << "x" << numYprobes << " probes, " << nq << "x" << nq << " px";
+	const double bytes = 2.0 * numXprobes * numYprobes * nq * nq * sizeof(PRISMATIC_FLOAT_PRECISION);
+	return BenchResult{"writeDatacube4D", ss.str(), seconds, (double)(numXprobes * numYprobes), "probes", bytes};
+}
+
+void printResult(const BenchResult &r)
+{
+	std::cout << std::left << std::setw(32) << r.name << std::setw(44) << r.problem << std::right
+			  << std::fixed << std::setprecision(3) << std::setw(12) << r.seconds * 1e3 << " ms"
+			  << std::setprecision(1) << std::setw(14) << r.work / r.seconds << " " << std::left << std::setw(8) << (r.unit + "/s");
+	if (r.bytes > 0)
+		std::cout << std::right << std::setprecision(3) << std::setw(10) << r.bytes / r.seconds / 1e9 << " GB/s";
+	std::cout << std::endl;
+}
+
+void printUsage()
+{
+	std::cout << "Usage: prismatic-bench [options]\n"
+			  << "  -i filename    : structure used by the stage benchmarks (default ../SI100.XYZ)\n"
+			  << "  -j value       : number of CPU threads (default: all cores)\n"
+			  << "  -r value       : timed repetitions per benchmark, the median is reported (default 5)\n"
+			  << "  -T value       : tile the structure this many times along x, y and z (default 3)\n"
+			  << "  -f value       : real space pixel size in Angstroms (default 0.1)\n"
+			  << "  -P value       : probe step in Angstroms (default 0.25)\n"
+			  << "  -n value       : number of atoms in the synthetic xyz file (default 200000)\n"
+			  << "  -d directory   : directory for temporary files (default .)\n"
+			  << "  --filter text  : only run benchmarks whose name contains text\n"
+			  << "  --fft-backend name : FFT library used by the stages, fftw or pocketfft (default fftw)\n"
+			  << "  -v             : show the output of the simulation stages\n"
+			  << "  -h             : print this message" << std::endl;
+}
+
+bool parseOptions(BenchOptions &opts, int argc, const char **argv)
+{
+	for (int a = 1; a < argc; ++a)
+	{
+		const std::string arg = argv[a];
+		if (arg == "-h" || arg == "--help")
+			return false;
+		if (arg == "-v")
+		{
+			opts.verbose = true;
+			continue;
+		}
+		if (a + 1 >= argc)
+		{
+			std::cout << "Missing value for " << arg << std::endl;
+			return false;
+		}
+		const std::string val = argv[++a];
+		try
+		{
+			if (arg == "-i")
+				opts.structure = val;
+			else if (arg == "-j")
+				opts.numThreads = std::max(1, std::stoi(val));
+			else if (arg == "-r")
+				opts.repeats = std::max(1, std::stoi(val));
+			else if (arg == "-T")
+				opts.tile = std::max(1, std::stoi(val));
+			else if (arg == "-f")
+				opts.pixelSize = std::stod(val);
+			else if (arg == "-P")
+				opts.probeStep = std::stod(val);
+			else if (arg == "-n")
+				opts.syntheticAtoms = std::max(1, std::stoi(val));
+			else if (arg == "-d")
+				opts.workDir = val;
+			else if (arg == "--filter")
+				opts.filter = val;
+			else if (arg == "--fft-backend")
+			{
+				if (!parseFFTBackend(val, opts.fftBackend) || !fftBackendAvailable(opts.fftBackend))
+				{
+					std::cout << "FFT backend " << val << " is not available in this build" << std::endl;
+					return false;
+				}
+			}
+			else
+			{
+				std::cout << "Unknown option " << arg << std::endl;
+				return false;
+			}
+		}
+		catch (const std::exception &)
+		{
+			std::cout << "Invalid value " << val << " for " << arg << std::endl;
+			return false;
+		}
+	}
+	return true;
+}
+} // namespace
+
+int main(int argc, const char **argv)
+{
+	BenchOptions opts;
+	if (!parseOptions(opts, argc, argv))
+	{
+		printUsage();
+		return 1;
+	}
+	if (fileSize(opts.structure) == 0)
+	{
+		std::cout << "Cannot read structure file " << opts.structure << std::endl;
+		return 1;
+	}
+
+	ThreadPool::instance().configure(opts.numThreads);
+	setFFTBackend(opts.fftBackend);
+	const std::string syntheticFile = tempFile(opts, "synthetic.xyz");
+	writeSyntheticXYZ(syntheticFile, opts.syntheticAtoms);
+
+	std::vector<std::pair<std::string, std::function<BenchResult()>>> benchmarks = {
+		{"projPot", [&] { return bench_projPot(opts); }},
+		{"readAtoms_xyz", [&] { return bench_readAtoms(opts, "readAtoms_xyz", opts.structure); }},
+		{"readAtoms_xyz_synthetic", [&] { return bench_readAtoms(opts, "readAtoms_xyz_synthetic", syntheticFile); }},
+		{"generateProjectedPotentials", [&] { return bench_potential(opts, false); }},
+		{"generateProjectedPotentials3D", [&] { return bench_potential(opts, true); }},
+		{"fill_Scompact_CPUOnly", [&] { return bench_Scompact(opts); }},
+		{"buildSignal_CPU", [&] { return bench_PRISMOutput(opts); }},
+		{"getMultisliceProbe_CPU_batch", [&] { return bench_multislice(opts); }},
+		{"writeDatacube4D", [&] { return bench_writeDatacube4D(opts); }}};
+
+	std::cout << "prismatic-bench: " << opts.numThreads << " threads, " << fftBackendName(opts.fftBackend) << " FFTs, " << opts.repeats << " repetitions (median), structure "
+			  << opts.structure << " tiled " << opts.tile << "x" << opts.tile << "x" << opts.tile << std::endl;
+	std::cout << std::left << std::setw(32) << "benchmark" << std::setw(44) << "problem" << std::right << std::setw(15) << "time"
+			  << std::setw(23) << "throughput" << std::endl;
+
+	int status = 0;
+	for (auto &b : benchmarks)
+	{
+		if (b.first.find(opts.filter) == std::string::npos)
+			continue;
+		try
+		{
+			BenchResult result;
+			{
+				SilenceOutput quiet(!opts.verbose);
+				result = b.second();
+			}
+			printResult(result);
+		}
+		catch (const std::exception &e)
+		{
+			std::cout << std::left << std::setw(32) << b.first << "failed: " << e.what() << std::endl;
+			status = 1;
+		}
+		catch (const H5::Exception &e)
+		{
+			std::cout << std::left << std::setw(32) << b.first << "failed: " << e.getDetailMsg() << std::endl;
+			status = 1;
+		}
+	}
+
+	std::remove(syntheticFile.c_str());
+	std::remove(tempFile(opts, "output.h5").c_str());
+	return status;
+}
@@ -0,0 +1,162 @@
+// Copyright Alan (AJ) Pryor, Jr. 2017
+// Transcribed from MATLAB code by Colin Ophus
+// Prismatic is distributed under the GNU General Public License (GPL)
+// If you use Prismatic, we kindly ask that you cite the following papers:
+
+// 1. Ophus, C.: A fast image simulation algorithm for scanning
+//    transmission electron microscopy. Advanced Structural and
+//    Chemical Imaging 3(1), 13 (2017)
+
+// 2. Pryor, Jr., A., Ophus, C., and Miao, J.: A Streaming Multi-GPU
+//    Implementation of Image Simulation Algorithms for Scanning
+//	  Transmission Electron Microscopy. arXiv:1706.08563 (2017)
+
+#ifndef PRISM_ARRAYALLOCATOR_H
+#define PRISM_ARRAYALLOCATOR_H
+
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+#include <vector>
+#include <algorithm>
+#include <iterator>
+#include <utility>
+#include <type_traits>
+#include "ThreadPool.h"
+#ifdef _WIN32
+#include <malloc.h>
+#endif
+#if defined(__linux__)
+#include <sys/mman.h>
+#endif
+
+namespace Prismatic
+{
+struct ArrayAllocationPolicy
+{
+	// how ArrayND storage is allocated and first touched; set once per simulation from the metadata, and kept
+	// by the simulation's ThreadPool so that overlapping runs do not share it
+	size_t alignment = 64;				  // bytes; enough for AVX-512 loads and what FFTW prefers
+	bool hugePages = false;				  // advise transparent huge pages for large buffers
+	size_t hugePageSize = 2 * 1024 * 1024; // large buffers are aligned to this when hugePages is set
+	size_t parallelThreshold = 4 * 1024 * 1024; // bytes below which a buffer is filled by the calling thread
+};
+
+inline ArrayAllocationPolicy &arrayAllocationPolicy()
+{
+	return ThreadPool::instance().allocationPolicy();
+}
+
+inline void *alignedAllocate(size_t bytes)
+{
+	const ArrayAllocationPolicy &policy = arrayAllocationPolicy();
+	const bool huge = policy.hugePages && bytes >= policy.hugePageSize;
+	const size_t alignment = huge ? policy.hugePageSize : policy.alignment;
+	void *ptr = nullptr;
+#ifdef _WIN32
+	ptr = _aligned_malloc(bytes, alignment);
+#else
+	if (posix_memalign(&ptr, alignment, bytes) != 0)
+		ptr = nullptr;
+#endif
+	if (ptr == nullptr)
+		throw std::bad_alloc();
+#if defined(__linux__) && defined(MADV_HUGEPAGE)
+	if (huge)
+		madvise(ptr, bytes, MADV_HUGEPAGE); //advisory only, ignore failure
+#endif
+	return ptr;
+}
+
+inline void alignedFree(void *ptr)
+{
+#ifdef _WIN32
+	_aligned_free(ptr);
+#else
+	free(ptr);
+#endif
+}
+
+template <class T>
+class ArrayAllocator
+{
+	// std::vector allocator for ArrayND storage. Memory is aligned according to arrayAllocationPolicy()
+	// and default insertion of trivially copyable types leaves memory untouched, so that pages are first
+	// touched by whichever threads later fill the buffer (see parallelFill)
+public:
+	typedef T value_type;
+	template <class U>
+	struct rebind
+	{
+		typedef ArrayAllocator<U> other;
+	};
+
+	ArrayAllocator() noexcept {};
+	template <class U>
+	ArrayAllocator(const ArrayAllocator<U> &) noexcept {};
+
+	T *allocate(size_t n)
+	{
+		if (n == 0)
+			return nullptr;
+		if (n > size_t(-1) / sizeof(T))
+			throw std::bad_alloc();
+		return static_cast<T *>(alignedAllocate(n * sizeof(T)));
+	}
+
+	void deallocate(T *ptr, size_t)
+	{
+		if (ptr != nullptr)
+			alignedFree(ptr);
+	}
+
+	template <class U>
+	void construct(U *ptr)
+	{
+		defaultConstruct(ptr, std::is_trivially_copyable<U>());
+	}
+
+	template <class U, class... Args>
+	void construct(U *ptr, Args &&... args)
+	{
+		::new ((void *)ptr) U(std::forward<Args>(args)...);
+	}
+
+private:
+	template <class U>
+	void defaultConstruct(U *, std::true_type) {}
+	template <class U>
+	void defaultConstruct(U *ptr, std::false_type) { ::new ((void *)ptr) U(); }
+};
+
+template <class T, class U>
+bool operator==(const ArrayAllocator<T> &, const ArrayAllocator<U> &) { return true; }
+
+template <class T, class U>
+bool operator!=(const ArrayAllocator<T> &, const ArrayAllocator<U> &) { return false; }
+
+template <class Iterator, class T>
+void parallelFill(Iterator first, Iterator last, const T &val)
+{
+	// fill [first, last) with one contiguous chunk per worker of the ThreadPool, so that on NUMA systems
+	// each chunk's pages are first touched, and therefore placed, near the (pinned) worker that fills it
+	const ArrayAllocationPolicy &policy = arrayAllocationPolicy();
+	const size_t n = std::distance(first, last);
+	const size_t numThreads = std::min(ThreadPool::instance().size(), std::max((size_t)1, n * sizeof(T) / policy.parallelThreshold));
+	if (numThreads <= 1)
+	{
+		std::fill(first, last, val);
+		return;
+	}
+
+	const size_t chunk = (n + numThreads - 1) / numThreads;
+	ThreadPool::instance().run(numThreads, [&](size_t t) {
+		const size_t start = std::min(n, t * chunk);
+		const size_t stop = std::min(n, start + chunk);
+		std::fill(first + start, first + stop, val);
+	});
+}
+
+} // namespace Prismatic
+
+#endif //PRISM_ARRAYALLOCATOR_H
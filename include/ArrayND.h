@@ -22,19 +22,114 @@
 #include <fstream>
 #include <cstring>
 #include <complex>
+#include "ArrayAllocator.h"
 namespace Prismatic
 {
+// Elementwise arithmetic on ArrayND is evaluated lazily. Each operator returns a lightweight expression
+// node instead of a new array, and the whole expression is computed in a single loop when it is assigned
+// to an ArrayND, so chains like (a + b) * c / d allocate at most once and sweep memory once.
+// Expression nodes hold arrays by reference, so they should not outlive the arrays they refer to; assign
+// them to an ArrayND rather than storing them with auto.
+template <class E>
+struct ArrayExpr
+{
+	const E &self() const { return static_cast<const E &>(*this); }
+};
+
+template <size_t N, class T>
+class ArrayND;
+
+// arrays are held by reference inside expressions, nested expressions by value
+template <class E>
+struct ArrayExprOperand
+{
+	typedef const E type;
+};
+
 template <size_t N, class T>
-class ArrayND
+struct ArrayExprOperand<ArrayND<N, T>>
+{
+	typedef const ArrayND<N, T> &type;
+};
+
+struct ArrayAdd
+{
+	template <class T>
+	static T apply(const T &a, const T &b) { return a + b; }
+};
+
+struct ArraySubtract
+{
+	template <class T>
+	static T apply(const T &a, const T &b) { return a - b; }
+};
+
+struct ArrayMultiply
+{
+	template <class T>
+	static T apply(const T &a, const T &b) { return a * b; }
+};
+
+struct ArrayDivide
+{
+	template <class T>
+	static T apply(const T &a, const T &b) { return a / b; }
+};
+
+template <class L, class R, class Op>
+class ArrayBinaryExpr : public ArrayExpr<ArrayBinaryExpr<L, R, Op>>
+{
+public:
+	typedef typename L::value_type value_type;
+	typedef typename L::dims_type dims_type;
+	ArrayBinaryExpr(const L &_lhs, const R &_rhs) : lhs(_lhs), rhs(_rhs){};
+	value_type operator[](const size_t &i) const { return Op::apply(lhs[i], rhs[i]); }
+	size_t size() const { return lhs.size(); }
+	dims_type get_dimarr() const { return lhs.get_dimarr(); }
+
+private:
+	typename ArrayExprOperand<L>::type lhs;
+	typename ArrayExprOperand<R>::type rhs;
+};
+
+// array-scalar expression; Left selects whether the scalar is the left operand
+template <class E, class Op, bool Left>
+class ArrayScalarExpr : public ArrayExpr<ArrayScalarExpr<E, Op, Left>>
+{
+public:
+	typedef typename E::value_type value_type;
+	typedef typename E::dims_type dims_type;
+	ArrayScalarExpr(const E &_expr, const value_type &_val) : expr(_expr), val(_val){};
+	value_type operator[](const size_t &i) const { return Left ? Op::apply(val, expr[i]) : Op::apply(expr[i], val); }
+	size_t size() const { return expr.size(); }
+	dims_type get_dimarr() const { return expr.get_dimarr(); }
+
+private:
+	typename ArrayExprOperand<E>::type expr;
+	const value_type val;
+};
+
+template <size_t N, class T>
+class ArrayND : public ArrayExpr<ArrayND<N, T>>
 {
 	// ND array class for data indexed as C-style, i.e. arr.at(k,j,i) where i is the fastest varying index
 	// and k is the slowest
 
-	// T is expected to be a std::vector
+	// T is expected to be a std::vector; elements are stored in an equivalent vector using ArrayAllocator
 public:
-	ArrayND(T _data,
+	typedef typename T::value_type value_type;
+	typedef std::array<size_t, N> dims_type;
+	typedef std::vector<value_type, ArrayAllocator<value_type>> storage_type;
+	ArrayND(const T &_data,
 			std::array<size_t, N> _dims);
+	ArrayND(const std::array<size_t, N> &_dims, const value_type &val);
 	ArrayND(){};
+	ArrayND(const ArrayND<N, T> &other) = default;
+	ArrayND(ArrayND<N, T> &&other) = default;
+	ArrayND<N, T> &operator=(const ArrayND<N, T> &other) = default;
+	ArrayND<N, T> &operator=(ArrayND<N, T> &&other) = default;
+	template <class E>
+	ArrayND(const ArrayExpr<E> &expr);
 	size_t get_dimi() const { return this->dims[N - 1]; }
 	size_t get_dimj() const { return this->dims[N - 2]; }
 	size_t get_dimk() const { return this->dims[N - 3]; }
@@ -44,10 +139,10 @@ public:
 	std::array<size_t, N> get_dimarr() const { return this->dims;}
 	std::array<size_t, N-1> get_strides() const { return this->strides;}
 	size_t size() const { return this->arr_size; }
-	typename T::iterator begin();
-	typename T::iterator end();
-	typename T::const_iterator begin() const;
-	typename T::const_iterator end() const;
+	typename storage_type::iterator begin();
+	typename storage_type::iterator end();
+	typename storage_type::const_iterator begin() const;
+	typename storage_type::const_iterator end() const;
 	typename T::value_type &at(const size_t &i);
 	typename T::value_type &at(const size_t &j, const size_t &i);
 	typename T::value_type &at(const size_t &k, const size_t &j, const size_t &i);
@@ -59,26 +154,16 @@ public:
 
 	typename T::value_type &operator[](const size_t &i);
 	typename T::value_type operator[](const size_t &i) const;
-	ArrayND<N, T> operator-(const ArrayND<N, T> &other);
-	ArrayND<N, T> operator+(const ArrayND<N, T> &other);
-	ArrayND<N, T> operator*(const ArrayND<N, T> &other);
-	ArrayND<N, T> operator/(const ArrayND<N, T> &other);
-	ArrayND<N, T> operator-(const typename T::value_type &val);
-	ArrayND<N, T> operator+(const typename T::value_type &val);
-	ArrayND<N, T> operator*(const typename T::value_type &val);
-	ArrayND<N, T> operator/(const typename T::value_type &val);
-	ArrayND<N, T> operator-(const ArrayND<N, T> &other) const;
-	ArrayND<N, T> operator+(const ArrayND<N, T> &other) const;
-	ArrayND<N, T> operator*(const ArrayND<N, T> &other) const;
-	ArrayND<N, T> operator/(const ArrayND<N, T> &other) const;
-	ArrayND<N, T> &operator-=(const ArrayND<N, T> &other);
-	ArrayND<N, T> &operator+=(const ArrayND<N, T> &other);
-	ArrayND<N, T> &operator*=(const ArrayND<N, T> &other);
-	ArrayND<N, T> &operator/=(const ArrayND<N, T> &other);
-	ArrayND<N, T> operator-(const typename T::value_type &val) const;
-	ArrayND<N, T> operator+(const typename T::value_type &val) const;
-	ArrayND<N, T> operator*(const typename T::value_type &val) const;
-	ArrayND<N, T> operator/(const typename T::value_type &val) const;
+	template <class E>
+	ArrayND<N, T> &operator=(const ArrayExpr<E> &expr);
+	template <class E>
+	ArrayND<N, T> &operator-=(const ArrayExpr<E> &other);
+	template <class E>
+	ArrayND<N, T> &operator+=(const ArrayExpr<E> &other);
+	template <class E>
+	ArrayND<N, T> &operator*=(const ArrayExpr<E> &other);
+	template <class E>
+	ArrayND<N, T> &operator/=(const ArrayExpr<E> &other);
 	ArrayND<N, T> &operator-=(const typename T::value_type &val);
 	ArrayND<N, T> &operator+=(const typename T::value_type &val);
 	ArrayND<N, T> &operator*=(const typename T::value_type &val);
@@ -87,15 +172,16 @@ public:
 	inline void toMRC_f(const char *filename) const;
 
 private:
+	void setDims(const std::array<size_t, N> &_dims);
 	std::array<size_t, N> dims;
 	std::array<size_t, N - 1> strides;
 	size_t arr_size;
-	T data;
+	storage_type data;
 };
 
 template <size_t N, class T>
-ArrayND<N, T>::ArrayND(T _data,
-					   std::array<size_t, N> _dims) : data(_data)
+ArrayND<N, T>::ArrayND(const T &_data,
+					   std::array<size_t, N> _dims) : data(_data.begin(), _data.end())
 {
 	size_t _size = 1;
 	for (auto &i : _dims)
@@ -104,6 +190,35 @@ ArrayND<N, T>::ArrayND(T _data,
 	{
 		throw std::domain_error("PRISM: Size mismatch! Desired array size does not match size of input data\n");
 	}
+	this->setDims(_dims);
+};
+
+template <size_t N, class T>
+ArrayND<N, T>::ArrayND(const std::array<size_t, N> &_dims, const value_type &val)
+{
+	// allocate without touching the memory, then fill in parallel for NUMA-friendly page placement
+	this->setDims(_dims);
+	data.resize(this->arr_size);
+	parallelFill(data.begin(), data.end(), val);
+};
+
+template <size_t N, class T>
+template <class E>
+ArrayND<N, T>::ArrayND(const ArrayExpr<E> &expr) : data(expr.self().size())
+{
+	// evaluate an expression into newly allocated storage
+	const E &e = expr.self();
+	this->setDims(e.get_dimarr());
+	for (size_t i = 0; i < this->arr_size; ++i)
+		data[i] = e[i];
+};
+
+template <size_t N, class T>
+void ArrayND<N, T>::setDims(const std::array<size_t, N> &_dims)
+{
+	size_t _size = 1;
+	for (auto &i : _dims)
+		_size *= i;
 	this->arr_size = _size;
 	this->dims = _dims;
 
@@ -116,16 +231,16 @@ ArrayND<N, T>::ArrayND(T _data,
 };
 
 template <size_t N, class T>
-typename T::iterator ArrayND<N, T>::begin() { return this->data.begin(); }
+typename ArrayND<N, T>::storage_type::iterator ArrayND<N, T>::begin() { return this->data.begin(); }
 
 template <size_t N, class T>
-typename T::iterator ArrayND<N, T>::end() { return this->data.end(); }
+typename ArrayND<N, T>::storage_type::iterator ArrayND<N, T>::end() { return this->data.end(); }
 
 template <size_t N, class T>
-typename T::const_iterator ArrayND<N, T>::begin() const { return this->data.begin(); }
+typename ArrayND<N, T>::storage_type::const_iterator ArrayND<N, T>::begin() const { return this->data.begin(); }
 
 template <size_t N, class T>
-typename T::const_iterator ArrayND<N, T>::end() const { return this->data.end(); }
+typename ArrayND<N, T>::storage_type::const_iterator ArrayND<N, T>::end() const { return this->data.end(); }
 
 template <size_t N, class T>
 typename T::value_type &ArrayND<N, T>::at(const size_t &i)
@@ -182,241 +297,178 @@ template <size_t N, class T>
 typename T::value_type ArrayND<N, T>::operator[](const size_t &i) const { return data[i]; }
 
 template <size_t N, class T>
-ArrayND<N, T> ArrayND<N, T>::operator-(const ArrayND<N, T> &other)
-{
-	ArrayND<N, T> result(*this);
-	typename T::value_type *o = other.begin();
-	for (auto &i : result)
-		i -= *o++;
-	return result;
-}
-
-template <size_t N, class T>
-ArrayND<N, T> ArrayND<N, T>::operator+(const ArrayND<N, T> &other)
-{
-	ArrayND<N, T> result(*this);
-	typename T::value_type *o = other.begin();
-	for (auto &i : result)
-		i += *o++;
-	return result;
-}
-
-template <size_t N, class T>
-ArrayND<N, T> ArrayND<N, T>::operator*(const ArrayND<N, T> &other)
-{
-	ArrayND<N, T> result(*this);
-	typename T::value_type *o = other.begin();
-	for (auto &i : result)
-		i *= *o++;
-	return result;
-}
-
-template <size_t N, class T>
-ArrayND<N, T> ArrayND<N, T>::operator/(const ArrayND<N, T> &other)
+template <class E>
+ArrayND<N, T> &ArrayND<N, T>::operator=(const ArrayExpr<E> &expr)
 {
-	ArrayND<N, T> result(*this);
-	typename T::value_type *o = other.begin();
-	for (auto &i : result)
-		i /= *o++;
-	return result;
+	// reuse the existing storage when the shape matches. Each element only depends on the same element
+	// of its operands, so this is safe even if the expression refers to this array
+	const E &e = expr.self();
+	if (this->data.size() == e.size() && this->dims == e.get_dimarr())
+	{
+		for (size_t i = 0; i < this->arr_size; ++i)
+			data[i] = e[i];
+	}
+	else
+	{
+		*this = ArrayND<N, T>(expr);
+	}
+	return *this;
 }
 
 template <size_t N, class T>
-ArrayND<N, T> ArrayND<N, T>::operator-(const typename T::value_type &val)
+ArrayND<N, T> &ArrayND<N, T>::operator-=(const typename T::value_type &val)
 {
-	ArrayND<N, T> result(*this);
-	for (auto &i : result)
+	for (auto &i : (*this))
 		i -= val;
-	return result;
+	return *this;
 }
 
 template <size_t N, class T>
-ArrayND<N, T> ArrayND<N, T>::operator+(const typename T::value_type &val)
+ArrayND<N, T> &ArrayND<N, T>::operator+=(const typename T::value_type &val)
 {
-	ArrayND<N, T> result(*this);
-	for (auto &i : result)
+	for (auto &i : (*this))
 		i += val;
-	return result;
+	return *this;
 }
 
 template <size_t N, class T>
-ArrayND<N, T> ArrayND<N, T>::operator*(const typename T::value_type &val)
+ArrayND<N, T> &ArrayND<N, T>::operator*=(const typename T::value_type &val)
 {
-	ArrayND<N, T> result(*this);
-	for (auto &i : result)
+	for (auto &i : (*this))
 		i *= val;
-	return result;
+	return *this;
 }
 
 template <size_t N, class T>
-ArrayND<N, T> ArrayND<N, T>::operator/(const typename T::value_type &val)
+ArrayND<N, T> &ArrayND<N, T>::operator/=(const typename T::value_type &val)
 {
-	ArrayND<N, T> result(*this);
-	for (auto &i : result)
+	for (auto &i : (*this))
 		i /= val;
-	return result;
+	return *this;
 }
 
 template <size_t N, class T>
-ArrayND<N, T> ArrayND<N, T>::operator-(const ArrayND<N, T> &other) const
+template <class E>
+ArrayND<N, T> &ArrayND<N, T>::operator-=(const ArrayExpr<E> &other)
 {
-	ArrayND<N, T> result(*this);
-	typename T::value_type *o = other.begin();
-	for (auto &i : result)
-		i -= *o++;
-	return result;
+	const E &o = other.self();
+	for (size_t i = 0; i < this->arr_size; ++i)
+		data[i] -= o[i];
+	return *this;
 }
 
 template <size_t N, class T>
-ArrayND<N, T> ArrayND<N, T>::operator+(const ArrayND<N, T> &other) const
+template <class E>
+ArrayND<N, T> &ArrayND<N, T>::operator+=(const ArrayExpr<E> &other)
 {
-	ArrayND<N, T> result(*this);
-	typename T::value_type *o = other.begin();
-	for (auto &i : result)
-		i += *o++;
-	return result;
+	const E &o = other.self();
+	for (size_t i = 0; i < this->arr_size; ++i)
+		data[i] += o[i];
+	return *this;
 }
 
 template <size_t N, class T>
-ArrayND<N, T> ArrayND<N, T>::operator*(const ArrayND<N, T> &other) const
+template <class E>
+ArrayND<N, T> &ArrayND<N, T>::operator*=(const ArrayExpr<E> &other)
 {
-	ArrayND<N, T> result(*this);
-	typename T::value_type *o = other.begin();
-	for (auto &i : result)
-		i *= *o++;
-	return result;
+	const E &o = other.self();
+	for (size_t i = 0; i < this->arr_size; ++i)
+		data[i] *= o[i];
+	return *this;
 }
 
 template <size_t N, class T>
-ArrayND<N, T> ArrayND<N, T>::operator/(const ArrayND<N, T> &other) const
+template <class E>
+ArrayND<N, T> &ArrayND<N, T>::operator/=(const ArrayExpr<E> &other)
 {
-	ArrayND<N, T> result(*this);
-	typename T::value_type *o = other.begin();
-	for (auto &i : result)
-		i /= *o++;
-	return result;
+	const E &o = other.self();
+	for (size_t i = 0; i < this->arr_size; ++i)
+		data[i] /= o[i];
+	return *this;
 }
 
-template <size_t N, class T>
-ArrayND<N, T> ArrayND<N, T>::operator-(const typename T::value_type &val) const
+template <class L, class R>
+ArrayBinaryExpr<L, R, ArrayAdd> operator+(const ArrayExpr<L> &lhs, const ArrayExpr<R> &rhs)
 {
-	ArrayND<N, T> result(*this);
-	for (auto &i : result)
-		i -= val;
-	return result;
+	return ArrayBinaryExpr<L, R, ArrayAdd>(lhs.self(), rhs.self());
 }
 
-template <size_t N, class T>
-ArrayND<N, T> ArrayND<N, T>::operator+(const typename T::value_type &val) const
+template <class E>
+ArrayScalarExpr<E, ArrayAdd, false> operator+(const ArrayExpr<E> &lhs, const typename E::value_type &val)
 {
-	ArrayND<N, T> result(*this);
-	for (auto &i : result)
-		i += val;
-	return result;
+	return ArrayScalarExpr<E, ArrayAdd, false>(lhs.self(), val);
 }
 
-template <size_t N, class T>
-ArrayND<N, T> ArrayND<N, T>::operator*(const typename T::value_type &val) const
+template <class E>
+ArrayScalarExpr<E, ArrayAdd, true> operator+(const typename E::value_type &val, const ArrayExpr<E> &rhs)
 {
-	ArrayND<N, T> result(*this);
-	for (auto &i : result)
-		i *= val;
-	return result;
+	return ArrayScalarExpr<E, ArrayAdd, true>(rhs.self(), val);
 }
 
-template <size_t N, class T>
-ArrayND<N, T> ArrayND<N, T>::operator/(const typename T::value_type &val) const
+template <class L, class R>
+ArrayBinaryExpr<L, R, ArraySubtract> operator-(const ArrayExpr<L> &lhs, const ArrayExpr<R> &rhs)
 {
-	ArrayND<N, T> result(*this);
-	for (auto &i : result)
-		i /= val;
-	return result;
+	return ArrayBinaryExpr<L, R, ArraySubtract>(lhs.self(), rhs.self());
 }
 
-template <size_t N, class T>
-ArrayND<N, T> &ArrayND<N, T>::operator-=(const typename T::value_type &val)
+template <class E>
+ArrayScalarExpr<E, ArraySubtract, false> operator-(const ArrayExpr<E> &lhs, const typename E::value_type &val)
 {
-	for (auto &i : (*this))
-		i -= val;
-	return *this;
+	return ArrayScalarExpr<E, ArraySubtract, false>(lhs.self(), val);
 }
 
-template <size_t N, class T>
-ArrayND<N, T> &ArrayND<N, T>::operator+=(const typename T::value_type &val)
+template <class E>
+ArrayScalarExpr<E, ArraySubtract, true> operator-(const typename E::value_type &val, const ArrayExpr<E> &rhs)
 {
-	for (auto &i : (*this))
-		i += val;
-	return *this;
+	return ArrayScalarExpr<E, ArraySubtract, true>(rhs.self(), val);
 }
 
-template <size_t N, class T>
-ArrayND<N, T> &ArrayND<N, T>::operator*=(const typename T::value_type &val)
+template <class L, class R>
+ArrayBinaryExpr<L, R, ArrayMultiply> operator*(const ArrayExpr<L> &lhs, const ArrayExpr<R> &rhs)
 {
-	for (auto &i : (*this))
-		i *= val;
-	return *this;
+	return ArrayBinaryExpr<L, R, ArrayMultiply>(lhs.self(), rhs.self());
 }
 
-template <size_t N, class T>
-ArrayND<N, T> &ArrayND<N, T>::operator/=(const typename T::value_type &val)
+template <class E>
+ArrayScalarExpr<E, ArrayMultiply, false> operator*(const ArrayExpr<E> &lhs, const typename E::value_type &val)
 {
-	for (auto &i : (*this))
-		i /= val;
-	return *this;
+	return ArrayScalarExpr<E, ArrayMultiply, false>(lhs.self(), val);
 }
 
-template <size_t N, class T>
-ArrayND<N, T> &ArrayND<N, T>::operator-=(const ArrayND<N, T> &other)
+template <class E>
+ArrayScalarExpr<E, ArrayMultiply, true> operator*(const typename E::value_type &val, const ArrayExpr<E> &rhs)
 {
-	auto o = other.begin();
-	for (auto &i : *this)
-		i -= *o++;
-	return *this;
+	return ArrayScalarExpr<E, ArrayMultiply, true>(rhs.self(), val);
 }
 
-template <size_t N, class T>
-ArrayND<N, T> &ArrayND<N, T>::operator+=(const ArrayND<N, T> &other)
+template <class L, class R>
+ArrayBinaryExpr<L, R, ArrayDivide> operator/(const ArrayExpr<L> &lhs, const ArrayExpr<R> &rhs)
 {
-	auto o = other.begin();
-	for (auto &i : *this)
-		i += *o++;
-	return *this;
+	return ArrayBinaryExpr<L, R, ArrayDivide>(lhs.self(), rhs.self());
 }
 
-template <size_t N, class T>
-ArrayND<N, T> &ArrayND<N, T>::operator*=(const ArrayND<N, T> &other)
+template <class E>
+ArrayScalarExpr<E, ArrayDivide, false> operator/(const ArrayExpr<E> &lhs, const typename E::value_type &val)
 {
-	auto o = other.begin();
-	for (auto &i : *this)
-		i *= *o++;
-	return *this;
+	return ArrayScalarExpr<E, ArrayDivide, false>(lhs.self(), val);
 }
 
-template <size_t N, class T>
-ArrayND<N, T> &ArrayND<N, T>::operator/=(const ArrayND<N, T> &other)
+template <class E>
+ArrayScalarExpr<E, ArrayDivide, true> operator/(const typename E::value_type &val, const ArrayExpr<E> &rhs)
 {
-	auto o = other.begin();
-	for (auto &i : *this)
-		i /= *o++;
-	return *this;
+	return ArrayScalarExpr<E, ArrayDivide, true>(rhs.self(), val);
 }
 
 template <size_t N, class T>
 Prismatic::ArrayND<N, std::vector<T>> ones_ND(const std::array<size_t, N> dims)
 {
-	size_t size = 1;
-	for (auto &i : dims)
-		size *= i;
-	return Prismatic::ArrayND<N, std::vector<T>>(std::vector<T>(size, 1), dims);
+	return Prismatic::ArrayND<N, std::vector<T>>(dims, (T)1);
 }
 
 template <size_t N, class T>
 Prismatic::ArrayND<N, std::vector<T>> zeros_ND(const std::array<size_t, N> dims)
 {
-	size_t size = 1;
-	for (auto &i : dims)
-		size *= i;
-	return Prismatic::ArrayND<N, std::vector<T>>(std::vector<T>(size, 0), dims);
+	return Prismatic::ArrayND<N, std::vector<T>>(dims, (T)0);
 }
 
 template <class T>
@@ -0,0 +1,210 @@
+// Copyright Alan (AJ) Pryor, Jr. 2017
+// Transcribed from MATLAB code by Colin Ophus
+// Prismatic is distributed under the GNU General Public License (GPL)
+// If you use Prismatic, we kindly ask that you cite the following papers:
+
+// 1. Ophus, C.: A fast image simulation algorithm for scanning
+//    transmission electron microscopy. Advanced Structural and
+//    Chemical Imaging 3(1), 13 (2017)
+
+// 2. Pryor, Jr., A., Ophus, C., and Miao, J.: A Streaming Multi-GPU
+//    Implementation of Image Simulation Algorithms for Scanning
+//	  Transmission Electron Microscopy. arXiv:1706.08563 (2017)
+
+#ifndef PRISM_ARRAYVIEW_H
+#define PRISM_ARRAYVIEW_H
+
+#include <array>
+#include <vector>
+#include <cstddef>
+#include <stdexcept>
+#include <type_traits>
+#include "ArrayND.h"
+
+namespace Prismatic
+{
+template <size_t N, class T>
+class ArrayView
+{
+	// non-owning view of ND data indexed as C-style like ArrayND, i.e. view.at(k,j,i) where i is the
+	// fastest varying index. Each dimension carries its own element stride, so slices, sub-blocks and
+	// transposes of an ArrayND can be passed on without copying. The viewed array must outlive the view.
+
+	// T is the element type, const-qualified for read-only views
+public:
+	typedef typename std::remove_const<T>::type value_type;
+	ArrayView(T *_ptr,
+			  std::array<size_t, N> _dims,
+			  std::array<size_t, N> _strides) : ptr(_ptr), dims(_dims), strides(_strides){};
+	// a mutable view also converts to a read-only one
+	template <class U, class = typename std::enable_if<std::is_convertible<U *, T *>::value>::type>
+	ArrayView(const ArrayView<N, U> &other) : ptr(other.data()), dims(other.get_dimarr()), strides(other.get_strides()){};
+	size_t get_dimi() const { return this->dims[N - 1]; }
+	size_t get_dimj() const { return this->dims[N - 2]; }
+	size_t get_dimk() const { return this->dims[N - 3]; }
+	size_t get_diml() const { return this->dims[N - 4]; }
+	size_t get_rank() const { return N; }
+	std::array<size_t, N> get_dimarr() const { return this->dims; }
+	std::array<size_t, N> get_strides() const { return this->strides; }
+	size_t size() const;
+	T *data() const { return this->ptr; }
+	bool isContiguous() const;
+
+	T &at(const size_t &i) const { return ptr[i * strides[N - 1]]; }
+	T &at(const size_t &j, const size_t &i) const { return ptr[j * strides[N - 2] + i * strides[N - 1]]; }
+	T &at(const size_t &k, const size_t &j, const size_t &i) const
+	{
+		return ptr[k * strides[N - 3] + j * strides[N - 2] + i * strides[N - 1]];
+	}
+	T &at(const size_t &l, const size_t &k, const size_t &j, const size_t &i) const
+	{
+		return ptr[l * strides[N - 4] + k * strides[N - 3] + j * strides[N - 2] + i * strides[N - 1]];
+	}
+
+	ArrayView<N - 1, T> slice(const size_t axis, const size_t idx) const;
+	ArrayView<N, T> subview(const std::array<size_t, N> &start, const std::array<size_t, N> &stop) const;
+	ArrayView<N, T> permute(const std::array<size_t, N> &order) const;
+	ArrayND<N, std::vector<value_type>> copy() const;
+
+private:
+	T *ptr;
+	std::array<size_t, N> dims;
+	std::array<size_t, N> strides;
+};
+
+template <size_t N, class T>
+size_t ArrayView<N, T>::size() const
+{
+	size_t _size = 1;
+	for (auto &i : dims)
+		_size *= i;
+	return _size;
+}
+
+template <size_t N, class T>
+bool ArrayView<N, T>::isContiguous() const
+{
+	size_t stride = 1;
+	for (auto i = N; i > 0; --i)
+	{
+		if (dims[i - 1] > 1 && strides[i - 1] != stride)
+			return false;
+		stride *= dims[i - 1];
+	}
+	return true;
+}
+
+template <size_t N, class T>
+ArrayView<N - 1, T> ArrayView<N, T>::slice(const size_t axis, const size_t idx) const
+{
+	//fix index idx along axis (0 is the slowest dimension) and keep the order of the others
+	static_assert(N > 1, "Cannot slice a 1D view");
+	if (axis >= N || idx >= dims[axis])
+		throw std::out_of_range("PRISM: slice index out of range\n");
+	std::array<size_t, N - 1> _dims;
+	std::array<size_t, N - 1> _strides;
+	for (size_t d = 0, o = 0; d < N; ++d)
+	{
+		if (d == axis)
+			continue;
+		_dims[o] = dims[d];
+		_strides[o++] = strides[d];
+	}
+	return ArrayView<N - 1, T>(ptr + idx * strides[axis], _dims, _strides);
+}
+
+template <size_t N, class T>
+ArrayView<N, T> ArrayView<N, T>::subview(const std::array<size_t, N> &start, const std::array<size_t, N> &stop) const
+{
+	//half open block [start, stop) along every dimension
+	std::array<size_t, N> _dims;
+	size_t offset = 0;
+	for (auto d = 0; d < N; ++d)
+	{
+		if (start[d] > stop[d] || stop[d] > dims[d])
+			throw std::out_of_range("PRISM: subview bounds out of range\n");
+		_dims[d] = stop[d] - start[d];
+		offset += start[d] * strides[d];
+	}
+	return ArrayView<N, T>(ptr + offset, _dims, strides);
+}
+
+template <size_t N, class T>
+ArrayView<N, T> ArrayView<N, T>::permute(const std::array<size_t, N> &order) const
+{
+	//dimension d of the result is dimension order[d] of this view
+	std::array<size_t, N> _dims;
+	std::array<size_t, N> _strides;
+	for (auto d = 0; d < N; ++d)
+	{
+		_dims[d] = dims[order[d]];
+		_strides[d] = strides[order[d]];
+	}
+	return ArrayView<N, T>(ptr, _dims, _strides);
+}
+
+template <size_t N, class T>
+ArrayND<N, std::vector<typename ArrayView<N, T>::value_type>> ArrayView<N, T>::copy() const
+{
+	//gather the viewed elements into a new contiguous array
+	ArrayND<N, std::vector<value_type>> output = zeros_ND<N, value_type>(dims);
+	if (isContiguous())
+	{
+		std::copy(ptr, ptr + output.size(), output.begin());
+		return output;
+	}
+
+	std::array<size_t, N> idx;
+	idx.fill(0);
+	const size_t n_i = dims[N - 1];
+	const size_t stride_i = strides[N - 1];
+	auto out = output.begin();
+	for (size_t row = 0; row < output.size() / (n_i > 0 ? n_i : 1) && n_i > 0; ++row)
+	{
+		size_t offset = 0;
+		for (auto d = 0; d < N - 1; ++d)
+			offset += idx[d] * strides[d];
+		const T *src = ptr + offset;
+		for (auto i = 0; i < n_i; ++i)
+			*out++ = src[i * stride_i];
+
+		//advance the outer indices like an odometer
+		for (auto d = (long)N - 2; d >= 0; --d)
+		{
+			if (++idx[d] < dims[d])
+				break;
+			idx[d] = 0;
+		}
+	}
+	return output;
+}
+
+template <size_t N, class T>
+ArrayView<N, T> view(ArrayND<N, std::vector<T>> &arr)
+{
+	std::array<size_t, N> strides;
+	size_t stride = 1;
+	for (auto i = N; i > 0; --i)
+	{
+		strides[i - 1] = stride;
+		stride *= arr.get_dimarr()[i - 1];
+	}
+	return ArrayView<N, T>(arr.size() > 0 ? &arr[0] : nullptr, arr.get_dimarr(), strides);
+}
+
+template <size_t N, class T>
+ArrayView<N, const T> view(const ArrayND<N, std::vector<T>> &arr)
+{
+	std::array<size_t, N> strides;
+	size_t stride = 1;
+	for (auto i = N; i > 0; --i)
+	{
+		strides[i - 1] = stride;
+		stride *= arr.get_dimarr()[i - 1];
+	}
+	return ArrayView<N, const T>(arr.size() > 0 ? &*arr.begin() : nullptr, arr.get_dimarr(), strides);
+}
+
+} // namespace Prismatic
+
+#endif //PRISM_ARRAYVIEW_H
@@ -0,0 +1,45 @@
+// Copyright Alan (AJ) Pryor, Jr. 2017
+// Transcribed from MATLAB code by Colin Ophus
+// Prismatic is distributed under the GNU General Public License (GPL)
+// If you use Prismatic, we kindly ask that you cite the following papers:
+
+// 1. Ophus, C.: A fast image simulation algorithm for scanning
+//    transmission electron microscopy. Advanced Structural and
+//    Chemical Imaging 3(1), 13 (2017)
+
+// 2. Pryor, Jr., A., Ophus, C., and Miao, J.: A Streaming Multi-GPU
+//    Implementation of Image Simulation Algorithms for Scanning
+//	  Transmission Electron Microscopy. arXiv:1706.08563 (2017)
+
+#ifndef PRISM_AUTOTUNER_H
+#define PRISM_AUTOTUNER_H
+#include <cstddef>
+#include <string>
+#include "defines.h"
+#include "meta.h"
+#include "ExecutionPolicy.h"
+
+namespace Prismatic {
+    // largest FFT batch tried per worker
+    constexpr size_t maxTunedBatchSize = 16;
+
+    struct BatchTuning {
+        size_t workers;   // outer worker threads, the rest of numThreads go to the FFTs
+        size_t batchSize; // waves per batched FFT
+        double seconds;   // measured time per wave (forward and inverse FFT plus a multiply), 0 if read from the cache
+    };
+
+    // the fastest worker count and batch size for propagating dimj x dimi waves on numThreads threads. Timed
+    // on first use for a grid, thread count, machine and FFT backend and appended to cacheFile, which later runs consult
+    BatchTuning tuneBatchedFFT(size_t dimj, size_t dimi, size_t numThreads, const std::string &cacheFile);
+
+    // the execution policy and batch size a stage should use for numJobs waves of dimj x dimi, tuned as above
+    // and kept within meta's maxWorkerThreads and, when planning to a memory budget, batchSizeTargetCPU
+    void autotuneBatch(const Metadata<PRISMATIC_FLOAT_PRECISION> &meta, size_t dimj, size_t dimi, size_t numJobs,
+                       ExecutionPolicy &policy, size_t &batchSize);
+
+    // meta.autotuneCache if set, otherwise prismatic_autotune.txt in $HOME (%APPDATA% on Windows), or in the
+    // working directory when that is not set
+    std::string autotuneCacheFile(const Metadata<PRISMATIC_FLOAT_PRECISION> &meta);
+}
+#endif //PRISM_AUTOTUNER_H
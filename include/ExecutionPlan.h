@@ -0,0 +1,79 @@
+// Copyright Alan (AJ) Pryor, Jr. 2017
+// Transcribed from MATLAB code by Colin Ophus
+// Prismatic is distributed under the GNU General Public License (GPL)
+// If you use Prismatic, we kindly ask that you cite the following papers:
+
+// 1. Ophus, C.: A fast image simulation algorithm for scanning
+//    transmission electron microscopy. Advanced Structural and
+//    Chemical Imaging 3(1), 13 (2017)
+
+// 2. Pryor, Jr., A., Ophus, C., and Miao, J.: A Streaming Multi-GPU
+//    Implementation of Image Simulation Algorithms for Scanning
+//	  Transmission Electron Microscopy. arXiv:1706.08563 (2017)
+
+#ifndef PRISM_EXECUTIONPLAN_H
+#define PRISM_EXECUTIONPLAN_H
+
+#include "defines.h"
+#include <complex>
+#include "ArrayND.h"
+
+#ifdef PRISMATIC_ENABLE_GPU
+#include <cuda_runtime.h>
+#endif //PRISMATIC_ENABLE_GPU
+
+namespace Prismatic {
+	template <class T>
+	class Metadata;
+	template <class T>
+	class Parameters;
+
+	using entry_func     = void (*)(Metadata<PRISMATIC_FLOAT_PRECISION>&);
+	using ms_output_func = void (*)(Parameters<PRISMATIC_FLOAT_PRECISION>&);
+
+	using prism_output_func = void (*)(Parameters<PRISMATIC_FLOAT_PRECISION>&);
+
+	using format_output_func = void (*)( Parameters<PRISMATIC_FLOAT_PRECISION>&,
+	                                     Array2D< std::complex<PRISMATIC_FLOAT_PRECISION> >&,
+	                                     const Array2D<PRISMATIC_FLOAT_PRECISION>&,
+										 const size_t,
+	                                     const size_t,
+	                                     const size_t);
+	using fill_Scompact_func = void(*)(Parameters<PRISMATIC_FLOAT_PRECISION> &pars);
+#ifdef PRISMATIC_ENABLE_GPU
+	using format_output_func_GPU = void (*)(Parameters<PRISMATIC_FLOAT_PRECISION>&,
+	                                        PRISMATIC_FLOAT_PRECISION *,
+	                                        const PRISMATIC_FLOAT_PRECISION *,
+	                                        PRISMATIC_FLOAT_PRECISION *,
+	                                        PRISMATIC_FLOAT_PRECISION*,
+	                                        const PRISMATIC_FLOAT_PRECISION *,
+	                                        const PRISMATIC_FLOAT_PRECISION *,
+	                                        const size_t,
+	                                        const size_t,
+											const size_t,
+	                                        const size_t&,
+	                                        const size_t&,
+	                                        const cudaStream_t&,
+	                                        const long&);
+#endif //PRISMATIC_ENABLE_GPU
+
+	// the implementations of the stages a run uses. Each run carries its own plan in Parameters, so runs
+	// with different algorithms or transfer modes can overlap
+	struct ExecutionPlan {
+		entry_func execute_plan = nullptr;
+		ms_output_func buildMultisliceOutput = nullptr;
+		prism_output_func buildPRISMOutput = nullptr;
+		prism_output_func buildPRISMOutput_series = nullptr; // NULL when the single pass series is unavailable
+		format_output_func formatOutput_CPU = nullptr;
+		fill_Scompact_func fill_Scompact = nullptr;
+#ifdef PRISMATIC_ENABLE_GPU
+		format_output_func_GPU formatOutput_GPU = nullptr;
+#endif //PRISMATIC_ENABLE_GPU
+	};
+
+	// select the stages for the algorithm and transfer mode of meta; an automatic transfer mode is resolved
+	// the way configure resolves it
+	ExecutionPlan executionPlan(const Metadata<PRISMATIC_FLOAT_PRECISION> &meta);
+}
+
+#endif //PRISM_EXECUTIONPLAN_H
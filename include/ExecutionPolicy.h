@@ -0,0 +1,34 @@
+// Copyright Alan (AJ) Pryor, Jr. 2017
+// Transcribed from MATLAB code by Colin Ophus
+// Prismatic is distributed under the GNU General Public License (GPL)
+// If you use Prismatic, we kindly ask that you cite the following papers:
+
+// 1. Ophus, C.: A fast image simulation algorithm for scanning
+//    transmission electron microscopy. Advanced Structural and
+//    Chemical Imaging 3(1), 13 (2017)
+
+// 2. Pryor, Jr., A., Ophus, C., and Miao, J.: A Streaming Multi-GPU
+//    Implementation of Image Simulation Algorithms for Scanning
+//	  Transmission Electron Microscopy. arXiv:1706.08563 (2017)
+
+#ifndef PRISM_EXECUTIONPOLICY_H
+#define PRISM_EXECUTIONPOLICY_H
+#include <cstddef>
+namespace Prismatic {
+    // FFTs with fewer elements than this are not worth splitting over FFT threads
+    constexpr size_t minFFTThreadingSize = 256 * 256;
+
+    struct ExecutionPolicy {
+        // how a stage spends its CPU threads: outerThreads workers each process independent jobs
+        // (probes, beams, planes) and every FFT plan a worker creates uses fftThreads FFT threads
+        size_t outerThreads;
+        size_t fftThreads;
+    };
+
+    // split numThreads between outer (job) and inner (FFT) parallelism for numJobs independent jobs
+    // whose FFTs have gridSize elements. Jobs are preferred; only threads that would otherwise idle
+    // because there are fewer jobs than threads are given to the FFTs, and only for large enough grids.
+    // maxOuterThreads, if nonzero, caps the workers (each holds its own scratch arrays) to save memory
+    ExecutionPolicy chooseExecutionPolicy(size_t numThreads, size_t numJobs, size_t gridSize, size_t maxOuterThreads = 0);
+}
+#endif //PRISM_EXECUTIONPOLICY_H
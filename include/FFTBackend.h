@@ -0,0 +1,119 @@
+// Copyright Alan (AJ) Pryor, Jr. 2017
+// Transcribed from MATLAB code by Colin Ophus
+// Prismatic is distributed under the GNU General Public License (GPL)
+// If you use Prismatic, we kindly ask that you cite the following papers:
+
+// 1. Ophus, C.: A fast image simulation algorithm for scanning
+//    transmission electron microscopy. Advanced Structural and
+//    Chemical Imaging 3(1), 13 (2017)
+
+// 2. Pryor, Jr., A., Ophus, C., and Miao, J.: A Streaming Multi-GPU
+//    Implementation of Image Simulation Algorithms for Scanning
+//	  Transmission Electron Microscopy. arXiv:1706.08563 (2017)
+
+#ifndef PRISM_FFTBACKEND_H
+#define PRISM_FFTBACKEND_H
+#include <atomic>
+#include <complex>
+#include <cstddef>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <tuple>
+#include "defines.h"
+
+namespace Prismatic {
+    enum class FFTBackendType{FFTW, PocketFFT};
+    enum class FFTDirection{Forward, Inverse};
+    enum class FFTKind{Complex, RealToComplex, ComplexToReal};
+    enum class FFTEffort{Estimate, Measure}; // how long FFTW may search for a fast plan; other backends ignore it
+
+    struct FFTShape {
+        // howmany dimj x dimi arrays stored one after another. Real-to-complex transforms read dimj x dimi
+        // reals and write dimj x (dimi/2 + 1) complex values per array, complex-to-real transforms the reverse
+        size_t dimj;
+        size_t dimi;
+        size_t howmany;
+        FFTKind kind;
+        FFTDirection direction; // only used by complex transforms
+        size_t threads;
+        FFTEffort effort;
+    };
+
+    class FFTKernel {
+        // a planned transform. Kernels are shared between threads, so execute must be safe to call
+        // concurrently on different arrays
+    public:
+        virtual ~FFTKernel() {}
+        virtual void execute(void *in, void *out) const = 0;
+    };
+
+    class FFTPlan {
+        // a kernel bound to the arrays it transforms. Kernels stay cached in the backend, so plans are cheap
+        // to create, copy and destroy, and unlike FFTW plans may be created from any thread without locking
+    public:
+        FFTPlan() : in(nullptr), out(nullptr) {}
+        FFTPlan(std::shared_ptr<const FFTKernel> kernel, void *in, void *out) : kernel(kernel), in(in), out(out) {}
+        void execute() const { kernel->execute(in, out); }
+        // transform other arrays with the same layout, placement (in or out of place) and alignment as planned for
+        void execute(void *other_in, void *other_out) const { kernel->execute(other_in, other_out); }
+        bool valid() const { return (bool)kernel; }
+    private:
+        std::shared_ptr<const FFTKernel> kernel;
+        void *in;
+        void *out;
+    };
+
+    class FFTBackend {
+        // creates and caches kernels. Only the first request for a shape, thread count and memory
+        // layout pays for planning; later requests are a lookup in a per-thread copy of the cache
+    public:
+        FFTBackend() : generation(0) {}
+        virtual ~FFTBackend() {}
+        virtual const char *name() const = 0;
+        FFTPlan plan(const FFTShape &shape, void *in, void *out);
+        // drop all cached kernels; each run clears them when it finishes, as plans rarely carry over
+        void clearPlans();
+        size_t numCachedPlans();
+    protected:
+        // distinguishes arrays a cached kernel cannot be reused for; by default only in-place from out-of-place
+        virtual size_t layoutKey(void *in, void *out) const { return in == out; }
+        virtual std::shared_ptr<const FFTKernel> createKernel(const FFTShape &shape, void *in, void *out) = 0;
+    private:
+        typedef std::tuple<size_t, size_t, size_t, FFTKind, FFTDirection, size_t, FFTEffort, size_t> PlanKey;
+        struct CachedKernel {
+            std::mutex planning; // held while the kernel is created, so each key is planned once
+            std::shared_ptr<const FFTKernel> kernel;
+        };
+        struct LocalKernels {
+            size_t generation = 0;
+            std::map<PlanKey, std::shared_ptr<const FFTKernel>> kernels;
+        };
+        std::mutex cacheLock; // guards kernels only, never held while planning
+        std::map<PlanKey, std::shared_ptr<CachedKernel>> kernels;
+        std::atomic<size_t> generation; // advanced by clearPlans, so threads drop their copies
+    };
+
+    // the backend all stages plan with, FFTW unless changed
+    FFTBackend &fftBackend();
+    // throws std::runtime_error if the backend was not compiled in
+    void setFFTBackend(FFTBackendType type);
+    bool fftBackendAvailable(FFTBackendType type);
+    std::string fftBackendName(FFTBackendType type);
+    // false if name is not a backend
+    bool parseFFTBackend(const std::string &name, FFTBackendType &type);
+
+    // complex transforms of howmany dimj x dimi arrays with fftBackend(); unnormalized in both directions
+    FFTPlan planFFT2D(size_t dimj, size_t dimi,
+                      std::complex<PRISMATIC_FLOAT_PRECISION> *in, std::complex<PRISMATIC_FLOAT_PRECISION> *out,
+                      FFTDirection direction, size_t threads = 1, FFTEffort effort = FFTEffort::Estimate, size_t howmany = 1);
+    // real transforms, which must be out of place; the complex-to-real transform may overwrite its input
+    FFTPlan planFFT2D_r2c(size_t dimj, size_t dimi,
+                          PRISMATIC_FLOAT_PRECISION *in, std::complex<PRISMATIC_FLOAT_PRECISION> *out,
+                          size_t threads = 1, FFTEffort effort = FFTEffort::Estimate, size_t howmany = 1);
+    FFTPlan planFFT2D_c2r(size_t dimj, size_t dimi,
+                          std::complex<PRISMATIC_FLOAT_PRECISION> *in, PRISMATIC_FLOAT_PRECISION *out,
+                          size_t threads = 1, FFTEffort effort = FFTEffort::Estimate, size_t howmany = 1);
+}
+#endif //PRISM_FFTBACKEND_H
@@ -0,0 +1,114 @@
+// Copyright Alan (AJ) Pryor, Jr. 2017
+// Transcribed from MATLAB code by Colin Ophus
+// Prismatic is distributed under the GNU General Public License (GPL)
+// If you use Prismatic, we kindly ask that you cite the following papers:
+
+// 1. Ophus, C.: A fast image simulation algorithm for scanning
+//    transmission electron microscopy. Advanced Structural and
+//    Chemical Imaging 3(1), 13 (2017)
+
+// 2. Pryor, Jr., A., Ophus, C., and Miao, J.: A Streaming Multi-GPU
+//    Implementation of Image Simulation Algorithms for Scanning
+//	  Transmission Electron Microscopy. arXiv:1706.08563 (2017)
+
+#ifndef PRISM_INSTRUMENTATION_H
+#define PRISM_INSTRUMENTATION_H
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <map>
+#include <iostream>
+#include "PerfCounters.h"
+
+namespace Prismatic {
+    typedef std::chrono::steady_clock ProfileClock;
+
+    class Profiler {
+        // collection of stage timings, worker busy time, lock waits and peak memory of one run. Disabled
+        // by default, in which case every hook below reduces to a check of one flag. Names passed in are
+        // kept by pointer and must be string literals
+    public:
+        static Profiler &instance(); // the profiler of the run's ThreadPool, so overlapping runs keep their own
+
+        void start(bool trace); // clear previous results and begin recording; trace keeps individual events
+        void stop();
+        bool isEnabled() const { return enabled.load(std::memory_order_relaxed); }
+
+        void beginScope(const char *name, size_t depth);
+        void addScope(const char *name, ProfileClock::time_point begin, ProfileClock::time_point end, const CounterValues &counters = CounterValues());
+        void addFlops(const char *name, double flops); // estimated floating point work done by the named, open scope
+        void setRoofline(const Roofline &_roofline);
+        void addLockWait(const char *lock, ProfileClock::time_point begin, ProfileClock::time_point end);
+        void addWorkerTask(size_t worker, ProfileClock::time_point begin, ProfileClock::time_point end);
+        void addPoolRun(ProfileClock::time_point begin, ProfileClock::time_point end);
+
+        void printSummary(std::ostream &out) const;
+        void writeTrace(const std::string &filename) const;
+
+        static size_t peakRSS(); // bytes, 0 if unknown on this platform
+    private:
+        friend class ThreadPool;
+        Profiler();
+        struct ScopeStats {
+            const char *name;
+            size_t depth;
+            size_t calls;
+            double seconds;
+            size_t peakRSS;
+            CounterValues counters;
+            double flops;
+        };
+        struct LockStats {
+            size_t count;
+            double seconds;
+            double maxSeconds;
+        };
+        struct TraceEvent {
+            const char *name;
+            const char *category;
+            int tid;
+            double ts; // microseconds since start()
+            double dur;
+            size_t rss;
+        };
+        double since(ProfileClock::time_point t) const;
+        std::vector<ScopeStats>::iterator findScope(const char *name);
+        void printCounters(std::ostream &out) const;
+        void addEvent(const char *name, const char *category, ProfileClock::time_point begin, ProfileClock::time_point end, size_t rss = 0);
+
+        std::atomic<bool> enabled;
+        bool trace;
+        ProfileClock::time_point t0, t1;
+        mutable std::mutex lock;
+        std::vector<ScopeStats> scopes;			  // in order of first entry
+        std::map<std::string, LockStats> locks;
+        std::vector<double> workerBusy;			  // seconds per pool worker
+        double poolSeconds;						  // wall time of all ThreadPool::run calls
+        std::vector<TraceEvent> events;
+        std::map<int, std::string> threadNames;
+        Roofline roofline;
+        bool countersOpen;
+    };
+
+    class ScopedTimer {
+        // times the enclosing scope as one stage or sub-stage, e.g. ScopedTimer timer("PRISM02_calcSMatrix");
+    public:
+        explicit ScopedTimer(const char *_name);
+        ~ScopedTimer();
+    private:
+        const char *name;
+        bool active;
+        ProfileClock::time_point begin;
+        CounterValues counters;
+    };
+
+    // lock m and account the time spent waiting for it under name
+    std::unique_lock<std::mutex> profiledLock(std::mutex &m, const char *name);
+    void profiledRelock(std::unique_lock<std::mutex> &gatekeeper, const char *name);
+
+    // trace file written next to the HDF5 output, e.g. output.h5 -> output.trace.json
+    std::string traceFilename(const std::string &filenameOutput);
+}
+#endif //PRISM_INSTRUMENTATION_H
@@ -24,7 +24,7 @@
 #include "ArrayND.h"
 #include "params.h"
 #include "utility.h"
-#include "fftw3.h"
+#include "FFTBackend.h"
 #include "WorkDispatcher.h"
 
 namespace Prismatic
@@ -34,6 +34,16 @@ void setupCoordinates_multislice(Parameters<PRISMATIC_FLOAT_PRECISION> &pars);
 
 void setupDetector_multislice(Parameters<PRISMATIC_FLOAT_PRECISION> &pars);
 
+// phases[j] = exp(-2*pi*i*q[j]*r), one factor of the shift of a probe to position r
+void shiftPhases(const Array1D<PRISMATIC_FLOAT_PRECISION> &q, const PRISMATIC_FLOAT_PRECISION r, std::complex<PRISMATIC_FLOAT_PRECISION> *phases);
+
+// the qx and qy factors of the shift of probe (ay, ax): table rows for a grid scan, evaluated for arbitrary probes
+void probeShiftPhases(const Parameters<PRISMATIC_FLOAT_PRECISION> &pars,
+					  const size_t ay,
+					  const size_t ax,
+					  std::vector<std::complex<PRISMATIC_FLOAT_PRECISION>> &xPhase,
+					  std::vector<std::complex<PRISMATIC_FLOAT_PRECISION>> &yPhase);
+
 void setupProbes_multislice(Parameters<PRISMATIC_FLOAT_PRECISION> &pars);
 
 void createTransmission(Parameters<PRISMATIC_FLOAT_PRECISION> &pars);
@@ -59,14 +69,14 @@ getSingleMultisliceProbe_CPU(Parameters<PRISMATIC_FLOAT_PRECISION> &pars, const
 void getMultisliceProbe_CPU_batch(Parameters<PRISMATIC_FLOAT_PRECISION> &pars,
 								  const size_t Nstart,
 								  const size_t Nstop,
-								  PRISMATIC_FFTW_PLAN &plan_forward,
-								  PRISMATIC_FFTW_PLAN &plan_inverse,
+								  const FFTPlan &plan_forward,
+								  const FFTPlan &plan_inverse,
 								  Array1D<complex<PRISMATIC_FLOAT_PRECISION>> &psi_stack);
 void getMultisliceProbe_CPU(Parameters<PRISMATIC_FLOAT_PRECISION> &pars,
 							const size_t ay,
 							const size_t ax,
-							PRISMATIC_FFTW_PLAN &plan_forward,
-							PRISMATIC_FFTW_PLAN &plan_inverse,
+							const FFTPlan &plan_forward,
+							const FFTPlan &plan_inverse,
 							Array2D<complex<PRISMATIC_FLOAT_PRECISION>> &psi);
 void buildMultisliceOutput_CPUOnly(Parameters<PRISMATIC_FLOAT_PRECISION> &pars);
 
@@ -16,7 +16,7 @@
 #include <mutex>
 #include <complex>
 #include "params.h"
-#include "fftw3.h"
+#include "FFTBackend.h"
 #include "configure.h"
 #include "defines.h"
 
@@ -30,17 +30,15 @@ namespace Prismatic {
 	void propagatePlaneWave_CPU(Parameters<PRISMATIC_FLOAT_PRECISION> &pars,
 	                            size_t currentBeam,
 	                            Array2D<std::complex<PRISMATIC_FLOAT_PRECISION> > &psi,
-	                            const PRISMATIC_FFTW_PLAN &plan_forward,
-	                            const PRISMATIC_FFTW_PLAN &plan_inverse,
-	                            std::mutex& fftw_plan_lock);
+	                            const FFTPlan &plan_forward,
+	                            const FFTPlan &plan_inverse);
 
 	void propagatePlaneWave_CPU_batch(Parameters<PRISMATIC_FLOAT_PRECISION> &pars,
 	                                  size_t currentBeam,
 	                                  size_t stopBeam,
 	                                  Array1D<std::complex<PRISMATIC_FLOAT_PRECISION> > &psi_stack,
-	                                  const PRISMATIC_FFTW_PLAN &plan_forward,
-	                                  const PRISMATIC_FFTW_PLAN &plan_inverse,
-	                                  std::mutex &fftw_plan_lock);
+	                                  const FFTPlan &plan_forward,
+	                                  const FFTPlan &plan_inverse);
 
 	void fill_Scompact_CPUOnly(Parameters<PRISMATIC_FLOAT_PRECISION> &pars);
 
@@ -48,6 +46,9 @@ namespace Prismatic {
 
 	void PRISM02_importSMatrix(Parameters<PRISMATIC_FLOAT_PRECISION>& pars);
 
+	void filterSMatrix_batch(Parameters<PRISMATIC_FLOAT_PRECISION> &pars,
+	                         const Array2D<std::complex<PRISMATIC_FLOAT_PRECISION>> &filter);
+
 	void refocus(Parameters<PRISMATIC_FLOAT_PRECISION> &pars);
 
 	void apply_aberrations(Parameters<PRISMATIC_FLOAT_PRECISION> &pars);
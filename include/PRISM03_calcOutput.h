@@ -20,7 +20,7 @@
 #include <thread>
 #include <mutex>
 #include <numeric>
-#include "fftw3.h"
+#include "FFTBackend.h"
 #include "utility.h"
 
 namespace Prismatic
@@ -35,17 +35,39 @@ void setupBeams_2(Parameters<PRISMATIC_FLOAT_PRECISION> &pars);
 void createStack_integrate(Parameters<PRISMATIC_FLOAT_PRECISION> &pars);
 void setupFourierCoordinates(Parameters<PRISMATIC_FLOAT_PRECISION> &pars);
 void transformIndices(Parameters<PRISMATIC_FLOAT_PRECISION> &pars);
+void setupPhaseShifts(Parameters<PRISMATIC_FLOAT_PRECISION> &pars);
+std::complex<PRISMATIC_FLOAT_PRECISION> probePhaseShift(const Parameters<PRISMATIC_FLOAT_PRECISION> &pars,
+														 const size_t ay,
+														 const size_t ax,
+														 const size_t a4);
 void initializeProbes(Parameters<PRISMATIC_FLOAT_PRECISION> &pars);
 std::pair<Prismatic::Array2D<std::complex<PRISMATIC_FLOAT_PRECISION>>, Prismatic::Array2D<std::complex<PRISMATIC_FLOAT_PRECISION>>>
 getSinglePRISMProbe_CPU(Parameters<PRISMATIC_FLOAT_PRECISION> &pars, const PRISMATIC_FLOAT_PRECISION xp, const PRISMATIC_FLOAT_PRECISION yp);
+void wrapCoordinates(const Array1D<PRISMATIC_FLOAT_PRECISION> &vec,
+					 const PRISMATIC_FLOAT_PRECISION shift,
+					 const size_t N,
+					 Array1D<PRISMATIC_FLOAT_PRECISION> &result);
+
 void buildSignal_CPU(Parameters<PRISMATIC_FLOAT_PRECISION> &pars,
 					 const size_t &ay,
 					 const size_t &ax,
-					 PRISMATIC_FFTW_PLAN &plan,
+					 const FFTPlan &plan,
 					 Array2D<std::complex<PRISMATIC_FLOAT_PRECISION>> &psi);
 
 void buildPRISMOutput_CPUOnly(Parameters<PRISMATIC_FLOAT_PRECISION> &pars);
 
+void buildSignal_series_CPU(Parameters<PRISMATIC_FLOAT_PRECISION> &pars,
+							const size_t &ay,
+							const size_t &ax,
+							const FFTPlan &plan,
+							Array3D<std::complex<PRISMATIC_FLOAT_PRECISION>> &psi_stack);
+
+void buildPRISMOutput_series_CPUOnly(Parameters<PRISMATIC_FLOAT_PRECISION> &pars);
+
+bool useSeriesSinglePass(Parameters<PRISMATIC_FLOAT_PRECISION> &pars);
+
 void PRISM03_calcOutput(Parameters<PRISMATIC_FLOAT_PRECISION> &pars);
+
+void PRISM03_calcOutput_series(Parameters<PRISMATIC_FLOAT_PRECISION> &pars);
 } // namespace Prismatic
 #endif //PRISMATIC_PRISM03_H
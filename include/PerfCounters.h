@@ -0,0 +1,75 @@
+// Copyright Alan (AJ) Pryor, Jr. 2017
+// Transcribed from MATLAB code by Colin Ophus
+// Prismatic is distributed under the GNU General Public License (GPL)
+// If you use Prismatic, we kindly ask that you cite the following papers:
+
+// 1. Ophus, C.: A fast image simulation algorithm for scanning
+//    transmission electron microscopy. Advanced Structural and
+//    Chemical Imaging 3(1), 13 (2017)
+
+// 2. Pryor, Jr., A., Ophus, C., and Miao, J.: A Streaming Multi-GPU
+//    Implementation of Image Simulation Algorithms for Scanning
+//	  Transmission Electron Microscopy. arXiv:1706.08563 (2017)
+
+#ifndef PRISM_PERFCOUNTERS_H
+#define PRISM_PERFCOUNTERS_H
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include <cmath>
+#include <mutex>
+#include <vector>
+
+namespace Prismatic {
+    // bytes moved to or from memory per last level cache miss
+    constexpr size_t cacheLineSize = 64;
+
+    struct CounterValues {
+        uint64_t cycles = 0;
+        uint64_t instructions = 0;
+        uint64_t llcReferences = 0;
+        uint64_t llcMisses = 0;
+        CounterValues &operator+=(const CounterValues &other);
+        CounterValues operator-(const CounterValues &other) const;
+    };
+
+    class PerfCounters {
+        // user space cycles, instructions and last level cache references/misses from Linux perf_event_open,
+        // counted per thread for the main thread and every ThreadPool worker and summed on read. Counting
+        // is unavailable on other platforms, without a PMU (many VMs) or when perf_event_paranoid forbids it
+    public:
+        static PerfCounters &instance(); // the counters of the run's ThreadPool
+
+        bool open();  // start counting on the calling thread, false if counters are unavailable
+        void close();
+        bool isOpen() const { return opened.load(std::memory_order_relaxed); }
+        void attachThisThread(); // start counting on the calling thread too; no-op if closed or already attached
+        CounterValues read();    // current totals over all attached threads, scaled for multiplexing
+
+        ~PerfCounters();
+    private:
+        friend class ThreadPool;
+        PerfCounters() : opened(false), session(0){};
+        PerfCounters(const PerfCounters &) = delete;
+        PerfCounters &operator=(const PerfCounters &) = delete;
+        bool openThread();
+
+        std::atomic<bool> opened;
+        std::atomic<size_t> session; // unique to every open(), so stale thread attachments are redone
+        std::mutex lock;
+        std::vector<int> leaders; // group leader fd of each attached thread
+        std::vector<int> fds;     // every open fd, for closing
+    };
+
+    struct Roofline {
+        double peakFlops = 0;     // FLOP/s of a multiply-add loop on all workers
+        double peakBandwidth = 0; // bytes/s of a stream triad on all workers
+    };
+
+    // measure the roofline of this machine with the current ThreadPool; takes a fraction of a second
+    Roofline measureRoofline();
+
+    // conventional operation count of a complex FFT with n points, used to rate FFT-heavy stages
+    inline double fftFlops(const double n) { return n > 1 ? 5.0 * n * std::log2(n) : 0; }
+}
+#endif //PRISM_PERFCOUNTERS_H
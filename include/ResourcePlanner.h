@@ -0,0 +1,82 @@
+// Copyright Alan (AJ) Pryor, Jr. 2017
+// Transcribed from MATLAB code by Colin Ophus
+// Prismatic is distributed under the GNU General Public License (GPL)
+// If you use Prismatic, we kindly ask that you cite the following papers:
+
+// 1. Ophus, C.: A fast image simulation algorithm for scanning
+//    transmission electron microscopy. Advanced Structural and
+//    Chemical Imaging 3(1), 13 (2017)
+
+// 2. Pryor, Jr., A., Ophus, C., and Miao, J.: A Streaming Multi-GPU
+//    Implementation of Image Simulation Algorithms for Scanning
+//	  Transmission Electron Microscopy. arXiv:1706.08563 (2017)
+
+#ifndef PRISM_RESOURCEPLANNER_H
+#define PRISM_RESOURCEPLANNER_H
+#include <array>
+#include <string>
+#include <vector>
+#include <iostream>
+#include "defines.h"
+#include "meta.h"
+#include "PerfCounters.h"
+
+namespace Prismatic {
+    struct SimulationSize {
+        // the dimensions of a simulation that determine its cost, derived the same way Parameters and
+        // the stages derive them but from the metadata and the header of the atom file only
+        std::array<size_t, 2> imageSize;
+        std::array<double, 3> tiledCellDim;
+        double lambda;
+        size_t numAtoms;   // after tiling
+        size_t numSpecies;
+        size_t numPlanes;
+        size_t numLayers;  // multislice output depths
+        size_t numProbes;
+        size_t numDetectors;
+        size_t numBeams;   // PRISM beams or HRTEM tilts
+        size_t numSeries;  // 1 unless simulating a series
+        unsigned long long inputBytes;
+    };
+
+    struct StagePlan {
+        const char *name;
+        unsigned long long sharedBytes; // arrays alive during the stage, including those kept from earlier stages
+        unsigned long long workerBytes; // scratch of one worker thread
+        size_t workers;
+        double flops;
+        unsigned long long ioBytes;
+        unsigned long long peakBytes() const { return sharedBytes + workerBytes * workers; }
+    };
+
+    struct ResourcePlan {
+        SimulationSize size;
+        std::vector<StagePlan> stages;
+        size_t batchSize;                      // chosen batchSizeTargetCPU
+        size_t maxWorkerThreads;               // chosen worker cap, 0 for none
+        unsigned long long seriesMemoryBudget; // chosen seriesMemoryBudget
+        unsigned long long memoryBudget;       // 0 for none
+        bool fits;
+
+        unsigned long long peakBytes() const;
+        double flops() const;
+        unsigned long long ioBytes() const;
+        // roofline, if measured, adds a lower bound on the run time
+        void print(std::ostream &out, const Roofline &roofline = Roofline()) const;
+    };
+
+    // elements of T written to the output file; Parameters::calculateFileSize checks the same count
+    unsigned long long outputFileElements(const Metadata<PRISMATIC_FLOAT_PRECISION> &meta,
+                                          const std::array<size_t, 2> &imageSize, const std::array<double, 2> &pixelSize,
+                                          double lambda, size_t numProbes, size_t numPlanes, size_t numSeries);
+
+    SimulationSize estimateSimulationSize(const Metadata<PRISMATIC_FLOAT_PRECISION> &meta);
+
+    // estimate memory, work and I/O per stage and, if meta.memoryBudget is set, pick the batch size,
+    // worker count and series spilling that fit it, preferring those that cost the least speed
+    ResourcePlan planResources(const Metadata<PRISMATIC_FLOAT_PRECISION> &meta, const SimulationSize &size);
+    ResourcePlan planResources(const Metadata<PRISMATIC_FLOAT_PRECISION> &meta);
+
+    void applyPlan(const ResourcePlan &plan, Metadata<PRISMATIC_FLOAT_PRECISION> &meta);
+}
+#endif //PRISM_RESOURCEPLANNER_H
@@ -0,0 +1,66 @@
+// Copyright Alan (AJ) Pryor, Jr. 2017
+// Transcribed from MATLAB code by Colin Ophus
+// Prismatic is distributed under the GNU General Public License (GPL)
+// If you use Prismatic, we kindly ask that you cite the following papers:
+
+// 1. Ophus, C.: A fast image simulation algorithm for scanning
+//    transmission electron microscopy. Advanced Structural and
+//    Chemical Imaging 3(1), 13 (2017)
+
+// 2. Pryor, Jr., A., Ophus, C., and Miao, J.: A Streaming Multi-GPU
+//    Implementation of Image Simulation Algorithms for Scanning
+//	  Transmission Electron Microscopy. arXiv:1706.08563 (2017)
+
+#ifndef PRISMATIC_SIMULATIONPROGRESS_H
+#define PRISMATIC_SIMULATIONPROGRESS_H
+#include <atomic>
+#include <cstddef>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+
+namespace Prismatic{
+
+// thrown out of the simulation once it notices it was cancelled
+class SimulationCancelled : public std::runtime_error
+{
+	public:
+	SimulationCancelled() : std::runtime_error("Simulation cancelled"){};
+};
+
+// Progress of a running simulation, shared with whoever started it. Set Metadata::progress to follow a run
+// from another thread and to cancel it. The work dispatchers report the stage and how many of its jobs have
+// been handed out; an observer reads the counters at its own pace, so reporting costs the workers nothing.
+class SimulationProgress
+{
+	public:
+	struct Snapshot
+	{
+		std::string stage;
+		size_t done = 0;
+		size_t total = 0;
+		size_t fpNum = 0;
+		size_t numFP = 0;
+	};
+
+	// throws SimulationCancelled if the run was cancelled before this frozen phonon started
+	void startFrozenPhonon(const size_t fpNum, const size_t numFP);
+	void startStage(const std::string &stage, const size_t total);
+	void setDone(const size_t done);
+	Snapshot snapshot() const;
+
+	// ask the simulation to stop: the dispatchers stop handing out work, and the run throws
+	// SimulationCancelled at the next frozen phonon or before its outputs are written
+	void cancel();
+	bool cancelled() const;
+	void checkCancelled() const;
+
+	private:
+	mutable std::mutex lock; // guards stage
+	std::string stage;
+	std::atomic<size_t> done{0}, total{0}, fpNum{0}, numFP{0};
+	std::atomic<bool> stop{false};
+};
+
+} //namespace Prismatic
+#endif //PRISMATIC_SIMULATIONPROGRESS_H
@@ -0,0 +1,78 @@
+// Copyright Alan (AJ) Pryor, Jr. 2017
+// Transcribed from MATLAB code by Colin Ophus
+// Prismatic is distributed under the GNU General Public License (GPL)
+// If you use Prismatic, we kindly ask that you cite the following papers:
+
+// 1. Ophus, C.: A fast image simulation algorithm for scanning
+//    transmission electron microscopy. Advanced Structural and
+//    Chemical Imaging 3(1), 13 (2017)
+
+// 2. Pryor, Jr., A., Ophus, C., and Miao, J.: A Streaming Multi-GPU
+//    Implementation of Image Simulation Algorithms for Scanning
+//	  Transmission Electron Microscopy. arXiv:1706.08563 (2017)
+
+#ifndef PRISMATIC_SIMULATIONRESULTS_H
+#define PRISMATIC_SIMULATIONRESULTS_H
+#include <array>
+#include <complex>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "defines.h"
+
+namespace Prismatic{
+
+// An output kept in memory. data points into a buffer kept alive by owner, so arrays can share a buffer
+// (the depths of one output stack do) and outlive the simulation without being copied.
+struct ResultArray
+{
+	std::vector<size_t> shape; //C order
+	bool complex = false; //interleaved real and imaginary parts
+	PRISMATIC_FLOAT_PRECISION *data = nullptr;
+	std::shared_ptr<void> owner;
+
+	size_t size() const;
+};
+
+// Collects the outputs of a simulation as they are saved, named after their group in the output file
+// (virtual_detector_depth0000, annular_detector_depth0000, DPC_CoM_depth0000, CBED_array_depth0000, plus
+// any series tag). Set Metadata::results to keep them; 4D datacubes are only kept if asked for, as they are large.
+// The detector and DPC stacks are the engine's own averaged buffers, handed over rather than copied. 4D datacubes
+// are otherwise only streamed to the output file, so keeping them costs a second, in-memory accumulation.
+class SimulationResults
+{
+	public:
+	SimulationResults(const bool keep4D = false) : keep4D(keep4D){};
+
+	// share shape elements starting at data, which owner keeps alive
+	void add(const std::string &name, const std::vector<size_t> &shape, PRISMATIC_FLOAT_PRECISION *data, std::shared_ptr<void> owner);
+
+	// add block / numFP to the in-memory datacube name of size dims at offset, mirroring the frozen phonon
+	// accumulation in the output file. Thread safe
+	void accumulateDatacube(const std::string &name, const std::array<size_t, 4> &dims,
+							const std::array<size_t, 4> &blockDims, const std::array<size_t, 4> &offset,
+							const PRISMATIC_FLOAT_PRECISION *block, const PRISMATIC_FLOAT_PRECISION numFP);
+	void accumulateDatacube(const std::string &name, const std::array<size_t, 4> &dims,
+							const std::array<size_t, 4> &blockDims, const std::array<size_t, 4> &offset,
+							const std::complex<PRISMATIC_FLOAT_PRECISION> *block, const PRISMATIC_FLOAT_PRECISION numFP);
+
+	// throws std::domain_error if there is no output called name
+	const ResultArray &get(const std::string &name) const;
+	std::vector<std::string> names() const;
+
+	const bool keep4D;
+
+	private:
+	template <class T>
+	void accumulateBlock(const std::string &name, const std::array<size_t, 4> &dims,
+						 const std::array<size_t, 4> &blockDims, const std::array<size_t, 4> &offset,
+						 const T *block, const PRISMATIC_FLOAT_PRECISION numFP);
+
+	mutable std::mutex lock;
+	std::map<std::string, ResultArray> arrays;
+};
+
+} //namespace Prismatic
+#endif //PRISMATIC_SIMULATIONRESULTS_H
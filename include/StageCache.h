@@ -0,0 +1,88 @@
+// Copyright Alan (AJ) Pryor, Jr. 2017
+// Transcribed from MATLAB code by Colin Ophus
+// Prismatic is distributed under the GNU General Public License (GPL)
+// If you use Prismatic, we kindly ask that you cite the following papers:
+
+// 1. Ophus, C.: A fast image simulation algorithm for scanning
+//    transmission electron microscopy. Advanced Structural and
+//    Chemical Imaging 3(1), 13 (2017)
+
+// 2. Pryor, Jr., A., Ophus, C., and Miao, J.: A Streaming Multi-GPU
+//    Implementation of Image Simulation Algorithms for Scanning
+//	  Transmission Electron Microscopy. arXiv:1706.08563 (2017)
+
+#ifndef PRISMATIC_STAGECACHE_H
+#define PRISMATIC_STAGECACHE_H
+#include <array>
+#include <complex>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "defines.h"
+#include "ArrayND.h"
+#include "atom.h"
+
+namespace Prismatic{
+
+template <class T>
+class Parameters;
+
+// Keeps the expensive intermediates of earlier runs so a sequence of simulations only recomputes what its
+// parameters invalidate: the parsed atoms of each input file, and the projected potential and compact S-matrix
+// of each frozen phonon. Set Metadata::stageCache to share one between runs. Entries are keyed by everything the
+// stage reads, so changing only detector, scan or aberration parameters reuses both stages, while changing
+// the atoms, sampling or slicing recomputes them. With thermal effects the key includes the seed each frozen phonon
+// draws, so runs reuse configurations only while the random seed they start from is unchanged.
+class StageCache
+{
+	public:
+	struct Stats
+	{
+		size_t atomsReused = 0;
+		size_t potentialsReused = 0;
+		size_t potentialsComputed = 0;
+		size_t sMatricesReused = 0;
+		size_t sMatricesComputed = 0;
+	};
+
+	// atoms and cell dimensions of an xyz file, parsed again only if the file changed
+	std::vector<atom> readAtoms(const std::string &filename, std::array<double, 3> &dims);
+
+	// restore the potential (or S-matrix) of frozen phonon pars.fpFlag if an earlier run computed it from
+	// the same inputs, otherwise return false; store keeps the one just computed
+	bool restorePotential(Parameters<PRISMATIC_FLOAT_PRECISION> &pars);
+	void storePotential(const Parameters<PRISMATIC_FLOAT_PRECISION> &pars);
+	bool restoreSMatrix(Parameters<PRISMATIC_FLOAT_PRECISION> &pars);
+	void storeSMatrix(const Parameters<PRISMATIC_FLOAT_PRECISION> &pars);
+
+	Stats stats() const;
+	void clear();
+
+	private:
+	struct AtomFile
+	{
+		std::string version; //size and modification time of the file when it was read
+		std::vector<atom> atoms;
+		std::array<double, 3> dims;
+	};
+	struct FrozenPhonon
+	{
+		std::string potentialKey;
+		ArrayND<3, std::vector<PRISMATIC_FLOAT_PRECISION>> pot;
+		size_t numPlanes = 0;
+		PRISMATIC_FLOAT_PRECISION dzPot = 0;
+		std::string sMatrixKey;
+		ArrayND<3, std::vector<std::complex<PRISMATIC_FLOAT_PRECISION>>> Scompact;
+	};
+
+	FrozenPhonon &entry(const size_t fpNum);
+
+	mutable std::mutex lock;
+	std::map<std::string, AtomFile> atomFiles;
+	std::vector<FrozenPhonon> frozenPhonons;
+	Stats counts;
+};
+
+} //namespace Prismatic
+#endif //PRISMATIC_STAGECACHE_H
@@ -0,0 +1,103 @@
+// Copyright Alan (AJ) Pryor, Jr. 2017
+// Transcribed from MATLAB code by Colin Ophus
+// Prismatic is distributed under the GNU General Public License (GPL)
+// If you use Prismatic, we kindly ask that you cite the following papers:
+
+// 1. Ophus, C.: A fast image simulation algorithm for scanning
+//    transmission electron microscopy. Advanced Structural and
+//    Chemical Imaging 3(1), 13 (2017)
+
+// 2. Pryor, Jr., A., Ophus, C., and Miao, J.: A Streaming Multi-GPU
+//    Implementation of Image Simulation Algorithms for Scanning
+//	  Transmission Electron Microscopy. arXiv:1706.08563 (2017)
+
+#ifndef PRISM_THREADPOOL_H
+#define PRISM_THREADPOOL_H
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <exception>
+#include <memory>
+
+namespace Prismatic {
+    struct ArrayAllocationPolicy;
+    class Profiler;
+    class PerfCounters;
+
+    class ThreadPool {
+        // pool of CPU worker threads shared by all stages of a simulation. Workers persist between calls,
+        // so repeated stages (frozen phonons, series) do not pay thread start-up costs, and their
+        // thread_local scratch arrays stay warm. With pinning, worker t is bound to a fixed core, with
+        // consecutive workers filling one NUMA node before moving on to the next.
+        // A run leases a pool for its duration: the process-wide one if it is free, otherwise a private pool,
+        // so overlapping runs never reconfigure each other's workers. The pool also holds the allocation
+        // policy and instrumentation of the run it serves, which its workers reach through instance()
+    public:
+        // the pool leased by the calling thread's run, or by the run a worker belongs to; the process-wide
+        // pool outside of a run
+        static ThreadPool &instance();
+
+        class Lease {
+            // binds a pool to the calling thread until destroyed. A nested lease keeps the outer one's pool
+        public:
+            Lease();
+            ~Lease();
+        private:
+            Lease(const Lease &) = delete;
+            Lease &operator=(const Lease &) = delete;
+            ThreadPool *previous;
+            std::unique_ptr<ThreadPool> own; // private pool, when the process-wide one was taken
+            bool shared;
+        };
+
+        // (re)start the workers if the thread count or pinning changed; must not be called from a task
+        void configure(size_t numThreads, bool pin = false);
+        size_t size() const { return numWorkers; }
+        bool isPinned() const { return pinned; }
+        int cpu(size_t worker) const; // core worker is pinned to, -1 if unpinned
+        size_t numaNode(size_t worker) const; // NUMA node of the core worker is pinned to, 0 if unpinned
+        size_t numNumaNodes() const { return numNodes; }
+
+        // call task(t) for t in [0, numTasks) and block until all have finished. Task t runs on worker
+        // t % size(). Exceptions thrown by a task are rethrown here. Called from within a task, or with
+        // no workers, the tasks run sequentially on the calling thread
+        void run(size_t numTasks, const std::function<void(size_t)> &task);
+
+        ArrayAllocationPolicy &allocationPolicy();
+        Profiler &profiler();
+        PerfCounters &perfCounters();
+
+        ~ThreadPool();
+    private:
+        ThreadPool();
+        ThreadPool(const ThreadPool &) = delete;
+        ThreadPool &operator=(const ThreadPool &) = delete;
+        void start(size_t numThreads, bool pin);
+        void stop();
+        void workerLoop(size_t id, size_t seen);
+
+        std::vector<std::thread> workers;
+        size_t numWorkers;
+        std::vector<int> cpus;      // core assigned to each worker when pinned
+        std::vector<size_t> nodes;  // NUMA node of each assigned core
+        size_t numNodes;
+        bool pinned;
+
+        std::mutex runLock;         // serializes run() and configure() from different caller threads
+        std::mutex lock;            // guards the job state below
+        std::condition_variable wake, finished;
+        const std::function<void(size_t)> *task;
+        size_t numTasks;
+        size_t generation;          // incremented for every job so workers can tell a new job from a spurious wakeup
+        size_t remaining;           // workers still busy with the current job
+        bool quit;
+        std::exception_ptr error;
+
+        std::unique_ptr<ArrayAllocationPolicy> policy;
+        std::unique_ptr<Profiler> runProfiler;
+        std::unique_ptr<PerfCounters> counters;
+    };
+}
+#endif //PRISM_THREADPOOL_H
@@ -15,17 +15,22 @@
 #define PRISM_WORKDISPATCHER_H
 #include "params.h"
 #include "configure.h"
+#include "SimulationProgress.h"
 #include <mutex>
 namespace Prismatic {
     class WorkDispatcher {
     public:
+        // with progress set, the dispatcher reports the jobs it hands out as stage and stops handing out work once the run is cancelled
         WorkDispatcher(size_t _current,
-                       size_t _stop);
+                       size_t _stop,
+                       SimulationProgress *_progress = nullptr,
+                       const std::string &stage = "");
 
         bool getWork(size_t& job_start, size_t& job_stop, size_t num_requested=1, size_t cpu_early_stop=SIZE_MAX);
     private:
         std::mutex lock;
         size_t current, stop;
+        SimulationProgress *progress;
     };
 }
 #endif //PRISM_WORKDISPATCHER_H
@@ -17,6 +17,8 @@
 #include <vector>
 #include <array>
 #include <iostream>
+#include <map>
+#include <complex>
 #include "ArrayND.h"
 #include "defines.h"
 
@@ -49,6 +51,44 @@ using Array2D = Prismatic::ArrayND<2, std::vector<T> >;
 
 std::vector<aberration> readAberrations(const std::string &filename);
 
+// Evaluates the aberration function chi on a fixed grid of spatial frequencies. The powers of alpha
+// and the cos/sin(m*theta) bases are computed once per grid and kept, so that a new set of
+// coefficients costs a few multiply-adds per pixel and term. When only some coefficients change
+// between calls, chi is updated by the difference of those terms alone.
+class ChiEngine
+{
+  public:
+    ChiEngine() : lambda(0), numIncrementalUpdates(0){};
+
+    // resets the cached bases if the grid or wavelength differ from the current ones
+    void setGrid(const Array2D<PRISMATIC_FLOAT_PRECISION> &q,
+                 const Array2D<PRISMATIC_FLOAT_PRECISION> &qTheta,
+                 const PRISMATIC_FLOAT_PRECISION &lambda);
+
+    const Array2D<PRISMATIC_FLOAT_PRECISION> &evaluate(const std::vector<aberration> &ab);
+
+    void clear();
+
+  private:
+    typedef std::pair<int, int> term_key; // (n, m)
+    typedef std::pair<PRISMATIC_FLOAT_PRECISION, PRISMATIC_FLOAT_PRECISION> term_coef; // weights of the cos and sin bases
+
+    const std::vector<PRISMATIC_FLOAT_PRECISION> &alphaPower(const int k);
+    const std::vector<PRISMATIC_FLOAT_PRECISION> &cosBasis(const int m);
+    const std::vector<PRISMATIC_FLOAT_PRECISION> &sinBasis(const int m);
+    void addTerm(const term_key &key, const term_coef &coef);
+
+    Array2D<PRISMATIC_FLOAT_PRECISION> q;
+    Array2D<PRISMATIC_FLOAT_PRECISION> qTheta;
+    PRISMATIC_FLOAT_PRECISION lambda;
+    std::map<int, std::vector<PRISMATIC_FLOAT_PRECISION>> alphaPowers;
+    std::map<int, std::vector<PRISMATIC_FLOAT_PRECISION>> cosBases;
+    std::map<int, std::vector<PRISMATIC_FLOAT_PRECISION>> sinBases;
+    std::map<term_key, term_coef> terms; // coefficients included in chi
+    Array2D<PRISMATIC_FLOAT_PRECISION> chi;
+    size_t numIncrementalUpdates;
+};
+
 Array2D<std::complex<PRISMATIC_FLOAT_PRECISION>> getChi(Array2D<PRISMATIC_FLOAT_PRECISION> &q,
                                                         Array2D<PRISMATIC_FLOAT_PRECISION> &qTheta,
                                                         PRISMATIC_FLOAT_PRECISION &lambda, 
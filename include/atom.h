@@ -50,6 +50,9 @@ std::vector<atom> readAtoms(const std::string &filename);
 
 std::array<double, 3> peekDims_xyz(const std::string &filename);
 
+// count the atoms and distinct species of an xyz file without reading the atoms themselves
+void peekAtomCounts_xyz(const std::string &filename, size_t &numAtoms, size_t &numSpecies);
+
 //	std::vector<atom> readAtoms_csv(const std::string& filename);
 
 std::vector<atom> readAtoms_xyz(const std::string &filename);
@@ -22,6 +22,7 @@
 #include "meta.h"
 #include "ArrayND.h"
 #include "params.h"
+#include "ExecutionPlan.h"
 
 #ifdef PRISMATIC_ENABLE_GPU
 //#define CUDA_API_PER_THREAD_DEFAULT_STREAM
@@ -34,44 +35,11 @@
 #endif
 
 namespace Prismatic {
-	using entry_func     = void (*)(Metadata<PRISMATIC_FLOAT_PRECISION>&);
-	using ms_output_func = void (*)(Parameters<PRISMATIC_FLOAT_PRECISION>&);
-
-	using prism_output_func = void (*)(Parameters<PRISMATIC_FLOAT_PRECISION>&);
-
-	using format_output_func = void (*)( Parameters<PRISMATIC_FLOAT_PRECISION>&,
-	                                     Array2D< std::complex<PRISMATIC_FLOAT_PRECISION> >&,
-	                                     const Array2D<PRISMATIC_FLOAT_PRECISION>&,
-										 const size_t,
-	                                     const size_t,
-	                                     const size_t);
-	using fill_Scompact_func = void(*)(Parameters<PRISMATIC_FLOAT_PRECISION> &pars);
-
-	extern entry_func execute_plan;
-	extern ms_output_func buildMultisliceOutput;
-	extern prism_output_func buildPRISMOutput;
-	extern format_output_func formatOutput_CPU;
-	extern fill_Scompact_func fill_Scompact;
 #ifdef PRISMATIC_ENABLE_GPU
-	using format_output_func_GPU = void (*)(Parameters<PRISMATIC_FLOAT_PRECISION>&,
-	                                        PRISMATIC_FLOAT_PRECISION *,
-	                                        const PRISMATIC_FLOAT_PRECISION *,
-	                                        PRISMATIC_FLOAT_PRECISION *,
-	                                        PRISMATIC_FLOAT_PRECISION*,
-	                                        const PRISMATIC_FLOAT_PRECISION *,
-	                                        const PRISMATIC_FLOAT_PRECISION *,
-	                                        const size_t,
-	                                        const size_t,
-											const size_t,
-	                                        const size_t&,
-	                                        const size_t&,
-	                                        const cudaStream_t&,
-	                                        const long&);
-	extern format_output_func_GPU formatOutput_GPU;
-
 	template <class T>
 	StreamingMode transferMethodAutoChooser(Prismatic::Metadata<T>& meta);
 #endif //PRISMATIC_ENABLE_GPU
+	// set up the FFT backend and transfer mode of a run; the stages it runs come from executionPlan
 	void configure(Metadata<PRISMATIC_FLOAT_PRECISION>&);
 }
 
@@ -15,6 +15,7 @@
 #define PRISMATIC_DEFINES_H
 
 #include <iostream>
+#include <string>
 
 namespace Prismatic
 {
@@ -26,6 +27,18 @@ enum class Algorithm
 	HRTEM
 };
 
+enum class Precision
+{
+	Single,
+	Double,
+	Mixed // waves propagated in single precision, detector outputs and frozen phonon sums accumulated in double
+};
+
+inline std::string precisionName(const Precision precision)
+{
+	return precision == Precision::Single ? "single" : (precision == Precision::Double ? "double" : "mixed");
+}
+
 inline void printHeader()
 {
 	std::cout << "\n\n*********************************************************************" << std::endl;
@@ -104,7 +117,12 @@ typedef double PRISMATIC_FLOAT_PRECISION;
 #define PRISMATIC_FFTW_PLAN fftw_plan
 #define PRISMATIC_FFTW_PLAN_DFT_2D fftw_plan_dft_2d
 #define PRISMATIC_FFTW_PLAN_DFT_BATCH fftw_plan_many_dft
+#define PRISMATIC_FFTW_PLAN_DFT_BATCH_R2C fftw_plan_many_dft_r2c
+#define PRISMATIC_FFTW_PLAN_DFT_BATCH_C2R fftw_plan_many_dft_c2r
 #define PRISMATIC_FFTW_EXECUTE fftw_execute
+#define PRISMATIC_FFTW_EXECUTE_DFT fftw_execute_dft
+#define PRISMATIC_FFTW_EXECUTE_DFT_R2C fftw_execute_dft_r2c
+#define PRISMATIC_FFTW_EXECUTE_DFT_C2R fftw_execute_dft_c2r
 #define PRISMATIC_FFTW_DESTROY_PLAN fftw_destroy_plan
 #define PRISMATIC_FFTW_COMPLEX fftw_complex
 #define PRISMATIC_FFTW_INIT_THREADS fftw_init_threads
@@ -118,7 +136,12 @@ typedef float PRISMATIC_FLOAT_PRECISION;
 #define PRISMATIC_FFTW_PLAN fftwf_plan
 #define PRISMATIC_FFTW_PLAN_DFT_2D fftwf_plan_dft_2d
 #define PRISMATIC_FFTW_PLAN_DFT_BATCH fftwf_plan_many_dft
+#define PRISMATIC_FFTW_PLAN_DFT_BATCH_R2C fftwf_plan_many_dft_r2c
+#define PRISMATIC_FFTW_PLAN_DFT_BATCH_C2R fftwf_plan_many_dft_c2r
 #define PRISMATIC_FFTW_EXECUTE fftwf_execute
+#define PRISMATIC_FFTW_EXECUTE_DFT fftwf_execute_dft
+#define PRISMATIC_FFTW_EXECUTE_DFT_R2C fftwf_execute_dft_r2c
+#define PRISMATIC_FFTW_EXECUTE_DFT_C2R fftwf_execute_dft_c2r
 #define PRISMATIC_FFTW_DESTROY_PLAN fftwf_destroy_plan
 #define PRISMATIC_FFTW_COMPLEX fftwf_complex
 #define PRISMATIC_FFTW_INIT_THREADS fftwf_init_threads
@@ -2,6 +2,9 @@
 #define PRISMATIC_FILEIO_H
 #include "H5Cpp.h"
 #include "params.h"
+#include "Instrumentation.h"
+#include "ArrayView.h"
+#include <functional>
 #include <thread>
 
 struct complex_float_t
@@ -57,6 +60,12 @@ void saveHRTEM(Parameters<PRISMATIC_FLOAT_PRECISION> &pars, Array3D<PRISMATIC_FL
 
 void saveSTEM(Parameters<PRISMATIC_FLOAT_PRECISION> &pars);
 
+Array2D<PRISMATIC_FLOAT_PRECISION> integrateAnnularDetector(Array4D<PRISMATIC_FLOAT_PRECISION> &stack,
+															const size_t layer,
+															const size_t lower,
+															const size_t upper,
+															const size_t numThreads);
+
 void save_qArr(Parameters<PRISMATIC_FLOAT_PRECISION> &pars);
 
 void saveProbe(Parameters<PRISMATIC_FLOAT_PRECISION> &pars);
@@ -75,6 +84,18 @@ Array4D<PRISMATIC_FLOAT_PRECISION> readDataSet4D(const std::string &filename, co
 
 Array4D<PRISMATIC_FLOAT_PRECISION> readDataSet4D_keepOrder(const std::string &filename, const std::string &dataPath);
 
+std::vector<size_t> readDataSetDims(const std::string &filename, const std::string &dataPath);
+
+//read a rank 3 dataset into data, which has the dims of the dataset but may have any strides (e.g. the transpose of
+//an array, as HDF5 stores (i, j, k) what ArrayND holds as (k, j, i)). Goes through a buffer of one plane
+void readRealDataSet_inOrder(const ArrayView<3, PRISMATIC_FLOAT_PRECISION> &data,
+                        const std::string &filename,
+                        const std::string &dataPath);
+
+void readComplexDataSet_inOrder(const ArrayView<3, std::complex<PRISMATIC_FLOAT_PRECISION>> &data,
+                        const std::string &filename,
+                        const std::string &dataPath);
+
 // template <size_t N, class T>
 // ArrayND<N, T> readDataSet(const std::string &filename, const std::string &dataPath, size_t );
 
@@ -114,6 +135,27 @@ void writeComplexDataSet_inOrder(H5::Group group,
                         const hsize_t *mdims,
                         const size_t &rank);
 
+//write a rank 3 dataset of dims mdims one plane (fixed first index) at a time; fillPlane(l, plane) fills plane l in
+//C order, so strided or reordered data is written through a buffer of one plane rather than a copy of all of it
+void writeRealDataSet_byPlane(H5::Group group,
+                        const std::string &dsetname,
+                        const hsize_t *mdims,
+                        const std::function<void(size_t, PRISMATIC_FLOAT_PRECISION *)> &fillPlane);
+
+void writeComplexDataSet_byPlane(H5::Group group,
+                        const std::string &dsetname,
+                        const hsize_t *mdims,
+                        const std::function<void(size_t, std::complex<PRISMATIC_FLOAT_PRECISION> *)> &fillPlane);
+
+//write the elements of a view in its index order, e.g. the transpose of an array
+void writeRealDataSet_inOrder(H5::Group group,
+                        const std::string &dsetname,
+                        const ArrayView<3, const PRISMATIC_FLOAT_PRECISION> &data);
+
+void writeComplexDataSet_inOrder(H5::Group group,
+                        const std::string &dsetname,
+                        const ArrayView<3, const std::complex<PRISMATIC_FLOAT_PRECISION>> &data);
+
 void writeScalarAttribute(H5::H5Object &object, const std::string &name, const int &data);
 
 void writeScalarAttribute(H5::H5Object& object, const std::string& name, const uint32_t& data);
@@ -141,6 +183,8 @@ void depthSeriesSG(H5::H5File &file);
 
 void CCseriesSG(H5::H5File &file);
 
+void seriesSG(Parameters<PRISMATIC_FLOAT_PRECISION> &pars);
+
 std::string reducedDataSetName(std::string &fullPath);
 
 void copyDataSet(H5::Group &targetGroup, H5::DataSet &source);
@@ -283,7 +327,7 @@ void writeDatacube4D(Parameters<PRISMATIC_FLOAT_PRECISION> &pars, T *buffer, T *
 {
 	//for 4D writes, need to first read the data set and then add; this way, FP are accounted for
 	//lock the whole file access/writing procedure in only one location
-	std::unique_lock<std::mutex> writeGatekeeper(write4D_lock);
+	std::unique_lock<std::mutex> writeGatekeeper = profiledLock(write4D_lock, "write4D_lock");
 
     H5::Group dataGroup = pars.outputFile.openGroup(nameString);
     H5::DataSet dataset = dataGroup.openDataSet("data");
@@ -301,6 +345,16 @@ void writeDatacube4D(Parameters<PRISMATIC_FLOAT_PRECISION> &pars, T *buffer, T *
         
     dataset.write(&readBuffer[0], dataset.getDataType(), mspace, fspace);
 
+    if (pars.meta.results && pars.meta.results->keep4D)
+    {
+        hsize_t fdims[4];
+        fspace.getSimpleExtentDims(fdims);
+        pars.meta.results->accumulateDatacube(nameString.substr(nameString.find_last_of('/') + 1),
+                                              {fdims[0], fdims[1], fdims[2], fdims[3]},
+                                              {mdims[0], mdims[1], mdims[2], mdims[3]},
+                                              {offset[0], offset[1], offset[2], offset[3]}, buffer, numFP);
+    }
+
     fspace.close();
     mspace.close();
     dataset.flush(H5F_SCOPE_LOCAL);
@@ -312,12 +366,6 @@ void writeDatacube4D(Parameters<PRISMATIC_FLOAT_PRECISION> &pars, T *buffer, T *
 	writeGatekeeper.unlock();
 };
 
-void createScratchFile(Parameters<PRISMATIC_FLOAT_PRECISION> &pars);
-
-void removeScratchFile(Parameters<PRISMATIC_FLOAT_PRECISION> &pars);
-
-void updateScratchData(Parameters<PRISMATIC_FLOAT_PRECISION> &pars);
-
 } //namespace Prismatic
 
 #endif //PRISMATIC_FILEIO_H
\ No newline at end of file
@@ -29,5 +29,16 @@
 namespace Prismatic
 {
 PRISMATIC_API void go(Metadata<PRISMATIC_FLOAT_PRECISION> meta);
+
+// parse the command line and run the simulation in this engine's precision; returns the exit status
+int runCLI(int argc, const char **argv);
+}
+
+#ifdef PRISMATIC_ENABLE_RUNTIME_PRECISION
+// the double precision engine: the core sources compiled a second time with the Prismatic namespace renamed
+namespace PrismaticDouble
+{
+int runCLI(int argc, const char **argv);
 }
+#endif //PRISMATIC_ENABLE_RUNTIME_PRECISION
 #endif //PRISM_GO_H
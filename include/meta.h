@@ -13,6 +13,7 @@
 
 #ifndef PRISMATIC_META_H
 #define PRISMATIC_META_H
+#include <algorithm>
 #include <vector>
 #include <string>
 #include <cstddef>
@@ -20,6 +21,12 @@
 #include "defines.h"
 #include <time.h>
 #include "aberration.h"
+#include "FFTBackend.h"
+#include "SimulationResults.h"
+#include "SimulationProgress.h"
+#include "StageCache.h"
+#include "atom.h"
+#include <memory>
 #include <chrono>
 #include <cstdint>
 #include <random>
@@ -148,8 +155,26 @@ namespace Prismatic{
             seriesVals            = {};
             seriesKeys            = {};
             seriesTags            = {};
+            seriesInputKeys       = {};
+            seriesInputVals       = {};
             maxFileSize           = 2e9;
+            seriesMemoryBudget    = 4e9;
+            memoryBudget          = 0;
+            planOnly              = false;
+            maxWorkerThreads      = 0;
+            autotune              = false;
+            autotuneCache         = "";
+            fftFriendlyGrid       = false;
+            fftBackend            = FFTBackendType::FFTW;
+            precision             = sizeof(T) == sizeof(double) ? Precision::Double : Precision::Single;
+            scratchDirectory      = "";
             matrixRefocus         = false;
+            seriesSinglePass      = true;
+            hugePages             = false;
+            pinThreads            = false;
+            profile               = false;
+            saveTrace             = false;
+            perfCounters          = false;
             arbitraryAberrations  = false;
             importFile            = "";
             importPath            = "";
@@ -160,6 +185,18 @@ namespace Prismatic{
             randomSeed = dist(rng);
         }
 
+        // the largest probe semiangle of the run; a probeSemiangle series shares one S-matrix, which needs the beams of all entries
+        T maxProbeSemiangle() const {
+            T maxAngle = probeSemiangle;
+            for (size_t i = 0; i < seriesKeys.size() && i < seriesVals.size(); i++)
+                if (seriesKeys[i] == "probeSemiangle")
+                    for (auto &v : seriesVals[i]) maxAngle = std::max(maxAngle, v);
+            for (size_t i = 0; i < seriesInputKeys.size() && i < seriesInputVals.size(); i++)
+                if (seriesInputKeys[i] == "probeSemiangle")
+                    for (auto &v : seriesInputVals[i]) maxAngle = std::max(maxAngle, v);
+            return maxAngle;
+        }
+
         size_t interpolationFactorY; // PRISM f_y parameter
         size_t interpolationFactorX; // PRISM f_x parameter
         std::string filenameAtoms; // filename of txt file containing atoms (x,y,z,Z CSV format -- one atom per line)
@@ -256,8 +293,30 @@ namespace Prismatic{
         std::vector<std::vector<T>> seriesVals;
         std::vector<std::string> seriesKeys;
         std::vector<std::string> seriesTags;
+        std::vector<std::string> seriesInputKeys; //user requested series axes; expanded on a grid into seriesKeys/seriesVals
+        std::vector<std::vector<T>> seriesInputVals;
         unsigned long long int maxFileSize; 
+        unsigned long long int seriesMemoryBudget; //series accumulators larger than this (bytes) are memory mapped to a scratch file
+        unsigned long long int memoryBudget; //bytes of RAM the simulation is planned to fit in; 0 for no limit
+        bool planOnly; //print the resource plan and exit without simulating
+        size_t maxWorkerThreads; //most worker threads a stage may run, remaining threads go to FFTW; 0 for no limit
+        bool autotune; //time candidate worker counts and batch sizes for batched FFTs once per grid and machine, then reuse them
+        std::string autotuneCache; //file the tuned choices are kept in; defaults to $HOME/prismatic_autotune.txt (%APPDATA% on Windows)
+        bool fftFriendlyGrid; //round the simulation grid to sizes with only 2, 3, 5 and 7 as factors besides 4 * interpolation factor
+        FFTBackendType fftBackend; //library all CPU FFTs are planned with
+        Precision precision; //precision of the engine running the simulation, or mixed: single precision waves with double precision sums
+        std::shared_ptr<SimulationResults> results; //if set, outputs are also kept here for the caller; not a simulation parameter
+        std::shared_ptr<SimulationProgress> progress; //if set, the run reports its progress here and can be cancelled through it; not a simulation parameter
+        std::shared_ptr<StageCache> stageCache; //if set, atoms, potentials and S-matrices are reused from and kept here for later runs; not a simulation parameter
+        std::shared_ptr<const std::vector<atom>> atoms; //if set, the atoms of the unit cell (fractional coordinates, cell size cellDim) used instead of reading filenameAtoms; not a simulation parameter
+        std::string scratchDirectory; //directory for scratch files; defaults to TMPDIR or /tmp
         bool matrixRefocus; //whether or not to refocus the comapct s-matrix in a PRISM sim
+        bool seriesSinglePass; //compute all entries of a PRISM series from one gather of the s-matrix per probe
+        bool hugePages; //advise transparent huge pages for large array allocations
+        bool pinThreads; //pin CPU worker threads to cores, grouped by NUMA node
+        bool profile; //print per-stage timings, worker and lock accounting and peak memory at the end
+        bool saveTrace; //write a Chrome trace of the stages next to the output file
+        bool perfCounters; //read hardware counters per stage and rate the stages against a measured roofline
         bool arbitraryAberrations;
         StreamingMode transferMode;
         TiltSelection tiltMode;
@@ -391,7 +450,27 @@ namespace Prismatic{
         std::cout << "saveProbe = " << saveProbe << std::endl;
         std::cout << "saveProbeComplex = " << saveProbeComplex << std::endl;
         std::cout << "simSeries = " << simSeries << std::endl;
+        for(auto i = 0; i < seriesInputKeys.size(); i++)
+        {
+            std::cout << "series axis " << seriesInputKeys[i] << " with " << seriesInputVals[i].size() << " values" << std::endl;
+        }
         std::cout << "matrixRefocus = " << matrixRefocus << std::endl;
+        std::cout << "seriesSinglePass = " << seriesSinglePass << std::endl;
+        std::cout << "hugePages = " << hugePages << std::endl;
+        std::cout << "pinThreads = " << pinThreads << std::endl;
+        std::cout << "profile = " << profile << std::endl;
+        std::cout << "saveTrace = " << saveTrace << std::endl;
+        std::cout << "perfCounters = " << perfCounters << std::endl;
+        std::cout << "seriesMemoryBudget = " << seriesMemoryBudget << std::endl;
+        std::cout << "memoryBudget = " << memoryBudget << std::endl;
+        std::cout << "planOnly = " << planOnly << std::endl;
+        std::cout << "maxWorkerThreads = " << maxWorkerThreads << std::endl;
+        std::cout << "autotune = " << autotune << std::endl;
+        if(autotuneCache.size() > 0) std::cout << "autotuneCache = " << autotuneCache << std::endl;
+        std::cout << "fftFriendlyGrid = " << fftFriendlyGrid << std::endl;
+        std::cout << "fftBackend = " << fftBackendName(fftBackend) << std::endl;
+        std::cout << "precision = " << precisionName(precision) << std::endl;
+        if(scratchDirectory.size() > 0) std::cout << "scratchDirectory = " << scratchDirectory << std::endl;
         std::cout << std::noboolalpha << std::endl;
 
     #ifdef PRISMATIC_ENABLE_GPU
@@ -494,7 +573,25 @@ namespace Prismatic{
         if(saveProbe != other.saveProbe)return false;
         if(saveProbeComplex != other.saveProbeComplex)return false;
         if(simSeries != other.simSeries)return false;
+        if(seriesInputKeys != other.seriesInputKeys)return false;
+        if(seriesInputVals != other.seriesInputVals)return false;
         if(matrixRefocus != other.matrixRefocus)return false;
+        if(seriesSinglePass != other.seriesSinglePass)return false;
+        if(hugePages != other.hugePages)return false;
+        if(pinThreads != other.pinThreads)return false;
+        if(profile != other.profile)return false;
+        if(saveTrace != other.saveTrace)return false;
+        if(perfCounters != other.perfCounters)return false;
+        if(seriesMemoryBudget != other.seriesMemoryBudget)return false;
+        if(memoryBudget != other.memoryBudget)return false;
+        if(planOnly != other.planOnly)return false;
+        if(maxWorkerThreads != other.maxWorkerThreads)return false;
+        if(autotune != other.autotune)return false;
+        if(autotuneCache != other.autotuneCache)return false;
+        if(fftFriendlyGrid != other.fftFriendlyGrid)return false;
+        if(fftBackend != other.fftBackend)return false;
+        if(precision != other.precision)return false;
+        if(scratchDirectory != other.scratchDirectory)return false;
         return true;
     }
 
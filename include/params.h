@@ -19,10 +19,14 @@
 #include <mutex>
 #include <complex>
 #include "ArrayND.h"
+#include "ThreadPool.h"
 #include "atom.h"
 #include "meta.h"
 #include "H5Cpp.h"
 #include "aberration.h"
+#include "seriesAccumulator.h"
+#include "ResourcePlanner.h"
+#include "ExecutionPlan.h"
 
 #ifdef PRISMATIC_BUILDING_GUI
 class prism_progressbar;
@@ -42,6 +46,33 @@ namespace Prismatic{
 
 	// for monitoring memory consumption on GPU
 	static std::mutex memLock;
+
+	// true if n has no prime factors other than 2, 3, 5 and 7, the sizes FFTW transforms fastest
+	inline bool isFFTFriendly(size_t n)
+	{
+		if (n == 0) return false;
+		for (size_t p : {2, 3, 5, 7})
+			while (n % p == 0) n /= p;
+		return n == 1;
+	}
+
+	// pixels of pixelSize across extent, rounded to a multiple of multiple (4 * interpolation factor) and at least 4.
+	// With fftFriendly the multiplier is the nearest FFT-friendly one instead, so large prime factors are avoided
+	inline size_t simulationGridSize(PRISMATIC_FLOAT_PRECISION extent, PRISMATIC_FLOAT_PRECISION pixelSize,
+									 PRISMATIC_FLOAT_PRECISION multiple, bool fftFriendly)
+	{
+		const PRISMATIC_FLOAT_PRECISION target = extent / pixelSize / multiple;
+		PRISMATIC_FLOAT_PRECISION count = round(target);
+		if (fftFriendly)
+		{
+			size_t below = std::max((size_t)1, (size_t)std::floor(target));
+			size_t above = std::max((size_t)1, (size_t)std::ceil(target));
+			while (!isFFTFriendly(below)) --below;
+			while (!isFFTFriendly(above)) ++above;
+			count = (target - below < above - target) ? below : above;
+		}
+		return (size_t)std::max((PRISMATIC_FLOAT_PRECISION)4.0, (PRISMATIC_FLOAT_PRECISION)(multiple * count));
+	}
 	
     template <class T>
     class Parameters {
@@ -51,17 +82,23 @@ namespace Prismatic{
 	    void calculateLambda();
 		void calculateFileSize();
 	    Metadata<T> meta;
+		ExecutionPlan plan; //stage implementations selected for meta
 	    Array3D< std::complex<T>  > Scompact;
 	    Array4D<T> output;
 	    Array4D<T> net_output;
 		Array4D<T> DPC_CoM;
 		Array4D<T> net_DPC_CoM;
+		Array4D<double> net_output_sum; //frozen phonon sums kept in double for mixed precision
+		Array4D<double> net_DPC_CoM_sum;
 		Array3D<T> pot;
 	    Array3D<std::complex<T> > transmission;
 	    Array2D< std::complex<T> > prop;
 	    Array2D< std::complex<T> > propBack;
 	    Array2D< std::complex<T> > propRefocus;
 	    Array2D< std::complex<T> > psiProbeInit;
+		Array3D< std::complex<T> > psiProbeSeries; //initial probe of every series entry, for single pass series
+		std::vector<Array4D<T>> outputSeries;
+		std::vector<Array4D<T>> DPC_CoMSeries;
 		Array2D<T> cbed_buffer;
 		Array2D<std::complex<T>> cbed_buffer_c;
 	    Array2D<unsigned int> qMask;
@@ -92,6 +129,8 @@ namespace Prismatic{
 		Array2D<T> qTheta;
         Array1D<T> xp;
         Array1D<T> yp;
+        Array2D<std::complex<T>> xPhaseShifts; //probe shift phase factors for each scan column, by beam (PRISM) or qx (multislice)
+        Array2D<std::complex<T>> yPhaseShifts; //probe shift phase factors for each scan row, by beam (PRISM) or qy (multislice)
 		Array1D<T> qx;
 		Array1D<T> qy;
         std::vector<size_t> beamsIndex;
@@ -135,7 +174,8 @@ namespace Prismatic{
 		std::vector<T> depths;
 	    size_t numberBeams;
 		H5::H5File outputFile;
-		H5::H5File scratchFile;
+		SeriesAccumulator seriesOutput; //running sums of each series entry across frozen phonons
+		ChiEngine chiEngine; //aberration function bases of the probe grid, kept across series entries
 		size_t fpFlag; //flag to prevent creation of new HDF5 files
 		std::string currentTag;
 		bool potentialReady;
@@ -159,6 +199,11 @@ namespace Prismatic{
 	    Parameters(Metadata<T> _meta) : meta(_meta){
 		#endif
 
+			//start the run's worker threads; large arrays allocated from here on are first touched by them
+			ThreadPool::instance().configure(meta.numThreads, meta.pinThreads);
+			arrayAllocationPolicy().hugePages = meta.hugePages;
+			plan = executionPlan(meta);
+
 		    constexpr double m = 9.109383e-31;
 		    constexpr double e = 1.602177e-19;
 		    constexpr double c = 299792458;
@@ -166,9 +211,22 @@ namespace Prismatic{
 		    const double pi = std::acos(-1);
 
 			try {
-				atoms = tileAtoms(meta.tileX, meta.tileY, meta.tileZ, readAtoms_xyz(meta.filenameAtoms));
+				std::array<double, 3> dims;
+				if (meta.atoms)
+				{
+					atoms = tileAtoms(meta.tileX, meta.tileY, meta.tileZ, *meta.atoms);
+					dims = {meta.cellDim[0], meta.cellDim[1], meta.cellDim[2]};
+				}
+				else if (meta.stageCache)
+				{
+					atoms = tileAtoms(meta.tileX, meta.tileY, meta.tileZ, meta.stageCache->readAtoms(meta.filenameAtoms, dims));
+				}
+				else
+				{
+					atoms = tileAtoms(meta.tileX, meta.tileY, meta.tileZ, readAtoms_xyz(meta.filenameAtoms));
+					if (!meta.userSpecifiedCelldims) dims = peekDims_xyz(meta.filenameAtoms);
+				}
 				if (!meta.userSpecifiedCelldims){
-					std::array<double, 3> dims = peekDims_xyz(meta.filenameAtoms);
 					meta.cellDim[0] = dims[0];
 					meta.cellDim[1] = dims[1];
 					meta.cellDim[2] = dims[2];
@@ -218,8 +276,8 @@ namespace Prismatic{
 		    T f_x = 4 * meta.interpolationFactorX;
 		    T f_y = 4 * meta.interpolationFactorY;
 		    Array1D<size_t> _imageSize({{(size_t)tiledCellDim[1], (size_t)tiledCellDim[2]}}, {{2}});
-		    _imageSize[0] = (size_t)std::max((PRISMATIC_FLOAT_PRECISION)4.0,  (PRISMATIC_FLOAT_PRECISION)(f_y * round((tiledCellDim[1]) / meta.realspacePixelSize[0] / f_y)));
-		    _imageSize[1] = (size_t)std::max((PRISMATIC_FLOAT_PRECISION)4.0,  (PRISMATIC_FLOAT_PRECISION)(f_x * round((tiledCellDim[2]) / meta.realspacePixelSize[1] / f_x)));
+		    _imageSize[0] = simulationGridSize(tiledCellDim[1], meta.realspacePixelSize[0], f_y, meta.fftFriendlyGrid);
+		    _imageSize[1] = simulationGridSize(tiledCellDim[2], meta.realspacePixelSize[1], f_x, meta.fftFriendlyGrid);
 
 		    this->imageSize = _imageSize;
 
@@ -227,13 +285,20 @@ namespace Prismatic{
 		    pixelSize = _pixelSize;
 		    pixelSize[0] /= (T)imageSize[0];
 		    pixelSize[1] /= (T)imageSize[1];
+			if (meta.fftFriendlyGrid)
+			{
+				std::cout << "FFT-friendly simulation grid: " << imageSize[0] << " x " << imageSize[1] << " pixels (nearest multiples "
+						  << simulationGridSize(tiledCellDim[1], meta.realspacePixelSize[0], f_y, false) << " x "
+						  << simulationGridSize(tiledCellDim[2], meta.realspacePixelSize[1], f_x, false) << "), pixel size "
+						  << pixelSize[0] << " x " << pixelSize[1] << " Angstroms" << std::endl;
+			}
 
 			numSlices = meta.numSlices;
 			zStartPlane = (size_t) std::ceil(meta.zStart / meta.sliceThickness);
 			
 			potentialReady = false;
 
-            meta.alphaBeamMax = meta.probeSemiangle + 2.5 / 1000.0;
+            meta.alphaBeamMax = meta.maxProbeSemiangle() + 2.5 / 1000.0;
 
 			//set tilt properties to prevent out of bound access
 			if(meta.algorithm == Algorithm::HRTEM)
@@ -309,7 +374,32 @@ namespace Prismatic{
 				meta.seriesVals.push_back(defocii);
 			}
 
-			
+			if(meta.seriesInputKeys.size() > 0)
+			{
+				//expand the defocus series and the requested axes on a grid, last axis varying fastest
+				std::vector<std::string> axisKeys = meta.seriesKeys;
+				std::vector<std::vector<PRISMATIC_FLOAT_PRECISION>> axisVals = meta.seriesVals;
+				axisKeys.insert(axisKeys.end(), meta.seriesInputKeys.begin(), meta.seriesInputKeys.end());
+				axisVals.insert(axisVals.end(), meta.seriesInputVals.begin(), meta.seriesInputVals.end());
+
+				size_t numEntries = 1;
+				for(auto i = 0; i < axisVals.size(); i++) numEntries *= axisVals[i].size();
+
+				meta.seriesKeys = axisKeys;
+				meta.seriesVals = std::vector<std::vector<PRISMATIC_FLOAT_PRECISION>>(axisKeys.size(), std::vector<PRISMATIC_FLOAT_PRECISION>(numEntries));
+				meta.seriesTags.clear();
+				for(auto e = 0; e < numEntries; e++)
+				{
+					size_t remainder = e;
+					for(int k = axisKeys.size() - 1; k >= 0; k--)
+					{
+						meta.seriesVals[k][e] = axisVals[k][remainder % axisVals[k].size()];
+						remainder /= axisVals[k].size();
+					}
+					meta.seriesTags.push_back("_series"+digitString(e));
+				}
+			}
+
 			//check filesize
 			try
 			{
@@ -370,21 +460,6 @@ namespace Prismatic{
 	template <class T>
 	void Parameters<T>::calculateFileSize(){
 
-		//calc detector size
-		long long ncx = (long long) floor((PRISMATIC_FLOAT_PRECISION) imageSize[1] / 2);
-		PRISMATIC_FLOAT_PRECISION dpx = 1.0 / ((PRISMATIC_FLOAT_PRECISION)imageSize[1] * meta.realspacePixelSize[1]);
-		long long ncy = (long long) floor((PRISMATIC_FLOAT_PRECISION) imageSize[0] / 2);
-		PRISMATIC_FLOAT_PRECISION dpy = 1.0 / ((PRISMATIC_FLOAT_PRECISION)imageSize[0] * meta.realspacePixelSize[0]);
-		PRISMATIC_FLOAT_PRECISION qmax_tmp = std::min(dpx*(ncx), dpy*(ncy)) / 2;
-
-		PRISMATIC_FLOAT_PRECISION alphaMax_tmp = qmax_tmp*lambda;
-		size_t Ndet_tmp = std::floor((alphaMax_tmp-meta.detectorAngleStep)/meta.detectorAngleStep);
-
-		//for beam calculations
-		PRISMATIC_FLOAT_PRECISION max_beam_angle = meta.alphaBeamMax / lambda;
-		PRISMATIC_FLOAT_PRECISION qx_extent = std::ceil(max_beam_angle/dpx);
-		PRISMATIC_FLOAT_PRECISION qy_extent = std::ceil(max_beam_angle/dpy);
-
 		//calc num probes
 		Array1D<PRISMATIC_FLOAT_PRECISION> xR = zeros_ND<1, PRISMATIC_FLOAT_PRECISION>({{2}});
 		xR[0] = scanWindowXMin * tiledCellDim[2];
@@ -401,31 +476,9 @@ namespace Prismatic{
 			numProbes = meta.probes_x.size();
 		}
 
-		unsigned long long int numElems = 0;
-		if(meta.save2DOutput) numElems += numProbes;
-		if(meta.save3DOutput) numElems += numProbes*Ndet_tmp;
-		if(meta.saveDPC_CoM) numElems += 2*numProbes; 
-
-		if(meta.algorithm == Algorithm::Multislice)
-		{
-			//TODO: num depth outputs
-			if(meta.save4DOutput) numElems += numProbes*imageSize[0]*imageSize[1]/4;
-		}
-		else if(meta.algorithm == Algorithm::PRISM)
-		{
-			size_t numBeams = std::ceil(qx_extent*qy_extent/(meta.interpolationFactorX*meta.interpolationFactorY));
-			if(meta.save4DOutput) numElems += numProbes*imageSize[0]*imageSize[1]/(4*meta.interpolationFactorX*meta.interpolationFactorY);
-			if(meta.saveSMatrix) numElems += numBeams*imageSize[0]*imageSize[1]/4; 
-		}
-		else if(meta.algorithm == Algorithm::HRTEM)
-		{
-			//TODO: calculate number of tilts here
-			numElems = 0;
-			size_t numBeams = 1;
-			numElems += imageSize[0]*imageSize[1]*numBeams*2/2; 
-		}
-
-		if(meta.savePotentialSlices) numElems += imageSize[0]*imageSize[1]*std::ceil(tiledCellDim[0]/meta.sliceThickness);
+		size_t numPlanes = std::ceil(tiledCellDim[0]/meta.sliceThickness);
+		unsigned long long int numElems = outputFileElements(meta, {{imageSize[0], imageSize[1]}}, {{(double)pixelSize[0], (double)pixelSize[1]}},
+															 lambda, numProbes, numPlanes, meta.seriesTags.size());
 		std::cout << "Approximate output file size is (Gb): " << (numElems*sizeof(PRISMATIC_FLOAT_PRECISION))/(1e9) << std::endl;
 		if(numElems*sizeof(PRISMATIC_FLOAT_PRECISION) > meta.maxFileSize)
 		{
@@ -27,5 +27,7 @@ bool parseParamFile(Metadata<PRISMATIC_FLOAT_PRECISION> &meta,
 bool writeParamFile(Metadata<PRISMATIC_FLOAT_PRECISION> &meta,
                     const std::string param_filename);
 void printHelp();
+// the --precision given on the command line or in a parameter file, or the build's precision if there is none
+Precision requestedPrecision(int argc, const char **argv);
 } // namespace Prismatic
 #endif //PRISM_PARSEINPUT_H
@@ -19,8 +19,9 @@
 #include <complex>
 #include <ctime>
 #include <iomanip>
-#include "fftw3.h"
+#include "FFTBackend.h"
 #include "ArrayND.h"
+#include "ArrayView.h"
 #include "utility.h"
 #include <boost/random/poisson_distribution.hpp>
 #include <boost/random/variate_generator.hpp>
@@ -98,21 +99,10 @@ Array2D<std::complex<PRISMATIC_FLOAT_PRECISION>> gaussian2D_k(const PRISMATIC_FL
     }
 
     //prepare FFT calls
-    extern std::mutex fftw_plan_lock;
     Array2D<std::complex<PRISMATIC_FLOAT_PRECISION>> output = zeros_ND<2, std::complex<PRISMATIC_FLOAT_PRECISION>>({{samples_x.get_dimj(), samples_x.get_dimi()}});
 
 	//create FFT plans 
-	PRISMATIC_FFTW_INIT_THREADS();
-	PRISMATIC_FFTW_PLAN_WITH_NTHREADS(1);
-	
-	std::unique_lock<std::mutex> gatekeeper(fftw_plan_lock);
-	PRISMATIC_FFTW_PLAN plan_forward = PRISMATIC_FFTW_PLAN_DFT_2D(output.get_dimj(), output.get_dimi(),
-															reinterpret_cast<PRISMATIC_FFTW_COMPLEX *>(&output[0]),
-															reinterpret_cast<PRISMATIC_FFTW_COMPLEX *>(&output[0]),
-															FFTW_FORWARD,
-															FFTW_ESTIMATE);
-
-	gatekeeper.unlock();
+	FFTPlan plan_forward = planFFT2D(output.get_dimj(), output.get_dimi(), &output[0], &output[0], FFTDirection::Forward);
 
     //copy data to transform
     for(auto i = 0; i < output.size(); i++){
@@ -120,7 +110,7 @@ Array2D<std::complex<PRISMATIC_FLOAT_PRECISION>> gaussian2D_k(const PRISMATIC_FL
     }
     
     //transform, multiply, transform
-    PRISMATIC_FFTW_EXECUTE(plan_forward);
+    plan_forward.execute();
 
     return output;
 };
@@ -154,202 +144,25 @@ void applyPoisson_norm(ArrayND<N, std::vector<PRISMATIC_FLOAT_PRECISION>> &arr,
     scaleArray(arr, 1.0/scale);
 };
 
+//subarray and subslice return copies; take view(arr).subview or view(arr).slice to reference arr instead
 template<typename T>
 Array1D<T> subarray(Array1D<T> &arr, size_t start, size_t stop)
 {
-    Array1D<T> output = zeros_ND<1, T>({{stop-start}});
-    for(auto i = start; i < stop; i++)
-    {
-        output.at(i-start) = arr.at(i);
-    }
-    return output;
+    return view(arr).subview({{start}}, {{stop}}).copy();
 };
 
-template<typename T>
-Array2D<T> subarray(Array2D<T> &arr, std::array<size_t, 2> start, std::array<size_t, 2> stop)
+template<size_t N, typename T>
+ArrayND<N, std::vector<T>> subarray(ArrayND<N, std::vector<T>> &arr, std::array<size_t, N> start, std::array<size_t, N> stop)
 {
-    std::array<size_t, 2> dims;
-    for(auto i = 0; i < 2; i++) dims[i] = stop[i] - start[i];
-
-    Array2D<T> output = zeros_ND<2, T>(dims);
-    for(auto j = start[0]; j < stop[0]; j++)
-    {
-        for(auto i = start[1]; i < stop[1]; i++)
-        {
-            output.at(j-start[0], i-start[1]) = arr.at(j, i);
-        }
-    }
-    return output;
+    return view(arr).subview(start, stop).copy();
 };
 
-template<typename T>
-Array3D<T> subarray(Array3D<T> &arr, std::array<size_t, 3> start, std::array<size_t, 3> stop)
+template<size_t N, typename T>
+ArrayND<N-1, std::vector<T>> subslice(ArrayND<N, std::vector<T>> &arr, size_t dim, size_t idx)
 {
-    std::array<size_t, 3> dims;
-    for(auto i = 0; i < 3; i++) dims[i] = stop[i] - start[i];
-
-    Array3D<T> output = zeros_ND<3, T>(dims);
-    for(auto k = start[0]; k < stop[0]; k++)
-    {
-        for(auto j = start[1]; j < stop[1]; j++)
-        {
-            for(auto i = start[2]; i < stop[2]; i++)
-            {
-                output.at(k-start[0], j-start[1], i-start[2]) = arr.at(k, j, i);
-            }
-        }
-    }
-    return output;
-};
-
-template<typename T>
-Array4D<T> subarray(Array4D<T> &arr, std::array<size_t, 4> start, std::array<size_t, 4> stop)
-{
-    std::array<size_t, 4> dims;
-    for(auto i = 0; i < 4; i++) dims[i] = stop[i] - start[i];
-
-    Array4D<T> output = zeros_ND<4, T>(dims);
-    for(auto l = start[0]; l < stop[0]; l++)
-    {
-        for(auto k = start[1]; k < stop[1]; k++)
-        {
-            for(auto j = start[2]; j < stop[2]; j++)
-            {
-                for(auto i = start[3]; i < stop[3]; i++)
-                {
-                    output.at(l-start[0], k-start[1], j-start[2], i-start[3]) = arr.at(l, k, j, i);
-                }
-            }
-        }
-    }
-    return output;
-};
-
-template<typename T>
-Array1D<T> subslice(Array2D<T> &arr, size_t dim, size_t idx)
-{
-    //return an array of N-1 dimensions where arr is indexed along a single dimension
-    Array1D<T> output;
-    switch (dim)
-    {
-        case 1: //freeze dim j
-            output = zeros_ND<1, T>({arr.get_dimi()});
-            for(auto i = 0; i < arr.get_dimi(); i++)
-                output.at(i) = arr.at(idx, i);
-            break;
-        case 0: //freeze dim i
-            output = zeros_ND<1, T>({arr.get_dimj()});
-            for(auto i = 0; i < arr.get_dimj(); i++)
-                output.at(i) = arr.at(i, idx);
-            break;
-    }
-    return output;
-};
-
-template<typename T>
-Array2D<T> subslice(Array3D<T> &arr, size_t dim, size_t idx)
-{
-    //return an array of N-1 dimensions where arr is indexed along a single dimension
-    //maintain order of dimensions otherwise
-    Array2D<T> output;
-    switch (dim)
-    {
-        case 2: //freeze dim k
-            output = zeros_ND<2, T>({arr.get_dimj(), arr.get_dimi()});
-            for(auto j = 0; j < arr.get_dimj(); j++)
-            {
-                for(auto i = 0; i < arr.get_dimi(); i++)
-                {
-                    output.at(j, i) = arr.at(idx, j, i);
-                }
-            }
-            break;
-        case 1: //freeze dim j
-            output = zeros_ND<2, T>({arr.get_dimk(), arr.get_dimi()});
-            for(auto j = 0; j < arr.get_dimk(); j++)
-            {
-                for(auto i = 0; i < arr.get_dimi(); i++)
-                {
-                    output.at(j, i) = arr.at(j, idx, i);
-                }
-            }
-            break;
-        case 0: //freeze dim i
-            output = zeros_ND<2, T>({arr.get_dimk(), arr.get_dimj()});
-            for(auto j = 0; j < arr.get_dimk(); j++)
-            {
-                for(auto i = 0; i < arr.get_dimj(); i++)
-                {
-                    output.at(j, i) = arr.at(j, i, idx);
-                }
-            }
-            break;
-    }
-    return output;
-};
-
-template<typename T>
-Array3D<T> subslice(Array4D<T> &arr, size_t dim, size_t idx)
-{
-    //return an array of N-1 dimensions where arr is indexed along a single dimension
-    //maintain order of dimensions otherwise
-    Array3D<T> output;
-    switch (dim)
-    {
-        case 3: //freeze dim l
-            output = zeros_ND<3, T>({arr.get_dimk(), arr.get_dimj(), arr.get_dimi()});
-            for(auto k = 0; k < arr.get_dimk(); k++)
-            {
-                for(auto j = 0; j < arr.get_dimj(); j++)
-                {
-                    for(auto i = 0; i < arr.get_dimi(); i++)
-                    {
-                        output.at(k, j, i) = arr.at(idx, k, j, i);
-                    }
-                }
-            }
-            break;
-        case 2: //freeze dim k
-            output = zeros_ND<3, T>({arr.get_diml(), arr.get_dimj(), arr.get_dimi()});
-            for(auto k = 0; k < arr.get_diml(); k++)
-            {
-                for(auto j = 0; j < arr.get_dimj(); j++)
-                {
-                    for(auto i = 0; i < arr.get_dimi(); i++)
-                    {
-                        output.at(k, j, i) = arr.at(k, idx, j, i);
-                    }
-                }
-            }
-            break;
-        case 1: //freeze dim j
-            output = zeros_ND<3, T>({arr.get_diml(), arr.get_dimk(), arr.get_dimi()});
-            for(auto k = 0; k < arr.get_diml(); k++)
-            {
-                for(auto j = 0; j < arr.get_dimk(); j++)
-                {
-                    for(auto i = 0; i < arr.get_dimi(); i++)
-                    {
-                        output.at(k, j, i) = arr.at(k, j, idx, i);
-                    }
-                }
-            }
-            break;
-        case 0: //freeze dim i
-            output = zeros_ND<3, T>({arr.get_diml(), arr.get_dimk(), arr.get_dimj()});
-            for(auto k = 0; k < arr.get_diml(); k++)
-            {
-                for(auto j = 0; j < arr.get_dimk(); j++)
-                {
-                    for(auto i = 0; i < arr.get_dimj(); i++)
-                    {
-                        output.at(k, j, i) = arr.at(k, j, i, idx);
-                    }
-                }
-            }
-            break;
-    }
-    return output;
+    //copy the N-1 dimensions where arr is indexed along a single dimension
+    //dim counts from the fastest varying index (0 freezes i); the order of the other dimensions is kept
+    return view(arr).slice(N - 1 - dim, idx).copy();
 };
 
 template<typename T>
@@ -442,8 +255,6 @@ ArrayND<N, std::vector<PRISMATIC_FLOAT_PRECISION>> getPhase(ArrayND<N, std::vect
 
 Array2D<PRISMATIC_FLOAT_PRECISION> fourierDownsample(Array2D<PRISMATIC_FLOAT_PRECISION> &arr, int Ni, int Nj)
 {
-    extern std::mutex fftw_plan_lock;
-
     Array2D<std::complex<PRISMATIC_FLOAT_PRECISION>> fstore = zeros_ND<2,std::complex<PRISMATIC_FLOAT_PRECISION>>({{arr.get_dimj(), arr.get_dimi()}});
 	Array2D<std::complex<PRISMATIC_FLOAT_PRECISION>> bstore = zeros_ND<2,std::complex<PRISMATIC_FLOAT_PRECISION>>({{Nj, Ni}});
 	Array2D<std::complex<PRISMATIC_FLOAT_PRECISION>> farr = zeros_ND<2,std::complex<PRISMATIC_FLOAT_PRECISION>>({{arr.get_dimj(),arr.get_dimi()}});
@@ -451,22 +262,8 @@ Array2D<PRISMATIC_FLOAT_PRECISION> fourierDownsample(Array2D<PRISMATIC_FLOAT_PRE
     Array2D<PRISMATIC_FLOAT_PRECISION> result = zeros_ND<2, PRISMATIC_FLOAT_PRECISION>({{Nj, Ni}});
 
 	//create FFT plans 
-	PRISMATIC_FFTW_INIT_THREADS();
-	PRISMATIC_FFTW_PLAN_WITH_NTHREADS(1);
-	
-	std::unique_lock<std::mutex> gatekeeper(fftw_plan_lock);
-	PRISMATIC_FFTW_PLAN plan_forward = PRISMATIC_FFTW_PLAN_DFT_2D(fstore.get_dimj(), fstore.get_dimi(),
-															reinterpret_cast<PRISMATIC_FFTW_COMPLEX *>(&farr[0]),
-															reinterpret_cast<PRISMATIC_FFTW_COMPLEX *>(&fstore[0]),
-															FFTW_FORWARD,
-															FFTW_ESTIMATE);
-
-	PRISMATIC_FFTW_PLAN plan_inverse = PRISMATIC_FFTW_PLAN_DFT_2D(bstore.get_dimj(), bstore.get_dimi(),
-															reinterpret_cast<PRISMATIC_FFTW_COMPLEX *>(&bstore[0]),
-															reinterpret_cast<PRISMATIC_FFTW_COMPLEX *>(&barr[0]),
-															FFTW_BACKWARD,
-															FFTW_ESTIMATE);
-	gatekeeper.unlock();
+	FFTPlan plan_forward = planFFT2D(fstore.get_dimj(), fstore.get_dimi(), &farr[0], &fstore[0], FFTDirection::Forward);
+	FFTPlan plan_inverse = planFFT2D(bstore.get_dimj(), bstore.get_dimi(), &bstore[0], &barr[0], FFTDirection::Inverse);
 
     //calculate indices for downsampling in fourier space
 	int nyqi = std::floor(Ni/2) + 1;
@@ -476,7 +273,7 @@ Array2D<PRISMATIC_FLOAT_PRECISION> fourierDownsample(Array2D<PRISMATIC_FLOAT_PRE
     for(auto i = 0; i < farr.size(); i++) farr[i] = arr[i];
     
     //forward transform 
-    PRISMATIC_FFTW_EXECUTE(plan_forward);
+    plan_forward.execute();
 
     //copy relevant quadrants to backward store
     //manual looping through quadrants
@@ -513,7 +310,7 @@ Array2D<PRISMATIC_FLOAT_PRECISION> fourierDownsample(Array2D<PRISMATIC_FLOAT_PRE
     }
 
     //inverse transform
-    PRISMATIC_FFTW_EXECUTE(plan_inverse);
+    plan_inverse.execute();
 
     //store slice in potential
     for(auto i = 0; i < barr.size(); i++) result[i] = barr[i].real();
@@ -537,34 +334,13 @@ void convolve2D(Array2D<PRISMATIC_FLOAT_PRECISION> &arr, Array2D<PRISMATIC_FLOAT
     if(arr.get_dimi() != kernel.get_dimi() || arr.get_dimj() != kernel.get_dimj()) return;
 
     //prepare FFT calls
-    extern std::mutex fftw_plan_lock;
-
     Array2D<std::complex<PRISMATIC_FLOAT_PRECISION>> karr = zeros_ND<2,std::complex<PRISMATIC_FLOAT_PRECISION>>({{arr.get_dimj(), arr.get_dimi()}});
 	Array2D<std::complex<PRISMATIC_FLOAT_PRECISION>> kkern = zeros_ND<2,std::complex<PRISMATIC_FLOAT_PRECISION>>({{kernel.get_dimj(),kernel.get_dimi()}});
 
 	//create FFT plans 
-	PRISMATIC_FFTW_INIT_THREADS();
-	PRISMATIC_FFTW_PLAN_WITH_NTHREADS(1);
-	
-	std::unique_lock<std::mutex> gatekeeper(fftw_plan_lock);
-	PRISMATIC_FFTW_PLAN plan_forward_arr = PRISMATIC_FFTW_PLAN_DFT_2D(karr.get_dimj(), karr.get_dimi(),
-															reinterpret_cast<PRISMATIC_FFTW_COMPLEX *>(&karr[0]),
-															reinterpret_cast<PRISMATIC_FFTW_COMPLEX *>(&karr[0]),
-															FFTW_FORWARD,
-															FFTW_ESTIMATE);
-
-	PRISMATIC_FFTW_PLAN plan_inv_arr = PRISMATIC_FFTW_PLAN_DFT_2D(karr.get_dimj(), karr.get_dimi(),
-															reinterpret_cast<PRISMATIC_FFTW_COMPLEX *>(&karr[0]),
-															reinterpret_cast<PRISMATIC_FFTW_COMPLEX *>(&karr[0]),
-															FFTW_BACKWARD,
-															FFTW_ESTIMATE);
-
-	PRISMATIC_FFTW_PLAN plan_forward_kern = PRISMATIC_FFTW_PLAN_DFT_2D(kkern.get_dimj(), kkern.get_dimi(),
-															reinterpret_cast<PRISMATIC_FFTW_COMPLEX *>(&kkern[0]),
-															reinterpret_cast<PRISMATIC_FFTW_COMPLEX *>(&kkern[0]),
-															FFTW_BACKWARD,
-															FFTW_ESTIMATE);
-	gatekeeper.unlock();
+	FFTPlan plan_forward_arr = planFFT2D(karr.get_dimj(), karr.get_dimi(), &karr[0], &karr[0], FFTDirection::Forward);
+	FFTPlan plan_inv_arr = planFFT2D(karr.get_dimj(), karr.get_dimi(), &karr[0], &karr[0], FFTDirection::Inverse);
+	FFTPlan plan_forward_kern = planFFT2D(kkern.get_dimj(), kkern.get_dimi(), &kkern[0], &kkern[0], FFTDirection::Inverse);
 
     //copy data to transform
     for(auto i = 0; i < arr.size(); i++){
@@ -573,12 +349,12 @@ void convolve2D(Array2D<PRISMATIC_FLOAT_PRECISION> &arr, Array2D<PRISMATIC_FLOAT
     }
     
     //transform, multiply, transform
-    PRISMATIC_FFTW_EXECUTE(plan_forward_arr);
-    PRISMATIC_FFTW_EXECUTE(plan_forward_kern);
+    plan_forward_arr.execute();
+    plan_forward_kern.execute();
 
     for(auto i = 0; i < karr.size(); i++) karr[i] *= kkern[i];
 
-    PRISMATIC_FFTW_EXECUTE(plan_inv_arr);
+    plan_inv_arr.execute();
 
     //copy data back and scale
     for(auto i = 0; i < arr.size(); i++) arr[i] = karr[i].real();
@@ -595,28 +371,11 @@ void convolve2D(Array2D<PRISMATIC_FLOAT_PRECISION> &arr, Array2D<std::complex<PR
     if(arr.get_dimi() != kkernel.get_dimi() || arr.get_dimj() != kkernel.get_dimj()) return;
 
     //prepare FFT calls
-    extern std::mutex fftw_plan_lock;
-
     Array2D<std::complex<PRISMATIC_FLOAT_PRECISION>> karr = zeros_ND<2,std::complex<PRISMATIC_FLOAT_PRECISION>>({{arr.get_dimj(), arr.get_dimi()}});
 
 	//create FFT plans 
-	PRISMATIC_FFTW_INIT_THREADS();
-	PRISMATIC_FFTW_PLAN_WITH_NTHREADS(1);
-	
-	std::unique_lock<std::mutex> gatekeeper(fftw_plan_lock);
-	PRISMATIC_FFTW_PLAN plan_forward_arr = PRISMATIC_FFTW_PLAN_DFT_2D(karr.get_dimj(), karr.get_dimi(),
-															reinterpret_cast<PRISMATIC_FFTW_COMPLEX *>(&karr[0]),
-															reinterpret_cast<PRISMATIC_FFTW_COMPLEX *>(&karr[0]),
-															FFTW_FORWARD,
-															FFTW_ESTIMATE);
-
-	PRISMATIC_FFTW_PLAN plan_inv_arr = PRISMATIC_FFTW_PLAN_DFT_2D(karr.get_dimj(), karr.get_dimi(),
-															reinterpret_cast<PRISMATIC_FFTW_COMPLEX *>(&karr[0]),
-															reinterpret_cast<PRISMATIC_FFTW_COMPLEX *>(&karr[0]),
-															FFTW_BACKWARD,
-															FFTW_ESTIMATE);
-
-	gatekeeper.unlock();
+	FFTPlan plan_forward_arr = planFFT2D(karr.get_dimj(), karr.get_dimi(), &karr[0], &karr[0], FFTDirection::Forward);
+	FFTPlan plan_inv_arr = planFFT2D(karr.get_dimj(), karr.get_dimi(), &karr[0], &karr[0], FFTDirection::Inverse);
 
     //copy data to transform
     for(auto i = 0; i < arr.size(); i++){
@@ -624,11 +383,11 @@ void convolve2D(Array2D<PRISMATIC_FLOAT_PRECISION> &arr, Array2D<std::complex<PR
     }
     
     //transform, multiply, transform
-    PRISMATIC_FFTW_EXECUTE(plan_forward_arr);
+    plan_forward_arr.execute();
 
     for(auto i = 0; i < karr.size(); i++) karr[i] *= kkernel[i];
 
-    PRISMATIC_FFTW_EXECUTE(plan_inv_arr);
+    plan_inv_arr.execute();
 
     //copy data back and scale
     for(auto i = 0; i < arr.size(); i++) arr[i] = karr[i].real();
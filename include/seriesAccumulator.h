@@ -0,0 +1,70 @@
+// Copyright Alan (AJ) Pryor, Jr. 2017
+// Transcribed from MATLAB code by Colin Ophus
+// Prismatic is distributed under the GNU General Public License (GPL)
+// If you use Prismatic, we kindly ask that you cite the following papers:
+
+// 1. Ophus, C.: A fast image simulation algorithm for scanning
+//    transmission electron microscopy. Advanced Structural and
+//    Chemical Imaging 3(1), 13 (2017)
+
+// 2. Pryor, Jr., A., Ophus, C., and Miao, J.: A Streaming Multi-GPU
+//    Implementation of Image Simulation Algorithms for Scanning
+//	  Transmission Electron Microscopy. arXiv:1706.08563 (2017)
+
+#ifndef PRISMATIC_SERIESACCUMULATOR_H
+#define PRISMATIC_SERIESACCUMULATOR_H
+#include <vector>
+#include <string>
+#include <array>
+#include <map>
+#include <memory>
+#include "defines.h"
+#include "ArrayND.h"
+
+namespace Prismatic{
+
+// Holds the frozen phonon sums for every entry of a simulation series. The accumulators are kept in RAM
+// when they fit within the memory budget and in a memory mapped scratch file otherwise.
+// Copies share the same storage.
+class SeriesAccumulator
+{
+	public:
+	typedef ArrayND<4, std::vector<PRISMATIC_FLOAT_PRECISION>> stack_type;
+	typedef ArrayND<4, std::vector<double>> sum_type;
+
+	SeriesAccumulator(){};
+
+	// reserve one zeroed accumulator (plus an optional DPC accumulator, if dims_DPC is nonzero) per tag,
+	// summing in double precision if doubleSums is set
+	void allocate(const std::vector<std::string> &tags,
+				  const std::array<size_t, 4> &dims_output,
+				  const std::array<size_t, 4> &dims_DPC,
+				  const unsigned long long int memoryBudget,
+				  const std::string &scratchDirectory,
+				  const bool doubleSums = false);
+
+	void accumulate(const std::string &tag, const stack_type &output);
+	void accumulate(const std::string &tag, const stack_type &output, const stack_type &DPC_CoM);
+
+	// copy the running sums for tag out into the given float or double stacks, resizing them as needed
+	template <class T>
+	void retrieve(const std::string &tag, ArrayND<4, std::vector<T>> &output);
+	template <class T>
+	void retrieve(const std::string &tag, ArrayND<4, std::vector<T>> &output, ArrayND<4, std::vector<T>> &DPC_CoM);
+
+	void release();
+
+	bool isAllocated() const;
+	bool isMapped() const;
+
+	private:
+	struct Storage;
+	std::shared_ptr<Storage> storage;
+
+	size_t slot(const std::string &tag); // offset of tag's accumulator, in elements
+};
+
+std::string getScratchDirectory(const std::string &scratchDirectory);
+
+} //namespace Prismatic
+#endif //PRISMATIC_SERIESACCUMULATOR_H
@@ -20,8 +20,11 @@
 #include <complex>
 #include <ctime>
 #include <iomanip>
+#include <array>
+#include <algorithm>
 #include "defines.h"
 #include "fftw3.h"
+#include "FFTBackend.h"
 #include "configure.h"
 
 namespace Prismatic
@@ -31,7 +34,35 @@ namespace Prismatic
 //auto tm = *std::localtime(&t);
 //std::cout << "Current time: " << std::put_time(&tm, "%F %H:%M:%S") << std::endl;
 //}
-extern std::mutex fftw_plan_lock; // for synchronizing access to shared FFTW resources
+
+template <size_t N, class T>
+void ensureDims(ArrayND<N, std::vector<T>> &arr, const std::array<size_t, N> &dims)
+{
+	//reallocate only when the shape changes, so reused buffers keep their storage
+	size_t size = 1;
+	for (auto d : dims) size *= d;
+	if (arr.size() != size || arr.get_dimarr() != dims) arr = zeros_ND<N, T>(dims);
+};
+
+//thread-local scratch arrays for per-probe temporaries. Each thread owns one array per slot and element type,
+//which keeps its storage between uses and is only reallocated when the requested shape changes. Contents are
+//left over from the previous use, so callers overwrite or clear them.
+enum ScratchSlot {SCRATCH_COORDS_X, SCRATCH_COORDS_Y, SCRATCH_INTENSITY, SCRATCH_FORMAT, SCRATCH_DETECTOR, NUM_SCRATCH_SLOTS};
+
+template <size_t N, class T>
+ArrayND<N, std::vector<T>> &scratchArray(const ScratchSlot slot)
+{
+	thread_local std::array<ArrayND<N, std::vector<T>>, NUM_SCRATCH_SLOTS> arena;
+	return arena[slot];
+};
+
+template <size_t N, class T>
+ArrayND<N, std::vector<T>> &scratchArray(const ScratchSlot slot, const std::array<size_t, N> &dims)
+{
+	ArrayND<N, std::vector<T>> &arr = scratchArray<N, T>(slot);
+	ensureDims(arr, dims);
+	return arr;
+};
 
 template <class T>
 std::vector<T> vecFromRange(const T &start, const T &step, const T &stop)
@@ -89,9 +120,9 @@ Array2D<T> fftshift2(Array2D<T> arr)
 };
 
 template <class T>
-Array2D<T> fftshift2_flip(Array2D<T> arr)
+void fftshift2_flip(const Array2D<T> &arr, Array2D<T> &result)
 {
-	Array2D<T> result = zeros_ND<2, T>({{arr.get_dimi(), arr.get_dimj()}});
+	ensureDims(result, {{arr.get_dimi(), arr.get_dimj()}});
 	const long sj = std::floor(arr.get_dimj() / 2);
 	const long si = std::floor(arr.get_dimi() / 2);
 	for (auto j = 0; j < arr.get_dimj(); ++j)
@@ -101,6 +132,13 @@ Array2D<T> fftshift2_flip(Array2D<T> arr)
 			result.at((i + si) % arr.get_dimi(), (j + sj) % arr.get_dimj()) = arr.at(j, i);
 		}
 	}
+};
+
+template <class T>
+Array2D<T> fftshift2_flip(Array2D<T> arr)
+{
+	Array2D<T> result;
+	fftshift2_flip(arr, result);
 	return result;
 };
 
@@ -117,9 +155,9 @@ Array1D<T> fftshift(Array1D<T> arr)
 };
 
 template <class T>
-Array2D<T> circShift(Array2D<T> &arr,const long sj, const long si)
+void circShift(const Array2D<T> &arr, const long sj, const long si, Array2D<T> &result)
 {
-    Array2D<T> result(arr);
+    ensureDims(result, arr.get_dimarr());
     for (auto j = 0; j < arr.get_dimj(); ++j)
     {
         for (auto i = 0; i < arr.get_dimi(); ++i)
@@ -127,11 +165,19 @@ Array2D<T> circShift(Array2D<T> &arr,const long sj, const long si)
             result.at((j + sj) % arr.get_dimj(), (i + si) % arr.get_dimi()) = arr.at(j, i);
         }
     }
-    return result;
 };
 
 template <class T>
-Array2D<T> cropOutput(Array2D<T> &img, const Parameters<T> &pars){
+Array2D<T> circShift(Array2D<T> &arr,const long sj, const long si)
+{
+    Array2D<T> result;
+    circShift(arr, sj, si, result);
+    return result;
+};
+
+template <class T, class P>
+void cropOutput(const Array2D<T> &img, const Parameters<P> &pars, Array2D<T> &cropped)
+{
     size_t qxInd_max = 0;
     size_t qyInd_max = 0;
     PRISMATIC_FLOAT_PRECISION qMax = pars.meta.crop4Damax / pars.lambda;
@@ -160,70 +206,89 @@ Array2D<T> cropOutput(Array2D<T> &img, const Parameters<T> &pars){
         }
     }
 
-    //shift image so that desired region is in top left
-    Array2D<T> shifted = circShift(img,qyInd_max,qxInd_max);
-
-    //construct cropped return image
-    Array2D<T> cropped = zeros_ND<2, T>({{qxInd_max*2, qyInd_max*2}});
-
-    //copy data to return array
-    for(auto j = 0; j < cropped.get_dimj(); j++)
+    //read the transposed window straight from the image, shifted so that the desired region starts at the top left
+    ensureDims(cropped, {{qxInd_max*2, qyInd_max*2}});
+    const long ndimj = (long) img.get_dimj();
+    const long ndimi = (long) img.get_dimi();
+    for(long j = 0; j < cropped.get_dimj(); j++)
     {
-        for(auto i = 0; i < cropped.get_dimi(); i++)
+        for(long i = 0; i < cropped.get_dimi(); i++)
         {
-            cropped.at(j,i) = shifted.at(i,j);
+            cropped.at(j,i) = img.at(((i - (long) qyInd_max) % ndimj + ndimj) % ndimj,
+                                     ((j - (long) qxInd_max) % ndimi + ndimi) % ndimi);
         }
     }
-    
+}
+
+template <class T>
+Array2D<T> cropOutput(Array2D<T> &img, const Parameters<T> &pars){
+    Array2D<T> cropped;
+    cropOutput(img, pars, cropped);
     return cropped;
 }
 
 template <class T>
 Array2D<std::complex<T>> cropOutput(Array2D<std::complex<T>> &img, const Parameters<T> &pars){
-    size_t qxInd_max = 0;
-    size_t qyInd_max = 0;
-    PRISMATIC_FLOAT_PRECISION qMax = pars.meta.crop4Damax / pars.lambda;
+    Array2D<std::complex<T>> cropped;
+    cropOutput(img, pars, cropped);
+    return cropped;
+}
 
-    for(auto i = 0; i < pars.qx.get_dimi(); i++)
+// adds each pixel to the detector bin alphaInd gives it (1-based, bins past Ndet are dropped);
+// S is the type the sums are kept in, so single precision intensities can be summed in double
+template <class S, class T>
+void binDetector(const T *intensity, const T *alphaInd, const size_t numPixels, const size_t Ndet, T *bins)
+{
+    ArrayND<1, std::vector<S>> &sums = scratchArray<1, S>(SCRATCH_DETECTOR, {{Ndet}});
+    std::copy(bins, bins + Ndet, sums.begin());
+    for (size_t p = 0; p < numPixels; ++p)
     {
-        if(pars.qx.at(i) < qMax)
-        {
-            qxInd_max++;
-        }
-        else
-        {
-            break;
-        }
+        if (alphaInd[p] <= Ndet)
+            sums[(size_t)alphaInd[p] - 1] += intensity[p];
     }
+    std::copy(sums.begin(), sums.end(), bins);
+}
 
-    for(auto j = 0; j < pars.qy.get_dimi(); j++)
+template <class T>
+void binDetector(const T *intensity, const T *alphaInd, const size_t numPixels, const size_t Ndet, T *bins, const bool doubleSums)
+{
+    if (doubleSums)
     {
-        if(pars.qy.at(j) < qMax)
-        {
-            qyInd_max++;
-        }
-        else
-        {
-            break;
-        }
+        binDetector<double>(intensity, alphaInd, numPixels, Ndet, bins);
+        return;
     }
+    for (size_t p = 0; p < numPixels; ++p)
+    {
+        if (alphaInd[p] <= Ndet)
+            bins[(size_t)alphaInd[p] - 1] += intensity[p];
+    }
+}
 
-    //shift image so that desired region is in top left
-    Array2D<std::complex<T>> shifted = circShift(img,qyInd_max,qxInd_max);
-
-    //construct cropped return image
-    Array2D<std::complex<T>> cropped = zeros_ND<2, std::complex<T>>({{qxInd_max*2, qyInd_max*2}});
-
-    //copy data to return array
-    for(auto j = 0; j < cropped.get_dimj(); j++)
+// adds the first moments of intensity over the Fourier coordinates qx, qy to com[0], com[1] and divides by the total intensity
+template <class S, class T>
+void centerOfMass(const T *intensity, const T *qx, const T *qy, const size_t numPixels, T *com)
+{
+    S comx = com[0];
+    S comy = com[1];
+    S intensitySum = 0;
+    for (size_t p = 0; p < numPixels; ++p)
     {
-        for(auto i = 0; i < cropped.get_dimi(); i++)
-        {
-            cropped.at(j,i) = shifted.at(i,j);
-        }
+        comx += qx[p] * intensity[p];
+        comy += qy[p] * intensity[p];
     }
-    
-    return cropped;
+    for (size_t p = 0; p < numPixels; ++p)
+        intensitySum += intensity[p];
+    com[0] = comx / intensitySum;
+    com[1] = comy / intensitySum;
+}
+
+template <class T>
+void centerOfMass(const T *intensity, const T *qx, const T *qy, const size_t numPixels, T *com, const bool doubleSums)
+{
+    if (doubleSums)
+        centerOfMass<double>(intensity, qx, qy, numPixels, com);
+    else
+        centerOfMass<T>(intensity, qx, qy, numPixels, com);
 }
 
 
@@ -274,8 +339,26 @@ std::vector<T> getUnique(std::vector<T> input)
     return input;
 }
 
+bool parseAberrationKey(const std::string &key, int &n, int &m, bool &isAngle);
+
+bool validSeriesKey(const std::string &key);
+
+bool seriesKeyChangesProbeOnly(const std::string &key);
+
 void updateSeriesParams(Parameters<PRISMATIC_FLOAT_PRECISION> &pars, size_t iter);
 
+void setupSeriesOutput(Parameters<PRISMATIC_FLOAT_PRECISION> &pars);
+
+void updateSeriesOutput(Parameters<PRISMATIC_FLOAT_PRECISION> &pars);
+
+void readSeriesOutput(Parameters<PRISMATIC_FLOAT_PRECISION> &pars);
+
+// add this configuration's output to the frozen phonon sums, in double precision for mixed precision runs
+void accumulateFrozenPhonon(Parameters<PRISMATIC_FLOAT_PRECISION> &pars, size_t fpNum);
+
+// divide the frozen phonon sums by the number of configurations, leaving the averages in net_output and net_DPC_CoM
+void averageFrozenPhonons(Parameters<PRISMATIC_FLOAT_PRECISION> &pars);
+
 } // namespace Prismatic
 
 #endif //PRISMATIC_UTILITY_H
@@ -14,7 +14,7 @@
 from . import core  # noqa
 from . import fileio  # noqa
 from . import process
-from pyprismatic.params import Metadata
+from pyprismatic.params import Metadata, Simulation, Session
 
 def keySearch(dictionary,layer):
     layer+=1
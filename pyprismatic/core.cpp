@@ -20,13 +20,80 @@
 #include <stdio.h>
 #include "aberration.h"
 #include "probe.h"
+#include "SimulationResults.h"
+#include "SimulationProgress.h"
+#include "StageCache.h"
+#include "kirkland_params.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
 #ifdef PRISMATIC_ENABLE_GPU
 #include "cuprismatic.h"
 #endif //PRISMATIC_ENABLE_GPU
 
-static PyObject *pyprismatic_core_go(PyObject *self, PyObject *args)
+// A simulation output exposed through the buffer protocol, so NumPy can wrap it without copying.
+// The ResultArray keeps the C++ buffer alive for as long as any array viewing it exists
+typedef struct
+{
+	PyObject_HEAD
+	Prismatic::ResultArray *result;
+	Py_ssize_t shape[4];
+	Py_ssize_t strides[4];
+} ResultBuffer;
+
+static PyTypeObject ResultBufferType = {PyVarObject_HEAD_INIT(NULL, 0)};
+
+static void ResultBuffer_dealloc(PyObject *obj)
+{
+	delete ((ResultBuffer *)obj)->result;
+	Py_TYPE(obj)->tp_free(obj);
+}
+
+static int ResultBuffer_getbuffer(PyObject *obj, Py_buffer *view, int flags)
+{
+	ResultBuffer *buffer = (ResultBuffer *)obj;
+	const bool isDouble = sizeof(PRISMATIC_FLOAT_PRECISION) == sizeof(double);
+	view->obj = obj;
+	Py_INCREF(obj);
+	view->buf = buffer->result->data;
+	view->itemsize = (buffer->result->complex ? 2 : 1) * sizeof(PRISMATIC_FLOAT_PRECISION);
+	view->len = buffer->result->size() * view->itemsize;
+	view->readonly = 0;
+	view->format = (flags & PyBUF_FORMAT) ? (char *)(buffer->result->complex ? (isDouble ? "Zd" : "Zf") : (isDouble ? "d" : "f")) : NULL;
+	view->ndim = buffer->result->shape.size();
+	view->shape = (flags & PyBUF_ND) ? buffer->shape : NULL;
+	view->strides = (flags & PyBUF_STRIDES) ? buffer->strides : NULL;
+	view->suboffsets = NULL;
+	view->internal = NULL;
+	return 0;
+}
+
+static PyBufferProcs ResultBuffer_as_buffer = {ResultBuffer_getbuffer, NULL};
+
+static PyObject *wrapResult(const Prismatic::ResultArray &result)
+{
+	ResultBuffer *buffer = PyObject_New(ResultBuffer, &ResultBufferType);
+	if (buffer == NULL)
+		return NULL;
+	buffer->result = new Prismatic::ResultArray(result);
+	Py_ssize_t stride = (result.complex ? 2 : 1) * sizeof(PRISMATIC_FLOAT_PRECISION);
+	for (int d = result.shape.size() - 1; d >= 0; d--)
+	{
+		buffer->shape[d] = result.shape[d];
+		buffer->strides[d] = stride;
+		stride *= result.shape[d];
+	}
+	return (PyObject *)buffer;
+}
+
+static bool parseMetadata(PyObject *args, Prismatic::Metadata<PRISMATIC_FLOAT_PRECISION> &meta)
 {
-	Prismatic::Metadata<PRISMATIC_FLOAT_PRECISION> meta;
 	int interpolationFactorY = 1;
 	int interpolationFactorX = 1;
 	int randomSeed;
@@ -145,7 +212,7 @@ static PyObject *pyprismatic_core_go(PyObject *self, PyObject *args)
 			&importPath,
 			&maxFileSize))
 	{
-		return NULL;
+		return false;
 	}
 	meta.interpolationFactorX = interpolationFactorX;
 	meta.interpolationFactorY = interpolationFactorY;
@@ -230,7 +297,9 @@ static PyObject *pyprismatic_core_go(PyObject *self, PyObject *args)
 		std::cout << "Reading probe positions from" << " " << std::string(probes_file) << std::endl;
 		Prismatic::readProbes(std::string(probes_file), meta.probes_x, meta.probes_y);
 	}
-	meta.randomSeed = randomSeed;
+	//seed the generator the frozen phonons draw from, as --random-seed does, so that a seed gives the same configurations
+	meta.rng = boost::ranlux3((uint32_t)randomSeed);
+	meta.reseed();
 	if (std::string(algorithm) == "multislice" || std::string(algorithm) == "m")
 	{
 		meta.algorithm = Prismatic::Algorithm::Multislice;
@@ -281,14 +350,134 @@ static PyObject *pyprismatic_core_go(PyObject *self, PyObject *args)
 		meta.transferMode = Prismatic::StreamingMode::Auto;
 	}
 
+	return true;
+}
+
+static bool validParameters(Prismatic::Metadata<PRISMATIC_FLOAT_PRECISION> &meta)
+{
 	// print metadata
 	//meta.toString();
 	int scratch = Prismatic::writeParamFile(meta,"scratch_param.txt");
 
 	Prismatic::Metadata<PRISMATIC_FLOAT_PRECISION> tmp_meta;
-	if(Prismatic::parseParamFile(tmp_meta,"scratch_param.txt"))
+	return Prismatic::parseParamFile(tmp_meta,"scratch_param.txt");
+}
+
+#ifndef H5_HAVE_THREADSAFE
+// Each run has its own worker threads, allocation policy, profiler and execution plan, so runs may overlap.
+// Only an HDF5 library built without thread safety makes them take turns; callers wait without the GIL
+static std::mutex hdf5Lock;
+#endif //H5_HAVE_THREADSAFE
+
+static PyObject *CancelledError = NULL;
+
+struct Outcome
+{
+	bool cancelled = false;
+	std::string error;
+};
+
+// run a simulation; called without the GIL
+static Outcome execute(Prismatic::Metadata<PRISMATIC_FLOAT_PRECISION> &meta)
+{
+	Outcome outcome;
+#ifndef H5_HAVE_THREADSAFE
+	std::lock_guard<std::mutex> gatekeeper(hdf5Lock);
+#endif //H5_HAVE_THREADSAFE
+	try
 	{
+		if (meta.progress)
+			meta.progress->checkCancelled();
 		Prismatic::go(meta);
+	}
+	catch (const Prismatic::SimulationCancelled &)
+	{
+		outcome.cancelled = true;
+	}
+	catch (const std::exception &e)
+	{
+		outcome.error = e.what();
+	}
+	return outcome;
+}
+
+static bool raiseOutcome(const Outcome &outcome)
+{
+	if (outcome.cancelled)
+	{
+		PyErr_SetString(CancelledError, "Simulation cancelled");
+		return true;
+	}
+	if (!outcome.error.empty())
+	{
+		PyErr_SetString(PyExc_RuntimeError, outcome.error.c_str());
+		return true;
+	}
+	return false;
+}
+
+static PyObject *wrapResults(const Prismatic::SimulationResults &simulationResults)
+{
+	PyObject *results = PyDict_New();
+	if (results == NULL)
+		return NULL;
+	for (auto &name : simulationResults.names())
+	{
+		PyObject *buffer = wrapResult(simulationResults.get(name));
+		if (buffer == NULL || PyDict_SetItemString(results, name.c_str(), buffer) != 0)
+		{
+			Py_XDECREF(buffer);
+			Py_DECREF(results);
+			return NULL;
+		}
+		Py_DECREF(buffer);
+	}
+	return results;
+}
+
+// parse the arguments of run and start: keep4D, then from firstField on the arguments of go
+static bool parseRunArguments(PyObject *args, const Py_ssize_t firstField, Prismatic::Metadata<PRISMATIC_FLOAT_PRECISION> &meta)
+{
+	const Py_ssize_t numArgs = PyTuple_Size(args);
+	if (numArgs < firstField)
+	{
+		PyErr_SetString(PyExc_TypeError, "expected keep4D followed by the simulation parameters");
+		return false;
+	}
+	const int keep4D = PyObject_IsTrue(PyTuple_GetItem(args, 0));
+	PyObject *fields = PyTuple_GetSlice(args, firstField, numArgs);
+	const bool parsed = keep4D >= 0 && parseMetadata(fields, meta);
+	Py_DECREF(fields);
+	if (!parsed)
+	{
+		return false;
+	}
+
+	if (!validParameters(meta))
+	{
+		PyErr_SetString(PyExc_ValueError, "Invalid parameters detected. Cancelling calculation, please check inputs.");
+		return false;
+	}
+	meta.results = std::make_shared<Prismatic::SimulationResults>(keep4D);
+	return true;
+}
+
+static PyObject *pyprismatic_core_go(PyObject *self, PyObject *args)
+{
+	Prismatic::Metadata<PRISMATIC_FLOAT_PRECISION> meta;
+	if (!parseMetadata(args, meta))
+	{
+		return NULL;
+	}
+
+	if(validParameters(meta))
+	{
+		Outcome outcome;
+		Py_BEGIN_ALLOW_THREADS
+		outcome = execute(meta);
+		Py_END_ALLOW_THREADS
+		if (raiseOutcome(outcome))
+			return NULL;
 	}else{
 		std::cout << "Invalid parameters detected. Cancelling calculation, please check inputs." << std::endl;
 	}
@@ -296,8 +485,276 @@ static PyObject *pyprismatic_core_go(PyObject *self, PyObject *args)
 	Py_RETURN_NONE;
 }
 
+static PyObject *pyprismatic_core_run(PyObject *self, PyObject *args)
+{
+	Prismatic::Metadata<PRISMATIC_FLOAT_PRECISION> meta;
+	if (!parseRunArguments(args, 1, meta))
+	{
+		return NULL;
+	}
+
+	Outcome outcome;
+	Py_BEGIN_ALLOW_THREADS
+	outcome = execute(meta);
+	Py_END_ALLOW_THREADS
+	if (raiseOutcome(outcome))
+		return NULL;
+	return wrapResults(*meta.results);
+}
+
+// A simulation running on its own thread, returned by start. The thread never touches Python objects;
+// wait hands progress to the callback from the waiting thread, with the GIL held
+struct BackgroundRun
+{
+	Prismatic::Metadata<PRISMATIC_FLOAT_PRECISION> meta;
+	std::thread worker;
+	std::mutex lock;
+	std::condition_variable finished;
+	bool done = false;
+	Outcome outcome;
+};
+
+typedef struct
+{
+	PyObject_HEAD
+	BackgroundRun *run;
+} Simulation;
+
+static PyTypeObject SimulationType = {PyVarObject_HEAD_INIT(NULL, 0)};
+
+// wait up to timeout for the run to finish, without the GIL
+static bool waitFor(BackgroundRun *run, const std::chrono::milliseconds timeout)
+{
+	bool done;
+	Py_BEGIN_ALLOW_THREADS
+	std::unique_lock<std::mutex> gatekeeper(run->lock);
+	done = run->finished.wait_for(gatekeeper, timeout, [run] { return run->done; });
+	Py_END_ALLOW_THREADS
+	return done;
+}
+
+static void joinRun(BackgroundRun *run)
+{
+	if (!run->worker.joinable())
+		return;
+	Py_BEGIN_ALLOW_THREADS
+	run->worker.join();
+	Py_END_ALLOW_THREADS
+}
+
+static void Simulation_dealloc(PyObject *obj)
+{
+	BackgroundRun *run = ((Simulation *)obj)->run;
+	run->meta.progress->cancel();
+	joinRun(run);
+	delete run;
+	Py_TYPE(obj)->tp_free(obj);
+}
+
+static PyObject *progressDict(const Prismatic::SimulationProgress &progress)
+{
+	const Prismatic::SimulationProgress::Snapshot snapshot = progress.snapshot();
+	return Py_BuildValue("{s:s,s:n,s:n,s:n,s:n}",
+						 "stage", snapshot.stage.c_str(),
+						 "done", (Py_ssize_t)snapshot.done,
+						 "total", (Py_ssize_t)snapshot.total,
+						 "frozen_phonon", (Py_ssize_t)snapshot.fpNum,
+						 "num_frozen_phonons", (Py_ssize_t)snapshot.numFP);
+}
+
+static PyObject *Simulation_poll(PyObject *obj, PyObject *)
+{
+	BackgroundRun *run = ((Simulation *)obj)->run;
+	std::lock_guard<std::mutex> gatekeeper(run->lock);
+	return PyBool_FromLong(run->done);
+}
+
+static PyObject *Simulation_progress(PyObject *obj, PyObject *)
+{
+	return progressDict(*((Simulation *)obj)->run->meta.progress);
+}
+
+static PyObject *Simulation_cancel(PyObject *obj, PyObject *)
+{
+	((Simulation *)obj)->run->meta.progress->cancel();
+	Py_RETURN_NONE;
+}
+
+static PyObject *Simulation_wait(PyObject *obj, PyObject *args, PyObject *kwargs)
+{
+	static const char *keywords[] = {"callback", "interval", NULL};
+	BackgroundRun *run = ((Simulation *)obj)->run;
+	PyObject *callback = Py_None;
+	double interval = 0.5;
+	if (!PyArg_ParseTupleAndKeywords(args, kwargs, "|Od", (char **)keywords, &callback, &interval))
+		return NULL;
+	if (callback != Py_None && !PyCallable_Check(callback))
+	{
+		PyErr_SetString(PyExc_TypeError, "callback must be callable");
+		return NULL;
+	}
+
+	// wake up every interval to report progress and to notice interrupts; the run is cancelled if either raises
+	const std::chrono::milliseconds timeout(std::max((long long)1, (long long)(interval * 1000)));
+	while (!waitFor(run, timeout))
+	{
+		bool failed = PyErr_CheckSignals() != 0;
+		if (!failed && callback != Py_None)
+		{
+			PyObject *progress = progressDict(*run->meta.progress);
+			PyObject *result = progress == NULL ? NULL : PyObject_CallFunctionObjArgs(callback, progress, NULL);
+			failed = result == NULL;
+			Py_XDECREF(progress);
+			Py_XDECREF(result);
+		}
+		if (failed)
+		{
+			run->meta.progress->cancel();
+			joinRun(run);
+			return NULL;
+		}
+	}
+	joinRun(run);
+
+	if (raiseOutcome(run->outcome))
+		return NULL;
+	return wrapResults(*run->meta.results);
+}
+
+static PyMethodDef Simulation_methods[] = {
+	{"poll", (PyCFunction)Simulation_poll, METH_NOARGS, "Return whether the simulation has finished"},
+	{"progress", (PyCFunction)Simulation_progress, METH_NOARGS, "Return the current stage, its jobs done and total, and the frozen phonon being computed"},
+	{"cancel", (PyCFunction)Simulation_cancel, METH_NOARGS, "Ask the simulation to stop; wait then raises Cancelled"},
+	{"wait", (PyCFunction)Simulation_wait, METH_VARARGS | METH_KEYWORDS, "Wait for the simulation, calling callback(progress) every interval seconds, and return its outputs as a dict of buffers"},
+	{NULL, NULL, 0, NULL}};
+
+// Intermediates shared by the runs started with it, so parameter sweeps only recompute the stages they invalidate
+typedef struct
+{
+	PyObject_HEAD
+	std::shared_ptr<Prismatic::StageCache> *cache;
+} Session;
+
+static PyTypeObject SessionType = {PyVarObject_HEAD_INIT(NULL, 0)};
+
+static PyObject *Session_new(PyTypeObject *type, PyObject *, PyObject *)
+{
+	Session *session = (Session *)type->tp_alloc(type, 0);
+	if (session == NULL)
+		return NULL;
+	session->cache = new std::shared_ptr<Prismatic::StageCache>(std::make_shared<Prismatic::StageCache>());
+	return (PyObject *)session;
+}
+
+static void Session_dealloc(PyObject *obj)
+{
+	// runs still using the cache keep it alive
+	delete ((Session *)obj)->cache;
+	Py_TYPE(obj)->tp_free(obj);
+}
+
+static PyObject *Session_stats(PyObject *obj, PyObject *)
+{
+	const Prismatic::StageCache::Stats stats = (*((Session *)obj)->cache)->stats();
+	return Py_BuildValue("{s:n,s:n,s:n,s:n,s:n}",
+						 "atoms_reused", (Py_ssize_t)stats.atomsReused,
+						 "potentials_reused", (Py_ssize_t)stats.potentialsReused,
+						 "potentials_computed", (Py_ssize_t)stats.potentialsComputed,
+						 "smatrices_reused", (Py_ssize_t)stats.sMatricesReused,
+						 "smatrices_computed", (Py_ssize_t)stats.sMatricesComputed);
+}
+
+static PyObject *Session_clear(PyObject *obj, PyObject *)
+{
+	(*((Session *)obj)->cache)->clear();
+	Py_RETURN_NONE;
+}
+
+static PyMethodDef Session_methods[] = {
+	{"stats", (PyCFunction)Session_stats, METH_NOARGS, "Return how many atom files, potentials and S-matrices were reused and computed"},
+	{"clear", (PyCFunction)Session_clear, METH_NOARGS, "Drop everything kept from earlier runs"},
+	{NULL, NULL, 0, NULL}};
+
+// atoms held by Python, as float64 rows of Z, x, y, z (Angstroms), occupancy and Debye-Waller sigma like the
+// lines of an xyz file, become the unit cell of meta, whose cellDim gives the cell size
+static bool parseAtoms(PyObject *obj, Prismatic::Metadata<PRISMATIC_FLOAT_PRECISION> &meta)
+{
+	Py_buffer view;
+	if (PyObject_GetBuffer(obj, &view, PyBUF_C_CONTIGUOUS | PyBUF_FORMAT) != 0)
+		return false;
+	const std::string format = view.format == NULL ? "B" : view.format;
+	if (view.ndim != 2 || view.shape[1] != 6 || view.shape[0] == 0 || view.itemsize != sizeof(double) || format.back() != 'd')
+	{
+		PyBuffer_Release(&view);
+		PyErr_SetString(PyExc_ValueError, "atoms must be a nonempty C-contiguous float64 array with rows Z, x, y, z, occupancy, sigma");
+		return false;
+	}
+
+	std::shared_ptr<std::vector<atom>> atoms = std::make_shared<std::vector<atom>>();
+	atoms->reserve(view.shape[0]);
+	const double *row = (const double *)view.buf;
+	for (Py_ssize_t n = 0; n < view.shape[0]; ++n, row += 6)
+	{
+		if (!(row[0] >= 1 && row[0] <= NUM_SPECIES_KIRKLAND) || row[0] != std::floor(row[0]))
+		{
+			std::ostringstream message;
+			message << "atom " << n << " has atomic number " << row[0] << ", expected an integer from 1 to " << NUM_SPECIES_KIRKLAND;
+			PyBuffer_Release(&view);
+			PyErr_SetString(PyExc_ValueError, message.str().c_str());
+			return false;
+		}
+		atoms->emplace_back(atom{row[1] / meta.cellDim[2], row[2] / meta.cellDim[1], row[3] / meta.cellDim[0], (size_t)row[0], row[5], row[4]});
+	}
+	PyBuffer_Release(&view);
+	meta.atoms = atoms;
+	meta.userSpecifiedCelldims = true;
+	return true;
+}
+
+static PyObject *pyprismatic_core_start(PyObject *self, PyObject *args)
+{
+	// keep4D, a Session or None, atoms or None, then the arguments of go
+	std::unique_ptr<BackgroundRun> run(new BackgroundRun);
+	if (!parseRunArguments(args, 3, run->meta))
+	{
+		return NULL;
+	}
+	PyObject *atoms = PyTuple_GetItem(args, 2);
+	if (atoms != Py_None && !parseAtoms(atoms, run->meta))
+	{
+		return NULL;
+	}
+	PyObject *session = PyTuple_GetItem(args, 1);
+	if (PyObject_TypeCheck(session, &SessionType))
+	{
+		run->meta.stageCache = *((Session *)session)->cache;
+	}
+	else if (session != Py_None)
+	{
+		PyErr_SetString(PyExc_TypeError, "session must be a Session or None");
+		return NULL;
+	}
+	run->meta.progress = std::make_shared<Prismatic::SimulationProgress>();
+
+	Simulation *simulation = PyObject_New(Simulation, &SimulationType);
+	if (simulation == NULL)
+		return NULL;
+	BackgroundRun *started = run.get();
+	started->worker = std::thread([started]() {
+		Outcome outcome = execute(started->meta);
+		std::lock_guard<std::mutex> gatekeeper(started->lock);
+		started->outcome = outcome;
+		started->done = true;
+		started->finished.notify_all();
+	});
+	simulation->run = run.release();
+	return (PyObject *)simulation;
+}
+
 static PyMethodDef pyprismatic_core_methods[] = {
 	{"go", (PyCFunction)pyprismatic_core_go, METH_VARARGS, "Execute Prismatic calculation"},
+	{"run", (PyCFunction)pyprismatic_core_run, METH_VARARGS, "Execute Prismatic calculation and return its outputs as a dict of buffers"},
+	{"start", (PyCFunction)pyprismatic_core_start, METH_VARARGS, "Start Prismatic calculation in the background and return a Simulation handle"},
 	{NULL, NULL, 0, NULL}};
 
 static struct PyModuleDef module_def = {
@@ -308,5 +765,45 @@ static struct PyModuleDef module_def = {
 
 PyMODINIT_FUNC PyInit_core()
 {
-	return PyModule_Create(&module_def);
+	ResultBufferType.tp_name = "pyprismatic.core.ResultBuffer";
+	ResultBufferType.tp_basicsize = sizeof(ResultBuffer);
+	ResultBufferType.tp_dealloc = ResultBuffer_dealloc;
+	ResultBufferType.tp_as_buffer = &ResultBuffer_as_buffer;
+	ResultBufferType.tp_flags = Py_TPFLAGS_DEFAULT;
+	ResultBufferType.tp_doc = "Simulation output shared with NumPy through the buffer protocol";
+	if (PyType_Ready(&ResultBufferType) < 0)
+		return NULL;
+
+	SimulationType.tp_name = "pyprismatic.core.Simulation";
+	SimulationType.tp_basicsize = sizeof(Simulation);
+	SimulationType.tp_dealloc = Simulation_dealloc;
+	SimulationType.tp_methods = Simulation_methods;
+	SimulationType.tp_flags = Py_TPFLAGS_DEFAULT;
+	SimulationType.tp_doc = "Simulation running in the background, returned by start";
+	if (PyType_Ready(&SimulationType) < 0)
+		return NULL;
+
+	SessionType.tp_name = "pyprismatic.core.Session";
+	SessionType.tp_basicsize = sizeof(Session);
+	SessionType.tp_new = Session_new;
+	SessionType.tp_dealloc = Session_dealloc;
+	SessionType.tp_methods = Session_methods;
+	SessionType.tp_flags = Py_TPFLAGS_DEFAULT;
+	SessionType.tp_doc = "Atoms, potentials and S-matrices kept between the runs started with it";
+	if (PyType_Ready(&SessionType) < 0)
+		return NULL;
+
+	PyObject *module = PyModule_Create(&module_def);
+	if (module == NULL)
+		return NULL;
+	Py_INCREF(&ResultBufferType);
+	PyModule_AddObject(module, "ResultBuffer", (PyObject *)&ResultBufferType);
+	Py_INCREF(&SimulationType);
+	PyModule_AddObject(module, "Simulation", (PyObject *)&SimulationType);
+	Py_INCREF(&SessionType);
+	PyModule_AddObject(module, "Session", (PyObject *)&SessionType);
+	CancelledError = PyErr_NewException("pyprismatic.core.Cancelled", PyExc_RuntimeError, NULL);
+	Py_XINCREF(CancelledError);
+	PyModule_AddObject(module, "Cancelled", CancelledError);
+	return module;
 }
@@ -21,7 +21,7 @@ class Metadata:
     """
     "interpolationFactorX" : PRISM interpolation factor in x-direction
     "interpolationFactorY" : PRISM interpolation factor in y-direction
-    "filenameAtoms" : filename containing input atom information in XYZ format (see http://prism-em.com/about/ for more details)
+    "filenameAtoms" : filename containing input atom information in XYZ format (see http://prism-em.com/about/ for more details); see setAtoms to use atoms held in memory instead
     "filenameOutput" : filename in which to save the 3D output. Also serves as base filename for 2D and 4D outputs if used
     "realspacePixelSizeX" : size of pixel size in X for probe/potential arrays
     "realspacePixelSizeY" : size of pixel size in Y for probe/potential arrays
@@ -363,9 +363,35 @@ class Metadata:
     @filenameAtoms.setter
     def filenameAtoms(self, filenameAtoms):
         self._filenameAtoms = filenameAtoms
+        self._atoms = None  # a file replaces atoms set with setAtoms
         if filenameAtoms != "":  # do not set cell dimensions for default empty string
             self._setCellDims(filenameAtoms)
 
+    def setAtoms(self, Z, positions, occupancy=1.0, sigma=0.0, cellDim=None):
+        """Simulate atoms held in memory instead of reading ``filenameAtoms``,
+        so nothing is written to or parsed from disk. ``Z`` holds the atomic
+        numbers, ``positions`` the x, y, z coordinates in Angstroms as an
+        (N, 3) array, and ``occupancy`` and ``sigma`` (Debye-Waller thermal
+        displacement, in Angstroms) are scalars or one value per atom, as in
+        the columns of an XYZ file. ``cellDim`` sets the unit cell size (X, Y,
+        Z) in Angstroms; otherwise the current ``cellDim`` is used. Setting
+        ``filenameAtoms`` switches back to reading a file.
+        """
+        import numpy as np
+
+        Z = np.asarray(Z, dtype=np.float64).reshape(-1)
+        positions = np.asarray(positions, dtype=np.float64).reshape(-1, 3)
+        if positions.shape[0] != Z.size:
+            raise ValueError("positions must hold x, y, z for each of the {} atoms".format(Z.size))
+        atoms = np.empty((Z.size, 6))
+        atoms[:, 0] = Z
+        atoms[:, 1:4] = positions
+        atoms[:, 4] = occupancy
+        atoms[:, 5] = sigma
+        if cellDim is not None:
+            self.cellDim = cellDim
+        self._atoms = atoms
+
     ##############################
     ### Convenience Properties ###
     ##############################
@@ -531,16 +557,45 @@ class Metadata:
         for field in Metadata.fields:
             print("{} = {}".format(field, getattr(self, field)))
 
-    def go(self, display_run_time=True, save_run_time=False):
-        """Run the simulation. To display and/or export the simulation run
-        time set the corresponding arguments ``display_run_time`` and
-        ``save_run_time`` to ``True`` or ``False`` (defaults are True and False).
+    def start(self, return_4D=False, session=None):
+        """Start the simulation in the background and return a ``Simulation``
+        handle to poll, wait for or cancel it. The Python interpreter is not
+        blocked while the simulation runs. Simulations started together run
+        at the same time, each on its own ``numThreads`` worker threads, and
+        may share a ``session``. ``return_4D`` and ``session`` are as in
+        ``go``.
         """
         self.algorithm: str = self.algorithm.lower()
         self.transferMode: str = self.transferMode.lower()
         l: List[Any] = [getattr(self, field) for field in Metadata.fields]
+        cache = None if session is None else session._cache
+        return Simulation(pyprismatic.core.start(return_4D, cache, self._atoms, *l))
+
+    def go(self, display_run_time=True, save_run_time=False, return_results=False, return_4D=False,
+           progress_callback=None, progress_interval=0.5, session=None):
+        """Run the simulation. To display and/or export the simulation run
+        time set the corresponding arguments ``display_run_time`` and
+        ``save_run_time`` to ``True`` or ``False`` (defaults are True and False).
+
+        With ``return_results=True`` the outputs are also returned as a dict of
+        NumPy arrays named after their groups in the output file, e.g.
+        ``virtual_detector_depth0000``, ``annular_detector_depth0000`` and
+        ``DPC_CoM_depth0000``. The arrays share memory with the simulation, so
+        no data is copied or read back from the output file. 4D outputs
+        (``CBED_array_depth0000``) are only returned with ``return_4D=True``,
+        as they are large.
+
+        ``progress_callback`` is called every ``progress_interval`` seconds
+        with the progress dict described in ``Simulation.progress``. If it
+        raises, or the run is interrupted, the simulation is cancelled and the
+        exception propagates.
+
+        With a ``Session``, the atoms, potentials and S-matrices of earlier
+        runs in the session are reused where this run's parameters leave them
+        unchanged.
+        """
         start = time.time()
-        pyprismatic.core.go(*l)
+        results = self.start(return_4D, session).wait(progress_callback, progress_interval)
         end = time.time()
 
         # Display and save run time when requested
@@ -552,3 +607,82 @@ class Metadata:
             filename = f"{os.path.splitext(self.filenameOutput)[0]}-timing.txt"
             with open(filename, 'w') as f:
                 f.write(total_time)
+
+        return results if return_results else None
+
+
+class Simulation:
+    """
+    A simulation running in the background, returned by ``Metadata.start``.
+    Dropping the handle cancels the simulation if it is still running.
+    """
+
+    def __init__(self, handle):
+        self._handle = handle
+
+    def poll(self):
+        """Return True once the simulation has finished, successfully or not."""
+        return self._handle.poll()
+
+    @property
+    def progress(self):
+        """Dict with the current ``stage`` ("potential slices", "atoms",
+        "plane waves" or "probe positions"), the number of its jobs handed out
+        so far (``done``) out of ``total``, and the ``frozen_phonon`` being
+        computed out of ``num_frozen_phonons``."""
+        return self._handle.progress()
+
+    def cancel(self):
+        """Ask the simulation to stop. It stops after the jobs in flight
+        finish, and ``wait`` then raises ``pyprismatic.core.Cancelled``."""
+        self._handle.cancel()
+
+    def wait(self, progress_callback=None, progress_interval=0.5):
+        """Wait for the simulation and return its outputs as a dict of NumPy
+        arrays, as ``Metadata.go`` with ``return_results=True`` does.
+        ``progress_callback`` is called every ``progress_interval`` seconds
+        with ``progress`` while waiting."""
+        import numpy as np
+
+        buffers = self._handle.wait(progress_callback, progress_interval)
+        return {name: np.asarray(buffer) for name, buffer in buffers.items()}
+
+
+class Session:
+    """
+    Keeps the parsed atoms, projected potentials and compact S-matrices of
+    the simulations run with it, and reuses them in later runs whose
+    parameters leave them unchanged. In a sweep over detector, scan or
+    aberration parameters only the final output stage is recomputed, e.g.
+
+    session = Session()
+    for df in defoci:
+        meta.probeDefocus = df
+        results = session.go(meta, return_results=True)
+
+    With thermal effects the frozen phonon configurations follow from
+    ``randomSeed``, so runs with the same seed reuse them, and a new seed
+    draws and computes new ones.
+    Everything is kept in memory until ``clear`` is called or the session is
+    dropped.
+    """
+
+    def __init__(self):
+        self._cache = pyprismatic.core.Session()
+
+    def go(self, meta, **kwargs):
+        """Run ``meta`` as ``Metadata.go`` does, reusing earlier results."""
+        return meta.go(session=self, **kwargs)
+
+    def start(self, meta, return_4D=False):
+        """Start ``meta`` as ``Metadata.start`` does, reusing earlier results."""
+        return meta.start(return_4D, session=self)
+
+    @property
+    def stats(self):
+        """Dict counting the atom files, potentials and S-matrices reused and computed."""
+        return self._cache.stats()
+
+    def clear(self):
+        """Drop everything kept from earlier runs."""
+        self._cache.clear()
@@ -0,0 +1,198 @@
+// Copyright Alan (AJ) Pryor, Jr. 2017
+// Transcribed from MATLAB code by Colin Ophus
+// Prismatic is distributed under the GNU General Public License (GPL)
+// If you use Prismatic, we kindly ask that you cite the following papers:
+
+// 1. Ophus, C.: A fast image simulation algorithm for scanning
+//    transmission electron microscopy. Advanced Structural and
+//    Chemical Imaging 3(1), 13 (2017)
+
+// 2. Pryor, Jr., A., Ophus, C., and Miao, J.: A Streaming Multi-GPU
+//    Implementation of Image Simulation Algorithms for Scanning
+//	  Transmission Electron Microscopy. arXiv:1706.08563 (2017)
+
+#include "Autotuner.h"
+#include "ArrayND.h"
+#include "ThreadPool.h"
+#include "Instrumentation.h"
+#include "FFTBackend.h"
+#include <algorithm>
+#include <chrono>
+#include <complex>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+namespace Prismatic
+{
+namespace
+{
+// candidates whose wave buffers would exceed this are not tried
+const size_t tuningMemory = (size_t)512 << 20;
+
+std::mutex tuningLock;
+std::map<std::string, BatchTuning> tunings; // results of this process, so repeated stages skip the cache file
+
+std::string machineKey()
+{
+	std::string model = "unknown";
+#if defined(__linux__)
+	std::ifstream cpuinfo("/proc/cpuinfo");
+	std::string line;
+	while (std::getline(cpuinfo, line))
+	{
+		if (line.compare(0, 10, "model name") == 0 && line.find(':') != std::string::npos)
+		{
+			model = line.substr(line.find_first_not_of(" \t", line.find(':') + 1));
+			break;
+		}
+	}
+#endif
+	std::replace(model.begin(), model.end(), ' ', '_');
+	return model + "/" + std::to_string(std::thread::hardware_concurrency());
+}
+
+std::string tuningKey(size_t dimj, size_t dimi, size_t numThreads)
+{
+	std::ostringstream key;
+	key << machineKey() << ' ' << fftBackend().name() << ' ' << (sizeof(PRISMATIC_FLOAT_PRECISION) == sizeof(float) ? "single" : "double") << ' '
+		<< numThreads << ' ' << dimj << 'x' << dimi;
+	return key.str();
+}
+
+bool readCache(const std::string &cacheFile, const std::string &key, BatchTuning &tuning)
+{
+	//one "machine backend precision threads grid workers batch" line per tuning; later lines win
+	std::ifstream f(cacheFile);
+	std::string line;
+	bool found = false;
+	while (std::getline(f, line))
+	{
+		std::istringstream ss(line);
+		std::string machine, backend, precision, threads, grid;
+		size_t workers, batchSize;
+		if (!(ss >> machine >> backend >> precision >> threads >> grid >> workers >> batchSize))
+			continue;
+		if (machine + ' ' + backend + ' ' + precision + ' ' + threads + ' ' + grid == key && workers > 0 && batchSize > 0)
+		{
+			tuning.workers = workers;
+			tuning.batchSize = batchSize;
+			tuning.seconds = 0;
+			found = true;
+		}
+	}
+	return found;
+}
+
+double timeCandidate(size_t dimj, size_t dimi, const ExecutionPolicy &policy, size_t batchSize)
+{
+	//every worker propagates the same number of waves in batches: forward FFT, a multiply, inverse FFT
+	ThreadPool &pool = ThreadPool::instance();
+	const size_t N = dimj * dimi;
+	const size_t wavesPerWorker = maxTunedBatchSize * std::max((size_t)1, ((size_t)1 << 20) / (maxTunedBatchSize * N));
+	const std::complex<PRISMATIC_FLOAT_PRECISION> factor((PRISMATIC_FLOAT_PRECISION)0.6 / N, (PRISMATIC_FLOAT_PRECISION)0.8 / N);
+	std::vector<Array1D_T<std::complex<PRISMATIC_FLOAT_PRECISION>>> waves(policy.outerThreads);
+	std::vector<FFTPlan> forward(policy.outerThreads), inverse(policy.outerThreads);
+
+	//planned the way the stages plan, so the chosen plans are already cached when they run
+	pool.run(policy.outerThreads, [&](size_t w) {
+		waves[w] = zeros_ND<1, std::complex<PRISMATIC_FLOAT_PRECISION>>({{N * batchSize}});
+		for (auto &v : waves[w])
+			v = 1;
+		forward[w] = planFFT2D(dimj, dimi, &waves[w][0], &waves[w][0], FFTDirection::Forward, policy.fftThreads, FFTEffort::Measure, batchSize);
+		inverse[w] = planFFT2D(dimj, dimi, &waves[w][0], &waves[w][0], FFTDirection::Inverse, policy.fftThreads, FFTEffort::Measure, batchSize);
+	});
+
+	auto start = std::chrono::steady_clock::now();
+	pool.run(policy.outerThreads, [&](size_t w) {
+		for (size_t done = 0; done < wavesPerWorker; done += batchSize)
+		{
+			forward[w].execute();
+			for (auto &v : waves[w])
+				v *= factor; // unit modulus once the FFT scaling is divided out, so values stay bounded
+			inverse[w].execute();
+		}
+	});
+	const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	return seconds / (wavesPerWorker * policy.outerThreads);
+}
+} // namespace
+
+BatchTuning tuneBatchedFFT(size_t dimj, size_t dimi, size_t numThreads, const std::string &cacheFile)
+{
+	std::lock_guard<std::mutex> gatekeeper(tuningLock);
+	numThreads = std::max((size_t)1, numThreads);
+	const std::string key = tuningKey(dimj, dimi, numThreads);
+	auto known = tunings.find(key);
+	if (known != tunings.end())
+		return known->second;
+
+	BatchTuning best;
+	if (readCache(cacheFile, key, best))
+	{
+		std::cout << "Using cached FFT tuning for " << dimj << "x" << dimi << " waves: " << best.workers << " workers, batch size "
+				  << best.batchSize << std::endl;
+		tunings[key] = best;
+		return best;
+	}
+
+	//fewer workers only pay off when the FFTs can use the threads they free
+	std::cout << "Tuning batched FFTs for " << dimj << "x" << dimi << " waves on " << numThreads << " threads" << std::endl;
+	ThreadPool::instance().configure(numThreads, ThreadPool::instance().isPinned());
+	const size_t N = dimj * dimi;
+	best.seconds = 0;
+	for (size_t workers = numThreads; workers >= 1; workers = (workers == 1 || N < minFFTThreadingSize) ? 0 : workers / 2)
+	{
+		const ExecutionPolicy policy = chooseExecutionPolicy(numThreads, workers, N);
+		for (size_t batchSize = 1; batchSize <= maxTunedBatchSize; batchSize *= 2)
+		{
+			if (batchSize > 1 && policy.outerThreads * batchSize * N * sizeof(std::complex<PRISMATIC_FLOAT_PRECISION>) > tuningMemory)
+				break;
+			const double seconds = timeCandidate(dimj, dimi, policy, batchSize);
+			std::cout << "  " << policy.outerThreads << " workers x " << policy.fftThreads << " FFT threads, batch size "
+					  << batchSize << ": " << seconds * 1e6 << " us per wave" << std::endl;
+			//larger batches and fewer workers cost memory or flexibility, so they have to win clearly
+			if (best.seconds == 0 || seconds < 0.97 * best.seconds)
+				best = BatchTuning{policy.outerThreads, batchSize, seconds};
+		}
+	}
+	std::cout << "Using " << best.workers << " workers with batch size " << best.batchSize << ", recorded in " << cacheFile << std::endl;
+
+	std::ofstream f(cacheFile, std::ios::app);
+	if (f)
+		f << key << ' ' << best.workers << ' ' << best.batchSize << '\n';
+	else
+		std::cout << "Warning: unable to write FFT tuning cache " << cacheFile << std::endl;
+	tunings[key] = best;
+	return best;
+}
+
+void autotuneBatch(const Metadata<PRISMATIC_FLOAT_PRECISION> &meta, size_t dimj, size_t dimi, size_t numJobs,
+				   ExecutionPolicy &policy, size_t &batchSize)
+{
+	ScopedTimer timer("autotuneBatch");
+	const BatchTuning tuning = tuneBatchedFFT(dimj, dimi, meta.numThreads, autotuneCacheFile(meta));
+	const size_t workers = meta.maxWorkerThreads > 0 ? std::min(tuning.workers, meta.maxWorkerThreads) : tuning.workers;
+	policy = chooseExecutionPolicy(meta.numThreads, numJobs, dimj * dimi, workers);
+	const size_t maxBatchSize = meta.memoryBudget > 0 ? std::max((size_t)1, meta.batchSizeTargetCPU) : tuning.batchSize;
+	batchSize = std::min(std::min(tuning.batchSize, maxBatchSize), std::max((size_t)1, numJobs / policy.outerThreads));
+}
+
+std::string autotuneCacheFile(const Metadata<PRISMATIC_FLOAT_PRECISION> &meta)
+{
+	if (meta.autotuneCache.size() > 0)
+		return meta.autotuneCache;
+#ifdef _WIN32
+	const char *home = std::getenv("APPDATA");
+	return home == NULL ? "prismatic_autotune.txt" : std::string(home) + "\\prismatic_autotune.txt";
+#else
+	const char *home = std::getenv("HOME");
+	return home == NULL ? "prismatic_autotune.txt" : std::string(home) + "/prismatic_autotune.txt";
+#endif //_WIN32
+}
+} // namespace Prismatic
@@ -0,0 +1,32 @@
+// Copyright Alan (AJ) Pryor, Jr. 2017
+// Transcribed from MATLAB code by Colin Ophus
+// Prismatic is distributed under the GNU General Public License (GPL)
+// If you use Prismatic, we kindly ask that you cite the following papers:
+
+// 1. Ophus, C.: A fast image simulation algorithm for scanning
+//    transmission electron microscopy. Advanced Structural and
+//    Chemical Imaging 3(1), 13 (2017)
+
+// 2. Pryor, Jr., A., Ophus, C., and Miao, J.: A Streaming Multi-GPU
+//    Implementation of Image Simulation Algorithms for Scanning
+//	  Transmission Electron Microscopy. arXiv:1706.08563 (2017)
+
+#include "ExecutionPolicy.h"
+#include "defines.h"
+#include <algorithm>
+
+namespace Prismatic
+{
+ExecutionPolicy chooseExecutionPolicy(size_t numThreads, size_t numJobs, size_t gridSize, size_t maxOuterThreads)
+{
+	ExecutionPolicy policy;
+	numThreads = std::max((size_t)1, numThreads);
+	if (maxOuterThreads > 0)
+		numJobs = std::min(numJobs, maxOuterThreads);
+	policy.outerThreads = std::max((size_t)1, std::min(numThreads, numJobs));
+	policy.fftThreads = 1;
+	if (gridSize >= minFFTThreadingSize)
+		policy.fftThreads = std::max((size_t)1, numThreads / policy.outerThreads);
+	return policy;
+}
+} // namespace Prismatic
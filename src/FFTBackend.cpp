@@ -0,0 +1,338 @@
+// Copyright Alan (AJ) Pryor, Jr. 2017
+// Transcribed from MATLAB code by Colin Ophus
+// Prismatic is distributed under the GNU General Public License (GPL)
+// If you use Prismatic, we kindly ask that you cite the following papers:
+
+// 1. Ophus, C.: A fast image simulation algorithm for scanning
+//    transmission electron microscopy. Advanced Structural and
+//    Chemical Imaging 3(1), 13 (2017)
+
+// 2. Pryor, Jr., A., Ophus, C., and Miao, J.: A Streaming Multi-GPU
+//    Implementation of Image Simulation Algorithms for Scanning
+//	  Transmission Electron Microscopy. arXiv:1706.08563 (2017)
+
+#include "FFTBackend.h"
+#include "Instrumentation.h"
+#include "fftw3.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+#ifdef PRISMATIC_ENABLE_POCKETFFT
+#include "pocketfft_hdronly.hpp"
+#endif //PRISMATIC_ENABLE_POCKETFFT
+
+namespace Prismatic
+{
+std::mutex fftw_plan_lock; // FFTW's planner is not thread-safe, only execution is
+
+namespace
+{
+typedef std::complex<PRISMATIC_FLOAT_PRECISION> complex_t;
+
+size_t inputBytes(const FFTShape &shape)
+{
+	const size_t halfComplex = shape.dimj * (shape.dimi / 2 + 1) * sizeof(complex_t);
+	if (shape.kind == FFTKind::RealToComplex)
+		return shape.howmany * shape.dimj * shape.dimi * sizeof(PRISMATIC_FLOAT_PRECISION);
+	if (shape.kind == FFTKind::ComplexToReal)
+		return shape.howmany * halfComplex;
+	return shape.howmany * shape.dimj * shape.dimi * sizeof(complex_t);
+}
+
+size_t outputBytes(const FFTShape &shape)
+{
+	if (shape.kind == FFTKind::RealToComplex)
+		return shape.howmany * shape.dimj * (shape.dimi / 2 + 1) * sizeof(complex_t);
+	if (shape.kind == FFTKind::ComplexToReal)
+		return shape.howmany * shape.dimj * shape.dimi * sizeof(PRISMATIC_FLOAT_PRECISION);
+	return shape.howmany * shape.dimj * shape.dimi * sizeof(complex_t);
+}
+
+class FFTWKernel : public FFTKernel
+{
+  public:
+	FFTWKernel(const FFTShape &shape, void *in, void *out) : kind(shape.kind)
+	{
+		int n[] = {(int)shape.dimj, (int)shape.dimi};
+		const int realDist = n[0] * n[1];
+		const int complexDist = shape.kind == FFTKind::Complex ? realDist : n[0] * (n[1] / 2 + 1);
+		const unsigned flags = shape.effort == FFTEffort::Measure ? FFTW_MEASURE : FFTW_ESTIMATE;
+
+		//measuring runs transforms on the arrays, so keep what the caller had in them
+		std::vector<char> savedIn, savedOut;
+		if (shape.effort == FFTEffort::Measure)
+		{
+			savedIn.assign((char *)in, (char *)in + inputBytes(shape));
+			if (out != in)
+				savedOut.assign((char *)out, (char *)out + outputBytes(shape));
+		}
+
+		std::unique_lock<std::mutex> gatekeeper = profiledLock(fftw_plan_lock, "fftw_plan_lock");
+		PRISMATIC_FFTW_PLAN_WITH_NTHREADS((int)shape.threads);
+		if (shape.kind == FFTKind::RealToComplex)
+			plan = PRISMATIC_FFTW_PLAN_DFT_BATCH_R2C(2, n, (int)shape.howmany, (PRISMATIC_FLOAT_PRECISION *)in, n, 1, realDist,
+													  (PRISMATIC_FFTW_COMPLEX *)out, NULL, 1, complexDist, flags);
+		else if (shape.kind == FFTKind::ComplexToReal)
+			plan = PRISMATIC_FFTW_PLAN_DFT_BATCH_C2R(2, n, (int)shape.howmany, (PRISMATIC_FFTW_COMPLEX *)in, NULL, 1, complexDist,
+													  (PRISMATIC_FLOAT_PRECISION *)out, n, 1, realDist, flags);
+		else
+			plan = PRISMATIC_FFTW_PLAN_DFT_BATCH(2, n, (int)shape.howmany, (PRISMATIC_FFTW_COMPLEX *)in, n, 1, realDist,
+												  (PRISMATIC_FFTW_COMPLEX *)out, n, 1, realDist,
+												  shape.direction == FFTDirection::Forward ? FFTW_FORWARD : FFTW_BACKWARD, flags);
+		gatekeeper.unlock();
+		if (plan == NULL)
+			throw std::runtime_error("FFTW could not plan a " + std::to_string(shape.dimj) + "x" + std::to_string(shape.dimi) + " transform");
+
+		if (!savedIn.empty())
+			std::memcpy(in, &savedIn[0], savedIn.size());
+		if (!savedOut.empty())
+			std::memcpy(out, &savedOut[0], savedOut.size());
+	}
+
+	~FFTWKernel()
+	{
+		std::lock_guard<std::mutex> gatekeeper(fftw_plan_lock);
+		PRISMATIC_FFTW_DESTROY_PLAN(plan);
+	}
+
+	void execute(void *in, void *out) const override
+	{
+		//the new-array execute functions are the thread-safe part of FFTW
+		if (kind == FFTKind::RealToComplex)
+			PRISMATIC_FFTW_EXECUTE_DFT_R2C(plan, (PRISMATIC_FLOAT_PRECISION *)in, (PRISMATIC_FFTW_COMPLEX *)out);
+		else if (kind == FFTKind::ComplexToReal)
+			PRISMATIC_FFTW_EXECUTE_DFT_C2R(plan, (PRISMATIC_FFTW_COMPLEX *)in, (PRISMATIC_FLOAT_PRECISION *)out);
+		else
+			PRISMATIC_FFTW_EXECUTE_DFT(plan, (PRISMATIC_FFTW_COMPLEX *)in, (PRISMATIC_FFTW_COMPLEX *)out);
+	}
+
+  private:
+	FFTKind kind;
+	PRISMATIC_FFTW_PLAN plan;
+};
+
+class FFTWBackend : public FFTBackend
+{
+  public:
+	FFTWBackend()
+	{
+		PRISMATIC_FFTW_INIT_THREADS();
+	}
+	~FFTWBackend()
+	{
+		clearPlans();
+	}
+	const char *name() const override { return "fftw"; }
+
+  protected:
+	// plans may only be executed on arrays with the SIMD alignment they were planned for
+	size_t layoutKey(void *in, void *out) const override
+	{
+		return ((uintptr_t)in % 64) * 128 + ((uintptr_t)out % 64) * 2 + (in == out);
+	}
+	std::shared_ptr<const FFTKernel> createKernel(const FFTShape &shape, void *in, void *out) override
+	{
+		return std::make_shared<FFTWKernel>(shape, in, out);
+	}
+};
+
+#ifdef PRISMATIC_ENABLE_POCKETFFT
+class PocketFFTKernel : public FFTKernel
+{
+  public:
+	PocketFFTKernel(const FFTShape &shape) : kind(shape.kind), forward(shape.direction == FFTDirection::Forward), threads(shape.threads)
+	{
+		//pocketfft takes strides in bytes and transforms the last two axes of the stack
+		const size_t halfDimi = shape.kind == FFTKind::Complex ? shape.dimi : shape.dimi / 2 + 1;
+		realShape = {shape.howmany, shape.dimj, shape.dimi};
+		axes = {1, 2};
+		if (shape.kind == FFTKind::Complex)
+			realStride = {(ptrdiff_t)(shape.dimj * shape.dimi * sizeof(complex_t)), (ptrdiff_t)(shape.dimi * sizeof(complex_t)), (ptrdiff_t)sizeof(complex_t)};
+		else
+			realStride = {(ptrdiff_t)(shape.dimj * shape.dimi * sizeof(PRISMATIC_FLOAT_PRECISION)), (ptrdiff_t)(shape.dimi * sizeof(PRISMATIC_FLOAT_PRECISION)),
+						  (ptrdiff_t)sizeof(PRISMATIC_FLOAT_PRECISION)};
+		complexStride = {(ptrdiff_t)(shape.dimj * halfDimi * sizeof(complex_t)), (ptrdiff_t)(halfDimi * sizeof(complex_t)), (ptrdiff_t)sizeof(complex_t)};
+	}
+
+	void execute(void *in, void *out) const override
+	{
+		if (kind == FFTKind::RealToComplex)
+			pocketfft::r2c(realShape, realStride, complexStride, axes, true, (const PRISMATIC_FLOAT_PRECISION *)in, (complex_t *)out,
+						   (PRISMATIC_FLOAT_PRECISION)1, threads);
+		else if (kind == FFTKind::ComplexToReal)
+			pocketfft::c2r(realShape, complexStride, realStride, axes, false, (const complex_t *)in, (PRISMATIC_FLOAT_PRECISION *)out,
+						   (PRISMATIC_FLOAT_PRECISION)1, threads);
+		else
+			pocketfft::c2c(realShape, realStride, realStride, axes, forward, (const complex_t *)in, (complex_t *)out,
+						   (PRISMATIC_FLOAT_PRECISION)1, threads);
+	}
+
+  private:
+	FFTKind kind;
+	bool forward;
+	size_t threads;
+	pocketfft::shape_t realShape, axes;
+	pocketfft::stride_t realStride, complexStride;
+};
+
+class PocketFFTBackend : public FFTBackend
+{
+  public:
+	const char *name() const override { return "pocketfft"; }
+
+  protected:
+	// pocketfft keeps its own twiddle cache and needs no planning, so kernels only hold the layout
+	std::shared_ptr<const FFTKernel> createKernel(const FFTShape &shape, void *in, void *out) override
+	{
+		return std::make_shared<PocketFFTKernel>(shape);
+	}
+};
+#endif //PRISMATIC_ENABLE_POCKETFFT
+
+FFTWBackend &fftwBackend()
+{
+	static FFTWBackend backend;
+	return backend;
+}
+
+std::atomic<FFTBackend *> currentBackend(nullptr);
+} // namespace
+
+FFTPlan FFTBackend::plan(const FFTShape &requested, void *in, void *out)
+{
+	if (requested.kind != FFTKind::Complex && in == out)
+		throw std::runtime_error("Real FFTs must be out of place");
+	FFTShape shape = requested;
+	shape.threads = std::max((size_t)1, shape.threads);
+	if (shape.kind != FFTKind::Complex)
+		shape.direction = shape.kind == FFTKind::RealToComplex ? FFTDirection::Forward : FFTDirection::Inverse;
+	const PlanKey key(shape.dimj, shape.dimi, shape.howmany, shape.kind, shape.direction,
+					  shape.threads, shape.effort, layoutKey(in, out));
+
+	//each thread keeps the kernels it has used, so repeated requests from workers take no lock
+	thread_local std::map<const FFTBackend *, LocalKernels> localKernels;
+	LocalKernels &local = localKernels[this];
+	const size_t current = generation.load();
+	if (local.generation != current)
+	{
+		local.kernels.clear();
+		local.generation = current;
+	}
+	auto known = local.kernels.find(key);
+	if (known != local.kernels.end())
+		return FFTPlan(known->second, in, out);
+
+	//the cache lock only covers the map. Workers asking for the same transform wait on its entry for one
+	//plan, while requests for other transforms go ahead
+	std::shared_ptr<CachedKernel> entry;
+	{
+		std::unique_lock<std::mutex> gatekeeper = profiledLock(cacheLock, "fft_plan_cache");
+		std::shared_ptr<CachedKernel> &cached = kernels[key];
+		if (!cached)
+			cached = std::make_shared<CachedKernel>();
+		entry = cached;
+	}
+	std::shared_ptr<const FFTKernel> kernel;
+	{
+		std::lock_guard<std::mutex> planning(entry->planning);
+		if (!entry->kernel)
+		{
+			try
+			{
+				entry->kernel = createKernel(shape, in, out);
+			}
+			catch (...)
+			{
+				std::lock_guard<std::mutex> gatekeeper(cacheLock);
+				auto failed = kernels.find(key);
+				if (failed != kernels.end() && failed->second == entry)
+					kernels.erase(failed);
+				throw;
+			}
+		}
+		kernel = entry->kernel;
+	}
+	local.kernels[key] = kernel;
+	return FFTPlan(kernel, in, out);
+}
+
+void FFTBackend::clearPlans()
+{
+	std::lock_guard<std::mutex> gatekeeper(cacheLock);
+	kernels.clear();
+	++generation;
+}
+
+size_t FFTBackend::numCachedPlans()
+{
+	std::lock_guard<std::mutex> gatekeeper(cacheLock);
+	return kernels.size();
+}
+
+FFTBackend &fftBackend()
+{
+	FFTBackend *backend = currentBackend.load();
+	return backend == nullptr ? fftwBackend() : *backend;
+}
+
+void setFFTBackend(FFTBackendType type)
+{
+	if (!fftBackendAvailable(type))
+		throw std::runtime_error("FFT backend " + fftBackendName(type) + " was not enabled when Prismatic was built");
+#ifdef PRISMATIC_ENABLE_POCKETFFT
+	static PocketFFTBackend pocketfftBackend;
+	if (type == FFTBackendType::PocketFFT)
+	{
+		currentBackend = &pocketfftBackend;
+		return;
+	}
+#endif //PRISMATIC_ENABLE_POCKETFFT
+	currentBackend = &fftwBackend();
+}
+
+bool fftBackendAvailable(FFTBackendType type)
+{
+#ifdef PRISMATIC_ENABLE_POCKETFFT
+	return true;
+#else
+	return type == FFTBackendType::FFTW;
+#endif //PRISMATIC_ENABLE_POCKETFFT
+}
+
+std::string fftBackendName(FFTBackendType type)
+{
+	return type == FFTBackendType::PocketFFT ? "pocketfft" : "fftw";
+}
+
+bool parseFFTBackend(const std::string &name, FFTBackendType &type)
+{
+	if (name == "fftw")
+		type = FFTBackendType::FFTW;
+	else if (name == "pocketfft")
+		type = FFTBackendType::PocketFFT;
+	else
+		return false;
+	return true;
+}
+
+FFTPlan planFFT2D(size_t dimj, size_t dimi, complex_t *in, complex_t *out,
+				  FFTDirection direction, size_t threads, FFTEffort effort, size_t howmany)
+{
+	return fftBackend().plan(FFTShape{dimj, dimi, howmany, FFTKind::Complex, direction, threads, effort}, in, out);
+}
+
+FFTPlan planFFT2D_r2c(size_t dimj, size_t dimi, PRISMATIC_FLOAT_PRECISION *in, complex_t *out,
+					  size_t threads, FFTEffort effort, size_t howmany)
+{
+	return fftBackend().plan(FFTShape{dimj, dimi, howmany, FFTKind::RealToComplex, FFTDirection::Forward, threads, effort}, in, out);
+}
+
+FFTPlan planFFT2D_c2r(size_t dimj, size_t dimi, complex_t *in, PRISMATIC_FLOAT_PRECISION *out,
+					  size_t threads, FFTEffort effort, size_t howmany)
+{
+	return fftBackend().plan(FFTShape{dimj, dimi, howmany, FFTKind::ComplexToReal, FFTDirection::Inverse, threads, effort}, in, out);
+}
+} // namespace Prismatic
@@ -59,11 +59,14 @@ void HRTEM_entry_pars(Parameters<PRISMATIC_FLOAT_PRECISION>& pars)
     pars.scale = 1.0;
 
 	Array3D<PRISMATIC_FLOAT_PRECISION> net_output;
+	Array3D<double> net_output_sum; //used instead of net_output for mixed precision
+	const bool doubleSums = pars.meta.precision == Precision::Mixed;
 
 	//run multiple frozen phonons
 	for(auto i = 0; i < pars.meta.numFP; i++)
 	{
 		HRTEM_runFP(pars, i);
+		if(pars.meta.progress) pars.meta.progress->checkCancelled();
 
 		if(pars.meta.saveComplexOutputWave)
 		{			
@@ -81,6 +84,7 @@ void HRTEM_entry_pars(Parameters<PRISMATIC_FLOAT_PRECISION>& pars)
 			if(i == 0)
 			{
 				net_output = zeros_ND<3, PRISMATIC_FLOAT_PRECISION>({{pars.Scompact.get_dimi(), pars.Scompact.get_dimj(), pars.Scompact.get_dimk()}});
+				if(doubleSums) net_output_sum = zeros_ND<3, double>(net_output.get_dimarr());
 			}
 
 			//integrate output
@@ -92,7 +96,11 @@ void HRTEM_entry_pars(Parameters<PRISMATIC_FLOAT_PRECISION>& pars)
 				{
 					for(auto ii = 0; ii < pars.Scompact.get_dimi(); ii++)
 					{
-						net_output.at(ii,jj,kk) += pow(std::abs(pars.Scompact.at(pars.HRTEMbeamOrder[kk],jj,ii)*scale), 2.0) / pars.meta.numFP;
+						const double intensity = pow(std::abs(pars.Scompact.at(pars.HRTEMbeamOrder[kk],jj,ii)*scale), 2.0) / pars.meta.numFP;
+						if(doubleSums)
+							net_output_sum.at(ii,jj,kk) += intensity;
+						else
+							net_output.at(ii,jj,kk) += intensity;
 					}
 				}
 			}
@@ -108,6 +116,7 @@ void HRTEM_entry_pars(Parameters<PRISMATIC_FLOAT_PRECISION>& pars)
 		std::cout << "Writing HRTEM data to output file." << std::endl;
 		setupHRTEMOutput(pars);
 		setupHRTEMOutput_virtual(pars);
+		if(doubleSums) std::copy(net_output_sum.begin(), net_output_sum.end(), net_output.begin());
 		saveHRTEM(pars, net_output);
 	};
 	
@@ -119,6 +128,7 @@ void HRTEM_entry_pars(Parameters<PRISMATIC_FLOAT_PRECISION>& pars)
 
 void HRTEM_runFP(Parameters<PRISMATIC_FLOAT_PRECISION> &pars, size_t fpNum)
 {
+	if(pars.meta.progress) pars.meta.progress->startFrozenPhonon(fpNum, pars.meta.numFP);
 	pars.meta.reseed();
 	pars.meta.fpNum = fpNum;
 	std::cout << "Frozen Phonon #" << fpNum << std::endl;
@@ -0,0 +1,364 @@
+// Copyright Alan (AJ) Pryor, Jr. 2017
+// Transcribed from MATLAB code by Colin Ophus
+// Prismatic is distributed under the GNU General Public License (GPL)
+// If you use Prismatic, we kindly ask that you cite the following papers:
+
+// 1. Ophus, C.: A fast image simulation algorithm for scanning
+//    transmission electron microscopy. Advanced Structural and
+//    Chemical Imaging 3(1), 13 (2017)
+
+// 2. Pryor, Jr., A., Ophus, C., and Miao, J.: A Streaming Multi-GPU
+//    Implementation of Image Simulation Algorithms for Scanning
+//	  Transmission Electron Microscopy. arXiv:1706.08563 (2017)
+
+#include "Instrumentation.h"
+#include "ThreadPool.h"
+#include <fstream>
+#include <iomanip>
+#include <algorithm>
+#if defined(_WIN32)
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+namespace Prismatic
+{
+namespace
+{
+// lock waits shorter than this are only counted, not kept as trace events
+const double minTracedLockWait = 50e-6;
+
+std::atomic<int> nextThreadId(0);
+thread_local int threadId = -1;
+thread_local size_t scopeDepth = 0;
+
+int currentThreadId()
+{
+	if (threadId < 0)
+		threadId = nextThreadId++;
+	return threadId;
+}
+
+std::string jsonEscape(const std::string &s)
+{
+	std::string out;
+	for (char c : s)
+	{
+		if (c == '"' || c == '\\')
+			out += '\\';
+		out += c;
+	}
+	return out;
+}
+} // namespace
+
+Profiler &Profiler::instance()
+{
+	return ThreadPool::instance().profiler();
+}
+
+Profiler::Profiler() : enabled(false), trace(false), poolSeconds(0), countersOpen(false){};
+
+size_t Profiler::peakRSS()
+{
+#if defined(_WIN32)
+	PROCESS_MEMORY_COUNTERS counters;
+	if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+		return counters.PeakWorkingSetSize;
+	return 0;
+#else
+	struct rusage usage;
+	if (getrusage(RUSAGE_SELF, &usage) != 0)
+		return 0;
+#if defined(__APPLE__)
+	return usage.ru_maxrss; // bytes on macOS
+#else
+	return usage.ru_maxrss * 1024; // kilobytes on Linux
+#endif
+#endif
+}
+
+void Profiler::start(bool _trace)
+{
+	std::lock_guard<std::mutex> gatekeeper(lock);
+	scopes.clear();
+	locks.clear();
+	workerBusy.clear();
+	poolSeconds = 0;
+	events.clear();
+	threadNames.clear();
+	threadNames[currentThreadId()] = "main";
+	trace = _trace;
+	roofline = Roofline();
+	countersOpen = PerfCounters::instance().isOpen();
+	t0 = t1 = ProfileClock::now();
+	enabled = true;
+}
+
+void Profiler::stop()
+{
+	std::lock_guard<std::mutex> gatekeeper(lock);
+	enabled = false;
+	t1 = ProfileClock::now();
+}
+
+double Profiler::since(ProfileClock::time_point t) const
+{
+	return std::chrono::duration<double, std::micro>(t - t0).count();
+}
+
+void Profiler::addEvent(const char *name, const char *category, ProfileClock::time_point begin, ProfileClock::time_point end, size_t rss)
+{
+	//caller holds lock
+	if (trace)
+		events.push_back(TraceEvent{name, category, currentThreadId(), since(begin), std::chrono::duration<double, std::micro>(end - begin).count(), rss});
+}
+
+std::vector<Profiler::ScopeStats>::iterator Profiler::findScope(const char *name)
+{
+	//caller holds lock
+	return std::find_if(scopes.begin(), scopes.end(), [&](const ScopeStats &x) { return x.name == name || std::string(x.name) == name; });
+}
+
+void Profiler::beginScope(const char *name, size_t depth)
+{
+	//list scopes in the order they are first entered, so that stages come before their sub-stages
+	if (!isEnabled())
+		return;
+	std::lock_guard<std::mutex> gatekeeper(lock);
+	if (findScope(name) == scopes.end())
+		scopes.push_back(ScopeStats{name, depth, 0, 0, 0, CounterValues(), 0});
+}
+
+void Profiler::addScope(const char *name, ProfileClock::time_point begin, ProfileClock::time_point end, const CounterValues &counters)
+{
+	if (!isEnabled())
+		return;
+	const size_t rss = peakRSS();
+	std::lock_guard<std::mutex> gatekeeper(lock);
+	auto s = findScope(name);
+	if (s == scopes.end())
+		return; // profiling was started inside this scope
+	++s->calls;
+	s->seconds += std::chrono::duration<double>(end - begin).count();
+	s->peakRSS = std::max(s->peakRSS, rss);
+	s->counters += counters;
+	addEvent(name, "stage", begin, end, rss);
+}
+
+void Profiler::addFlops(const char *name, double flops)
+{
+	if (!isEnabled())
+		return;
+	std::lock_guard<std::mutex> gatekeeper(lock);
+	auto s = findScope(name);
+	if (s != scopes.end())
+		s->flops += flops;
+}
+
+void Profiler::setRoofline(const Roofline &_roofline)
+{
+	std::lock_guard<std::mutex> gatekeeper(lock);
+	roofline = _roofline;
+}
+
+void Profiler::addLockWait(const char *name, ProfileClock::time_point begin, ProfileClock::time_point end)
+{
+	if (!isEnabled())
+		return;
+	const double seconds = std::chrono::duration<double>(end - begin).count();
+	std::lock_guard<std::mutex> gatekeeper(lock);
+	LockStats &l = locks[name];
+	++l.count;
+	l.seconds += seconds;
+	l.maxSeconds = std::max(l.maxSeconds, seconds);
+	if (seconds >= minTracedLockWait)
+		addEvent(name, "lock wait", begin, end);
+}
+
+void Profiler::addWorkerTask(size_t worker, ProfileClock::time_point begin, ProfileClock::time_point end)
+{
+	if (!isEnabled())
+		return;
+	std::lock_guard<std::mutex> gatekeeper(lock);
+	if (worker >= workerBusy.size())
+		workerBusy.resize(worker + 1, 0);
+	workerBusy[worker] += std::chrono::duration<double>(end - begin).count();
+	if (trace)
+	{
+		threadNames[currentThreadId()] = "worker " + std::to_string(worker);
+		addEvent("task", "worker", begin, end);
+	}
+}
+
+void Profiler::addPoolRun(ProfileClock::time_point begin, ProfileClock::time_point end)
+{
+	if (!isEnabled())
+		return;
+	std::lock_guard<std::mutex> gatekeeper(lock);
+	poolSeconds += std::chrono::duration<double>(end - begin).count();
+}
+
+void Profiler::printSummary(std::ostream &out) const
+{
+	std::lock_guard<std::mutex> gatekeeper(lock);
+	const double total = std::chrono::duration<double>(t1 - t0).count();
+	out << "\nTiming summary (" << std::fixed << std::setprecision(3) << total << " s total, peak RSS "
+		<< std::setprecision(1) << peakRSS() / 1048576.0 << " MB)\n";
+	out << std::left << std::setw(40) << "stage" << std::right << std::setw(8) << "calls" << std::setw(12) << "time (s)"
+		<< std::setw(10) << "%" << std::setw(16) << "peak RSS (MB)" << '\n';
+	for (auto &s : scopes)
+	{
+		out << std::left << std::setw(40) << (std::string(2 * s.depth, ' ') + s.name) << std::right << std::setw(8) << s.calls
+			<< std::setw(12) << std::setprecision(3) << s.seconds << std::setw(10) << std::setprecision(1)
+			<< (total > 0 ? 100 * s.seconds / total : 0) << std::setw(16) << s.peakRSS / 1048576.0 << '\n';
+	}
+
+	if (!workerBusy.empty())
+	{
+		out << "Worker threads (" << std::setprecision(3) << poolSeconds << " s in parallel sections)\n";
+		for (size_t w = 0; w < workerBusy.size(); ++w)
+		{
+			const double idle = std::max(0.0, poolSeconds - workerBusy[w]);
+			out << "  worker " << std::left << std::setw(4) << w << std::right << " busy " << std::setw(10) << workerBusy[w]
+				<< " s  idle " << std::setw(10) << idle << " s\n";
+		}
+	}
+
+	for (auto &l : locks)
+	{
+		out << "Lock " << std::left << std::setw(16) << l.first << std::right << std::setw(10) << l.second.count << " acquisitions, waited "
+			<< std::setprecision(3) << l.second.seconds << " s (max " << l.second.maxSeconds * 1e3 << " ms)\n";
+	}
+	printCounters(out);
+	out << std::defaultfloat << std::flush;
+}
+
+void Profiler::printCounters(std::ostream &out) const
+{
+	//caller holds lock. Memory traffic is approximated by last level cache misses times the line size,
+	//and a stage is rated against the roofline by its arithmetic intensity (FLOP per byte of traffic)
+	const bool haveRoofline = roofline.peakFlops > 0 && roofline.peakBandwidth > 0;
+	const bool haveFlops = std::any_of(scopes.begin(), scopes.end(), [](const ScopeStats &s) { return s.flops > 0; });
+	if (!countersOpen && !haveFlops)
+		return;
+
+	const double ridge = haveRoofline ? roofline.peakFlops / roofline.peakBandwidth : 0;
+	if (haveRoofline)
+		out << "Roofline: " << std::setprecision(2) << roofline.peakFlops / 1e9 << " GFLOP/s, "
+			<< roofline.peakBandwidth / 1e9 << " GB/s, ridge point " << ridge << " FLOP/byte\n";
+	out << std::left << std::setw(40) << "stage" << std::right;
+	if (countersOpen)
+		out << std::setw(10) << "Gcycles" << std::setw(8) << "IPC" << std::setw(12) << "LLC miss %" << std::setw(12) << "mem GB/s";
+	out << std::setw(10) << "GFLOP/s";
+	if (countersOpen)
+		out << std::setw(12) << "FLOP/byte" << std::setw(10) << "bound";
+	out << '\n';
+
+	for (auto &s : scopes)
+	{
+		if (s.seconds <= 0 || (s.flops <= 0 && s.counters.cycles == 0))
+			continue;
+		const double bytes = (double)s.counters.llcMisses * cacheLineSize;
+		out << std::left << std::setw(40) << (std::string(2 * s.depth, ' ') + s.name) << std::right << std::setprecision(2);
+		if (countersOpen)
+		{
+			out << std::setw(10) << s.counters.cycles / 1e9
+				<< std::setw(8) << (s.counters.cycles > 0 ? (double)s.counters.instructions / s.counters.cycles : 0)
+				<< std::setw(12) << (s.counters.llcReferences > 0 ? 100.0 * s.counters.llcMisses / s.counters.llcReferences : 0)
+				<< std::setw(12) << bytes / s.seconds / 1e9;
+		}
+		if (s.flops > 0)
+			out << std::setw(10) << s.flops / s.seconds / 1e9;
+		else
+			out << std::setw(10) << "-";
+		if (countersOpen && s.flops > 0 && bytes > 0)
+		{
+			const double intensity = s.flops / bytes;
+			out << std::setw(12) << intensity;
+			if (haveRoofline)
+				out << std::setw(10) << (intensity < ridge ? "memory" : "compute");
+		}
+		out << '\n';
+	}
+}
+
+void Profiler::writeTrace(const std::string &filename) const
+{
+	//Chrome trace event format, viewable in chrome://tracing or Perfetto
+	std::lock_guard<std::mutex> gatekeeper(lock);
+	std::ofstream f(filename);
+	if (!f)
+	{
+		std::cout << "Warning: could not write trace file " << filename << std::endl;
+		return;
+	}
+	f << std::fixed << std::setprecision(3);
+	f << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+	f << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"prismatic\"}}";
+	for (auto &t : threadNames)
+		f << ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << t.first << ",\"args\":{\"name\":\"" << jsonEscape(t.second) << "\"}}";
+	for (auto &e : events)
+	{
+		f << ",\n{\"name\":\"" << jsonEscape(e.name) << "\",\"cat\":\"" << e.category << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << e.tid
+		  << ",\"ts\":" << e.ts << ",\"dur\":" << e.dur << "}";
+		if (e.rss > 0)
+			f << ",\n{\"name\":\"peak RSS (MB)\",\"ph\":\"C\",\"pid\":1,\"ts\":" << e.ts + e.dur << ",\"args\":{\"MB\":" << e.rss / 1048576.0 << "}}";
+	}
+	f << "\n]}\n";
+	std::cout << "Trace written to " << filename << std::endl;
+}
+
+ScopedTimer::ScopedTimer(const char *_name) : name(_name), active(Profiler::instance().isEnabled())
+{
+	if (active)
+	{
+		Profiler::instance().beginScope(name, scopeDepth++);
+		if (PerfCounters::instance().isOpen())
+			counters = PerfCounters::instance().read();
+		begin = ProfileClock::now();
+	}
+}
+
+ScopedTimer::~ScopedTimer()
+{
+	if (active)
+	{
+		const ProfileClock::time_point end = ProfileClock::now();
+		--scopeDepth;
+		CounterValues delta;
+		if (PerfCounters::instance().isOpen())
+			delta = PerfCounters::instance().read() - counters;
+		Profiler::instance().addScope(name, begin, end, delta);
+	}
+}
+
+std::unique_lock<std::mutex> profiledLock(std::mutex &m, const char *name)
+{
+	std::unique_lock<std::mutex> gatekeeper(m, std::defer_lock);
+	profiledRelock(gatekeeper, name);
+	return gatekeeper;
+}
+
+void profiledRelock(std::unique_lock<std::mutex> &gatekeeper, const char *name)
+{
+	if (!Profiler::instance().isEnabled())
+	{
+		gatekeeper.lock();
+		return;
+	}
+	const ProfileClock::time_point begin = ProfileClock::now();
+	gatekeeper.lock();
+	Profiler::instance().addLockWait(name, begin, ProfileClock::now());
+}
+
+std::string traceFilename(const std::string &filenameOutput)
+{
+	const size_t dot = filenameOutput.find_last_of('.');
+	const size_t slash = filenameOutput.find_last_of("/\\");
+	const bool hasExtension = dot != std::string::npos && (slash == std::string::npos || dot > slash);
+	return (hasExtension ? filenameOutput.substr(0, dot) : filenameOutput) + ".trace.json";
+}
+} // namespace Prismatic
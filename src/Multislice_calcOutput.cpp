@@ -22,8 +22,12 @@
 #include "ArrayND.h"
 #include "params.h"
 #include "utility.h"
-#include "fftw3.h"
+#include "FFTBackend.h"
 #include "WorkDispatcher.h"
+#include "ThreadPool.h"
+#include "ExecutionPolicy.h"
+#include "Autotuner.h"
+#include "Instrumentation.h"
 #include "Multislice_calcOutput.h"
 #include "fileIO.h"
 
@@ -31,7 +35,6 @@ namespace Prismatic{
 	using namespace std;
 	static const PRISMATIC_FLOAT_PRECISION pi = acos(-1);
 	static const std::complex<PRISMATIC_FLOAT_PRECISION> i(0, 1);
-	mutex fftw_plan_lock; // for synchronizing access to shared FFTW resources
 	// mutex HDF5_lock;
 
 	void setupCoordinates_multislice(Parameters<PRISMATIC_FLOAT_PRECISION>& pars){
@@ -157,12 +160,31 @@ namespace Prismatic{
 		Array1D<PRISMATIC_FLOAT_PRECISION> detectorAngles(detectorAngles_d, {{detectorAngles_d.size()}});
 		pars.detectorAngles = detectorAngles;
 		pars.Ndet = pars.detectorAngles.size();
-		Array2D<PRISMATIC_FLOAT_PRECISION> alpha = pars.q1 * pars.lambda;
-		pars.alphaInd = (alpha + pars.meta.detectorAngleStep/2) / pars.meta.detectorAngleStep;
+		pars.alphaInd = (pars.q1 * pars.lambda + pars.meta.detectorAngleStep/2) / pars.meta.detectorAngleStep;
 		for (auto& q : pars.alphaInd) q = std::round(q);
 		pars.dq = (pars.qxa.at(0, 1) + pars.qya.at(1, 0)) / 2;
 	}
 
+	void shiftPhases(const Array1D<PRISMATIC_FLOAT_PRECISION>& q, const PRISMATIC_FLOAT_PRECISION r, complex<PRISMATIC_FLOAT_PRECISION>* phases){
+		for (auto j = 0; j < q.size(); ++j) phases[j] = exp(-2 * pi * i * q[j] * r);
+	}
+
+	void probeShiftPhases(const Parameters<PRISMATIC_FLOAT_PRECISION>& pars,
+	                      const size_t ay,
+	                      const size_t ax,
+	                      std::vector<complex<PRISMATIC_FLOAT_PRECISION> >& xPhase,
+	                      std::vector<complex<PRISMATIC_FLOAT_PRECISION> >& yPhase){
+		xPhase.resize(pars.qx.size());
+		yPhase.resize(pars.qy.size());
+		if (pars.meta.arbitraryProbes){
+			shiftPhases(pars.qx, pars.xp[ax], &xPhase[0]);
+			shiftPhases(pars.qy, pars.yp[ay], &yPhase[0]);
+		} else {
+			for (auto x = 0; x < xPhase.size(); ++x) xPhase[x] = pars.xPhaseShifts.at(ax, x);
+			for (auto y = 0; y < yPhase.size(); ++y) yPhase[y] = pars.yPhaseShifts.at(ay, y);
+		}
+	}
+
 	void setupProbes_multislice(Parameters<PRISMATIC_FLOAT_PRECISION>& pars){
 
 		PRISMATIC_FLOAT_PRECISION qProbeMax = pars.meta.probeSemiangle/ pars.lambda; // currently a single semiangle
@@ -201,12 +223,13 @@ namespace Prismatic{
 						   return atan2(b,a);
 					   });
 		
-		Array2D<std::complex<PRISMATIC_FLOAT_PRECISION>> chi = getChi(pars.q1, pars.qTheta, pars.lambda, pars.meta.aberrations);
+		pars.chiEngine.setGrid(pars.q1, pars.qTheta, pars.lambda);
+		const Array2D<PRISMATIC_FLOAT_PRECISION> &chi = pars.chiEngine.evaluate(pars.meta.aberrations);
 
 		transform(pars.psiProbeInit.begin(), pars.psiProbeInit.end(),
 				chi.begin(), pars.psiProbeInit.begin(),
-				[](std::complex<PRISMATIC_FLOAT_PRECISION> &a, std::complex<PRISMATIC_FLOAT_PRECISION> &b) {
-					a = a * exp(-i * b);
+				[](std::complex<PRISMATIC_FLOAT_PRECISION> &a, const PRISMATIC_FLOAT_PRECISION &b) {
+					a = a * std::complex<PRISMATIC_FLOAT_PRECISION>(cos(b), -sin(b));
 					return a;
 				});
 
@@ -221,6 +244,18 @@ namespace Prismatic{
 					return a / norm_constant;
 				});
 
+		// the probe shift exp(-2*pi*i*(qx*x + qy*y)) factors into a scan column part and a scan row part.
+		// Arbitrary probes share no rows or columns, so their factors are evaluated per probe instead
+		if (pars.meta.arbitraryProbes){
+			pars.xPhaseShifts = Array2D<complex<PRISMATIC_FLOAT_PRECISION> >();
+			pars.yPhaseShifts = Array2D<complex<PRISMATIC_FLOAT_PRECISION> >();
+		} else {
+			pars.xPhaseShifts = zeros_ND<2, complex<PRISMATIC_FLOAT_PRECISION> >({{pars.xp.size(), pars.qx.size()}});
+			pars.yPhaseShifts = zeros_ND<2, complex<PRISMATIC_FLOAT_PRECISION> >({{pars.yp.size(), pars.qy.size()}});
+			for (auto ax = 0; ax < pars.xp.size(); ++ax) shiftPhases(pars.qx, pars.xp[ax], &pars.xPhaseShifts.at(ax, 0));
+			for (auto ay = 0; ay < pars.yp.size(); ++ay) shiftPhases(pars.qy, pars.yp[ay], &pars.yPhaseShifts.at(ay, 0));
+		}
+
 		if(pars.meta.saveProbe && pars.fpFlag == 0)
 		{
             setupProbeOutput(pars);
@@ -229,6 +264,7 @@ namespace Prismatic{
 	}
 
 	void createTransmission(Parameters<PRISMATIC_FLOAT_PRECISION>& pars){
+		ScopedTimer timer("createTransmission");
 		pars.transmission = zeros_ND<3, complex<PRISMATIC_FLOAT_PRECISION> >(
 				{{pars.pot.get_dimk(), pars.pot.get_dimj(), pars.pot.get_dimi()}});
 		{
@@ -253,9 +289,9 @@ namespace Prismatic{
 		pars.depths = depths;
 		pars.numLayers = numLayers;
 		
-		pars.output = zeros_ND<4, PRISMATIC_FLOAT_PRECISION>({{numLayers, pars.numYprobes, pars.numXprobes, pars.Ndet}});
+		pars.output = zeros_ND<4, PRISMATIC_FLOAT_PRECISION>({{numLayers, pars.numXprobes, pars.numYprobes, pars.Ndet}});
 
-		if(pars.meta.saveDPC_CoM) pars.DPC_CoM = zeros_ND<4, PRISMATIC_FLOAT_PRECISION>({{numLayers,pars.numYprobes, pars.numXprobes,2}});
+		if(pars.meta.saveDPC_CoM) pars.DPC_CoM = zeros_ND<4, PRISMATIC_FLOAT_PRECISION>({{numLayers, pars.numXprobes, pars.numYprobes, 2}});
 		if(pars.meta.save4DOutput)
 		{
 			if(pars.fpFlag == 0 or pars.meta.saveComplexOutputWave) setup4DOutput(pars);
@@ -280,38 +316,21 @@ namespace Prismatic{
 										   const size_t currentSlice,
 	                                       const size_t ay,
 	                                       const size_t ax){
-		Array2D<PRISMATIC_FLOAT_PRECISION> intOutput = zeros_ND<2, PRISMATIC_FLOAT_PRECISION>({{psi.get_dimj(), psi.get_dimi()}});
+		Array2D<PRISMATIC_FLOAT_PRECISION> &intOutput = scratchArray<2, PRISMATIC_FLOAT_PRECISION>(SCRATCH_INTENSITY, psi.get_dimarr());
 		
 		auto psi_ptr = psi.begin();
 
 		for (auto& j:intOutput) j = pow(abs(*psi_ptr++),2);
 
 
+		const bool doubleSums = pars.meta.precision == Precision::Mixed;
 		if (pars.meta.saveDPC_CoM){
 			//calculate center of mass; qxa, qya are the fourier coordinates, should have 0 components at boundaries
-			for (long y = 0; y < psi.get_dimj(); ++y){
-				for (long x = 0; x < psi.get_dimi(); ++x){
-					pars.DPC_CoM.at(currentSlice,ay,ax,0) += pars.qxa.at(y,x) * intOutput.at(y,x);
-					pars.DPC_CoM.at(currentSlice,ay,ax,1) += pars.qya.at(y,x) * intOutput.at(y,x);
-				}
-			}
-			//divide by sum of intensity
-			PRISMATIC_FLOAT_PRECISION intensitySum = 0;
-			for (auto iter = intOutput.begin(); iter != intOutput.end(); ++iter){
-				intensitySum += *iter;
-			}
-			pars.DPC_CoM.at(currentSlice,ay,ax,0) /= intensitySum;
-			pars.DPC_CoM.at(currentSlice,ay,ax,1) /= intensitySum;
+			centerOfMass(&intOutput[0], &pars.qxa[0], &pars.qya[0], intOutput.size(), &pars.DPC_CoM.at(currentSlice,ax,ay,0), doubleSums);
 		}
 
 		//update stack -- ax,ay are unique per thread so this write is thread-safe without a lock
-		auto idx = alphaInd.begin();
-		for (auto counts = intOutput.begin(); counts != intOutput.end(); ++counts){
-			if (*idx <= pars.Ndet){
-				pars.output.at(currentSlice,ay,ax,(*idx)-1) += *counts;
-			}
-			++idx;
-		};
+		binDetector(&intOutput[0], &*alphaInd.begin(), intOutput.size(), pars.Ndet, &pars.output.at(currentSlice,ax,ay,0), doubleSums);
 
 		//save 4D output if applicable
 		if (pars.meta.save4DOutput)
@@ -328,15 +347,15 @@ namespace Prismatic{
 			if(pars.meta.saveComplexOutputWave)
 			{
 				nameString += "_fp" + getDigitString(pars.meta.fpNum);
-				Array2D<std::complex<PRISMATIC_FLOAT_PRECISION>> intOutput_small;
+				Array2D<std::complex<PRISMATIC_FLOAT_PRECISION>> &intOutput_small = scratchArray<2, std::complex<PRISMATIC_FLOAT_PRECISION>>(SCRATCH_FORMAT);
 				
 				if(pars.meta.crop4DOutput)
 				{
-					intOutput_small = cropOutput(psi, pars);
+					cropOutput(psi, pars, intOutput_small);
 				}
 				else
 				{
-					intOutput_small = zeros_ND<2, std::complex<PRISMATIC_FLOAT_PRECISION>>({{psi.get_dimi()/2, psi.get_dimj()/2}});
+					ensureDims(intOutput_small, {{psi.get_dimi()/2, psi.get_dimj()/2}});
 					{
 						long offset_x = psi.get_dimi() / 4;
 						long offset_y = psi.get_dimj() / 4;
@@ -359,15 +378,15 @@ namespace Prismatic{
 			else
 			{
 
-				Array2D<PRISMATIC_FLOAT_PRECISION> intOutput_small;
+				Array2D<PRISMATIC_FLOAT_PRECISION> &intOutput_small = scratchArray<2, PRISMATIC_FLOAT_PRECISION>(SCRATCH_FORMAT);
 				
 				if(pars.meta.crop4DOutput)
 				{
-					intOutput_small = cropOutput(intOutput,pars);
+					cropOutput(intOutput, pars, intOutput_small);
 				}
 				else
 				{
-					intOutput_small = zeros_ND<2, PRISMATIC_FLOAT_PRECISION>({{psi.get_dimi()/2, psi.get_dimj()/2}});
+					ensureDims(intOutput_small, {{psi.get_dimi()/2, psi.get_dimj()/2}});
 					{
 						long offset_x = psi.get_dimi() / 4;
 						long offset_y = psi.get_dimj() / 4;
@@ -404,10 +423,10 @@ namespace Prismatic{
 			const size_t ax = (pars.meta.arbitraryProbes) ? Nstart : Nstart % pars.numXprobes;
 
 			//can't just use PSI like in single integrate for complex output
-			Array2D<PRISMATIC_FLOAT_PRECISION> intOutput = zeros_ND<2, PRISMATIC_FLOAT_PRECISION>({{pars.psiProbeInit.get_dimj(), pars.psiProbeInit.get_dimi()}});
-			Array2D<std::complex<PRISMATIC_FLOAT_PRECISION>> intOutput_c;
+			Array2D<PRISMATIC_FLOAT_PRECISION> &intOutput = scratchArray<2, PRISMATIC_FLOAT_PRECISION>(SCRATCH_INTENSITY, pars.psiProbeInit.get_dimarr());
+			Array2D<std::complex<PRISMATIC_FLOAT_PRECISION>> &intOutput_c = scratchArray<2, std::complex<PRISMATIC_FLOAT_PRECISION>>(SCRATCH_INTENSITY);
 			if(pars.meta.saveComplexOutputWave)
-				intOutput_c = zeros_ND<2, std::complex<PRISMATIC_FLOAT_PRECISION>>({{pars.psiProbeInit.get_dimj(), pars.psiProbeInit.get_dimi()}});
+				ensureDims(intOutput_c, pars.psiProbeInit.get_dimarr());
 			
 			auto psi_ptr = &psi_stack[probe_idx*pars.psiProbeInit.size()];
 			for (auto& j:intOutput) j = pow(abs(*psi_ptr++),2);
@@ -418,32 +437,14 @@ namespace Prismatic{
 				for (auto& j:intOutput_c) j = *psi_ptr++;
 			}
 
+			const bool doubleSums = pars.meta.precision == Precision::Mixed;
 			if (pars.meta.saveDPC_CoM){
 				//calculate center of mass; qxa, qya are the fourier coordinates, should have 0 components at boundaries
-				for (long y = 0; y < pars.psiProbeInit.get_dimj(); ++y){
-					for (long x = 0; x < pars.psiProbeInit.get_dimi(); ++x){
-						pars.DPC_CoM.at(currentSlice,ay,ax,0) += pars.qxa.at(y,x) * intOutput.at(y,x);
-						pars.DPC_CoM.at(currentSlice,ay,ax,1) += pars.qya.at(y,x) * intOutput.at(y,x);
-					}
-				}
-
-				//divide by sum of intensity
-				PRISMATIC_FLOAT_PRECISION intensitySum = 0;
-				for (auto iter = intOutput.begin(); iter != intOutput.end(); ++iter){
-					intensitySum += *iter;
-				}
-				pars.DPC_CoM.at(currentSlice,ay,ax,0) /= intensitySum;
-				pars.DPC_CoM.at(currentSlice,ay,ax,1) /= intensitySum;
+				centerOfMass(&intOutput[0], &pars.qxa[0], &pars.qya[0], intOutput.size(), &pars.DPC_CoM.at(currentSlice,ax,ay,0), doubleSums);
 			}
 
 			//update stack -- ax,ay are unique per thread so this write is thread-safe without a lock
-			auto idx = alphaInd.begin();
-			for (auto counts = intOutput.begin(); counts != intOutput.end(); ++counts) {
-				if (*idx <= pars.Ndet) {
-					pars.output.at(currentSlice, ay, ax, (*idx) - 1) += *counts;
-				}
-				++idx;
-			};
+			binDetector(&intOutput[0], &*alphaInd.begin(), intOutput.size(), pars.Ndet, &pars.output.at(currentSlice,ax,ay,0), doubleSums);
 
 			if (pars.meta.save4DOutput)
 			{
@@ -458,15 +459,15 @@ namespace Prismatic{
 				if(pars.meta.saveComplexOutputWave)
 				{
 					nameString += "_fp" + getDigitString(pars.meta.fpNum);
-					Array2D<std::complex<PRISMATIC_FLOAT_PRECISION>> intOutput_small;
+					Array2D<std::complex<PRISMATIC_FLOAT_PRECISION>> &intOutput_small = scratchArray<2, std::complex<PRISMATIC_FLOAT_PRECISION>>(SCRATCH_FORMAT);
 					
 					if(pars.meta.crop4DOutput)
 					{
-						intOutput_small = cropOutput(intOutput_c, pars);
+						cropOutput(intOutput_c, pars, intOutput_small);
 					}
 					else
 					{
-						intOutput_small = zeros_ND<2, std::complex<PRISMATIC_FLOAT_PRECISION>>({{pars.psiProbeInit.get_dimi()/2, pars.psiProbeInit.get_dimj()/2}});
+						ensureDims(intOutput_small, {{pars.psiProbeInit.get_dimi()/2, pars.psiProbeInit.get_dimj()/2}});
 						{
 							long offset_x = pars.psiProbeInit.get_dimi() / 4;
 							long offset_y = pars.psiProbeInit.get_dimj() / 4;
@@ -489,15 +490,15 @@ namespace Prismatic{
 				else
 				{
 
-					Array2D<PRISMATIC_FLOAT_PRECISION> intOutput_small;
+					Array2D<PRISMATIC_FLOAT_PRECISION> &intOutput_small = scratchArray<2, PRISMATIC_FLOAT_PRECISION>(SCRATCH_FORMAT);
 					
 					if(pars.meta.crop4DOutput)
 					{
-						intOutput_small = cropOutput(intOutput,pars);
+						cropOutput(intOutput, pars, intOutput_small);
 					}
 					else
 					{
-						intOutput_small = zeros_ND<2, PRISMATIC_FLOAT_PRECISION>({{pars.psiProbeInit.get_dimi()/2, pars.psiProbeInit.get_dimj()/2}});
+						ensureDims(intOutput_small, {{pars.psiProbeInit.get_dimi()/2, pars.psiProbeInit.get_dimj()/2}});
 						{
 							long offset_x = pars.psiProbeInit.get_dimi() / 4;
 							long offset_y = pars.psiProbeInit.get_dimj() / 4;
@@ -529,31 +530,26 @@ namespace Prismatic{
 
 		Array2D< std::complex<PRISMATIC_FLOAT_PRECISION> > realspace_probe;
 		Array2D< std::complex<PRISMATIC_FLOAT_PRECISION> > kspace_probe;
-		PRISMATIC_FFTW_INIT_THREADS();
-		PRISMATIC_FFTW_PLAN_WITH_NTHREADS(pars.meta.numThreads);
 		Array2D<complex<PRISMATIC_FLOAT_PRECISION> > psi(pars.psiProbeInit);
-		unique_lock<mutex> gatekeeper(fftw_plan_lock);
-		PRISMATIC_FFTW_PLAN plan_forward = PRISMATIC_FFTW_PLAN_DFT_2D(psi.get_dimj(), psi.get_dimi(),
-		                                                      reinterpret_cast<PRISMATIC_FFTW_COMPLEX *>(&psi[0]),
-		                                                      reinterpret_cast<PRISMATIC_FFTW_COMPLEX *>(&psi[0]),
-		                                                      FFTW_FORWARD, FFTW_ESTIMATE);
-		PRISMATIC_FFTW_PLAN plan_inverse = PRISMATIC_FFTW_PLAN_DFT_2D(psi.get_dimj(), psi.get_dimi(),
-		                                                      reinterpret_cast<PRISMATIC_FFTW_COMPLEX *>(&psi[0]),
-		                                                      reinterpret_cast<PRISMATIC_FFTW_COMPLEX *>(&psi[0]),
-		                                                      FFTW_BACKWARD, FFTW_ESTIMATE);
-		gatekeeper.unlock();
+		const size_t fftThreads = chooseExecutionPolicy(pars.meta.numThreads, 1, psi.size()).fftThreads;
+		FFTPlan plan_forward = planFFT2D(psi.get_dimj(), psi.get_dimi(), &psi[0], &psi[0], FFTDirection::Forward, fftThreads);
+		FFTPlan plan_inverse = planFFT2D(psi.get_dimj(), psi.get_dimi(), &psi[0], &psi[0], FFTDirection::Inverse, fftThreads);
 		{
-			auto qxa_ptr = pars.qxa.begin();
-			auto qya_ptr = pars.qya.begin();
-			for (auto& p:psi)p*=exp(-2 * pi * i * ( (*qxa_ptr++)*xp +
-			                                        (*qya_ptr++)*yp));
+			std::vector<complex<PRISMATIC_FLOAT_PRECISION> > xPhase(pars.qx.size());
+			std::vector<complex<PRISMATIC_FLOAT_PRECISION> > yPhase(pars.qy.size());
+			shiftPhases(pars.qx, xp, &xPhase[0]);
+			shiftPhases(pars.qy, yp, &yPhase[0]);
+			auto psi_ptr = psi.begin();
+			for (auto y = 0; y < psi.get_dimj(); ++y){
+				for (auto x = 0; x < psi.get_dimi(); ++x) *psi_ptr++ *= yPhase[y] * xPhase[x];
+			}
 		}
 
 		for (auto a2 = 0; a2 < pars.numPlanes; ++a2){
-			PRISMATIC_FFTW_EXECUTE(plan_inverse);
+			plan_inverse.execute();
 			complex<PRISMATIC_FLOAT_PRECISION>* t_ptr = &pars.transmission[a2 * pars.transmission.get_dimj() * pars.transmission.get_dimi()];
 			for (auto& p:psi)p *= (*t_ptr++); // transmit
-			PRISMATIC_FFTW_EXECUTE(plan_forward);
+			plan_forward.execute();
 			auto p_ptr = pars.prop.begin();
 			for (auto& p:psi)p *= (*p_ptr++); // propagate
 			for (auto& p:psi)p /= psi.size(); // scale FFT
@@ -577,29 +573,17 @@ namespace Prismatic{
 		}
 		psi_small = fftshift2(psi_small);
 		kspace_probe = psi_small;
-		gatekeeper.lock();
-		PRISMATIC_FFTW_PLAN plan_inverse_small = PRISMATIC_FFTW_PLAN_DFT_2D(psi_small.get_dimj(), psi_small.get_dimi(),
-		                                                            reinterpret_cast<PRISMATIC_FFTW_COMPLEX *>(&psi_small[0]),
-		                                                            reinterpret_cast<PRISMATIC_FFTW_COMPLEX *>(&psi_small[0]),
-		                                                            FFTW_BACKWARD, FFTW_ESTIMATE);
-		gatekeeper.unlock();
-		PRISMATIC_FFTW_EXECUTE(plan_inverse_small);
+		FFTPlan plan_inverse_small = planFFT2D(psi_small.get_dimj(), psi_small.get_dimi(), &psi_small[0], &psi_small[0], FFTDirection::Inverse);
+		plan_inverse_small.execute();
 		realspace_probe = psi_small;
-
-		// cleanup plans
-		gatekeeper.lock();
-		PRISMATIC_FFTW_DESTROY_PLAN(plan_forward);
-		PRISMATIC_FFTW_DESTROY_PLAN(plan_inverse);
-		PRISMATIC_FFTW_DESTROY_PLAN(plan_inverse_small);
-		PRISMATIC_FFTW_CLEANUP_THREADS();
 		return std::make_pair(realspace_probe, kspace_probe);
 	};
 
 	void getMultisliceProbe_CPU_batch(Parameters<PRISMATIC_FLOAT_PRECISION>& pars,
 	                                  const size_t Nstart,
 	                                  const size_t Nstop,
-	                                  PRISMATIC_FFTW_PLAN& plan_forward,
-	                                  PRISMATIC_FFTW_PLAN& plan_inverse,
+	                                  const FFTPlan& plan_forward,
+	                                  const FFTPlan& plan_inverse,
 	                                  Array1D<complex<PRISMATIC_FLOAT_PRECISION> >& psi_stack){
 		{
 			auto psi_ptr = psi_stack.begin();
@@ -608,6 +592,7 @@ namespace Prismatic{
 			}
 		}
 		auto psi_ptr   = psi_stack.begin();
+		std::vector<complex<PRISMATIC_FLOAT_PRECISION> > xPhase, yPhase;
 		for (auto probe_num = Nstart; probe_num < Nstop; ++probe_num) {
 			//			for (auto i:pars.psiProbeInit)*psi_ptr++=i;
 			// Initialize the probes
@@ -617,11 +602,11 @@ namespace Prismatic{
 			// populates the output stack for Multislice simulation using the CPU. The number of
 			// threads used is determined by pars.meta.numThreads
 			{
-				auto qxa_ptr = pars.qxa.begin();
-				auto qya_ptr = pars.qya.begin();
-				for (auto jj = 0; jj < pars.qxa.size(); ++jj) {
-					*psi_ptr++ *= exp(-2 * pi * i * ((*qxa_ptr++) * pars.xp[ax] +
-					                               (*qya_ptr++) * pars.yp[ay]));
+				probeShiftPhases(pars, ay, ax, xPhase, yPhase);
+				for (auto y = 0; y < pars.psiProbeInit.get_dimj(); ++y) {
+					for (auto x = 0; x < pars.psiProbeInit.get_dimi(); ++x) {
+						*psi_ptr++ *= yPhase[y] * xPhase[x];
+					}
 				}
 			}
 		}
@@ -632,7 +617,7 @@ namespace Prismatic{
 		size_t currentSlice = 0;
 
 			for (auto a2 = 0; a2 < pars.numPlanes; ++a2){
-				PRISMATIC_FFTW_EXECUTE(plan_inverse); // batch FFT
+				plan_inverse.execute(); // batch FFT
 
 				// transmit each of the probes in the batch
 				for (auto batch_idx = 0; batch_idx < min(pars.meta.batchSizeCPU, Nstop - Nstart); ++batch_idx){
@@ -643,7 +628,7 @@ namespace Prismatic{
 					}
 				}
 				slice_ptr += pars.psiProbeInit.size(); // advance to point to the beginning of the next potential slice
-				PRISMATIC_FFTW_EXECUTE(plan_forward); // batch FFT
+				plan_forward.execute(); // batch FFT
 
 				// propagate each of the probes in the batch
 				for (auto batch_idx = 0; batch_idx < min(pars.meta.batchSizeCPU, Nstop - Nstart); ++batch_idx){
@@ -664,8 +649,8 @@ namespace Prismatic{
 	void getMultisliceProbe_CPU(Parameters<PRISMATIC_FLOAT_PRECISION>& pars,
 	                            const size_t ay,
 	                            const size_t ax,
-								PRISMATIC_FFTW_PLAN& plan_forward,
-								PRISMATIC_FFTW_PLAN& plan_inverse,
+								const FFTPlan& plan_forward,
+								const FFTPlan& plan_inverse,
 								Array2D<complex<PRISMATIC_FLOAT_PRECISION> >& psi){
 
 		// populates the output stack for Multislice simulation using the CPU. The number of
@@ -685,10 +670,12 @@ namespace Prismatic{
 		//		                                                      FFTW_BACKWARD, FFTW_ESTIMATE);
 		//		gatekeeper.unlock(); // unlock it so we only block as long as necessary to deal with plans
 		{
-			auto qxa_ptr = pars.qxa.begin();
-			auto qya_ptr = pars.qya.begin();
-			for (auto& p:psi)p*=exp(-2 * pi * i * ( (*qxa_ptr++)*pars.xp[ax] +
-			                                        (*qya_ptr++)*pars.yp[ay]));
+			std::vector<complex<PRISMATIC_FLOAT_PRECISION> > xPhase, yPhase;
+			probeShiftPhases(pars, ay, ax, xPhase, yPhase);
+			auto psi_ptr = psi.begin();
+			for (auto y = 0; y < psi.get_dimj(); ++y){
+				for (auto x = 0; x < psi.get_dimi(); ++x) *psi_ptr++ *= yPhase[y] * xPhase[x];
+			}
 		}
 
 		auto scaled_prop = pars.prop;
@@ -697,109 +684,86 @@ namespace Prismatic{
 		size_t currentSlice = 0;
 
 			for (auto a2 = 0; a2 < pars.numPlanes; ++a2){
-				PRISMATIC_FFTW_EXECUTE(plan_inverse);
+				plan_inverse.execute();
 				for (auto& p:psi)p *= (*t_ptr++); // transmit
-				PRISMATIC_FFTW_EXECUTE(plan_forward);
+				plan_forward.execute();
 				auto p_ptr = scaled_prop.begin();
 				for (auto& p:psi)p *= (*p_ptr++); // propagate
 
 				if ( ( (((a2+1) % pars.numSlices) == 0) && ((a2+1) >= pars.zStartPlane) ) || ((a2+1) == pars.numPlanes) ){
-					formatOutput_CPU(pars, psi, pars.alphaInd, currentSlice, ay, ax);
+					pars.plan.formatOutput_CPU(pars, psi, pars.alphaInd, currentSlice, ay, ax);
 					currentSlice++;
 				}
 			}
 	}
 
 	void buildMultisliceOutput_CPUOnly(Parameters<PRISMATIC_FLOAT_PRECISION>& pars){
+		ScopedTimer timer("buildMultisliceOutput_CPUOnly");
 
 #ifdef PRISMATIC_BUILDING_GUI
         pars.progressbar->signalDescriptionMessage("Computing final output (Multislice)");
 #endif
 
-		vector<thread> workers;
-		workers.reserve(pars.meta.numThreads); // prevents multiple reallocations
-		PRISMATIC_FFTW_INIT_THREADS();
-		PRISMATIC_FFTW_PLAN_WITH_NTHREADS(pars.meta.numThreads);
+		ExecutionPolicy policy = chooseExecutionPolicy(pars.meta.numThreads, pars.numProbes, pars.psiProbeInit.size(), pars.meta.maxWorkerThreads);
 		const size_t PRISMATIC_PRINT_FREQUENCY_PROBES = max((size_t)1, pars.numProbes/ 10); // for printing status
-		WorkDispatcher dispatcher(0, pars.numProbes);
+		WorkDispatcher dispatcher(0, pars.numProbes, pars.meta.progress.get(), "probe positions");
 
 		// If the batch size is too big, the work won't be spread over the threads, which will usually hurt more than the benefit
 		// of batch FFT
-		pars.meta.batchSizeCPU = min(pars.meta.batchSizeTargetCPU, max((size_t)1, pars.numProbes / pars.meta.numThreads));
-		for (auto t = 0; t < pars.meta.numThreads; ++t){
-			cout << "Launching CPU worker #" << t << endl;
-			workers.push_back(thread([&pars, &dispatcher, t, &PRISMATIC_PRINT_FREQUENCY_PROBES]() {
-				size_t Nstart, Nstop;
+		pars.meta.batchSizeCPU = min(pars.meta.batchSizeTargetCPU, max((size_t)1, pars.numProbes / policy.outerThreads));
+		if (pars.meta.autotune)
+			autotuneBatch(pars.meta, pars.psiProbeInit.get_dimj(), pars.psiProbeInit.get_dimi(), pars.numProbes, policy, pars.meta.batchSizeCPU);
+		cout << "Running " << policy.outerThreads << " CPU workers with " << policy.fftThreads << " FFT threads each" << endl;
+		ThreadPool::instance().run(policy.outerThreads, [&pars, &dispatcher, &policy, &PRISMATIC_PRINT_FREQUENCY_PROBES](size_t t) {
+			size_t Nstart, Nstop;
                 Nstart=Nstop=0;
-				if (dispatcher.getWork(Nstart, Nstop, pars.meta.batchSizeCPU)){ // synchronously get work assignment
-
-					// Allocate memory for the propagated probes. These are 2D arrays, but as they will be operated on
-					// as a batch FFT they are all stacked together into one linearized array
-					Array1D<complex<PRISMATIC_FLOAT_PRECISION> > psi_stack = zeros_ND<1, complex<PRISMATIC_FLOAT_PRECISION> >({{pars.psiProbeInit.size() * pars.meta.batchSizeCPU}});
-
-					// setup batch FFTW parameters
-					const int rank    = 2;
-					int n[]           = {(int)pars.psiProbeInit.get_dimj(), (int)pars.psiProbeInit.get_dimi()};
-					const int howmany = pars.meta.batchSizeCPU;
-					int idist         = n[0]*n[1];
-					int odist         = n[0]*n[1];
-					int istride       = 1;
-					int ostride       = 1;
-					int *inembed      = n;
-					int *onembed      = n;
-					unique_lock<mutex> gatekeeper(fftw_plan_lock);
-
-			//					PRISMATIC_FFTW_PLAN plan_forward = PRISMATIC_FFTW_PLAN_DFT_2D(psi_stack.get_dimj(), psi_stack.get_dimi(),
-			//																		  reinterpret_cast<PRISMATIC_FFTW_COMPLEX *>(&psi_stack[0]),
-			//																		  reinterpret_cast<PRISMATIC_FFTW_COMPLEX *>(&psi_stack[0]),
-			//																		  FFTW_FORWARD, FFTW_MEASURE);
-			//					PRISMATIC_FFTW_PLAN plan_inverse = PRISMATIC_FFTW_PLAN_DFT_2D(psi_stack.get_dimj(), psi_stack.get_dimi(),
-			//																		  reinterpret_cast<PRISMATIC_FFTW_COMPLEX *>(&psi_stack[0]),
-			//																		  reinterpret_cast<PRISMATIC_FFTW_COMPLEX *>(&psi_stack[0]),
-			//																		  FFTW_BACKWARD, FFTW_MEASURE);
-
-
-					PRISMATIC_FFTW_PLAN plan_forward = PRISMATIC_FFTW_PLAN_DFT_BATCH(rank, n, howmany,
-					                                                         reinterpret_cast<PRISMATIC_FFTW_COMPLEX *>(&psi_stack[0]), inembed,
-					                                                         istride, idist,
-					                                                         reinterpret_cast<PRISMATIC_FFTW_COMPLEX *>(&psi_stack[0]), onembed,
-					                                                         ostride, odist,
-					                                                         FFTW_FORWARD, FFTW_MEASURE);
-					PRISMATIC_FFTW_PLAN plan_inverse = PRISMATIC_FFTW_PLAN_DFT_BATCH(rank, n, howmany,
-					                                                         reinterpret_cast<PRISMATIC_FFTW_COMPLEX *>(&psi_stack[0]), inembed,
-					                                                         istride, idist,
-					                                                         reinterpret_cast<PRISMATIC_FFTW_COMPLEX *>(&psi_stack[0]), onembed,
-					                                                         ostride, odist,
-					                                                         FFTW_BACKWARD, FFTW_MEASURE);
-
-					gatekeeper.unlock();
-					// main work loop
+			if (dispatcher.getWork(Nstart, Nstop, pars.meta.batchSizeCPU)){ // synchronously get work assignment
+
+				// Allocate memory for the propagated probes. These are 2D arrays, but as they will be operated on
+				// as a batch FFT they are all stacked together into one linearized array
+				Array1D<complex<PRISMATIC_FLOAT_PRECISION> > psi_stack = zeros_ND<1, complex<PRISMATIC_FLOAT_PRECISION> >({{pars.psiProbeInit.size() * pars.meta.batchSizeCPU}});
+
+				// batched plans; workers with the same batch size share them through the plan cache
+
+		//					PRISMATIC_FFTW_PLAN plan_forward = PRISMATIC_FFTW_PLAN_DFT_2D(psi_stack.get_dimj(), psi_stack.get_dimi(),
+		//																		  reinterpret_cast<PRISMATIC_FFTW_COMPLEX *>(&psi_stack[0]),
+		//																		  reinterpret_cast<PRISMATIC_FFTW_COMPLEX *>(&psi_stack[0]),
+		//																		  FFTW_FORWARD, FFTW_MEASURE);
+		//					PRISMATIC_FFTW_PLAN plan_inverse = PRISMATIC_FFTW_PLAN_DFT_2D(psi_stack.get_dimj(), psi_stack.get_dimi(),
+		//																		  reinterpret_cast<PRISMATIC_FFTW_COMPLEX *>(&psi_stack[0]),
+		//																		  reinterpret_cast<PRISMATIC_FFTW_COMPLEX *>(&psi_stack[0]),
+		//																		  FFTW_BACKWARD, FFTW_MEASURE);
+
+
+				FFTPlan plan_forward = planFFT2D(pars.psiProbeInit.get_dimj(), pars.psiProbeInit.get_dimi(), &psi_stack[0], &psi_stack[0],
+				                                 FFTDirection::Forward, policy.fftThreads, FFTEffort::Measure, pars.meta.batchSizeCPU);
+				FFTPlan plan_inverse = planFFT2D(pars.psiProbeInit.get_dimj(), pars.psiProbeInit.get_dimi(), &psi_stack[0], &psi_stack[0],
+				                                 FFTDirection::Inverse, policy.fftThreads, FFTEffort::Measure, pars.meta.batchSizeCPU);
+				// main work loop
                     do {
-						while (Nstart < Nstop) {
-							if (Nstart % PRISMATIC_PRINT_FREQUENCY_PROBES < pars.meta.batchSizeCPU | Nstart == 100){
-								cout << "Computing Probe Position #" << Nstart << "/" << pars.numProbes << endl;
-							}
-							getMultisliceProbe_CPU_batch(pars, Nstart, Nstop, plan_forward, plan_inverse, psi_stack);
+					while (Nstart < Nstop) {
+						if (Nstart % PRISMATIC_PRINT_FREQUENCY_PROBES < pars.meta.batchSizeCPU | Nstart == 100){
+							cout << "Computing Probe Position #" << Nstart << "/" << pars.numProbes << endl;
+						}
+						getMultisliceProbe_CPU_batch(pars, Nstart, Nstop, plan_forward, plan_inverse, psi_stack);
 #ifdef PRISMATIC_BUILDING_GUI
                             pars.progressbar->signalOutputUpdate(Nstart, pars.numProbes);
 #endif
-							Nstart=Nstop;
-						}
-					} while(dispatcher.getWork(Nstart, Nstop, pars.meta.batchSizeCPU));
-					gatekeeper.lock();
-					PRISMATIC_FFTW_DESTROY_PLAN(plan_forward);
-					PRISMATIC_FFTW_DESTROY_PLAN(plan_inverse);
-					gatekeeper.unlock();
-				}
-				cout << "CPU worker #" << t << " finished\n";
-			}));
-		}
-		for (auto& t:workers)t.join();
-		PRISMATIC_FFTW_CLEANUP_THREADS();
+						Nstart=Nstop;
+					}
+				} while(dispatcher.getWork(Nstart, Nstop, pars.meta.batchSizeCPU));
+			}
+			cout << "CPU worker #" << t << " finished\n";
+		});
+
+		// per probe and plane: two FFTs, transmission and propagator products
+		const double N = pars.psiProbeInit.size();
+		Profiler::instance().addFlops("buildMultisliceOutput_CPUOnly", (double)pars.numProbes * pars.numPlanes * (2 * fftFlops(N) + 12 * N));
 	};
 
 
 	void Multislice_calcOutput(Parameters<PRISMATIC_FLOAT_PRECISION>& pars){
+		ScopedTimer timer("Multislice_calcOutput");
 
 		// setup coordinates and build propagators
 		setupCoordinates_multislice(pars);
@@ -822,7 +786,7 @@ namespace Prismatic{
 #endif
 
 		// create the output
-		buildMultisliceOutput(pars);
+		pars.plan.buildMultisliceOutput(pars);
 	}
 
 }
@@ -28,8 +28,6 @@
 #include "params.cuh"
 
 namespace Prismatic{
-	extern std::mutex fftw_plan_lock;
-
 	inline void createPlansAndStreamsM(Parameters<PRISMATIC_FLOAT_PRECISION> &pars,
 									   CudaParameters<PRISMATIC_FLOAT_PRECISION> &cuda_pars){
 		// create CUDA streams
@@ -245,7 +243,7 @@ namespace Prismatic{
 		size_t psi_size = pars.psiProbeInit.size();
 		int stream_count = 0;
 		const size_t PRISMATIC_PRINT_FREQUENCY_PROBES = max((size_t)1, pars.numProbes / 10); // for printing status
-		WorkDispatcher dispatcher(0, pars.numProbes);
+		WorkDispatcher dispatcher(0, pars.numProbes, pars.meta.progress.get(), "probe positions");
 
 		for (auto t = 0; t < total_num_streams; ++t)
 		{
@@ -313,8 +311,7 @@ namespace Prismatic{
 		// now launch CPU work
 		std::cout<<"Also do CPU work: "<<pars.meta.alsoDoCPUWork<<std::endl;
 		if (pars.meta.alsoDoCPUWork){
-			PRISMATIC_FFTW_INIT_THREADS();
-			PRISMATIC_FFTW_PLAN_WITH_NTHREADS(pars.meta.numThreads);vector<thread> workers_CPU;
+			vector<thread> workers_CPU;
 			workers_CPU.reserve(pars.meta.numThreads); // prevents multiple reallocations
 
 			// If the batch size is too big, the work won't be spread over the threads, which will usually hurt more than the benefit
@@ -338,30 +335,11 @@ namespace Prismatic{
 					if (dispatcher.getWork(Nstart, Nstop, pars.meta.batchSizeCPU, early_CPU_stop)) { // synchronously get work assignment
 						Array1D<std::complex<PRISMATIC_FLOAT_PRECISION> > psi_stack = zeros_ND<1, complex<PRISMATIC_FLOAT_PRECISION> >({{pars.psiProbeInit.size() * pars.meta.batchSizeCPU}});
 
-						// setup batch FFTW parameters
-						const int rank    = 2;
-						int n[]           = {(int)pars.psiProbeInit.get_dimj(), (int)pars.psiProbeInit.get_dimi()};
-						const int howmany = pars.meta.batchSizeCPU;
-						int idist         = n[0]*n[1];
-						int odist         = n[0]*n[1];
-						int istride       = 1;
-						int ostride       = 1;
-						int *inembed      = n;
-						int *onembed      = n;
-						unique_lock<mutex> gatekeeper(fftw_plan_lock);
-						PRISMATIC_FFTW_PLAN plan_forward = PRISMATIC_FFTW_PLAN_DFT_BATCH(rank, n, howmany,
-						                                                         reinterpret_cast<PRISMATIC_FFTW_COMPLEX *>(&psi_stack[0]), inembed,
-						                                                         istride, idist,
-						                                                         reinterpret_cast<PRISMATIC_FFTW_COMPLEX *>(&psi_stack[0]), onembed,
-						                                                         ostride, odist,
-						                                                         FFTW_FORWARD, FFTW_MEASURE);
-						PRISMATIC_FFTW_PLAN plan_inverse = PRISMATIC_FFTW_PLAN_DFT_BATCH(rank, n, howmany,
-						                                                         reinterpret_cast<PRISMATIC_FFTW_COMPLEX *>(&psi_stack[0]), inembed,
-						                                                         istride, idist,
-						                                                         reinterpret_cast<PRISMATIC_FFTW_COMPLEX *>(&psi_stack[0]), onembed,
-						                                                         ostride, odist,
-						                                                         FFTW_BACKWARD, FFTW_MEASURE);
-						gatekeeper.unlock();
+						// batched plans; workers with the same batch size share them through the plan cache
+						FFTPlan plan_forward = planFFT2D(pars.psiProbeInit.get_dimj(), pars.psiProbeInit.get_dimi(), &psi_stack[0], &psi_stack[0],
+						                                 FFTDirection::Forward, 1, FFTEffort::Measure, pars.meta.batchSizeCPU);
+						FFTPlan plan_inverse = planFFT2D(pars.psiProbeInit.get_dimj(), pars.psiProbeInit.get_dimi(), &psi_stack[0], &psi_stack[0],
+						                                 FFTDirection::Inverse, 1, FFTEffort::Measure, pars.meta.batchSizeCPU);
 
 						// main work loop
 						do {
@@ -378,16 +356,11 @@ namespace Prismatic{
 							}
 							if (Nstop >= early_CPU_stop) break;
 						} while(dispatcher.getWork(Nstart, Nstop, pars.meta.batchSizeCPU, early_CPU_stop));
-						gatekeeper.lock();
-						PRISMATIC_FFTW_DESTROY_PLAN(plan_forward);
-						PRISMATIC_FFTW_DESTROY_PLAN(plan_inverse);
-						gatekeeper.unlock();
 					}
 				}));
 			}
 			cout << "Waiting on CPU threads..." << endl;
 			for (auto& t:workers_CPU)t.join();
-			PRISMATIC_FFTW_CLEANUP_THREADS();
 		}
 		// synchronize threads
 		cout << "Waiting on GPU threads..." << endl;
@@ -407,7 +380,7 @@ namespace Prismatic{
 		size_t psi_size = pars.psiProbeInit.size();
 		int stream_count = 0;
 		const size_t PRISMATIC_PRINT_FREQUENCY_PROBES = max((size_t)1, pars.numProbes / 10); // for printing status
-		WorkDispatcher dispatcher(0, pars.numProbes);
+		WorkDispatcher dispatcher(0, pars.numProbes, pars.meta.progress.get(), "probe positions");
 		// If the batch size is too big, the work won't be spread over the threads, which will usually hurt more than the benefit
 		// of batch FFT
 
@@ -479,8 +452,7 @@ namespace Prismatic{
 
 		// now launch CPU work
 		if (pars.meta.alsoDoCPUWork){
-			PRISMATIC_FFTW_INIT_THREADS();
-			PRISMATIC_FFTW_PLAN_WITH_NTHREADS(pars.meta.numThreads);vector<thread> workers_CPU;
+			vector<thread> workers_CPU;
 			workers_CPU.reserve(pars.meta.numThreads); // prevents multiple reallocations
 			for (auto t = 0; t < pars.meta.numThreads; ++t) {
 				cout << "Launching CPU worker #" << t << endl;
@@ -499,30 +471,11 @@ namespace Prismatic{
 					if (dispatcher.getWork(Nstart, Nstop, pars.meta.batchSizeCPU, early_CPU_stop)) { // synchronously get work assignment
 						Array1D<std::complex<PRISMATIC_FLOAT_PRECISION> > psi_stack = zeros_ND<1, complex<PRISMATIC_FLOAT_PRECISION> >({{pars.psiProbeInit.size() * pars.meta.batchSizeCPU}});
 
-						// setup batch FFTW parameters
-						const int rank = 2;
-						int n[] = {(int)pars.psiProbeInit.get_dimj(), (int)pars.psiProbeInit.get_dimi()};
-						const int howmany = pars.meta.batchSizeCPU;
-						int idist = n[0]*n[1];
-						int odist = n[0]*n[1];
-						int istride = 1;
-						int ostride = 1;
-						int *inembed = n;
-						int *onembed = n;
-						unique_lock<mutex> gatekeeper(fftw_plan_lock);
-						PRISMATIC_FFTW_PLAN plan_forward = PRISMATIC_FFTW_PLAN_DFT_BATCH(rank, n, howmany,
-						                                                         reinterpret_cast<PRISMATIC_FFTW_COMPLEX *>(&psi_stack[0]), inembed,
-						                                                         istride, idist,
-						                                                         reinterpret_cast<PRISMATIC_FFTW_COMPLEX *>(&psi_stack[0]), onembed,
-						                                                         ostride, odist,
-						                                                         FFTW_FORWARD, FFTW_MEASURE);
-						PRISMATIC_FFTW_PLAN plan_inverse = PRISMATIC_FFTW_PLAN_DFT_BATCH(rank, n, howmany,
-						                                                         reinterpret_cast<PRISMATIC_FFTW_COMPLEX *>(&psi_stack[0]), inembed,
-						                                                         istride, idist,
-						                                                         reinterpret_cast<PRISMATIC_FFTW_COMPLEX *>(&psi_stack[0]), onembed,
-						                                                         ostride, odist,
-						                                                         FFTW_BACKWARD, FFTW_MEASURE);
-						gatekeeper.unlock();
+						// batched plans; workers with the same batch size share them through the plan cache
+						FFTPlan plan_forward = planFFT2D(pars.psiProbeInit.get_dimj(), pars.psiProbeInit.get_dimi(), &psi_stack[0], &psi_stack[0],
+						                                 FFTDirection::Forward, 1, FFTEffort::Measure, pars.meta.batchSizeCPU);
+						FFTPlan plan_inverse = planFFT2D(pars.psiProbeInit.get_dimj(), pars.psiProbeInit.get_dimi(), &psi_stack[0], &psi_stack[0],
+						                                 FFTDirection::Inverse, 1, FFTEffort::Measure, pars.meta.batchSizeCPU);
 
 						// main work loop
 						do {
@@ -539,17 +492,12 @@ namespace Prismatic{
 							}
 							if (Nstop >= early_CPU_stop) break;
 						} while(dispatcher.getWork(Nstart, Nstop, pars.meta.batchSizeCPU, early_CPU_stop));
-						gatekeeper.lock();
-						PRISMATIC_FFTW_DESTROY_PLAN(plan_forward);
-						PRISMATIC_FFTW_DESTROY_PLAN(plan_inverse);
-						gatekeeper.unlock();
 					}
 					cout << "CPU worker #" << t << " finished\n";
 				}));
 			}
 			cout << "Waiting on GPU threads..." << endl;
 			for (auto& t:workers_CPU)t.join();
-			PRISMATIC_FFTW_CLEANUP_THREADS();
 		}
 		// synchronize threads
 		cout << "Waiting on GPU threads..." << endl;
@@ -66,25 +66,15 @@ void Multislice_entry_pars(Parameters<PRISMATIC_FLOAT_PRECISION> &pars){
 		{
 			Multislice_series_runFP(pars, i);
 		}
+		if(pars.meta.progress) pars.meta.progress->checkCancelled();
 
 		for(auto i = 0; i < pars.meta.seriesTags.size(); i++)
 		{
-			std::string currentName = pars.meta.seriesTags[i];
-			pars.currentTag = currentName;
-			pars.meta.probeDefocus = pars.meta.seriesVals[0][i]; //TODO: later, if expanding sim series past defocus, need to pull current val more generally
+			updateSeriesParams(pars, i);
 			
-			readRealDataSet_inOrder(pars.net_output, "prismatic_scratch.h5", "scratch/"+currentName);
-			if(pars.meta.saveDPC_CoM)
-				readRealDataSet_inOrder(pars.net_DPC_CoM, "prismatic_scratch.h5", "scratch/"+currentName+"_DPC");
+			readSeriesOutput(pars);
 			//average data by fp
-			for (auto &i : pars.net_output)
-				i /= pars.meta.numFP;
-
-			if (pars.meta.saveDPC_CoM)
-			{
-				for (auto &j : pars.net_DPC_CoM)
-					j /= pars.meta.numFP; //since squared intensities are used to calculate DPC_CoM, this is incoherent averaging
-			}
+			averageFrozenPhonons(pars);
 
 			saveSTEM(pars);
 		}
@@ -97,16 +87,10 @@ void Multislice_entry_pars(Parameters<PRISMATIC_FLOAT_PRECISION> &pars){
 		{
 			Multislice_runFP(pars, i);
 		}	
+		if(pars.meta.progress) pars.meta.progress->checkCancelled();
 
 		//average data by fp
-		for (auto &i : pars.net_output)
-			i /= pars.meta.numFP;
-
-		if (pars.meta.saveDPC_CoM)
-		{
-			for (auto &j : pars.net_DPC_CoM)
-				j /= pars.meta.numFP; //since squared intensities are used to calculate DPC_CoM, this is incoherent averaging
-		}
+		averageFrozenPhonons(pars);
 
 		saveSTEM(pars);
 	}
@@ -114,11 +98,11 @@ void Multislice_entry_pars(Parameters<PRISMATIC_FLOAT_PRECISION> &pars){
 	pars.outputFile = H5::H5File(pars.meta.filenameOutput.c_str(), H5F_ACC_RDWR);
 	
 	//perhaps have this check against the keys
-	if(pars.meta.simSeries) CCseriesSG(pars.outputFile);
+	if(pars.meta.simSeries) seriesSG(pars);
 
 	writeMetadata(pars);
 	pars.outputFile.close();
-	if (pars.meta.simSeries) removeScratchFile(pars);
+	if (pars.meta.simSeries) pars.seriesOutput.release();
 
 #ifdef PRISMATIC_ENABLE_GPU
 	cout << "peak GPU memory usage = " << pars.maxGPUMem << '\n';
@@ -130,6 +114,7 @@ void Multislice_entry_pars(Parameters<PRISMATIC_FLOAT_PRECISION> &pars){
 void Multislice_runFP(Parameters<PRISMATIC_FLOAT_PRECISION> &pars, size_t fpNum)
 {
 
+	if(pars.meta.progress) pars.meta.progress->startFrozenPhonon(fpNum, pars.meta.numFP);
 	pars.meta.reseed();
 	pars.meta.fpNum = fpNum;
 	cout << "Frozen Phonon #" << fpNum << endl;
@@ -165,16 +150,7 @@ void Multislice_runFP(Parameters<PRISMATIC_FLOAT_PRECISION> &pars, size_t fpNum)
 	Multislice_calcOutput(pars);
 	pars.outputFile.close();
 
-	if(fpNum >= 1)
-	{
-		pars.net_output += pars.output;
-		if (pars.meta.saveDPC_CoM) pars.net_DPC_CoM += pars.DPC_CoM;
-	}
-	else
-	{
-		pars.net_output = pars.output;
-		if (pars.meta.saveDPC_CoM) pars.net_DPC_CoM = pars.DPC_CoM;
-	}
+	accumulateFrozenPhonon(pars, fpNum);
 	
 
 };
@@ -182,6 +158,7 @@ void Multislice_runFP(Parameters<PRISMATIC_FLOAT_PRECISION> &pars, size_t fpNum)
 void Multislice_series_runFP(Parameters<PRISMATIC_FLOAT_PRECISION> &pars, size_t fpNum)
 {
 
+	if(pars.meta.progress) pars.meta.progress->startFrozenPhonon(fpNum, pars.meta.numFP);
 	pars.meta.reseed();
 	pars.meta.fpNum = fpNum;
 	cout << "Frozen Phonon #" << fpNum << endl;
@@ -221,13 +198,8 @@ void Multislice_series_runFP(Parameters<PRISMATIC_FLOAT_PRECISION> &pars, size_t
 		pars.meta.aberrations = updateAberrations(pars.meta.aberrations, pars.meta.probeDefocus, pars.meta.C3, pars.meta.C5, pars.lambda);
 		Multislice_calcOutput(pars);
 
-		if(i == 0 and fpNum == 0) 
-		{
-			std::cout << "Creating scratch file" << std::endl;
-			createScratchFile(pars);
-
-		}
-		updateScratchData(pars);
+		if(i == 0 and fpNum == 0) setupSeriesOutput(pars);
+		updateSeriesOutput(pars);
 	}
 	pars.outputFile.close();
 
@@ -23,11 +23,15 @@
 #include <sstream>
 #include "params.h"
 #include "ArrayND.h"
+#include "ArrayView.h"
 #include "projectedPotential.h"
 #include "WorkDispatcher.h"
+#include "ThreadPool.h"
+#include "ExecutionPolicy.h"
+#include "Instrumentation.h"
 #include "utility.h"
 #include "fileIO.h"
-#include "fftw3.h"
+#include "FFTBackend.h"
 #include <complex>
 #include <boost/random/mersenne_twister.hpp>
 #include <boost/random/normal_distribution.hpp>
@@ -42,13 +46,13 @@ namespace Prismatic
 
 using namespace std;
 mutex potentialWriteLock;
-extern mutex fftw_plan_lock;
 
 void fetch_potentials(Array3D<PRISMATIC_FLOAT_PRECISION> &potentials,
 					  const vector<size_t> &atomic_species,
 					  const Array1D<PRISMATIC_FLOAT_PRECISION> &xr,
 					  const Array1D<PRISMATIC_FLOAT_PRECISION> &yr)
 {
+	ScopedTimer timer("fetch_potentials");
 	Array2D<PRISMATIC_FLOAT_PRECISION> cur_pot;
 	for (auto k = 0; k < potentials.get_dimk(); ++k)
 	{
@@ -69,8 +73,9 @@ void fetch_potentials3D(Array4D<std::complex<PRISMATIC_FLOAT_PRECISION>> &potent
 					  const Array1D<PRISMATIC_FLOAT_PRECISION> &yr,
 					  const Array1D<PRISMATIC_FLOAT_PRECISION> &zr)
 {
+	ScopedTimer timer("fetch_potentials3D");
 	Array3D<PRISMATIC_FLOAT_PRECISION> cur_pot;
-	PRISMATIC_FFTW_INIT_THREADS();
+	const ExecutionPolicy policy = {1, 1}; // the lookup tables are small, transform them serially
 	for (auto l = 0; l < potentials.get_diml(); l++)
 	{
 		Array3D<PRISMATIC_FLOAT_PRECISION> cur_pot = kirklandPotential3D(atomic_species[l], xr, yr, zr);
@@ -85,21 +90,11 @@ void fetch_potentials3D(Array4D<std::complex<PRISMATIC_FLOAT_PRECISION>> &potent
 					fstore.at(j,i).real(cur_pot.at(k,j,i));
 				}
 			}
-			unique_lock<mutex> gatekeeper(fftw_plan_lock);
-			PRISMATIC_FFTW_PLAN plan_forward = PRISMATIC_FFTW_PLAN_DFT_2D(cur_pot.get_dimj(), cur_pot.get_dimi(),
-																	reinterpret_cast<PRISMATIC_FFTW_COMPLEX *>(&fstore[0]),
-																	reinterpret_cast<PRISMATIC_FFTW_COMPLEX *>(&potentials.at(l,k,0,0)),
-																	FFTW_FORWARD,
-																	FFTW_ESTIMATE);
-
-			gatekeeper.unlock();
-			PRISMATIC_FFTW_EXECUTE(plan_forward);
-
-			gatekeeper.lock();
-			PRISMATIC_FFTW_DESTROY_PLAN(plan_forward);
+			FFTPlan plan_forward = planFFT2D(cur_pot.get_dimj(), cur_pot.get_dimi(), &fstore[0], &potentials.at(l,k,0,0),
+											 FFTDirection::Forward, policy.fftThreads);
+			plan_forward.execute();
 		}
 	}
-	PRISMATIC_FFTW_CLEANUP_THREADS();
 }
 
 vector<size_t> get_unique_atomic_species(Parameters<PRISMATIC_FLOAT_PRECISION> &pars)
@@ -120,6 +115,7 @@ void generateProjectedPotentials(Parameters<PRISMATIC_FLOAT_PRECISION> &pars,
 								 const Array1D<long> &xvec,
 								 const Array1D<long> &yvec)
 {
+	ScopedTimer timer("generateProjectedPotentials");
 	// splits the atomic coordinates into slices and computes the projected potential for each.
 
 	// create arrays for the coordinates
@@ -171,101 +167,92 @@ void generateProjectedPotentials(Parameters<PRISMATIC_FLOAT_PRECISION> &pars,
 
 	//loop over each plane, perturb the atomic positions, and place the corresponding potential at each location
 	// using parallel calculation of each individual slice
-	std::vector<std::thread> workers;
-	workers.reserve(pars.meta.numThreads);
-
-	WorkDispatcher dispatcher(0, pars.numPlanes);
-	for (long t = 0; t < pars.meta.numThreads; ++t)
+	WorkDispatcher dispatcher(0, pars.numPlanes, pars.meta.progress.get(), "potential slices");
+	ThreadPool::instance().run(pars.meta.numThreads, [&pars, &x, &y, &z, &ID, &Z_lookup, &xvec, &sigma, &occ,
+													  &zPlane, &yvec, &potentialLookup, &dispatcher](size_t t)
 	{
-		workers.push_back(thread([&pars, &x, &y, &z, &ID, &Z_lookup, &xvec, &sigma, &occ,
-								  &zPlane, &yvec, &potentialLookup, &dispatcher, t]()
-		{
-			// create a random number generator to simulate thermal effects
-			// std::cout<<"random seed = " << pars.meta.randomSeed << std::endl;
-			// srand(pars.meta.randomSeed);
-			// std::default_random_engine de(pars.meta.randomSeed);
-			// normal_distribution<PRISMATIC_FLOAT_PRECISION> randn(0,1);
-			Array1D<long> xp;
-			Array1D<long> yp;
-
-			size_t currentSlice, stop;
-			currentSlice = stop = 0;
+		// create a random number generator to simulate thermal effects
+		// std::cout<<"random seed = " << pars.meta.randomSeed << std::endl;
+		// srand(pars.meta.randomSeed);
+		// std::default_random_engine de(pars.meta.randomSeed);
+		// normal_distribution<PRISMATIC_FLOAT_PRECISION> randn(0,1);
+		Array1D<long> xp;
+		Array1D<long> yp;
+
+		size_t currentSlice, stop;
+		currentSlice = stop = 0;
             // create a random number generator to simulate thermal effects
-			unsigned int thread_seed = pars.meta.randomSeed + static_cast<unsigned int>(10000 * t);
+		unsigned int thread_seed = pars.meta.randomSeed + static_cast<unsigned int>(10000 * t);
 
-			std::ostringstream oss;
-			oss << "Launched thread #" << t << " to compute projected potential slices with seed " << thread_seed << std::endl;
-			std::cout << oss.str();
+		std::ostringstream oss;
+		oss << "Launched thread #" << t << " to compute projected potential slices with seed " << thread_seed << std::endl;
+		std::cout << oss.str();
 
             boost::mt19937 thread_rng(thread_seed);
-			PRISMATIC_FLOAT_PRECISION zero = 0.0;
-			PRISMATIC_FLOAT_PRECISION one = 1.0;
+		PRISMATIC_FLOAT_PRECISION zero = 0.0;
+		PRISMATIC_FLOAT_PRECISION one = 1.0;
             boost::random::normal_distribution<PRISMATIC_FLOAT_PRECISION> randn(zero, one);
-			boost::random::uniform_real_distribution<PRISMATIC_FLOAT_PRECISION> uniform_d01(zero, one);
-
-			while (dispatcher.getWork(currentSlice, stop))
-			{ // synchronously get work assignment
-				Array2D<PRISMATIC_FLOAT_PRECISION> projectedPotential = zeros_ND<2, PRISMATIC_FLOAT_PRECISION>({{pars.imageSize[0], pars.imageSize[1]}});
-				const long dim0 = (long)pars.imageSize[0];
-				const long dim1 = (long)pars.imageSize[1];
-				while (currentSlice != stop)
+		boost::random::uniform_real_distribution<PRISMATIC_FLOAT_PRECISION> uniform_d01(zero, one);
+
+		while (dispatcher.getWork(currentSlice, stop))
+		{ // synchronously get work assignment
+			Array2D<PRISMATIC_FLOAT_PRECISION> projectedPotential = zeros_ND<2, PRISMATIC_FLOAT_PRECISION>({{pars.imageSize[0], pars.imageSize[1]}});
+			const long dim0 = (long)pars.imageSize[0];
+			const long dim1 = (long)pars.imageSize[1];
+			while (currentSlice != stop)
+			{
+				for (auto atom_num = 0; atom_num < x.size(); ++atom_num)
 				{
-					for (auto atom_num = 0; atom_num < x.size(); ++atom_num)
+					if (zPlane[atom_num] == currentSlice)
 					{
-						if (zPlane[atom_num] == currentSlice)
+						if (pars.meta.includeOccupancy)
 						{
-							if (pars.meta.includeOccupancy)
+							if (uniform_d01(thread_rng) > occ[atom_num])
 							{
-								if (uniform_d01(thread_rng) > occ[atom_num])
-								{
-									continue;
-								}
+								continue;
 							}
-							const size_t cur_Z = Z_lookup[ID[atom_num]];
-							PRISMATIC_FLOAT_PRECISION X, Y;
-							if (pars.meta.includeThermalEffects)
-							{ // apply random perturbations
+						}
+						const size_t cur_Z = Z_lookup[ID[atom_num]];
+						PRISMATIC_FLOAT_PRECISION X, Y;
+						if (pars.meta.includeThermalEffects)
+						{ // apply random perturbations
                                 PRISMATIC_FLOAT_PRECISION perturbX = randn(thread_rng) * sigma[atom_num];
                                 PRISMATIC_FLOAT_PRECISION perturbY = randn(thread_rng) * sigma[atom_num];
-								X = round((x[atom_num] + perturbX) / pars.pixelSize[1]);
-								Y = round((y[atom_num] + perturbY) / pars.pixelSize[0]);
-							}
-							else
-							{
-								X = round((x[atom_num]) / pars.pixelSize[1]); // this line uses no thermal factor
-								Y = round((y[atom_num]) / pars.pixelSize[0]); // this line uses no thermal factor
-							}
-							xp = xvec + (long)X;
-							for (auto &i : xp)
-								i = (i % dim1 + dim1) % dim1; // make sure to get a positive value
-
-							yp = yvec + (long)Y;
-							for (auto &i : yp)
-								i = (i % dim0 + dim0) % dim0; // make sure to get a positive value
-							for (auto ii = 0; ii < xp.size(); ++ii)
+							X = round((x[atom_num] + perturbX) / pars.pixelSize[1]);
+							Y = round((y[atom_num] + perturbY) / pars.pixelSize[0]);
+						}
+						else
+						{
+							X = round((x[atom_num]) / pars.pixelSize[1]); // this line uses no thermal factor
+							Y = round((y[atom_num]) / pars.pixelSize[0]); // this line uses no thermal factor
+						}
+						xp = xvec + (long)X;
+						for (auto &i : xp)
+							i = (i % dim1 + dim1) % dim1; // make sure to get a positive value
+
+						yp = yvec + (long)Y;
+						for (auto &i : yp)
+							i = (i % dim0 + dim0) % dim0; // make sure to get a positive value
+						for (auto ii = 0; ii < xp.size(); ++ii)
+						{
+							for (auto jj = 0; jj < yp.size(); ++jj)
 							{
-								for (auto jj = 0; jj < yp.size(); ++jj)
-								{
-									// fill in value with lookup table
-									projectedPotential.at(yp[jj], xp[ii]) += potentialLookup.at(cur_Z, jj, ii);
-								}
+								// fill in value with lookup table
+								projectedPotential.at(yp[jj], xp[ii]) += potentialLookup.at(cur_Z, jj, ii);
 							}
-							//								}
 						}
+						//								}
 					}
-					// copy the result to the full array
-					copy(projectedPotential.begin(), projectedPotential.end(), &pars.pot.at(currentSlice, 0, 0));
-					#ifdef PRISMATIC_BUILDING_GUI
-					pars.progressbar->signalPotentialUpdate(currentSlice, pars.numPlanes);
-					#endif //PRISMATIC_BUILDING_GUI
-					++currentSlice;
 				}
+				// copy the result to the full array
+				copy(projectedPotential.begin(), projectedPotential.end(), &pars.pot.at(currentSlice, 0, 0));
+				#ifdef PRISMATIC_BUILDING_GUI
+				pars.progressbar->signalPotentialUpdate(currentSlice, pars.numPlanes);
+				#endif //PRISMATIC_BUILDING_GUI
+				++currentSlice;
 			}
-		}));
-	}
-	cout << "Waiting for threads...\n";
-	for (auto &t : workers)
-		t.join();
+		}
+	});
 #ifdef PRISMATIC_BUILDING_GUI
 	pars.progressbar->setProgress(100);
 #endif //PRISMATIC_BUILDING_GUI
@@ -317,6 +304,7 @@ void generateProjectedPotentials3D(Parameters<PRISMATIC_FLOAT_PRECISION> &pars,
 								   const Array1D<long> &yvec,
 								   const Array1D<PRISMATIC_FLOAT_PRECISION> &zvec)
 {		
+	ScopedTimer timer("generateProjectedPotentials3D");
 	long numPlanes = ceil(pars.tiledCellDim[0]/pars.meta.sliceThickness);
 	//check if intermediate output was specified, if so, create index of output slices
 	pars.numPlanes = numPlanes;
@@ -420,164 +408,158 @@ void generateProjectedPotentials3D(Parameters<PRISMATIC_FLOAT_PRECISION> &pars,
 	for (auto i = 0; i < unique_species.size(); ++i)
 		Z_lookup[unique_species[i]] = i;
 		
-	std::vector<std::thread> workers;
-	size_t numWorkers = pars.meta.numThreads; //std::min(pars.meta.numThreads, (size_t) 4); //heuristic for now, TODO: improve parallelization scheme to segment atoms over regions to avoid write locks
-	workers.reserve(numWorkers);
-	WorkDispatcher dispatcher(0, pars.atoms.size());
+	//one small FFT per atom, so parallelize over atoms. TODO: improve parallelization scheme to segment atoms over regions to avoid write locks
+	const ExecutionPolicy policy = chooseExecutionPolicy(pars.meta.numThreads, pars.atoms.size(), rband.size(), pars.meta.maxWorkerThreads);
+	WorkDispatcher dispatcher(0, pars.atoms.size(), pars.meta.progress.get(), "atoms");
 	const size_t print_frequency = std::max((size_t)1, pars.atoms.size() / 10);
 
-	PRISMATIC_FFTW_INIT_THREADS();
 	std::cout << "Base random seed = " << pars.meta.randomSeed << std::endl;
-	for (long t = 0; t < numWorkers; t++)
+	ThreadPool::instance().run(policy.outerThreads, [&pars, &x, &y, &z, &ID, &sigma, &occ, &print_frequency,
+													 &Z_lookup, &xvec, &yvec, &zvec, &zr, &dim0, &dim1, &policy,
+													 &numPlanes, &potLookup, &rband, &qband, &qxShift, &qyShift, &dispatcher](size_t t)
 	{
-		workers.push_back(thread([&pars, &x, &y, &z, &ID, &sigma, &occ, &print_frequency,
-								 &Z_lookup, &xvec, &yvec, &zvec, &zr, &dim0, &dim1,
-								 &numPlanes, &potLookup, &rband, &qband, &qxShift, &qyShift, &dispatcher, t]()
-		{
-			size_t currentAtom, stop;
-			currentAtom = stop = 0;
+		size_t currentAtom, stop;
+		currentAtom = stop = 0;
             // create a random number generator to simulate thermal effects
-			unsigned int thread_seed = pars.meta.randomSeed + static_cast<unsigned int>(10000 * t);
+		unsigned int thread_seed = pars.meta.randomSeed + static_cast<unsigned int>(10000 * t);
 
-			std::ostringstream oss;
-			oss << "Launched thread #" << t << " to compute projected potential slices with seed " << thread_seed << std::endl;
-			std::cout << oss.str();
+		std::ostringstream oss;
+		oss << "Launched thread #" << t << " to compute projected potential slices with seed " << thread_seed << std::endl;
+		std::cout << oss.str();
 
-			boost::mt19937 thread_rng(thread_seed);
-			PRISMATIC_FLOAT_PRECISION zero = 0.0;
-			PRISMATIC_FLOAT_PRECISION one = 1.0;
-			boost::random::normal_distribution<PRISMATIC_FLOAT_PRECISION> randn(zero, one);
+		boost::mt19937 thread_rng(thread_seed);
+		PRISMATIC_FLOAT_PRECISION zero = 0.0;
+		PRISMATIC_FLOAT_PRECISION one = 1.0;
+		boost::random::normal_distribution<PRISMATIC_FLOAT_PRECISION> randn(zero, one);
 
-			while (dispatcher.getWork(currentAtom, stop))
+		while (dispatcher.getWork(currentAtom, stop))
+		{
+			while(currentAtom != stop)
 			{
-				while(currentAtom != stop)
+				if(!(currentAtom % print_frequency))
 				{
-					if(!(currentAtom % print_frequency))
-					{
-						std::ostringstream oss;
-						oss << "Computing atom " << currentAtom << "/" << pars.atoms.size() << std::endl;
-						std::cout << oss.str();
-					}
-					
-					const size_t cur_Z = Z_lookup[ID[currentAtom]];
-					PRISMATIC_FLOAT_PRECISION X, Y, Z;
-					PRISMATIC_FLOAT_PRECISION perturbX, perturbY, perturbZ;
-					if (pars.meta.includeThermalEffects)
-					{ // apply random perturbations
-						perturbX = randn(thread_rng) * sigma[currentAtom];
-						perturbY = randn(thread_rng) * sigma[currentAtom];
-						perturbZ = randn(thread_rng) * sigma[currentAtom];
-						X = round((x[currentAtom] + perturbX) / pars.pixelSize[1]);
-						Y = round((y[currentAtom] + perturbY) / pars.pixelSize[0]);
-						Z = (z[currentAtom] + perturbZ); //z gets rounded and normalized later
-					}
-					else
-					{
-						perturbX = perturbY = perturbZ = 0;
-						X = round((x[currentAtom]) / pars.pixelSize[1]); // this line uses no thermal factor
-						Y = round((y[currentAtom]) / pars.pixelSize[0]); // this line uses no thermal factor
-						Z = (z[currentAtom]); // this line uses no thermal factor, z gets rounded and normalized later
-					}
+					std::ostringstream oss;
+					oss << "Computing atom " << currentAtom << "/" << pars.atoms.size() << std::endl;
+					std::cout << oss.str();
+				}
+				
+				const size_t cur_Z = Z_lookup[ID[currentAtom]];
+				PRISMATIC_FLOAT_PRECISION X, Y, Z;
+				PRISMATIC_FLOAT_PRECISION perturbX, perturbY, perturbZ;
+				if (pars.meta.includeThermalEffects)
+				{ // apply random perturbations
+					perturbX = randn(thread_rng) * sigma[currentAtom];
+					perturbY = randn(thread_rng) * sigma[currentAtom];
+					perturbZ = randn(thread_rng) * sigma[currentAtom];
+					X = round((x[currentAtom] + perturbX) / pars.pixelSize[1]);
+					Y = round((y[currentAtom] + perturbY) / pars.pixelSize[0]);
+					Z = (z[currentAtom] + perturbZ); //z gets rounded and normalized later
+				}
+				else
+				{
+					perturbX = perturbY = perturbZ = 0;
+					X = round((x[currentAtom]) / pars.pixelSize[1]); // this line uses no thermal factor
+					Y = round((y[currentAtom]) / pars.pixelSize[0]); // this line uses no thermal factor
+					Z = (z[currentAtom]); // this line uses no thermal factor, z gets rounded and normalized later
+				}
 
-					PRISMATIC_FLOAT_PRECISION dxPx = (x[currentAtom] + perturbX)/ pars.pixelSize[1] - X;
-					PRISMATIC_FLOAT_PRECISION dyPy = (y[currentAtom] + perturbY)/ pars.pixelSize[0] - Y;
+				PRISMATIC_FLOAT_PRECISION dxPx = (x[currentAtom] + perturbX)/ pars.pixelSize[1] - X;
+				PRISMATIC_FLOAT_PRECISION dyPy = (y[currentAtom] + perturbY)/ pars.pixelSize[0] - Y;
 
-					Array1D<long> xp = xvec + (long) X;
-					Array1D<long> yp = yvec + (long) Y;
+				Array1D<long> xp = xvec + (long) X;
+				Array1D<long> yp = yvec + (long) Y;
 
-					for(auto &i : xp) i = (i % dim1 + dim1) % dim1;
-					for(auto &i : yp) i = (i % dim0 + dim0) % dim0;
-					Array1D<long> zp = zeros_ND<1, long>({{zvec.get_dimi()}});
-					std::vector<long> zVals(zp.size(), 0);
-					for(auto i = 0; i < zp.size(); i++)
-					{
-						PRISMATIC_FLOAT_PRECISION tmp = round((Z+zr[i])/pars.meta.sliceThickness + 0.5)-1;
-						tmp = std::max(tmp, (PRISMATIC_FLOAT_PRECISION) 0.0);
-						zp[i] = std::min((long) tmp, numPlanes-1);
-						zVals[i] = zp[i];
-					}
+				for(auto &i : xp) i = (i % dim1 + dim1) % dim1;
+				for(auto &i : yp) i = (i % dim0 + dim0) % dim0;
+				Array1D<long> zp = zeros_ND<1, long>({{zvec.get_dimi()}});
+				std::vector<long> zVals(zp.size(), 0);
+				for(auto i = 0; i < zp.size(); i++)
+				{
+					PRISMATIC_FLOAT_PRECISION tmp = round((Z+zr[i])/pars.meta.sliceThickness + 0.5)-1;
+					tmp = std::max(tmp, (PRISMATIC_FLOAT_PRECISION) 0.0);
+					zp[i] = std::min((long) tmp, numPlanes-1);
+					zVals[i] = zp[i];
+				}
 
-					std::sort(zVals.begin(), zVals.end());
-					auto last = std::unique(zVals.begin(), zVals.end());
-					zVals.erase(last, zVals.end());
+				std::sort(zVals.begin(), zVals.end());
+				auto last = std::unique(zVals.begin(), zVals.end());
+				zVals.erase(last, zVals.end());
 
-					//iterate through unique z slice values
-					for(auto cz_ind = 0; cz_ind < zVals.size(); cz_ind++)
-					{
-						
-						//create tmp array to add potential lookup table to
-						Array2D<std::complex<PRISMATIC_FLOAT_PRECISION>> tmp_pot = zeros_ND<2, std::complex<PRISMATIC_FLOAT_PRECISION>>({{yp.size(), xp.size()}});
+				//iterate through unique z slice values
+				for(auto cz_ind = 0; cz_ind < zVals.size(); cz_ind++)
+				{
+					
+					//create tmp array to add potential lookup table to
+					Array2D<std::complex<PRISMATIC_FLOAT_PRECISION>> tmp_pot = zeros_ND<2, std::complex<PRISMATIC_FLOAT_PRECISION>>({{yp.size(), xp.size()}});
 
-						for(auto kk = 0; kk < zp.size(); kk++)
+					for(auto kk = 0; kk < zp.size(); kk++)
+					{
+						if(zp[kk] == zVals[cz_ind])
 						{
-							if(zp[kk] == zVals[cz_ind])
+							for(auto jj = 0; jj < yp.size(); jj++)
 							{
-								for(auto jj = 0; jj < yp.size(); jj++)
+								for(auto ii = 0; ii < xp.size(); ii++)
 								{
-									for(auto ii = 0; ii < xp.size(); ii++)
-									{
-										tmp_pot.at(jj,ii) += potLookup.at(cur_Z, kk,jj,ii);
-									}
+									tmp_pot.at(jj,ii) += potLookup.at(cur_Z, kk,jj,ii);
 								}
 							}
 						}
+					}
 
-						//apply fourier shift and qband limit
-						for(auto jj = 0; jj < yp.size(); jj++)
+					//apply fourier shift and qband limit
+					for(auto jj = 0; jj < yp.size(); jj++)
+					{
+						for(auto ii = 0; ii < xp.size(); ii++)
 						{
-							for(auto ii = 0; ii < xp.size(); ii++)
-							{
-								tmp_pot.at(jj,ii) *= qband.at(jj,ii) * exp(qxShift.at(jj,ii)*dxPx + qyShift.at(jj,ii)*dyPy);
-							}
+							tmp_pot.at(jj,ii) *= qband.at(jj,ii) * exp(qxShift.at(jj,ii)*dxPx + qyShift.at(jj,ii)*dyPy);
 						}
+					}
+
+					//inverse FFT and normalize by size of array
+					FFTPlan plan_inverse = planFFT2D(tmp_pot.get_dimj(), tmp_pot.get_dimi(), &tmp_pot[0], &tmp_pot[0],
+													 FFTDirection::Inverse, policy.fftThreads);
+					plan_inverse.execute();
+					for(auto &t : tmp_pot) t /= tmp_pot.get_dimi()*tmp_pot.get_dimj();
 
-						//inverse FFT and normalize by size of array
-						unique_lock<mutex> gatekeeper(fftw_plan_lock);
-						PRISMATIC_FFTW_PLAN plan_inverse = PRISMATIC_FFTW_PLAN_DFT_2D(tmp_pot.get_dimj(), tmp_pot.get_dimi(),
-																				reinterpret_cast<PRISMATIC_FFTW_COMPLEX *>(&tmp_pot[0]),
-																				reinterpret_cast<PRISMATIC_FFTW_COMPLEX *>(&tmp_pot[0]),
-																				FFTW_BACKWARD,
-																				FFTW_ESTIMATE);
-						gatekeeper.unlock();
-						PRISMATIC_FFTW_EXECUTE(plan_inverse);
-						gatekeeper.lock();
-						PRISMATIC_FFTW_DESTROY_PLAN(plan_inverse);
-						gatekeeper.unlock();
-						for(auto &t : tmp_pot) t /= tmp_pot.get_dimi()*tmp_pot.get_dimj();
-
-						//apply realspace band limit
-						for(auto i = 0; i < tmp_pot.size(); i++) tmp_pot[i] *= rband[i];
-
-						//then write
-						//put into a mutex lock to prevent race condition on potential writing when atoms overlap within potential bound
-						std::unique_lock<std::mutex> write_gatekeeper(potentialWriteLock);
-						for(auto jj = 0; jj < yp.size(); jj++)
+					//apply realspace band limit
+					for(auto i = 0; i < tmp_pot.size(); i++) tmp_pot[i] *= rband[i];
+
+					//then write
+					//put into a mutex lock to prevent race condition on potential writing when atoms overlap within potential bound
+					std::unique_lock<std::mutex> write_gatekeeper = profiledLock(potentialWriteLock, "potentialWriteLock");
+					for(auto jj = 0; jj < yp.size(); jj++)
+					{
+						for(auto ii = 0; ii < xp.size(); ii++)
 						{
-							for(auto ii = 0; ii < xp.size(); ii++)
-							{
-								pars.pot.at(zVals[cz_ind],yp[jj],xp[ii]) += tmp_pot.at(jj,ii).real();
-							}
+							pars.pot.at(zVals[cz_ind],yp[jj],xp[ii]) += tmp_pot.at(jj,ii).real();
 						}
-						write_gatekeeper.unlock();
 					}
-					++currentAtom;
+					write_gatekeeper.unlock();
 				}
+				++currentAtom;
 			}
-		}));
-	}
-	std::cout << "Waiting for threads...\n";
-	for (auto &t : workers)
-		t.join();
-
-	PRISMATIC_FFTW_CLEANUP_THREADS();
+		}
+	});
 };
 
 void PRISM01_calcPotential(Parameters<PRISMATIC_FLOAT_PRECISION> &pars)
 {
+	ScopedTimer timer("PRISM01_calcPotential");
 	//builds projected, sliced potential
 	
-	// setup some coordinates
 	cout << "Entering PRISM01_calcPotential" << endl;
+	if (pars.meta.stageCache && pars.meta.stageCache->restorePotential(pars))
+	{
+		cout << "Reusing projected potential of an earlier run" << endl;
+		if (pars.meta.savePotentialSlices)
+		{
+			std::cout << "Writing potential slices to output file." << std::endl;
+			savePotentialSlices(pars);
+		}
+		return;
+	}
+
+	// setup some coordinates
 	PRISMATIC_FLOAT_PRECISION yleng = std::ceil(pars.meta.potBound / pars.pixelSize[0]);
 	PRISMATIC_FLOAT_PRECISION xleng = std::ceil(pars.meta.potBound / pars.pixelSize[1]);
 	ArrayND<1, vector<long>> xvec(vector<long>(2 * (size_t)xleng + 1, 0), {{2 * (size_t)xleng + 1}});
@@ -636,6 +618,12 @@ void PRISM01_calcPotential(Parameters<PRISMATIC_FLOAT_PRECISION> &pars)
 		addExtraPotential(pars);
 	}
 
+	// a cancelled run leaves slices unfilled, which must not be kept for later runs
+	if (pars.meta.progress)
+		pars.meta.progress->checkCancelled();
+	if (pars.meta.stageCache)
+		pars.meta.stageCache->storePotential(pars);
+
 	if (pars.meta.savePotentialSlices) 
 	{
 		std::cout << "Writing potential slices to output file." << std::endl;
@@ -645,32 +633,15 @@ void PRISM01_calcPotential(Parameters<PRISMATIC_FLOAT_PRECISION> &pars)
 
 void PRISM01_importPotential(Parameters<PRISMATIC_FLOAT_PRECISION> &pars)
 {
+	ScopedTimer timer("PRISM01_importPotential");
 	std::cout << "Setting up PRISM01 auxilary variables according to " << pars.meta.importFile << " metadata." << std::endl;
-	//scope out imported tmp_pot as soon as possible
+	//read straight into the potential array, through a view with the dimensions (k, j, i) reversed
 	{
-		Array3D<PRISMATIC_FLOAT_PRECISION> tmp_pot;
-		if(pars.meta.importPath.size() > 0)
-		{
-			readRealDataSet_inOrder(tmp_pot, pars.meta.importFile, pars.meta.importPath);
-		}
-		else //read default path
-		{
-			std::string groupPath = "4DSTEM_simulation/data/realslices/ppotential_fp" + getDigitString(pars.fpFlag) + "/data";
-			readRealDataSet_inOrder(tmp_pot, pars.meta.importFile, groupPath);
-		}
-
-		//initailize array and get data in right order
-		pars.pot = zeros_ND<3, PRISMATIC_FLOAT_PRECISION>({{tmp_pot.get_dimi(), tmp_pot.get_dimj(), tmp_pot.get_dimk()}});  // the dimensions (k, j, i) are reversed here
-		for(auto i = 0; i < tmp_pot.get_dimi(); i++)
-		{
-			for(auto j = 0; j < tmp_pot.get_dimj(); j++)
-			{
-				for(auto k = 0; k < tmp_pot.get_dimk(); k++)
-				{
-					pars.pot.at(i,j,k) = tmp_pot.at(k,j,i);
-				}
-			}
-		}
+		std::string dataPath = pars.meta.importPath.size() > 0 ? pars.meta.importPath
+									: "4DSTEM_simulation/data/realslices/ppotential_fp" + getDigitString(pars.fpFlag) + "/data"; //default path
+		std::vector<size_t> dims = readDataSetDims(pars.meta.importFile, dataPath);
+		pars.pot = zeros_ND<3, PRISMATIC_FLOAT_PRECISION>({{dims[2], dims[1], dims[0]}});
+		readRealDataSet_inOrder(view(pars.pot).permute({{2, 1, 0}}), pars.meta.importFile, dataPath);
 	}
 
 	pars.numPlanes = pars.pot.get_dimk();
@@ -718,12 +689,11 @@ void PRISM01_importPotential(Parameters<PRISMATIC_FLOAT_PRECISION> &pars)
 };
 
 void addExtraPotential(Parameters<PRISMATIC_FLOAT_PRECISION>& pars) {
-	Array3D<PRISMATIC_FLOAT_PRECISION> imported_slices;
+	Array3D<PRISMATIC_FLOAT_PRECISION> tmp_pot;
 	Array1D<PRISMATIC_FLOAT_PRECISION> z_imported;
+	PRISMATIC_FLOAT_PRECISION pot_factor = 0.0;
 
-	//scope out imported tmp_pot as soon as possible
 	{
-		Array3D<PRISMATIC_FLOAT_PRECISION> tmp_pot;
 		if (pars.meta.importPath.size() > 0)
 		{
 			readRealDataSet_inOrder(tmp_pot, pars.meta.importFile, pars.meta.importPath + "/data");
@@ -748,7 +718,6 @@ void addExtraPotential(Parameters<PRISMATIC_FLOAT_PRECISION>& pars) {
 			throw std::runtime_error("Wrong number of z coordinates provided.\n");
 		}
 
-		PRISMATIC_FLOAT_PRECISION pot_factor = 0.0;
 		if (pars.meta.extraPotentialType == ExtraPotentialType::Angle) {
 			pot_factor = pars.meta.extraPotentialFactor / pars.sigma;
 		}
@@ -758,21 +727,11 @@ void addExtraPotential(Parameters<PRISMATIC_FLOAT_PRECISION>& pars) {
 		else {
 			throw std::runtime_error("Invalid ExtraPotentialType");
 		}
-
-		//initailize array and get data in right order
-		imported_slices = zeros_ND<3, PRISMATIC_FLOAT_PRECISION>({ {tmp_pot.get_dimi(), tmp_pot.get_dimj(), tmp_pot.get_dimk()} });  // the dimensions (k, j, i) are reversed here
-		for (auto i = 0; i < tmp_pot.get_dimi(); i++)
-		{
-			for (auto j = 0; j < tmp_pot.get_dimj(); j++)
-			{
-				for (auto k = 0; k < tmp_pot.get_dimk(); k++)
-				{
-					imported_slices.at(i, j, k) = tmp_pot.at(k, j, i) * pot_factor;
-				}
-			}
-		}
 	}
 
+	//read the imported slices through a transposed view instead of restriding a copy
+	ArrayView<3, PRISMATIC_FLOAT_PRECISION> imported_slices = view(tmp_pot).permute({{2, 1, 0}});  // the dimensions (k, j, i) are reversed here
+
 	//std::cout << pars.meta.cellDim[0] << " " << pars.tiledCellDim[0] << " " << pars.meta.sliceThickness << std::endl;
 
 	std::transform(z_imported.begin(), z_imported.end(), z_imported.begin(), [&pars](PRISMATIC_FLOAT_PRECISION& t_z) {
@@ -815,7 +774,7 @@ void addExtraPotential(Parameters<PRISMATIC_FLOAT_PRECISION>& pars) {
 				std::cout << from_slice << " -> " << to_slice << std::endl;
 				for (auto jj = 0; jj < pars.pot.get_dimj(); ++jj) {
 					for (auto ii = 0; ii < pars.pot.get_dimi(); ++ii) {
-						pars.pot.at(to_slice, jj, ii) += imported_slices.at(from_slice, jj, ii);
+						pars.pot.at(to_slice, jj, ii) += imported_slices.at(from_slice, jj, ii) * pot_factor;
 					}
 				}
 			}
@@ -843,22 +802,10 @@ void fourierResampling(Parameters<PRISMATIC_FLOAT_PRECISION> &pars)
 	Array2D<complex<PRISMATIC_FLOAT_PRECISION>> bpot = zeros_ND<2,complex<PRISMATIC_FLOAT_PRECISION>>({{(size_t)Nj,(size_t) Ni}});
 	
 	//create FFT plans 
-	PRISMATIC_FFTW_INIT_THREADS();
-	PRISMATIC_FFTW_PLAN_WITH_NTHREADS(pars.meta.numThreads);
-	
-	unique_lock<mutex> gatekeeper(fftw_plan_lock);
-	PRISMATIC_FFTW_PLAN plan_forward = PRISMATIC_FFTW_PLAN_DFT_2D(fstore.get_dimj(), fstore.get_dimi(),
-															reinterpret_cast<PRISMATIC_FFTW_COMPLEX *>(&fpot[0]),
-															reinterpret_cast<PRISMATIC_FFTW_COMPLEX *>(&fstore[0]),
-															FFTW_FORWARD,
-															FFTW_ESTIMATE);
-
-	PRISMATIC_FFTW_PLAN plan_inverse = PRISMATIC_FFTW_PLAN_DFT_2D(bstore.get_dimj(), bstore.get_dimi(),
-															reinterpret_cast<PRISMATIC_FFTW_COMPLEX *>(&bstore[0]),
-															reinterpret_cast<PRISMATIC_FFTW_COMPLEX *>(&bpot[0]),
-															FFTW_BACKWARD,
-															FFTW_ESTIMATE);
-	gatekeeper.unlock();
+	//slices are resampled one after another, so the threads go to the FFTs
+	const ExecutionPolicy policy = chooseExecutionPolicy(pars.meta.numThreads, 1, fstore.size());
+	FFTPlan plan_forward = planFFT2D(fstore.get_dimj(), fstore.get_dimi(), &fpot[0], &fstore[0], FFTDirection::Forward, policy.fftThreads);
+	FFTPlan plan_inverse = planFFT2D(bstore.get_dimj(), bstore.get_dimi(), &bstore[0], &bpot[0], FFTDirection::Inverse, policy.fftThreads);
 
 	//calculate indices for downsampling in fourier space
 	int nyqi = std::floor(Ni/2) + 1;
@@ -870,7 +817,7 @@ void fourierResampling(Parameters<PRISMATIC_FLOAT_PRECISION> &pars)
 		for(auto i = 0; i < fpot.size(); i++) fpot[i] = pars.pot[k*pars.pot.get_dimj()*pars.pot.get_dimi()+i];
 		
 		//forward transform 
-		PRISMATIC_FFTW_EXECUTE(plan_forward);
+		plan_forward.execute();
 
 		//copy relevant quadrants to backward store
 		//manual looping through quadrants
@@ -907,7 +854,7 @@ void fourierResampling(Parameters<PRISMATIC_FLOAT_PRECISION> &pars)
 		}
 
 		//inverse transform
-		PRISMATIC_FFTW_EXECUTE(plan_inverse);
+		plan_inverse.execute();
 
 		//store slice in potential
 		for(auto i = 0; i < bpot.size(); i++) newPot[k*newPot.get_dimj()*newPot.get_dimi()+i] = bpot[i].real();
@@ -16,13 +16,18 @@
 #include <iostream>
 #include <vector>
 #include <thread>
-#include "fftw3.h"
+#include "FFTBackend.h"
 #include <mutex>
 #include "ArrayND.h"
+#include "ArrayView.h"
 #include <complex>
 #include "utility.h"
 #include "configure.h"
 #include "WorkDispatcher.h"
+#include "ThreadPool.h"
+#include "ExecutionPolicy.h"
+#include "Autotuner.h"
+#include "Instrumentation.h"
 #include "fileIO.h"
 #ifdef PRISMATIC_BUILDING_GUI
 #include "prism_progressbar.h"
@@ -288,6 +293,7 @@ inline void setupSMatrixCoordinates(Parameters<PRISMATIC_FLOAT_PRECISION> &pars)
 
 inline void downsampleFourierComponents(Parameters<PRISMATIC_FLOAT_PRECISION> &pars)
 {
+	ScopedTimer timer("downsampleFourierComponents");
 	// downsample Fourier components to only keep relevant/nonzero values
 	pars.imageSizeOutput = pars.imageSize;
 	pars.imageSizeOutput[0] /= 2;
@@ -315,15 +321,14 @@ inline void downsampleFourierComponents(Parameters<PRISMATIC_FLOAT_PRECISION> &p
 void propagatePlaneWave_CPU(Parameters<PRISMATIC_FLOAT_PRECISION> &pars,
 							size_t currentBeam,
 							Array2D<complex<PRISMATIC_FLOAT_PRECISION>> &psi,
-							const PRISMATIC_FFTW_PLAN &plan_forward,
-							const PRISMATIC_FFTW_PLAN &plan_inverse,
-							mutex &fftw_plan_lock)
+							const FFTPlan &plan_forward,
+							const FFTPlan &plan_inverse)
 {
 	// propagates a single plan wave and fills in the corresponding section of compact S-matrix, very similar to multislice
 
 	psi[pars.beamsIndex[currentBeam]] = 1;
 	const PRISMATIC_FLOAT_PRECISION slice_size = (PRISMATIC_FLOAT_PRECISION)psi.size();
-	PRISMATIC_FFTW_EXECUTE(plan_inverse);
+	plan_inverse.execute();
 	for (auto &i : psi)
 		i /= slice_size;													   // fftw scales by N, need to correct
 	const complex<PRISMATIC_FLOAT_PRECISION> *trans_t = &pars.transmission[0]; // pointer to beginning of the transmission array
@@ -331,25 +336,20 @@ void propagatePlaneWave_CPU(Parameters<PRISMATIC_FLOAT_PRECISION> &pars,
 	{
 		for (auto &p : psi)
 			p *= (*trans_t++);				  // transmit
-		PRISMATIC_FFTW_EXECUTE(plan_forward); // FFT
+		plan_forward.execute(); // FFT
 		for (auto i = psi.begin(), j = pars.prop.begin(); i != psi.end(); ++i, ++j)
 			*i *= (*j);						  // propagate
-		PRISMATIC_FFTW_EXECUTE(plan_inverse); // IFFT
+		plan_inverse.execute(); // IFFT
 		for (auto &i : psi)
 			i /= slice_size; // fftw scales by N, need to correct
 	}
-	PRISMATIC_FFTW_EXECUTE(plan_forward); // final FFT to get result at detector plane
+	plan_forward.execute(); // final FFT to get result at detector plane
 
 	// only keep the necessary plane waves
 	Array2D<complex<PRISMATIC_FLOAT_PRECISION>> psi_small = zeros_ND<2, complex<PRISMATIC_FLOAT_PRECISION>>(
 		{{pars.qyInd.size(), pars.qxInd.size()}});
 
-	unique_lock<mutex> gatekeeper(fftw_plan_lock);
-	PRISMATIC_FFTW_PLAN plan_final = PRISMATIC_FFTW_PLAN_DFT_2D(psi_small.get_dimj(), psi_small.get_dimi(),
-																reinterpret_cast<PRISMATIC_FFTW_COMPLEX *>(&psi_small[0]),
-																reinterpret_cast<PRISMATIC_FFTW_COMPLEX *>(&psi_small[0]),
-																FFTW_BACKWARD, FFTW_ESTIMATE);
-	gatekeeper.unlock();
+	FFTPlan plan_final = planFFT2D(psi_small.get_dimj(), psi_small.get_dimi(), &psi_small[0], &psi_small[0], FFTDirection::Inverse);
 	for (auto y = 0; y < pars.qyInd.size(); ++y)
 	{
 		for (auto x = 0; x < pars.qxInd.size(); ++x)
@@ -359,10 +359,7 @@ void propagatePlaneWave_CPU(Parameters<PRISMATIC_FLOAT_PRECISION> &pars,
 	}
 
 	// final FFT to get the cropped plane wave result in real space
-	PRISMATIC_FFTW_EXECUTE(plan_final);
-	gatekeeper.lock();
-	PRISMATIC_FFTW_DESTROY_PLAN(plan_final);
-	gatekeeper.unlock();
+	plan_final.execute();
 
 	// insert the cropped/propagated plane wave into the relevant slice of the compact S-matrix
 	complex<PRISMATIC_FLOAT_PRECISION> *S_t = &pars.Scompact[currentBeam * pars.Scompact.get_dimj() * pars.Scompact.get_dimi()];
@@ -377,9 +374,8 @@ void propagatePlaneWave_CPU_batch(Parameters<PRISMATIC_FLOAT_PRECISION> &pars,
 								  size_t currentBeam,
 								  size_t stopBeam,
 								  Array1D<complex<PRISMATIC_FLOAT_PRECISION>> &psi_stack,
-								  const PRISMATIC_FFTW_PLAN &plan_forward,
-								  const PRISMATIC_FFTW_PLAN &plan_inverse,
-								  mutex &fftw_plan_lock)
+								  const FFTPlan &plan_forward,
+								  const FFTPlan &plan_inverse)
 {
 	// propagates a batch of plane waves and fills in the corresponding sections of compact S-matrix
 	const size_t slice_size = pars.imageSize[0] * pars.imageSize[1];
@@ -393,7 +389,7 @@ void propagatePlaneWave_CPU_batch(Parameters<PRISMATIC_FLOAT_PRECISION> &pars,
 		}
 	}
 
-	PRISMATIC_FFTW_EXECUTE(plan_inverse);
+	plan_inverse.execute();
 	for (auto &i : psi_stack)
 		i /= slice_size_f; // fftw scales by N, need to correct
 	complex<PRISMATIC_FLOAT_PRECISION> *slice_ptr = &pars.transmission[0];
@@ -409,8 +405,8 @@ void propagatePlaneWave_CPU_batch(Parameters<PRISMATIC_FLOAT_PRECISION> &pars,
 				*psi_ptr++ *= (*t_ptr++); // transmit
 			}
 		}
-		slice_ptr += slice_size;			  // advance to point to the beginning of the next potential slice
-		PRISMATIC_FFTW_EXECUTE(plan_forward); // FFT
+		slice_ptr += slice_size; // advance to point to the beginning of the next potential slice
+		plan_forward.execute();	 // FFT
 
 		// propagate each of the probes in the batch
 		for (auto batch_idx = 0; batch_idx < min(pars.meta.batchSizeCPU, stopBeam - currentBeam); ++batch_idx)
@@ -422,11 +418,11 @@ void propagatePlaneWave_CPU_batch(Parameters<PRISMATIC_FLOAT_PRECISION> &pars,
 				*psi_ptr++ *= (*p_ptr++); // propagate
 			}
 		}
-		PRISMATIC_FFTW_EXECUTE(plan_inverse); // IFFT
+		plan_inverse.execute(); // IFFT
 		for (auto &i : psi_stack)
 			i /= slice_size_f; // fftw scales by N, need to correct
 	}
-	PRISMATIC_FFTW_EXECUTE(plan_forward);
+	plan_forward.execute();
 
 	// only keep the necessary plane waves
 
@@ -447,12 +443,7 @@ void propagatePlaneWave_CPU_batch(Parameters<PRISMATIC_FLOAT_PRECISION> &pars,
 	Array2D<complex<PRISMATIC_FLOAT_PRECISION>> psi_small = zeros_ND<2, complex<PRISMATIC_FLOAT_PRECISION>>(
 		{{pars.qyInd.size(), pars.qxInd.size()}});
 	const PRISMATIC_FLOAT_PRECISION N_small = (PRISMATIC_FLOAT_PRECISION)psi_small.size();
-	unique_lock<mutex> gatekeeper(fftw_plan_lock);
-	PRISMATIC_FFTW_PLAN plan_final = PRISMATIC_FFTW_PLAN_DFT_2D(psi_small.get_dimj(), psi_small.get_dimi(),
-																reinterpret_cast<PRISMATIC_FFTW_COMPLEX *>(&psi_small[0]),
-																reinterpret_cast<PRISMATIC_FFTW_COMPLEX *>(&psi_small[0]),
-																FFTW_BACKWARD, FFTW_ESTIMATE);
-	gatekeeper.unlock();
+	FFTPlan plan_final = planFFT2D(psi_small.get_dimj(), psi_small.get_dimi(), &psi_small[0], &psi_small[0], FFTDirection::Inverse);
 	int batch_idx = 0;
 	while (currentBeam < stopBeam)
 	{
@@ -463,7 +454,7 @@ void propagatePlaneWave_CPU_batch(Parameters<PRISMATIC_FLOAT_PRECISION> &pars,
 				psi_small.at(y, x) = psi_stack[batch_idx * slice_size + pars.qyInd[y] * pars.imageSize[1] + pars.qxInd[x]];
 			}
 		}
-		PRISMATIC_FFTW_EXECUTE(plan_final);
+		plan_final.execute();
 		complex<PRISMATIC_FLOAT_PRECISION> *S_t = &pars.Scompact[currentBeam * pars.Scompact.get_dimj() * pars.Scompact.get_dimi()];
 		for (auto &jj : psi_small)
 		{
@@ -472,17 +463,13 @@ void propagatePlaneWave_CPU_batch(Parameters<PRISMATIC_FLOAT_PRECISION> &pars,
 		++currentBeam;
 		++batch_idx;
 	}
-	gatekeeper.lock();
-	PRISMATIC_FFTW_DESTROY_PLAN(plan_final);
-	gatekeeper.unlock();
 }
 
 void fill_Scompact_CPUOnly(Parameters<PRISMATIC_FLOAT_PRECISION> &pars)
 {
+	ScopedTimer timer("fill_Scompact_CPUOnly");
 	// populates the compact S-matrix using CPU resources
 
-	extern mutex fftw_plan_lock; // lock for protecting FFTW plans
-
 	// initialize arrays
 	pars.Scompact = zeros_ND<3, complex<PRISMATIC_FLOAT_PRECISION>>(
 		{{pars.numberBeams, pars.imageSize[0] / 2, pars.imageSize[1] / 2}});
@@ -495,103 +482,67 @@ void fill_Scompact_CPUOnly(Parameters<PRISMATIC_FLOAT_PRECISION> &pars)
 	}
 
 	// prepare to launch the calculation
-	vector<thread> workers;
-	workers.reserve(pars.meta.numThreads);												  // prevents multiple reallocations
 	const size_t PRISMATIC_PRINT_FREQUENCY_BEAMS = max((size_t)1, pars.numberBeams / 10); // for printing status
-	WorkDispatcher dispatcher(0, pars.numberBeams);
-	pars.meta.batchSizeCPU = min(pars.meta.batchSizeTargetCPU, max((size_t)1, pars.numberBeams / pars.meta.numThreads));
-
-	// initialize FFTW threads
-	PRISMATIC_FFTW_INIT_THREADS();
-	PRISMATIC_FFTW_PLAN_WITH_NTHREADS(pars.meta.numThreads);
-	for (auto t = 0; t < pars.meta.numThreads; ++t)
-	{
-		cout << "Launching thread #" << t << " to compute beams\n";
-		workers.push_back(thread([&pars, &dispatcher, &PRISMATIC_PRINT_FREQUENCY_BEAMS]() {
-			// allocate array for psi just once per thread
-			//				Array2D<complex<PRISMATIC_FLOAT_PRECISION> > psi = zeros_ND<2, complex<PRISMATIC_FLOAT_PRECISION> >(
-			//						{{pars.imageSize[0], pars.imageSize[1]}});
-			size_t currentBeam, stopBeam;
-			currentBeam = stopBeam = 0;
-			if (dispatcher.getWork(currentBeam, stopBeam, pars.meta.batchSizeCPU))
-			{
-				Array1D<complex<PRISMATIC_FLOAT_PRECISION>> psi_stack = zeros_ND<1, complex<PRISMATIC_FLOAT_PRECISION>>(
-					{{pars.imageSize[0] * pars.imageSize[1] * pars.meta.batchSizeCPU}});
-				//				PRISMATIC_FFTW_PLAN plan_forward = PRISMATIC_FFTW_PLAN_DFT_2D(psi.get_dimj(), psi.get_dimi(),
-				//				                                                      reinterpret_cast<PRISMATIC_FFTW_COMPLEX *>(&psi[0]),
-				//				                                                      reinterpret_cast<PRISMATIC_FFTW_COMPLEX *>(&psi[0]),
-				//				                                                      FFTW_FORWARD, FFTW_MEASURE);
-				//				PRISMATIC_FFTW_PLAN plan_inverse = PRISMATIC_FFTW_PLAN_DFT_2D(psi.get_dimj(), psi.get_dimi(),
-				//				                                                      reinterpret_cast<PRISMATIC_FFTW_COMPLEX *>(&psi[0]),
-				//				                                                      reinterpret_cast<PRISMATIC_FFTW_COMPLEX *>(&psi[0]),
-				//				                                                      FFTW_BACKWARD, FFTW_MEASURE);
-
-				// setup batch FFTW parameters
-				const int rank = 2;
-				int n[] = {(int)pars.imageSize[0], (int)pars.imageSize[1]};
-				const int howmany = pars.meta.batchSizeCPU;
-				int idist = n[0] * n[1];
-				int odist = n[0] * n[1];
-				int istride = 1;
-				int ostride = 1;
-				int *inembed = n;
-				int *onembed = n;
-
-				unique_lock<mutex> gatekeeper(fftw_plan_lock);
-				PRISMATIC_FFTW_PLAN plan_forward = PRISMATIC_FFTW_PLAN_DFT_BATCH(rank, n, howmany,
-																				 reinterpret_cast<PRISMATIC_FFTW_COMPLEX *>(&psi_stack[0]),
-																				 inembed,
-																				 istride, idist,
-																				 reinterpret_cast<PRISMATIC_FFTW_COMPLEX *>(&psi_stack[0]),
-																				 onembed,
-																				 ostride, odist,
-																				 FFTW_FORWARD, FFTW_MEASURE);
-				PRISMATIC_FFTW_PLAN plan_inverse = PRISMATIC_FFTW_PLAN_DFT_BATCH(rank, n, howmany,
-																				 reinterpret_cast<PRISMATIC_FFTW_COMPLEX *>(&psi_stack[0]),
-																				 inembed,
-																				 istride, idist,
-																				 reinterpret_cast<PRISMATIC_FFTW_COMPLEX *>(&psi_stack[0]),
-																				 onembed,
-																				 ostride, odist,
-																				 FFTW_BACKWARD, FFTW_MEASURE);
-				gatekeeper.unlock(); // unlock it so we only block as long as necessary to deal with plans
-
-				// main work loop
-				do
-				{ // synchronously get work assignment
-					while (currentBeam < stopBeam)
+	WorkDispatcher dispatcher(0, pars.numberBeams, pars.meta.progress.get(), "plane waves");
+	ExecutionPolicy policy = chooseExecutionPolicy(pars.meta.numThreads, pars.numberBeams, pars.imageSize[0] * pars.imageSize[1], pars.meta.maxWorkerThreads);
+	pars.meta.batchSizeCPU = min(pars.meta.batchSizeTargetCPU, max((size_t)1, pars.numberBeams / policy.outerThreads));
+	if (pars.meta.autotune)
+		autotuneBatch(pars.meta, pars.imageSize[0], pars.imageSize[1], pars.numberBeams, policy, pars.meta.batchSizeCPU);
+
+	cout << "Running " << policy.outerThreads << " worker threads with " << policy.fftThreads << " FFT threads each to compute beams\n";
+	ThreadPool::instance().run(policy.outerThreads, [&pars, &dispatcher, &policy, &PRISMATIC_PRINT_FREQUENCY_BEAMS](size_t) {
+		// allocate array for psi just once per thread
+		//				Array2D<complex<PRISMATIC_FLOAT_PRECISION> > psi = zeros_ND<2, complex<PRISMATIC_FLOAT_PRECISION> >(
+		//						{{pars.imageSize[0], pars.imageSize[1]}});
+		size_t currentBeam, stopBeam;
+		currentBeam = stopBeam = 0;
+		if (dispatcher.getWork(currentBeam, stopBeam, pars.meta.batchSizeCPU))
+		{
+			Array1D<complex<PRISMATIC_FLOAT_PRECISION>> psi_stack = zeros_ND<1, complex<PRISMATIC_FLOAT_PRECISION>>(
+				{{pars.imageSize[0] * pars.imageSize[1] * pars.meta.batchSizeCPU}});
+			//				PRISMATIC_FFTW_PLAN plan_forward = PRISMATIC_FFTW_PLAN_DFT_2D(psi.get_dimj(), psi.get_dimi(),
+			//				                                                      reinterpret_cast<PRISMATIC_FFTW_COMPLEX *>(&psi[0]),
+			//				                                                      reinterpret_cast<PRISMATIC_FFTW_COMPLEX *>(&psi[0]),
+			//				                                                      FFTW_FORWARD, FFTW_MEASURE);
+			//				PRISMATIC_FFTW_PLAN plan_inverse = PRISMATIC_FFTW_PLAN_DFT_2D(psi.get_dimj(), psi.get_dimi(),
+			//				                                                      reinterpret_cast<PRISMATIC_FFTW_COMPLEX *>(&psi[0]),
+			//				                                                      reinterpret_cast<PRISMATIC_FFTW_COMPLEX *>(&psi[0]),
+			//				                                                      FFTW_BACKWARD, FFTW_MEASURE);
+
+			// batched plans; workers with the same batch size share them through the plan cache
+			FFTPlan plan_forward = planFFT2D(pars.imageSize[0], pars.imageSize[1], &psi_stack[0], &psi_stack[0], FFTDirection::Forward,
+											 policy.fftThreads, FFTEffort::Measure, pars.meta.batchSizeCPU);
+			FFTPlan plan_inverse = planFFT2D(pars.imageSize[0], pars.imageSize[1], &psi_stack[0], &psi_stack[0], FFTDirection::Inverse,
+											 policy.fftThreads, FFTEffort::Measure, pars.meta.batchSizeCPU);
+
+			// main work loop
+			do
+			{ // synchronously get work assignment
+				while (currentBeam < stopBeam)
+				{
+					if (currentBeam % PRISMATIC_PRINT_FREQUENCY_BEAMS < pars.meta.batchSizeCPU |
+						currentBeam == 100)
 					{
-						if (currentBeam % PRISMATIC_PRINT_FREQUENCY_BEAMS < pars.meta.batchSizeCPU |
-							currentBeam == 100)
-						{
-							cout << "Computing Plane Wave #" << currentBeam << "/" << pars.numberBeams << endl;
-						}
-
-						// re-zero psi each iteration
-						memset((void *)&psi_stack[0], 0,
-							   psi_stack.size() * sizeof(complex<PRISMATIC_FLOAT_PRECISION>));
-						//							propagatePlaneWave_CPU(pars, currentBeam, psi, plan_forward, plan_inverse, fftw_plan_lock);
-						propagatePlaneWave_CPU_batch(pars, currentBeam, stopBeam, psi_stack, plan_forward,
-													 plan_inverse, fftw_plan_lock);
+						cout << "Computing Plane Wave #" << currentBeam << "/" << pars.numberBeams << endl;
+					}
+
+					// re-zero psi each iteration
+					memset((void *)&psi_stack[0], 0,
+						   psi_stack.size() * sizeof(complex<PRISMATIC_FLOAT_PRECISION>));
+					//							propagatePlaneWave_CPU(pars, currentBeam, psi, plan_forward, plan_inverse);
+					propagatePlaneWave_CPU_batch(pars, currentBeam, stopBeam, psi_stack, plan_forward, plan_inverse);
 #ifdef PRISMATIC_BUILDING_GUI
-						pars.progressbar->signalScompactUpdate(currentBeam, pars.numberBeams);
+					pars.progressbar->signalScompactUpdate(currentBeam, pars.numberBeams);
 #endif
-						currentBeam = stopBeam;
-					}
-				} while (dispatcher.getWork(currentBeam, stopBeam, pars.meta.batchSizeCPU));
+					currentBeam = stopBeam;
+				}
+			} while (dispatcher.getWork(currentBeam, stopBeam, pars.meta.batchSizeCPU));
+		}
+	});
 
-				// clean up plans
-				gatekeeper.lock();
-				PRISMATIC_FFTW_DESTROY_PLAN(plan_forward);
-				PRISMATIC_FFTW_DESTROY_PLAN(plan_inverse);
-				gatekeeper.unlock();
-			}
-		}));
-	}
-	cout << "Waiting for threads...\n";
-	for (auto &t : workers)
-		t.join();
-	PRISMATIC_FFTW_CLEANUP_THREADS();
+	// per beam and plane: two FFTs, transmission and propagator products
+	const double N = pars.imageSize[0] * pars.imageSize[1];
+	Profiler::instance().addFlops("fill_Scompact_CPUOnly", (double)pars.numberBeams * pars.numPlanes * (2 * fftFlops(N) + 12 * N));
 #ifdef PRISMATIC_BUILDING_GUI
 	pars.progressbar->setProgress(100);
 	pars.progressbar->signalCalcStatusMessage(QString("Plane Wave ") +
@@ -601,10 +552,56 @@ void fill_Scompact_CPUOnly(Parameters<PRISMATIC_FLOAT_PRECISION> &pars)
 #endif //PRISMATIC_BUILDING_GUI
 }
 
-void refocus(Parameters<PRISMATIC_FLOAT_PRECISION> &pars)
+void filterSMatrix_batch(Parameters<PRISMATIC_FLOAT_PRECISION> &pars,
+						 const Array2D<std::complex<PRISMATIC_FLOAT_PRECISION>> &filter)
 {
-	extern mutex fftw_plan_lock;  // lock for protecting FFTW plans
+	// multiply every beam of the compact S-matrix by filter in Fourier space, in place.
+	// each thread transforms a contiguous block of beams with a single batched plan
+
+	const size_t numBeams = pars.Scompact.get_dimk();
+	const size_t dimj = pars.Scompact.get_dimj();
+	const size_t dimi = pars.Scompact.get_dimi();
+	const size_t planeSize = dimj * dimi;
+	const ExecutionPolicy policy = chooseExecutionPolicy(pars.meta.numThreads, numBeams, planeSize);
+	const size_t blockSize = (numBeams + policy.outerThreads - 1) / policy.outerThreads;
+
+	// fold the inverse FFT normalization into the filter
+	Array2D<std::complex<PRISMATIC_FLOAT_PRECISION>> scaledFilter = zeros_ND<2, std::complex<PRISMATIC_FLOAT_PRECISION>>({{dimj, dimi}});
+	for (auto y = 0; y < dimj; y++)
+	{
+		for (auto x = 0; x < dimi; x++)
+		{
+			scaledFilter.at(y, x) = filter.at(y, x) / (PRISMATIC_FLOAT_PRECISION)planeSize;
+		}
+	}
+
+	ThreadPool::instance().run(policy.outerThreads, [&pars, &scaledFilter, &policy, numBeams, blockSize, dimj, dimi, planeSize](size_t t) {
+		const size_t start = t * blockSize;
+		const size_t stop = min(numBeams, start + blockSize);
+		if (start >= stop) return;
+
+		const size_t howmany = stop - start;
+		std::complex<PRISMATIC_FLOAT_PRECISION> *block = &pars.Scompact[start * planeSize];
 
+		// the filter is applied once, so estimated plans are enough
+		FFTPlan plan_forward = planFFT2D(dimj, dimi, block, block, FFTDirection::Forward, policy.fftThreads, FFTEffort::Estimate, howmany);
+		FFTPlan plan_inverse = planFFT2D(dimj, dimi, block, block, FFTDirection::Inverse, policy.fftThreads, FFTEffort::Estimate, howmany);
+
+		plan_forward.execute();
+		for (auto b = 0; b < howmany; b++)
+		{
+			std::complex<PRISMATIC_FLOAT_PRECISION> *beam = block + b * planeSize;
+			for (auto j = 0; j < planeSize; j++)
+			{
+				beam[j] *= scaledFilter[j];
+			}
+		}
+		plan_inverse.execute();
+	});
+}
+
+void refocus(Parameters<PRISMATIC_FLOAT_PRECISION> &pars)
+{
 	//calculate relative defocus
 	PRISMATIC_FLOAT_PRECISION rel_defocus = (pars.sMatrix_defocus-pars.meta.probeDefocus);
 
@@ -625,51 +622,9 @@ void refocus(Parameters<PRISMATIC_FLOAT_PRECISION> &pars)
 										 complex<PRISMATIC_FLOAT_PRECISION>(rel_defocus, 0));
 		}
 	}
-	
-	Array2D<std::complex<PRISMATIC_FLOAT_PRECISION>> beamHold = zeros_ND<2, std::complex<PRISMATIC_FLOAT_PRECISION>>(
-				{{pars.Scompact.get_dimj(), pars.Scompact.get_dimi()}});
-
-	//create FFT plans
-	PRISMATIC_FFTW_INIT_THREADS();
-	PRISMATIC_FFTW_PLAN_WITH_NTHREADS(pars.meta.numThreads);
-	
-	unique_lock<mutex> gatekeeper(fftw_plan_lock);
-	PRISMATIC_FFTW_PLAN plan_forward = PRISMATIC_FFTW_PLAN_DFT_2D(beamHold.get_dimj(), beamHold.get_dimi(),
-															reinterpret_cast<PRISMATIC_FFTW_COMPLEX *>(&beamHold[0]),
-															reinterpret_cast<PRISMATIC_FFTW_COMPLEX *>(&beamHold[0]),
-															FFTW_FORWARD,
-															FFTW_ESTIMATE);
-
-	PRISMATIC_FFTW_PLAN plan_inverse = PRISMATIC_FFTW_PLAN_DFT_2D(beamHold.get_dimj(), beamHold.get_dimi(),
-															reinterpret_cast<PRISMATIC_FFTW_COMPLEX *>(&beamHold[0]),
-															reinterpret_cast<PRISMATIC_FFTW_COMPLEX *>(&beamHold[0]),
-															FFTW_BACKWARD,
-															FFTW_ESTIMATE);
-	gatekeeper.unlock();
-
 
 	//apply propagator to all s-matrix beams
-	for(auto idx = 0; idx < pars.Scompact.get_dimk(); idx++)
-	{
-		//copy data into beamHold
-		copy(&pars.Scompact.at(idx,0,0), &pars.Scompact.at(idx+1,0,0), beamHold.begin());
-
-		//apply propagator
-		PRISMATIC_FFTW_EXECUTE(plan_forward);
-		for(auto y = 0; y < pars.qyInd.size(); y++)
-		{
-			for(auto x = 0; x < pars.qxInd.size(); x++)
-			{
-				beamHold.at(y,x) *=  pars.propRefocus.at(y,x);
-			}
-		}
-
-		PRISMATIC_FFTW_EXECUTE(plan_inverse);
-
-		// scale FFT and copy back into smatrix
-		beamHold /= beamHold.size();
-		copy(beamHold.begin(), beamHold.end(), &pars.Scompact.at(idx,0,0));
-	}
+	filterSMatrix_batch(pars, pars.propRefocus);
 
 	pars.sMatrix_defocus = pars.meta.probeDefocus;
 
@@ -677,8 +632,6 @@ void refocus(Parameters<PRISMATIC_FLOAT_PRECISION> &pars)
 
 void apply_aberrations(Parameters<PRISMATIC_FLOAT_PRECISION> &pars)
 {
-	extern mutex fftw_plan_lock;  // lock for protecting FFTW plans
-
 	//create a new propagator
 	pars.qTheta = pars.q1;
 	std::transform(pars.qxa.begin(), pars.qxa.end(),
@@ -688,55 +641,14 @@ void apply_aberrations(Parameters<PRISMATIC_FLOAT_PRECISION> &pars)
 	
 	Array2D<std::complex<PRISMATIC_FLOAT_PRECISION>> chi = getChi(pars.q1, pars.qTheta, pars.lambda, pars.meta.aberrations);
 
-	Array2D<std::complex<PRISMATIC_FLOAT_PRECISION>> beamHold = zeros_ND<2, std::complex<PRISMATIC_FLOAT_PRECISION>>(
-				{{pars.Scompact.get_dimj(), pars.Scompact.get_dimi()}});
-
-	//create FFT plans
-	PRISMATIC_FFTW_INIT_THREADS();
-	PRISMATIC_FFTW_PLAN_WITH_NTHREADS(pars.meta.numThreads);
-	
-	unique_lock<mutex> gatekeeper(fftw_plan_lock);
-	PRISMATIC_FFTW_PLAN plan_forward = PRISMATIC_FFTW_PLAN_DFT_2D(beamHold.get_dimj(), beamHold.get_dimi(),
-															reinterpret_cast<PRISMATIC_FFTW_COMPLEX *>(&beamHold[0]),
-															reinterpret_cast<PRISMATIC_FFTW_COMPLEX *>(&beamHold[0]),
-															FFTW_FORWARD,
-															FFTW_ESTIMATE);
-
-	PRISMATIC_FFTW_PLAN plan_inverse = PRISMATIC_FFTW_PLAN_DFT_2D(beamHold.get_dimj(), beamHold.get_dimi(),
-															reinterpret_cast<PRISMATIC_FFTW_COMPLEX *>(&beamHold[0]),
-															reinterpret_cast<PRISMATIC_FFTW_COMPLEX *>(&beamHold[0]),
-															FFTW_BACKWARD,
-															FFTW_ESTIMATE);
-	gatekeeper.unlock();
-
-
 	//apply propagator to all s-matrix beams
-	for(auto idx = 0; idx < pars.Scompact.get_dimk(); idx++)
-	{
-		//copy data into beamHold
-		copy(&pars.Scompact.at(idx,0,0), &pars.Scompact.at(idx+1,0,0), beamHold.begin());
-
-		//apply propagator
-		PRISMATIC_FFTW_EXECUTE(plan_forward);
-		for(auto y = 0; y < pars.qyInd.size(); y++)
-		{
-			for(auto x = 0; x < pars.qxInd.size(); x++)
-			{
-				beamHold.at(y,x) *=  chi.at(y,x);
-			}
-		}
-
-		PRISMATIC_FFTW_EXECUTE(plan_inverse);
-
-		// scale FFT and copy back into smatrix
-		beamHold /= beamHold.size();
-		copy(beamHold.begin(), beamHold.end(), &pars.Scompact.at(idx,0,0));
-	}
+	filterSMatrix_batch(pars, chi);
 
 }
 
 void PRISM02_calcSMatrix(Parameters<PRISMATIC_FLOAT_PRECISION> &pars)
 {
+	ScopedTimer timer("PRISM02_calcSMatrix");
 	// propagate plane waves to construct compact S-matrix
 
 	cout << "Entering PRISM02_calcSMatrix" << endl;
@@ -764,8 +676,20 @@ void PRISM02_calcSMatrix(Parameters<PRISMATIC_FLOAT_PRECISION> &pars)
 	pars.progressbar->signalScompactUpdate(-1, pars.numberBeams);
 #endif //PRISMATIC_BUILDING_GUI
 
-	// populate compact S-matrix
-	fill_Scompact(pars);
+	// populate compact S-matrix, unless an earlier run already did from the same inputs
+	if (pars.meta.stageCache && pars.meta.stageCache->restoreSMatrix(pars))
+	{
+		cout << "Reusing compact S-matrix of an earlier run" << endl;
+	}
+	else
+	{
+		pars.plan.fill_Scompact(pars);
+		// a cancelled run leaves beams uncomputed, which must not be kept for later runs
+		if (pars.meta.progress)
+			pars.meta.progress->checkCancelled();
+		if (pars.meta.stageCache)
+			pars.meta.stageCache->storeSMatrix(pars);
+	}
 
 	// only keep the relevant/nonzero Fourier components
 	downsampleFourierComponents(pars);
@@ -778,52 +702,23 @@ void PRISM02_calcSMatrix(Parameters<PRISMATIC_FLOAT_PRECISION> &pars)
 		std::cout << "Writing scattering matrix to output file." << std::endl;
 		setupSMatrixOutput(pars, pars.fpFlag);
 		H5::Group smatrix_group = pars.outputFile.openGroup("4DSTEM_simulation/data/realslices/smatrix_fp" + getDigitString(pars.fpFlag));
-		hsize_t mdims[3] = {pars.Scompact.get_dimi(), pars.Scompact.get_dimj(), pars.numberBeams};
 
-		Array3D<std::complex<PRISMATIC_FLOAT_PRECISION>> output_buffer = zeros_ND<3, std::complex<PRISMATIC_FLOAT_PRECISION>>({{pars.Scompact.get_dimi(), pars.Scompact.get_dimj(), pars.Scompact.get_dimk()}});
-
-		for(auto i = 0; i < pars.Scompact.get_dimi(); i++)
-		{
-			for(auto j = 0; j < pars.Scompact.get_dimj(); j++)
-			{
-				for(auto k = 0; k < pars.Scompact.get_dimk(); k++)
-				{
-					output_buffer.at(i,j,k) = pars.Scompact.at(k,j,i);
-				}
-			}
-		}		
-		writeComplexDataSet_inOrder(smatrix_group, "data", &output_buffer[0], mdims, 3);
+		//HDF5 order is reversed, so write out the transpose
+		writeComplexDataSet_inOrder(smatrix_group, "data", view(pars.Scompact).permute({{2, 1, 0}}));
 	}
 }
 
 void PRISM02_importSMatrix(Parameters<PRISMATIC_FLOAT_PRECISION> &pars)
 {
+	ScopedTimer timer("PRISM02_importSMatrix");
 	std::cout << "Setting up auxilary variables according to " << pars.meta.importFile << " metadata." << std::endl;
-	//scope out imported smatrix as soon as possible
+	//read straight into the S-matrix, through a view with the dimensions reversed
 	{
-		Array3D<std::complex<PRISMATIC_FLOAT_PRECISION>> tmp_sm;
-		if(pars.meta.importPath.size() > 0)
-		{
-			readComplexDataSet_inOrder(tmp_sm, pars.meta.importFile, pars.meta.importPath);
-		}
-		else //read default path
-		{
-			std::string groupPath = "4DSTEM_simulation/data/realslices/smatrix_fp" + getDigitString(pars.fpFlag) + "/data";
-			readComplexDataSet_inOrder(tmp_sm, pars.meta.importFile, groupPath);
-		}
-
-		//initailize array and get data in right order
-		pars.Scompact = zeros_ND<3, std::complex<PRISMATIC_FLOAT_PRECISION>>({{tmp_sm.get_dimi(), tmp_sm.get_dimj(), tmp_sm.get_dimk()}});
-		for(auto i = 0; i < tmp_sm.get_dimi(); i++)
-		{
-			for(auto j = 0; j < tmp_sm.get_dimj(); j++)
-			{
-				for(auto k = 0; k < tmp_sm.get_dimk(); k++)
-				{
-					pars.Scompact.at(i,j,k) = tmp_sm.at(k,j,i);
-				}
-			}
-		}
+		std::string dataPath = pars.meta.importPath.size() > 0 ? pars.meta.importPath
+									: "4DSTEM_simulation/data/realslices/smatrix_fp" + getDigitString(pars.fpFlag) + "/data"; //default path
+		std::vector<size_t> dims = readDataSetDims(pars.meta.importFile, dataPath);
+		pars.Scompact = zeros_ND<3, std::complex<PRISMATIC_FLOAT_PRECISION>>({{dims[2], dims[1], dims[0]}});
+		readComplexDataSet_inOrder(view(pars.Scompact).permute({{2, 1, 0}}), pars.meta.importFile, dataPath);
 	}
 	
 	//acquire necessary metadata to create auxillary variables
@@ -905,21 +800,9 @@ void PRISM02_importSMatrix(Parameters<PRISMATIC_FLOAT_PRECISION> &pars)
 		std::cout << "Writing scattering matrix to output file." << std::endl;
 		setupSMatrixOutput(pars, pars.fpFlag);
 		H5::Group smatrix_group = pars.outputFile.openGroup("4DSTEM_simulation/data/realslices/smatrix_fp" + getDigitString(pars.fpFlag));
-		hsize_t mdims[3] = {pars.Scompact.get_dimi(), pars.Scompact.get_dimj(), pars.numberBeams};
-
-		Array3D<std::complex<PRISMATIC_FLOAT_PRECISION>> output_buffer = zeros_ND<3, std::complex<PRISMATIC_FLOAT_PRECISION>>({{pars.Scompact.get_dimi(), pars.Scompact.get_dimj(), pars.Scompact.get_dimk()}});
 
-		for(auto i = 0; i < pars.Scompact.get_dimi(); i++)
-		{
-			for(auto j = 0; j < pars.Scompact.get_dimj(); j++)
-			{
-				for(auto k = 0; k < pars.Scompact.get_dimk(); k++)
-				{
-					output_buffer.at(i,j,k) = pars.Scompact.at(k,j,i);
-				}
-			}
-		}		
-		writeComplexDataSet_inOrder(smatrix_group, "data", &output_buffer[0], mdims, 3);
+		//HDF5 order is reversed, so write out the transpose
+		writeComplexDataSet_inOrder(smatrix_group, "data", view(pars.Scompact).permute({{2, 1, 0}}));
 	}
 
 }
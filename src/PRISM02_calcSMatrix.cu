@@ -365,7 +365,7 @@ namespace Prismatic {
 		workers_GPU.reserve(total_num_streams); // prevents multiple reallocations
 		int stream_count = 0;
 		const size_t PRISMATIC_PRINT_FREQUENCY_BEAMS = max((size_t)1,pars.numberBeams / 10); // for printing status
-		WorkDispatcher dispatcher(0, pars.numberBeams); // create the work dispatcher
+		WorkDispatcher dispatcher(0, pars.numberBeams, pars.meta.progress.get(), "plane waves"); // create the work dispatcher
 
 		// create threads
 		for (auto t = 0; t < total_num_streams; ++t) {
@@ -465,9 +465,6 @@ namespace Prismatic {
 			workers_CPU.reserve(pars.meta.numThreads); // prevents multiple reallocations
 			pars.meta.batchSizeCPU = min(pars.meta.batchSizeTargetCPU, max((size_t)1, pars.numberBeams / pars.meta.numThreads));
 
-			// startup FFTW threads
-			PRISMATIC_FFTW_INIT_THREADS();
-			PRISMATIC_FFTW_PLAN_WITH_NTHREADS(pars.meta.numThreads);
 			for (auto t = 0; t < pars.meta.numThreads; ++t) {
 				cout << "Launching thread #" << t << " to compute beams\n";
 				workers_CPU.push_back(thread([&pars, &dispatcher, &PRISMATIC_PRINT_FREQUENCY_BEAMS]() {
@@ -488,33 +485,11 @@ namespace Prismatic {
 						Array1D<complex<PRISMATIC_FLOAT_PRECISION> > psi_stack = zeros_ND<1, complex<PRISMATIC_FLOAT_PRECISION> >(
 								{{pars.imageSize[0]*pars.imageSize[1]*pars.meta.batchSizeCPU}});
 
-//						 setup batch FFTW parameters
-						const int rank    = 2;
-						int n[]           = {(int)pars.imageSize[0], (int)pars.imageSize[1]};
-						const int howmany = pars.meta.batchSizeCPU;
-						int idist         = n[0]*n[1];
-						int odist         = n[0]*n[1];
-						int istride       = 1;
-						int ostride       = 1;
-						int *inembed      = n;
-						int *onembed      = n;
-
-						// create FFTW plans
-						unique_lock<mutex> gatekeeper(fftw_plan_lock);
-						PRISMATIC_FFTW_PLAN plan_forward = PRISMATIC_FFTW_PLAN_DFT_BATCH(rank, n, howmany,
-						                                                         reinterpret_cast<PRISMATIC_FFTW_COMPLEX *>(&psi_stack[0]), inembed,
-						                                                         istride, idist,
-						                                                         reinterpret_cast<PRISMATIC_FFTW_COMPLEX *>(&psi_stack[0]), onembed,
-						                                                         ostride, odist,
-						                                                         FFTW_FORWARD, FFTW_MEASURE);
-						PRISMATIC_FFTW_PLAN plan_inverse = PRISMATIC_FFTW_PLAN_DFT_BATCH(rank, n, howmany,
-						                                                         reinterpret_cast<PRISMATIC_FFTW_COMPLEX *>(&psi_stack[0]), inembed,
-						                                                         istride, idist,
-						                                                         reinterpret_cast<PRISMATIC_FFTW_COMPLEX *>(&psi_stack[0]), onembed,
-						                                                         ostride, odist,
-						                                                         FFTW_BACKWARD, FFTW_MEASURE);
-
-						gatekeeper.unlock(); // unlock it so we only block as long as necessary to deal with plans
+						// batched plans; workers with the same batch size share them through the plan cache
+						FFTPlan plan_forward = planFFT2D(pars.imageSize[0], pars.imageSize[1], &psi_stack[0], &psi_stack[0],
+						                                 FFTDirection::Forward, 1, FFTEffort::Measure, pars.meta.batchSizeCPU);
+						FFTPlan plan_inverse = planFFT2D(pars.imageSize[0], pars.imageSize[1], &psi_stack[0], &psi_stack[0],
+						                                 FFTDirection::Inverse, 1, FFTEffort::Measure, pars.meta.batchSizeCPU);
 
 						// main work loop
 						do { // synchronously get work assignment
@@ -524,8 +499,8 @@ namespace Prismatic {
 								}
 								// re-zero psi each iteration
 								memset((void *) &psi_stack[0], 0, psi_stack.size() * sizeof(complex<PRISMATIC_FLOAT_PRECISION>));
-//								propagatePlaneWave_CPU(pars, currentBeam, psi, plan_forward, plan_inverse, fftw_plan_lock);
-								propagatePlaneWave_CPU_batch(pars, currentBeam, stopBeam, psi_stack, plan_forward, plan_inverse, fftw_plan_lock);
+//								propagatePlaneWave_CPU(pars, currentBeam, psi, plan_forward, plan_inverse);
+								propagatePlaneWave_CPU_batch(pars, currentBeam, stopBeam, psi_stack, plan_forward, plan_inverse);
 #ifdef PRISMATIC_BUILDING_GUI
 								pars.progressbar->signalScompactUpdate(currentBeam, pars.numberBeams);
 #endif
@@ -534,16 +509,10 @@ namespace Prismatic {
 							}
 							if (currentBeam >= early_CPU_stop) break;
 						} while (dispatcher.getWork(currentBeam, stopBeam, pars.meta.batchSizeCPU, early_CPU_stop));
-						// clean up
-						gatekeeper.lock();
-						PRISMATIC_FFTW_DESTROY_PLAN(plan_forward);
-						PRISMATIC_FFTW_DESTROY_PLAN(plan_inverse);
-						gatekeeper.unlock();
 					}
 				}));
 			}
 			for (auto &t:workers_CPU)t.join();
-			PRISMATIC_FFTW_CLEANUP_THREADS();
 		}
 		// synchronize workers
 		for (auto &t:workers_GPU)t.join();
@@ -559,7 +528,7 @@ namespace Prismatic {
 		workers_GPU.reserve(total_num_streams); // prevents multiple reallocations
 		int stream_count = 0;
 		const size_t PRISMATIC_PRINT_FREQUENCY_BEAMS = max((size_t)1,pars.numberBeams / 10); // for printing status
-		WorkDispatcher dispatcher(0, pars.numberBeams); // create work dispatcher
+		WorkDispatcher dispatcher(0, pars.numberBeams, pars.meta.progress.get(), "plane waves"); // create work dispatcher
 		for (auto t = 0; t < total_num_streams; ++t) {
 			int GPU_num = stream_count % pars.meta.numGPUs; // determine which GPU handles this job
 			cudaSetDevice(GPU_num);
@@ -654,15 +623,11 @@ namespace Prismatic {
 			// launch CPU work
 			vector<thread> workers_CPU;
 			workers_CPU.reserve(pars.meta.numThreads); // prevents multiple reallocations
-			mutex fftw_plan_lock;
 			pars.meta.batchSizeCPU = min(pars.meta.batchSizeTargetCPU, max((size_t)1, pars.numberBeams / pars.meta.numThreads));
 
-			// startup FFTW threads
-			PRISMATIC_FFTW_INIT_THREADS();
-			PRISMATIC_FFTW_PLAN_WITH_NTHREADS(pars.meta.numThreads);
 			for (auto t = 0; t < pars.meta.numThreads; ++t) {
 				cout << "Launching thread #" << t << " to compute beams\n";
-				workers_CPU.push_back(thread([&pars, &fftw_plan_lock, &dispatcher, &PRISMATIC_PRINT_FREQUENCY_BEAMS]() {
+				workers_CPU.push_back(thread([&pars, &dispatcher, &PRISMATIC_PRINT_FREQUENCY_BEAMS]() {
 
 					size_t currentBeam, stopBeam, early_CPU_stop;
 					currentBeam=stopBeam=0;
@@ -678,32 +643,11 @@ namespace Prismatic {
 						Array1D<complex<PRISMATIC_FLOAT_PRECISION> > psi_stack = zeros_ND<1, complex<PRISMATIC_FLOAT_PRECISION> >(
 								{{pars.imageSize[0]*pars.imageSize[1]*pars.meta.batchSizeCPU}});
 
-						// setup batch FFTW parameters
-						const int rank    = 2;
-						int n[]           = {(int)pars.imageSize[0], (int)pars.imageSize[1]};
-						const int howmany = pars.meta.batchSizeCPU;
-						int idist         = n[0]*n[1];
-						int odist         = n[0]*n[1];
-						int istride       = 1;
-						int ostride       = 1;
-						int *inembed      = n;
-						int *onembed      = n;
-
-						// create FFTW plans
-						unique_lock<mutex> gatekeeper(fftw_plan_lock);
-						PRISMATIC_FFTW_PLAN plan_forward = PRISMATIC_FFTW_PLAN_DFT_BATCH(rank, n, howmany,
-						                                                         reinterpret_cast<PRISMATIC_FFTW_COMPLEX *>(&psi_stack[0]), inembed,
-						                                                         istride, idist,
-						                                                         reinterpret_cast<PRISMATIC_FFTW_COMPLEX *>(&psi_stack[0]), onembed,
-						                                                         ostride, odist,
-						                                                         FFTW_FORWARD, FFTW_MEASURE);
-						PRISMATIC_FFTW_PLAN plan_inverse = PRISMATIC_FFTW_PLAN_DFT_BATCH(rank, n, howmany,
-						                                                         reinterpret_cast<PRISMATIC_FFTW_COMPLEX *>(&psi_stack[0]), inembed,
-						                                                         istride, idist,
-						                                                         reinterpret_cast<PRISMATIC_FFTW_COMPLEX *>(&psi_stack[0]), onembed,
-						                                                         ostride, odist,
-						                                                         FFTW_BACKWARD, FFTW_MEASURE);
-						gatekeeper.unlock(); // unlock it so we only block as long as necessary to deal with plans
+						// batched plans; workers with the same batch size share them through the plan cache
+						FFTPlan plan_forward = planFFT2D(pars.imageSize[0], pars.imageSize[1], &psi_stack[0], &psi_stack[0],
+						                                 FFTDirection::Forward, 1, FFTEffort::Measure, pars.meta.batchSizeCPU);
+						FFTPlan plan_inverse = planFFT2D(pars.imageSize[0], pars.imageSize[1], &psi_stack[0], &psi_stack[0],
+						                                 FFTDirection::Inverse, 1, FFTEffort::Measure, pars.meta.batchSizeCPU);
 
 						// main work loop
 						do { // synchronously get work assignment
@@ -713,8 +657,8 @@ namespace Prismatic {
 								}
 								// re-zero psi each iteration
 								memset((void *) &psi_stack[0], 0, psi_stack.size() * sizeof(complex<PRISMATIC_FLOAT_PRECISION>));
-//								propagatePlaneWave_CPU(pars, currentBeam, psi, plan_forward, plan_inverse, fftw_plan_lock);
-								propagatePlaneWave_CPU_batch(pars, currentBeam, stopBeam, psi_stack, plan_forward, plan_inverse, fftw_plan_lock);
+//								propagatePlaneWave_CPU(pars, currentBeam, psi, plan_forward, plan_inverse);
+								propagatePlaneWave_CPU_batch(pars, currentBeam, stopBeam, psi_stack, plan_forward, plan_inverse);
 #ifdef PRISMATIC_BUILDING_GUI
 								pars.progressbar->signalScompactUpdate(currentBeam, pars.numberBeams);
 #endif
@@ -723,16 +667,10 @@ namespace Prismatic {
 							}
 							if (currentBeam >= early_CPU_stop) break;
 						} while (dispatcher.getWork(currentBeam, stopBeam, pars.meta.batchSizeCPU, early_CPU_stop));
-						// clean up
-						gatekeeper.lock();
-						PRISMATIC_FFTW_DESTROY_PLAN(plan_forward);
-						PRISMATIC_FFTW_DESTROY_PLAN(plan_inverse);
-						gatekeeper.unlock();
 					}
 				}));
 			}
 			for (auto &t:workers_CPU)t.join();
-			PRISMATIC_FFTW_CLEANUP_THREADS();
 		}
 		for (auto &t:workers_GPU)t.join();
 	}
@@ -21,11 +21,16 @@
 #include <mutex>
 #include <numeric>
 #include <vector>
-#include "fftw3.h"
+#include "FFTBackend.h"
 #include "utility.h"
 #include "WorkDispatcher.h"
+#include "ThreadPool.h"
+#include "ExecutionPolicy.h"
+#include "Instrumentation.h"
 #include "ArrayND.h"
 #include "fileIO.h"
+#include "aberration.h"
+#include "configure.h"
 
 #ifdef PRISMATIC_BUILDING_GUI
 #include "prism_progressbar.h"
@@ -33,7 +38,6 @@
 
 namespace Prismatic
 {
-extern std::mutex fftw_plan_lock; // for synchronizing access to shared FFTW resources
 // extern std::mutex HDF5_lock;
 using namespace std;
 const static std::complex<PRISMATIC_FLOAT_PRECISION> i(0, 1);
@@ -167,9 +171,9 @@ void createStack_integrate(Parameters<PRISMATIC_FLOAT_PRECISION> &pars)
 {
 	// create output of a size corresponding to 3D mode (integration)
 	pars.numLayers = 1;
-	pars.output = zeros_ND<4, PRISMATIC_FLOAT_PRECISION>({{1, pars.numYprobes, pars.numXprobes, pars.Ndet}});
+	pars.output = zeros_ND<4, PRISMATIC_FLOAT_PRECISION>({{1, pars.numXprobes, pars.numYprobes, pars.Ndet}});
 	if (pars.meta.saveDPC_CoM)
-		pars.DPC_CoM = zeros_ND<4, PRISMATIC_FLOAT_PRECISION>({{1, pars.numYprobes, pars.numXprobes, 2}});
+		pars.DPC_CoM = zeros_ND<4, PRISMATIC_FLOAT_PRECISION>({{1, pars.numXprobes, pars.numYprobes, 2}});
 	
 	std::vector<PRISMATIC_FLOAT_PRECISION> depths(1);
 	depths[0] = pars.numPlanes*pars.meta.sliceThickness;
@@ -227,12 +231,8 @@ getSinglePRISMProbe_CPU(Parameters<PRISMATIC_FLOAT_PRECISION> &pars, const PRISM
 
 	Array2D<std::complex<PRISMATIC_FLOAT_PRECISION>> psi = Prismatic::zeros_ND<2, std::complex<PRISMATIC_FLOAT_PRECISION>>(
 		{{pars.imageSizeReduce[0], pars.imageSizeReduce[1]}});
-	unique_lock<mutex> gatekeeper(fftw_plan_lock);
-	PRISMATIC_FFTW_PLAN plan = PRISMATIC_FFTW_PLAN_DFT_2D(psi.get_dimj(), psi.get_dimi(),
-														  reinterpret_cast<PRISMATIC_FFTW_COMPLEX *>(&psi[0]),
-														  reinterpret_cast<PRISMATIC_FFTW_COMPLEX *>(&psi[0]),
-														  FFTW_FORWARD, FFTW_ESTIMATE);
-	gatekeeper.unlock();
+	FFTPlan plan = planFFT2D(psi.get_dimj(), psi.get_dimi(), &psi[0], &psi[0], FFTDirection::Forward,
+							 chooseExecutionPolicy(pars.meta.numThreads, 1, psi.size()).fftThreads);
 	const static std::complex<PRISMATIC_FLOAT_PRECISION> i(0, 1);
 	const static PRISMATIC_FLOAT_PRECISION pi = std::acos(-1);
 
@@ -280,16 +280,14 @@ getSinglePRISMProbe_CPU(Parameters<PRISMATIC_FLOAT_PRECISION> &pars, const PRISM
 		}
 	}
 	realspace_probe = psi;
-	PRISMATIC_FFTW_EXECUTE(plan);
+	plan.execute();
 	kspace_probe = psi;
-	gatekeeper.lock();
-	PRISMATIC_FFTW_DESTROY_PLAN(plan);
-	gatekeeper.unlock();
 	return std::make_pair(realspace_probe, kspace_probe);
 }
 
 void buildPRISMOutput_CPUOnly(Parameters<PRISMATIC_FLOAT_PRECISION> &pars)
 {
+	ScopedTimer timer("buildPRISMOutput_CPUOnly");
 
 	// launch threads to compute results for batches of xp, yp
 	// I do this by dividing the xp points among threads, and each computes
@@ -298,93 +296,74 @@ void buildPRISMOutput_CPUOnly(Parameters<PRISMATIC_FLOAT_PRECISION> &pars)
 	// If that is not the case
 	// this may need to be adapted
 
-	// initialize FFTW threads
-	PRISMATIC_FFTW_INIT_THREADS();
-	PRISMATIC_FFTW_PLAN_WITH_NTHREADS(pars.meta.numThreads);
-	vector<thread> workers;
-	workers.reserve(pars.meta.numThreads);																  // prevents multiple reallocations
+	const ExecutionPolicy policy = chooseExecutionPolicy(pars.meta.numThreads, pars.numProbes, pars.imageSizeReduce[0] * pars.imageSizeReduce[1], pars.meta.maxWorkerThreads);
 	const size_t PRISMATIC_PRINT_FREQUENCY_PROBES = max((size_t)1, pars.numProbes / 10); // for printing status
-	WorkDispatcher dispatcher(0, pars.numProbes);
-	for (auto t = 0; t < pars.meta.numThreads; ++t)
-	{
-		cout << "Launching CPU worker thread #" << t << " to compute partial PRISM result\n";
-		workers.push_back(thread([&pars, &dispatcher, &PRISMATIC_PRINT_FREQUENCY_PROBES]() {
-			size_t Nstart, Nstop, ay, ax;
-			Nstart = Nstop = 0;
-			if (dispatcher.getWork(Nstart, Nstop))
-			{ // synchronously get work assignment
-				Array2D<std::complex<PRISMATIC_FLOAT_PRECISION>> psi = Prismatic::zeros_ND<2, std::complex<PRISMATIC_FLOAT_PRECISION>>(
-					{{pars.imageSizeReduce[0], pars.imageSizeReduce[1]}});
-
-				unique_lock<mutex> gatekeeper(fftw_plan_lock);
-				PRISMATIC_FFTW_PLAN plan = PRISMATIC_FFTW_PLAN_DFT_2D(psi.get_dimj(), psi.get_dimi(),
-																	  reinterpret_cast<PRISMATIC_FFTW_COMPLEX *>(&psi[0]),
-																	  reinterpret_cast<PRISMATIC_FFTW_COMPLEX *>(&psi[0]),
-																	  FFTW_FORWARD, FFTW_MEASURE);
-				gatekeeper.unlock();
-
-				// main work loop
-				do
+	WorkDispatcher dispatcher(0, pars.numProbes, pars.meta.progress.get(), "probe positions");
+	cout << "Running " << policy.outerThreads << " CPU worker threads with " << policy.fftThreads << " FFT threads each to compute partial PRISM result\n";
+	ThreadPool::instance().run(policy.outerThreads, [&pars, &dispatcher, &policy, &PRISMATIC_PRINT_FREQUENCY_PROBES](size_t) {
+		size_t Nstart, Nstop, ay, ax;
+		Nstart = Nstop = 0;
+		if (dispatcher.getWork(Nstart, Nstop))
+		{ // synchronously get work assignment
+			Array2D<std::complex<PRISMATIC_FLOAT_PRECISION>> psi = Prismatic::zeros_ND<2, std::complex<PRISMATIC_FLOAT_PRECISION>>(
+				{{pars.imageSizeReduce[0], pars.imageSizeReduce[1]}});
+
+			FFTPlan plan = planFFT2D(psi.get_dimj(), psi.get_dimi(), &psi[0], &psi[0], FFTDirection::Forward, policy.fftThreads, FFTEffort::Measure);
+
+			// main work loop
+			do
+			{
+				while (Nstart < Nstop)
 				{
-					while (Nstart < Nstop)
+					if (Nstart % PRISMATIC_PRINT_FREQUENCY_PROBES == 0 | Nstart == 100)
 					{
-						if (Nstart % PRISMATIC_PRINT_FREQUENCY_PROBES == 0 | Nstart == 100)
-						{
-							cout << "Computing Probe Position #" << Nstart << "/" << pars.numProbes << endl;
-						}
-						ay = (pars.meta.arbitraryProbes) ? Nstart : Nstart / pars.numXprobes;
-						ax = (pars.meta.arbitraryProbes) ? Nstart : Nstart % pars.numXprobes;
-						buildSignal_CPU(pars, ay, ax, plan, psi);
+						cout << "Computing Probe Position #" << Nstart << "/" << pars.numProbes << endl;
+					}
+					ay = (pars.meta.arbitraryProbes) ? Nstart : Nstart / pars.numXprobes;
+					ax = (pars.meta.arbitraryProbes) ? Nstart : Nstart % pars.numXprobes;
+					buildSignal_CPU(pars, ay, ax, plan, psi);
 #ifdef PRISMATIC_BUILDING_GUI
-						pars.progressbar->signalOutputUpdate(Nstart, pars.numProbes);
+					pars.progressbar->signalOutputUpdate(Nstart, pars.numProbes);
 #endif
-						++Nstart;
-					}
-				} while (dispatcher.getWork(Nstart, Nstop));
-				gatekeeper.lock();
-				PRISMATIC_FFTW_DESTROY_PLAN(plan);
-				gatekeeper.unlock();
-			}
-		}));
-	}
-	// synchronize
-	cout << "Waiting for threads...\n";
-	for (auto &t : workers)
-		t.join();
-	PRISMATIC_FFTW_CLEANUP_THREADS();
+					++Nstart;
+				}
+			} while (dispatcher.getWork(Nstart, Nstop));
+		}
+	});
+
+	// per probe: a complex multiply-add of every beam over the reduced grid, then one FFT and |psi|^2
+	const double N = pars.imageSizeReduce[0] * pars.imageSizeReduce[1];
+	Profiler::instance().addFlops("buildPRISMOutput_CPUOnly", (double)pars.numProbes * (8 * N * pars.numberBeams + fftFlops(N) + 3 * N));
+}
+
+void wrapCoordinates(const Array1D<PRISMATIC_FLOAT_PRECISION> &vec,
+					 const PRISMATIC_FLOAT_PRECISION shift,
+					 const size_t N,
+					 Array1D<PRISMATIC_FLOAT_PRECISION> &result)
+{
+	// periodic S-matrix indices of the probe window; the second call to fmod makes sure the result is positive
+	const PRISMATIC_FLOAT_PRECISION N_f = (PRISMATIC_FLOAT_PRECISION)N;
+	for (auto i = 0; i < vec.size(); ++i)
+		result[i] = fmod(N_f + fmod(vec[i] + shift, N_f), N_f);
 }
 
 void buildSignal_CPU(Parameters<PRISMATIC_FLOAT_PRECISION> &pars,
 					 const size_t &ay,
 					 const size_t &ax,
-					 PRISMATIC_FFTW_PLAN &plan,
+					 const FFTPlan &plan,
 					 Array2D<std::complex<PRISMATIC_FLOAT_PRECISION>> &psi)
 {
 	// build the output for a single probe position using CPU resources
 
-	const static std::complex<PRISMATIC_FLOAT_PRECISION> i(0, 1);
-	const static PRISMATIC_FLOAT_PRECISION pi = std::acos(-1);
-
 	// setup some coordinates
 	PRISMATIC_FLOAT_PRECISION x0 = pars.xp[ax] / pars.pixelSizeOutput[1];
 	PRISMATIC_FLOAT_PRECISION y0 = pars.yp[ay] / pars.pixelSizeOutput[0];
-	Array1D<PRISMATIC_FLOAT_PRECISION> x = pars.xVec + round(x0);
+	Array1D<PRISMATIC_FLOAT_PRECISION> &x = scratchArray<1, PRISMATIC_FLOAT_PRECISION>(SCRATCH_COORDS_X, pars.xVec.get_dimarr());
+	Array1D<PRISMATIC_FLOAT_PRECISION> &y = scratchArray<1, PRISMATIC_FLOAT_PRECISION>(SCRATCH_COORDS_Y, pars.yVec.get_dimarr());
+	wrapCoordinates(pars.xVec, round(x0), pars.imageSizeOutput[1], x);
+	wrapCoordinates(pars.yVec, round(y0), pars.imageSizeOutput[0], y);
 
-	// the second call to fmod here is to make sure the result is positive
-	transform(x.begin(), x.end(), x.begin(), [&pars](PRISMATIC_FLOAT_PRECISION &a) {
-		return fmod((PRISMATIC_FLOAT_PRECISION)pars.imageSizeOutput[1] +
-						fmod(a, (PRISMATIC_FLOAT_PRECISION)pars.imageSizeOutput[1]),
-					(PRISMATIC_FLOAT_PRECISION)pars.imageSizeOutput[1]);
-	});
-
-	Array1D<PRISMATIC_FLOAT_PRECISION> y = pars.yVec + round(y0);
-	transform(y.begin(), y.end(), y.begin(), [&pars](PRISMATIC_FLOAT_PRECISION &a) {
-		return fmod((PRISMATIC_FLOAT_PRECISION)pars.imageSizeOutput[0] +
-						fmod(a, (PRISMATIC_FLOAT_PRECISION)pars.imageSizeOutput[0]),
-					(PRISMATIC_FLOAT_PRECISION)pars.imageSizeOutput[0]);
-	});
-
-	Array2D<PRISMATIC_FLOAT_PRECISION> intOutput = Prismatic::zeros_ND<2, PRISMATIC_FLOAT_PRECISION>(
+	Array2D<PRISMATIC_FLOAT_PRECISION> &intOutput = scratchArray<2, PRISMATIC_FLOAT_PRECISION>(SCRATCH_INTENSITY,
 		{{pars.imageSizeReduce[0], pars.imageSizeReduce[1]}});
 
 	memset(&psi[0], 0, sizeof(std::complex<PRISMATIC_FLOAT_PRECISION>) * psi.size());
@@ -396,10 +375,7 @@ void buildSignal_CPU(Parameters<PRISMATIC_FLOAT_PRECISION> &pars,
 
 		if (abs(pars.psiProbeInit.at(yB, xB)) > 0)
 		{
-			PRISMATIC_FLOAT_PRECISION q0_0 = pars.qxaReduce.at(yB, xB);
-			PRISMATIC_FLOAT_PRECISION q0_1 = pars.qyaReduce.at(yB, xB);
-			std::complex<PRISMATIC_FLOAT_PRECISION> phaseShift = exp(
-				-2 * pi * i * (q0_0 * (pars.xp[ax] + pars.xTiltShift) + q0_1 * (pars.yp[ay] + pars.yTiltShift)));
+			const std::complex<PRISMATIC_FLOAT_PRECISION> phaseShift = probePhaseShift(pars, ay, ax, a4);
 
 			const std::complex<PRISMATIC_FLOAT_PRECISION> tmp_const = pars.psiProbeInit.at(yB, xB) * phaseShift;
 			for (auto j = 0; j < y.size(); ++j)
@@ -412,48 +388,26 @@ void buildSignal_CPU(Parameters<PRISMATIC_FLOAT_PRECISION> &pars,
 		}
 	}
 
-	PRISMATIC_FFTW_EXECUTE(plan);
+	plan.execute();
 
 	for (auto jj = 0; jj < intOutput.get_dimj(); ++jj)
 	{
 		for (auto ii = 0; ii < intOutput.get_dimi(); ++ii)
 		{
-			intOutput.at(jj, ii) += pow(abs(psi.at(jj, ii)), 2) * pars.scale;
+			intOutput.at(jj, ii) = pow(abs(psi.at(jj, ii)), 2) * pars.scale;
 		}
 	}
 
 	size_t write_ay = (pars.meta.arbitraryProbes) ? 0 : ay;
+	const bool doubleSums = pars.meta.precision == Precision::Mixed;
 	if (pars.meta.saveDPC_CoM)
 	{
 		//calculate center of mass; qxa, qya are the fourier coordinates, should have 0 components at boundaries
-		for (long y = 0; y < intOutput.get_dimj(); ++y)
-		{
-			for (long x = 0; x < intOutput.get_dimi(); ++x)
-			{
-				pars.DPC_CoM.at(0, write_ay, ax, 0) += pars.qxaReduce.at(y, x) * intOutput.at(y, x);
-				pars.DPC_CoM.at(0, write_ay, ax, 1) += pars.qyaReduce.at(y, x) * intOutput.at(y, x);
-			}
-		}
-		//divide by sum of intensity
-		PRISMATIC_FLOAT_PRECISION intensitySum = 0;
-		for (auto iter = intOutput.begin(); iter != intOutput.end(); ++iter)
-		{
-			intensitySum += *iter;
-		}
-		pars.DPC_CoM.at(0, write_ay, ax, 0) /= intensitySum;
-		pars.DPC_CoM.at(0, write_ay, ax, 1) /= intensitySum;
+		centerOfMass(&intOutput[0], &pars.qxaReduce[0], &pars.qyaReduce[0], intOutput.size(), &pars.DPC_CoM.at(0, ax, write_ay, 0), doubleSums);
 	}
 
 	//         update output -- ax,ay are unique per thread so this write is thread-safe without a lock
-	auto idx = pars.alphaInd.begin();
-	for (auto counts = intOutput.begin(); counts != intOutput.end(); ++counts)
-	{
-		if (*idx <= pars.Ndet)
-		{
-			pars.output.at(0, write_ay, ax, (*idx) - 1) += *counts;
-		}
-		++idx;
-	};
+	binDetector(&intOutput[0], &pars.alphaInd[0], intOutput.size(), pars.Ndet, &pars.output.at(0, ax, write_ay, 0), doubleSums);
 
 	//save 4D output if applicable
 	if (pars.meta.save4DOutput)
@@ -466,17 +420,17 @@ void buildSignal_CPU(Parameters<PRISMATIC_FLOAT_PRECISION> &pars,
 		if(pars.meta.saveComplexOutputWave)
 		{
 			nameString += "_fp" + getDigitString(pars.meta.fpNum);
-			Array2D<std::complex<PRISMATIC_FLOAT_PRECISION>> finalOutput;
+			Array2D<std::complex<PRISMATIC_FLOAT_PRECISION>> &finalOutput = scratchArray<2, std::complex<PRISMATIC_FLOAT_PRECISION>>(SCRATCH_FORMAT);
 			if(pars.meta.crop4DOutput)
 			{
-				finalOutput = cropOutput(psi, pars);
+				cropOutput(psi, pars, finalOutput);
 				finalOutput *= sqrt(pars.scale);
 				hsize_t mdims[4] = {1, 1, finalOutput.get_dimj(), finalOutput.get_dimi()};
 				writeDatacube4D(pars, &finalOutput[0], &pars.cbed_buffer_c[0], mdims, offset, numFP, nameString.c_str());
 			}
 			else
 			{
-				finalOutput = fftshift2_flip(psi);
+				fftshift2_flip(psi, finalOutput);
 				finalOutput *= sqrt(pars.scale);
 				hsize_t mdims[4] = {1, 1, finalOutput.get_dimj(), finalOutput.get_dimi()};
 				writeDatacube4D(pars, &finalOutput[0], &pars.cbed_buffer_c[0], mdims, offset, numFP, nameString.c_str());
@@ -484,21 +438,147 @@ void buildSignal_CPU(Parameters<PRISMATIC_FLOAT_PRECISION> &pars,
 		}
 		else
 		{
+			Array2D<PRISMATIC_FLOAT_PRECISION> &finalOutput = scratchArray<2, PRISMATIC_FLOAT_PRECISION>(SCRATCH_FORMAT);
 			if(pars.meta.crop4DOutput)
 			{
-				Array2D<PRISMATIC_FLOAT_PRECISION> croppedOutput = cropOutput(intOutput, pars);
-				hsize_t mdims[4] = {1, 1, croppedOutput.get_dimj(), croppedOutput.get_dimi()};
-				writeDatacube4D(pars, &croppedOutput[0],  &pars.cbed_buffer[0], mdims, offset, numFP, nameString.c_str());
+				cropOutput(intOutput, pars, finalOutput);
 			}
 			else
 			{
-				intOutput = fftshift2_flip(intOutput);
-				hsize_t mdims[4] = {1, 1, intOutput.get_dimj(), intOutput.get_dimi()};
-				writeDatacube4D(pars, &intOutput[0],  &pars.cbed_buffer[0], mdims, offset, numFP, nameString.c_str());
+				fftshift2_flip(intOutput, finalOutput);
+			}
+			hsize_t mdims[4] = {1, 1, finalOutput.get_dimj(), finalOutput.get_dimi()};
+			writeDatacube4D(pars, &finalOutput[0],  &pars.cbed_buffer[0], mdims, offset, numFP, nameString.c_str());
+		}
+
+	}
+}
+
+void buildPRISMOutput_series_CPUOnly(Parameters<PRISMATIC_FLOAT_PRECISION> &pars)
+{
+	// same work distribution as buildPRISMOutput_CPUOnly, but every probe position produces the
+	// output of all series entries at once, so each thread holds a stack of one psi per entry
+	const ExecutionPolicy policy = chooseExecutionPolicy(pars.meta.numThreads, pars.numProbes, pars.imageSizeReduce[0] * pars.imageSizeReduce[1], pars.meta.maxWorkerThreads);
+	const size_t PRISMATIC_PRINT_FREQUENCY_PROBES = max((size_t)1, pars.numProbes / 10); // for printing status
+	WorkDispatcher dispatcher(0, pars.numProbes, pars.meta.progress.get(), "probe positions");
+	cout << "Running " << policy.outerThreads << " CPU worker threads with " << policy.fftThreads << " FFT threads each to compute partial PRISM series result\n";
+	ThreadPool::instance().run(policy.outerThreads, [&pars, &dispatcher, &policy, &PRISMATIC_PRINT_FREQUENCY_PROBES](size_t) {
+		size_t Nstart, Nstop, ay, ax;
+		Nstart = Nstop = 0;
+		if (dispatcher.getWork(Nstart, Nstop))
+		{ // synchronously get work assignment
+			Array3D<std::complex<PRISMATIC_FLOAT_PRECISION>> psi_stack = zeros_ND<3, std::complex<PRISMATIC_FLOAT_PRECISION>>(
+				{{pars.psiProbeSeries.get_dimk(), pars.imageSizeReduce[0], pars.imageSizeReduce[1]}});
+			FFTPlan plan = planFFT2D(psi_stack.get_dimj(), psi_stack.get_dimi(), &psi_stack[0], &psi_stack[0], FFTDirection::Forward,
+									 policy.fftThreads, FFTEffort::Measure, psi_stack.get_dimk());
+
+			// main work loop
+			do
+			{
+				while (Nstart < Nstop)
+				{
+					if (Nstart % PRISMATIC_PRINT_FREQUENCY_PROBES == 0 | Nstart == 100)
+					{
+						cout << "Computing Probe Position #" << Nstart << "/" << pars.numProbes << endl;
+					}
+					ay = (pars.meta.arbitraryProbes) ? Nstart : Nstart / pars.numXprobes;
+					ax = (pars.meta.arbitraryProbes) ? Nstart : Nstart % pars.numXprobes;
+					buildSignal_series_CPU(pars, ay, ax, plan, psi_stack);
+#ifdef PRISMATIC_BUILDING_GUI
+					pars.progressbar->signalOutputUpdate(Nstart, pars.numProbes);
+#endif
+					++Nstart;
+				}
+			} while (dispatcher.getWork(Nstart, Nstop));
+		}
+	});
+}
+
+void buildSignal_series_CPU(Parameters<PRISMATIC_FLOAT_PRECISION> &pars,
+							const size_t &ay,
+							const size_t &ax,
+							const FFTPlan &plan,
+							Array3D<std::complex<PRISMATIC_FLOAT_PRECISION>> &psi_stack)
+{
+	// build the output of every series entry for a single probe position. The S-matrix window is
+	// gathered once per beam and contracted against the probe weights of all entries
+
+	const size_t numEntries = psi_stack.get_dimk();
+	const size_t psiSize = psi_stack.get_dimj() * psi_stack.get_dimi();
+
+	// setup some coordinates
+	PRISMATIC_FLOAT_PRECISION x0 = pars.xp[ax] / pars.pixelSizeOutput[1];
+	PRISMATIC_FLOAT_PRECISION y0 = pars.yp[ay] / pars.pixelSizeOutput[0];
+	Array1D<PRISMATIC_FLOAT_PRECISION> &x = scratchArray<1, PRISMATIC_FLOAT_PRECISION>(SCRATCH_COORDS_X, pars.xVec.get_dimarr());
+	Array1D<PRISMATIC_FLOAT_PRECISION> &y = scratchArray<1, PRISMATIC_FLOAT_PRECISION>(SCRATCH_COORDS_Y, pars.yVec.get_dimarr());
+	wrapCoordinates(pars.xVec, round(x0), pars.imageSizeOutput[1], x);
+	wrapCoordinates(pars.yVec, round(y0), pars.imageSizeOutput[0], y);
+
+	memset(&psi_stack[0], 0, sizeof(std::complex<PRISMATIC_FLOAT_PRECISION>) * psi_stack.size());
+
+	std::vector<std::complex<PRISMATIC_FLOAT_PRECISION>> weights(numEntries);
+	for (auto a4 = 0; a4 < pars.beamsIndex.size(); ++a4)
+	{
+		PRISMATIC_FLOAT_PRECISION yB = pars.xyBeams.at(a4, 0);
+		PRISMATIC_FLOAT_PRECISION xB = pars.xyBeams.at(a4, 1);
+
+		bool beamUsed = false;
+		for (auto k = 0; k < numEntries; ++k)
+			beamUsed |= abs(pars.psiProbeSeries.at(k, yB, xB)) > 0;
+
+		if (beamUsed)
+		{
+			const std::complex<PRISMATIC_FLOAT_PRECISION> phaseShift = probePhaseShift(pars, ay, ax, a4);
+			for (auto k = 0; k < numEntries; ++k)
+				weights[k] = pars.psiProbeSeries.at(k, yB, xB) * phaseShift;
+
+			for (auto j = 0; j < y.size(); ++j)
+			{
+				for (auto i = 0; i < x.size(); ++i)
+				{
+					const std::complex<PRISMATIC_FLOAT_PRECISION> S = pars.Scompact.at(a4, y[j], x[i]);
+					std::complex<PRISMATIC_FLOAT_PRECISION> *psi_ptr = &psi_stack.at(0, j, i);
+					for (auto k = 0; k < numEntries; ++k)
+						psi_ptr[k * psiSize] += weights[k] * S;
+				}
 			}
 		}
+	}
+
+	plan.execute();
+
+	size_t write_ay = (pars.meta.arbitraryProbes) ? 0 : ay;
+	Array2D<PRISMATIC_FLOAT_PRECISION> &intOutput = scratchArray<2, PRISMATIC_FLOAT_PRECISION>(SCRATCH_INTENSITY,
+		{{pars.imageSizeReduce[0], pars.imageSizeReduce[1]}});
+	const bool doubleSums = pars.meta.precision == Precision::Mixed;
+	for (auto k = 0; k < numEntries; ++k)
+	{
+		Array4D<PRISMATIC_FLOAT_PRECISION> &output = pars.outputSeries[k];
+		auto psi_ptr = &psi_stack.at(k, 0, 0);
+		for (auto &j : intOutput)
+			j = pow(abs(*psi_ptr++), 2) * pars.scale;
+
+		if (pars.meta.saveDPC_CoM)
+		{
+			//calculate center of mass; qxa, qya are the fourier coordinates, should have 0 components at boundaries
+			centerOfMass(&intOutput[0], &pars.qxaReduce[0], &pars.qyaReduce[0], intOutput.size(), &pars.DPC_CoMSeries[k].at(0, ax, write_ay, 0), doubleSums);
+		}
+
+		// update output -- ax,ay are unique per thread so this write is thread-safe without a lock
+		binDetector(&intOutput[0], &pars.alphaInd[0], intOutput.size(), pars.Ndet, &output.at(0, ax, write_ay, 0), doubleSums);
+	}
+}
 
+bool useSeriesSinglePass(Parameters<PRISMATIC_FLOAT_PRECISION> &pars)
+{
+	// the single pass shares one S-matrix and detector geometry between all series entries, so it
+	// only applies when the entries differ in their probe weights alone
+	for(auto i = 0; i < pars.meta.seriesKeys.size(); i++)
+	{
+		if(!seriesKeyChangesProbeOnly(pars.meta.seriesKeys[i])) return false;
 	}
+	return pars.meta.seriesSinglePass && pars.plan.buildPRISMOutput_series != NULL &&
+		   !pars.meta.matrixRefocus && !pars.meta.save4DOutput && !pars.meta.saveProbe;
 }
 
 void transformIndices(Parameters<PRISMATIC_FLOAT_PRECISION> &pars)
@@ -510,9 +590,8 @@ void transformIndices(Parameters<PRISMATIC_FLOAT_PRECISION> &pars)
 
 	pars.scale = scale;
 
-	//		 The operators +, -, /, * return PRISM arrays by value, so to avoid unnecessary memory
-	//		 allocations/copies for chained operations I try to do things like create variables
-	//		 initially with at most one operation, and then perform in-place transforms if more is needed
+	//		 The operators +, -, /, * build lazy expressions that are evaluated in one pass on assignment,
+	//		 so chained arithmetic is fine; nonlinear steps are still done with in-place transforms
 	Array2D<PRISMATIC_FLOAT_PRECISION> qxaShift = pars.qxaReduce - (pars.meta.probeXtilt / pars.lambda);
 	Array2D<PRISMATIC_FLOAT_PRECISION> qyaShift = pars.qyaReduce - (pars.meta.probeYtilt / pars.lambda);
 	transform(qxaShift.begin(), qxaShift.end(),
@@ -548,6 +627,47 @@ void transformIndices(Parameters<PRISMATIC_FLOAT_PRECISION> &pars)
 			  [&pars](const PRISMATIC_FLOAT_PRECISION &a) { return (a < pars.Ndet) ? 1 : 0; });
 }
 
+void setupPhaseShifts(Parameters<PRISMATIC_FLOAT_PRECISION> &pars)
+{
+	// the probe shift exp(-2*pi*i*(qx*x + qy*y)) of each beam factors into a scan column part and a
+	// scan row part, so tabulate both once instead of evaluating the exponential per beam per probe.
+	// Arbitrary probes have no rows or columns to share, and one table row per probe could be huge,
+	// so probePhaseShift evaluates their shifts directly
+	const size_t numBeams = pars.beamsIndex.size();
+	if (pars.meta.arbitraryProbes)
+	{
+		pars.xPhaseShifts = Array2D<std::complex<PRISMATIC_FLOAT_PRECISION>>();
+		pars.yPhaseShifts = Array2D<std::complex<PRISMATIC_FLOAT_PRECISION>>();
+		return;
+	}
+	pars.xPhaseShifts = zeros_ND<2, std::complex<PRISMATIC_FLOAT_PRECISION>>({{pars.xp.size(), numBeams}});
+	pars.yPhaseShifts = zeros_ND<2, std::complex<PRISMATIC_FLOAT_PRECISION>>({{pars.yp.size(), numBeams}});
+	for (auto a4 = 0; a4 < numBeams; ++a4)
+	{
+		PRISMATIC_FLOAT_PRECISION yB = pars.xyBeams.at(a4, 0);
+		PRISMATIC_FLOAT_PRECISION xB = pars.xyBeams.at(a4, 1);
+		PRISMATIC_FLOAT_PRECISION q0_0 = pars.qxaReduce.at(yB, xB);
+		PRISMATIC_FLOAT_PRECISION q0_1 = pars.qyaReduce.at(yB, xB);
+		for (auto ax = 0; ax < pars.xp.size(); ++ax)
+			pars.xPhaseShifts.at(ax, a4) = exp(-2 * pi * i * q0_0 * (pars.xp[ax] + pars.xTiltShift));
+		for (auto ay = 0; ay < pars.yp.size(); ++ay)
+			pars.yPhaseShifts.at(ay, a4) = exp(-2 * pi * i * q0_1 * (pars.yp[ay] + pars.yTiltShift));
+	}
+}
+
+std::complex<PRISMATIC_FLOAT_PRECISION> probePhaseShift(const Parameters<PRISMATIC_FLOAT_PRECISION> &pars,
+														 const size_t ay,
+														 const size_t ax,
+														 const size_t a4)
+{
+	if (!pars.meta.arbitraryProbes)
+		return pars.xPhaseShifts.at(ax, a4) * pars.yPhaseShifts.at(ay, a4);
+	PRISMATIC_FLOAT_PRECISION yB = pars.xyBeams.at(a4, 0);
+	PRISMATIC_FLOAT_PRECISION xB = pars.xyBeams.at(a4, 1);
+	return exp(-2 * pi * i * (pars.qxaReduce.at(yB, xB) * (pars.xp[ax] + pars.xTiltShift) +
+							  pars.qyaReduce.at(yB, xB) * (pars.yp[ay] + pars.yTiltShift)));
+}
+
 void initializeProbes(Parameters<PRISMATIC_FLOAT_PRECISION> &pars)
 {
 	// initialize the probe
@@ -583,11 +703,12 @@ void initializeProbes(Parameters<PRISMATIC_FLOAT_PRECISION> &pars)
 	pars.psiProbeInit.at(0,0).real(1.0);
 
 
-	Array2D<std::complex<PRISMATIC_FLOAT_PRECISION>> chi = getChi(pars.q1, pars.qTheta, pars.lambda, pars.meta.aberrations);
+	pars.chiEngine.setGrid(pars.q1, pars.qTheta, pars.lambda);
+	const Array2D<PRISMATIC_FLOAT_PRECISION> &chi = pars.chiEngine.evaluate(pars.meta.aberrations);
 	transform(pars.psiProbeInit.begin(), pars.psiProbeInit.end(),
 				chi.begin(), pars.psiProbeInit.begin(),
-				[](std::complex<PRISMATIC_FLOAT_PRECISION> &a, std::complex<PRISMATIC_FLOAT_PRECISION> &b) {
-					a = a * exp(-i * b);
+				[](std::complex<PRISMATIC_FLOAT_PRECISION> &a, const PRISMATIC_FLOAT_PRECISION &b) {
+					a = a * std::complex<PRISMATIC_FLOAT_PRECISION>(cos(b), -sin(b));
 					return a;
 				});
 
@@ -614,8 +735,46 @@ void initializeProbes(Parameters<PRISMATIC_FLOAT_PRECISION> &pars)
 	}
 }
 
+void PRISM03_calcOutput_series(Parameters<PRISMATIC_FLOAT_PRECISION> &pars)
+{
+	// compute the final images of every series entry in one pass over the probe positions
+
+	cout << "Entering PRISM03_calcOutput_series" << endl;
+	setupCoordinates_2(pars);
+	setupDetector(pars);
+	setupBeams_2(pars);
+	setupFourierCoordinates(pars);
+	createStack_integrate(pars);
+	transformIndices(pars);
+	setupPhaseShifts(pars);
+
+	// initialize the probe of each series entry
+	const size_t numEntries = pars.meta.seriesTags.size();
+	pars.psiProbeSeries = zeros_ND<3, std::complex<PRISMATIC_FLOAT_PRECISION>>(
+		{{numEntries, pars.imageSizeReduce[0], pars.imageSizeReduce[1]}});
+	for (auto k = 0; k < numEntries; ++k)
+	{
+		updateSeriesParams(pars, k);
+		pars.meta.aberrations = updateAberrations(pars.meta.aberrations, pars.meta.probeDefocus, pars.meta.C3, pars.meta.C5, pars.lambda);
+		initializeProbes(pars);
+		std::copy(pars.psiProbeInit.begin(), pars.psiProbeInit.end(), &pars.psiProbeSeries.at(k, 0, 0));
+	}
+
+	pars.outputSeries.assign(numEntries, pars.output);
+	if (pars.meta.saveDPC_CoM)
+		pars.DPC_CoMSeries.assign(numEntries, pars.DPC_CoM);
+
+#ifdef PRISMATIC_BUILDING_GUI
+	pars.progressbar->signalDescriptionMessage("Computing final output (PRISM series)");
+	pars.progressbar->signalOutputUpdate(0, pars.numProbes);
+#endif
+
+	pars.plan.buildPRISMOutput_series(pars);
+}
+
 void PRISM03_calcOutput(Parameters<PRISMATIC_FLOAT_PRECISION> &pars)
 {
+	ScopedTimer timer("PRISM03_calcOutput");
 	// compute final image
 
 	cout << "Entering PRISM03_calcOutput" << endl;
@@ -637,6 +796,9 @@ void PRISM03_calcOutput(Parameters<PRISMATIC_FLOAT_PRECISION> &pars)
 	// perform some necessary setup transformations of the data
 	transformIndices(pars);
 
+	// tabulate the probe shift phase factors
+	setupPhaseShifts(pars);
+
 	// initialize/compute the probes
 	initializeProbes(pars);
 
@@ -646,6 +808,6 @@ void PRISM03_calcOutput(Parameters<PRISMATIC_FLOAT_PRECISION> &pars)
 #endif
 
 	// compute the final PRISM output
-	buildPRISMOutput(pars);
+	pars.plan.buildPRISMOutput(pars);
 }
 } // namespace Prismatic
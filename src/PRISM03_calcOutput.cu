@@ -24,8 +24,6 @@
 #include "fileIO.cuh"
 
 namespace Prismatic {
-	extern std::mutex fftw_plan_lock;
-
 	// define some constants
 	__device__ __constant__ float pi_f = PI;
 	__device__ __constant__ cuFloatComplex i_f = {0, 1};
@@ -361,7 +359,7 @@ namespace Prismatic {
 		workers_GPU.reserve(total_num_streams); // prevents multiple reallocations
 		int stream_count = 0;
 		const size_t PRISMATIC_PRINT_FREQUENCY_PROBES = max((size_t) 1, pars.numProbes / 10); // for printing status
-		WorkDispatcher dispatcher(0, pars.numProbes); // create work dispatcher
+		WorkDispatcher dispatcher(0, pars.numProbes, pars.meta.progress.get(), "probe positions"); // create work dispatcher
 
 		for (auto t = 0; t < total_num_streams; ++t) {
 
@@ -443,8 +441,6 @@ namespace Prismatic {
 
 		// Now launch CPU work
 		if (pars.meta.alsoDoCPUWork) {
-			PRISMATIC_FFTW_INIT_THREADS();
-			PRISMATIC_FFTW_PLAN_WITH_NTHREADS(pars.meta.numThreads);
 			vector <thread> workers_CPU;
 			workers_CPU.reserve(pars.meta.numThreads); // prevents multiple reallocations
 			for (auto t = 0; t < pars.meta.numThreads; ++t) {
@@ -463,12 +459,7 @@ namespace Prismatic {
 					if (dispatcher.getWork(Nstart, Nstop, 1, early_CPU_stop)) { // synchronously get work assignment
 						Array2D <std::complex<PRISMATIC_FLOAT_PRECISION>> psi = Prismatic::zeros_ND<2, std::complex<PRISMATIC_FLOAT_PRECISION> >(
 								{{pars.imageSizeReduce[0], pars.imageSizeReduce[1]}});
-						unique_lock <mutex> gatekeeper(fftw_plan_lock);
-						PRISMATIC_FFTW_PLAN plan = PRISMATIC_FFTW_PLAN_DFT_2D(psi.get_dimj(), psi.get_dimi(),
-						                                              reinterpret_cast<PRISMATIC_FFTW_COMPLEX *>(&psi[0]),
-						                                              reinterpret_cast<PRISMATIC_FFTW_COMPLEX *>(&psi[0]),
-						                                              FFTW_FORWARD, FFTW_MEASURE);
-						gatekeeper.unlock();
+						FFTPlan plan = planFFT2D(psi.get_dimj(), psi.get_dimi(), &psi[0], &psi[0], FFTDirection::Forward, 1, FFTEffort::Measure);
 
 						// main work loop
 						do {
@@ -487,15 +478,11 @@ namespace Prismatic {
 							}
 							if (Nstop >= early_CPU_stop) break;
 						} while (dispatcher.getWork(Nstart, Nstop, 1, early_CPU_stop));
-						gatekeeper.lock();
-						PRISMATIC_FFTW_DESTROY_PLAN(plan);
-						gatekeeper.unlock();
 					}
 				}));
 			}
 			cout << "Waiting for CPU threads...\n";
 			for (auto &t:workers_CPU)t.join();
-			PRISMATIC_FFTW_CLEANUP_THREADS();
 		}
 
 		// synchronize
@@ -518,7 +505,7 @@ namespace Prismatic {
 		workers_GPU.reserve(total_num_streams); // prevents multiple reallocations
 		int stream_count = 0;
 		const size_t PRISMATIC_PRINT_FREQUENCY_PROBES = max((size_t)1,pars.numProbes / 10); // for printing status
-		WorkDispatcher dispatcher(0, pars.numProbes);
+		WorkDispatcher dispatcher(0, pars.numProbes, pars.meta.progress.get(), "probe positions");
 
 		for (auto t = 0; t < total_num_streams; ++t) {
 
@@ -594,8 +581,6 @@ namespace Prismatic {
 
 		// Now launch CPU work
 		if (pars.meta.alsoDoCPUWork) {
-			PRISMATIC_FFTW_INIT_THREADS();
-			PRISMATIC_FFTW_PLAN_WITH_NTHREADS(pars.meta.numThreads);
 			vector<thread> workers_CPU;
 			workers_CPU.reserve(pars.meta.numThreads); // prevents multiple reallocations
 			for (auto t = 0; t < pars.meta.numThreads; ++t) {
@@ -613,14 +598,7 @@ namespace Prismatic {
 					if(dispatcher.getWork(Nstart, Nstop, 1, early_CPU_stop)) { // synchronously get work assignment
 						Array2D<std::complex<PRISMATIC_FLOAT_PRECISION> > psi = Prismatic::zeros_ND<2, std::complex<PRISMATIC_FLOAT_PRECISION> > (
 								{{pars.imageSizeReduce[0], pars.imageSizeReduce[1]}});
-						unique_lock<mutex> gatekeeper(fftw_plan_lock);
-
-
-						PRISMATIC_FFTW_PLAN plan = PRISMATIC_FFTW_PLAN_DFT_2D(psi.get_dimj(), psi.get_dimi(),
-						                                              reinterpret_cast<PRISMATIC_FFTW_COMPLEX *>(&psi[0]),
-						                                              reinterpret_cast<PRISMATIC_FFTW_COMPLEX *>(&psi[0]),
-						                                              FFTW_FORWARD, FFTW_MEASURE);
-						gatekeeper.unlock();
+						FFTPlan plan = planFFT2D(psi.get_dimj(), psi.get_dimi(), &psi[0], &psi[0], FFTDirection::Forward, 1, FFTEffort::Measure);
 
 						// main work loop
 						do {
@@ -638,15 +616,11 @@ namespace Prismatic {
 							}
 							if (Nstop >= early_CPU_stop) break;
 						} while(dispatcher.getWork(Nstart, Nstop, 1, early_CPU_stop));
-						gatekeeper.lock();
-						PRISMATIC_FFTW_DESTROY_PLAN(plan);
-						gatekeeper.unlock();
 					}
 				}));
 			}
 			cout << "Waiting for CPU threads...\n";
 			for (auto& t:workers_CPU)t.join();
-			PRISMATIC_FFTW_CLEANUP_THREADS();
 		}
 
 		// synchronize
@@ -59,25 +59,15 @@ void PRISM_entry_pars(Parameters<PRISMATIC_FLOAT_PRECISION> &pars)
 		{
 			PRISM_series_runFP(pars, i);
 		}
+		if(pars.meta.progress) pars.meta.progress->checkCancelled();
 
 		for(auto i = 0; i < pars.meta.seriesTags.size(); i++)
 		{
-			std::string currentName = pars.meta.seriesTags[i];
-			pars.currentTag = currentName;
-			pars.meta.probeDefocus = pars.meta.seriesVals[0][i]; //TODO: later, if expanding sim series past defocus, need to pull current val more generally
+			updateSeriesParams(pars, i);
 
-			readRealDataSet_inOrder(pars.net_output, "prismatic_scratch.h5", "scratch/"+currentName);
-			if(pars.meta.saveDPC_CoM)
-				readRealDataSet_inOrder(pars.net_DPC_CoM, "prismatic_scratch.h5", "scratch/"+currentName+"_DPC");
+			readSeriesOutput(pars);
 			//average data by fp
-			for (auto &i : pars.net_output)
-				i /= pars.meta.numFP;
-
-			if (pars.meta.saveDPC_CoM)
-			{
-				for (auto &j : pars.net_DPC_CoM)
-					j /= pars.meta.numFP; //since squared intensities are used to calculate DPC_CoM, this is incoherent averaging
-			}
+			averageFrozenPhonons(pars);
 
 			saveSTEM(pars);
 		}
@@ -89,17 +79,11 @@ void PRISM_entry_pars(Parameters<PRISMATIC_FLOAT_PRECISION> &pars)
 		{
 			PRISM_runFP(pars, i);
 		}
+		if(pars.meta.progress) pars.meta.progress->checkCancelled();
 
 		std::cout << "All frozen phonon configurations complete. Writing data to output file." << std::endl;
 		//average data by fp
-		for (auto &i : pars.net_output)
-			i /= pars.meta.numFP;
-
-		if (pars.meta.saveDPC_CoM)
-		{
-			for (auto &j : pars.net_DPC_CoM)
-				j /= pars.meta.numFP; //since squared intensities are used to calculate DPC_CoM, this is incoherent averaging
-		}
+		averageFrozenPhonons(pars);
 
 		saveSTEM(pars);
 	}
@@ -107,12 +91,12 @@ void PRISM_entry_pars(Parameters<PRISMATIC_FLOAT_PRECISION> &pars)
 	pars.outputFile = H5::H5File(pars.meta.filenameOutput.c_str(), H5F_ACC_RDWR);
 	
 	//perhaps have this check against the keys
-	if(pars.meta.simSeries) CCseriesSG(pars.outputFile);
+	if(pars.meta.simSeries) seriesSG(pars);
 
 	writeMetadata(pars);
 	pars.outputFile.close();
 
-	if (pars.meta.simSeries) removeScratchFile(pars);
+	if (pars.meta.simSeries) pars.seriesOutput.release();
 
 #ifdef PRISMATIC_ENABLE_GPU
 	cout << "peak GPU memory usage = " << pars.maxGPUMem << '\n';
@@ -123,6 +107,7 @@ void PRISM_entry_pars(Parameters<PRISMATIC_FLOAT_PRECISION> &pars)
 
 void PRISM_runFP(Parameters<PRISMATIC_FLOAT_PRECISION> &pars, size_t fpNum)
 {
+	if(pars.meta.progress) pars.meta.progress->startFrozenPhonon(fpNum, pars.meta.numFP);
 	pars.meta.reseed();
 	pars.meta.fpNum = fpNum;
 	cout << "Frozen Phonon #" << fpNum << endl;
@@ -174,21 +159,13 @@ void PRISM_runFP(Parameters<PRISMATIC_FLOAT_PRECISION> &pars, size_t fpNum)
 	PRISM03_calcOutput(pars);
 	pars.outputFile.close();
 
-	if(fpNum >= 1)
-	{
-		pars.net_output += pars.output;
-		if (pars.meta.saveDPC_CoM) pars.net_DPC_CoM += pars.DPC_CoM;
-	}
-	else
-	{
-		pars.net_output = pars.output;
-		if (pars.meta.saveDPC_CoM) pars.net_DPC_CoM = pars.DPC_CoM;
-	}
+	accumulateFrozenPhonon(pars, fpNum);
 	
 };
 
 void PRISM_series_runFP(Parameters<PRISMATIC_FLOAT_PRECISION> &pars, size_t fpNum)
 {
+	if(pars.meta.progress) pars.meta.progress->startFrozenPhonon(fpNum, pars.meta.numFP);
 	pars.meta.reseed();
 	pars.meta.fpNum = fpNum;
 	cout << "Frozen Phonon #" << fpNum << endl;
@@ -231,6 +208,22 @@ void PRISM_series_runFP(Parameters<PRISMATIC_FLOAT_PRECISION> &pars, size_t fpNu
 		PRISM02_calcSMatrix(pars);
 	}
 
+	if(useSeriesSinglePass(pars))
+	{
+		std::cout << "Computing " << pars.meta.seriesTags.size() << " series entries in a single pass" << std::endl;
+		PRISM03_calcOutput_series(pars);
+		for(auto i = 0; i < pars.meta.seriesTags.size(); i++)
+		{
+			pars.currentTag = pars.meta.seriesTags[i];
+			std::swap(pars.output, pars.outputSeries[i]);
+			if(pars.meta.saveDPC_CoM) std::swap(pars.DPC_CoM, pars.DPC_CoMSeries[i]);
+			if(i == 0 and fpNum == 0) setupSeriesOutput(pars);
+			updateSeriesOutput(pars);
+		}
+		pars.outputFile.close();
+		return;
+	}
+
 	for(auto i = 0; i < pars.meta.seriesVals[0].size(); i++)
 	{
 		std::cout << "------------------- Series iter " << i << " -------------------" << std::endl;
@@ -243,8 +236,8 @@ void PRISM_series_runFP(Parameters<PRISMATIC_FLOAT_PRECISION> &pars, size_t fpNu
 		}
 		PRISM03_calcOutput(pars);
 
-		if(i == 0 and fpNum == 0) createScratchFile(pars);
-		updateScratchData(pars);
+		if(i == 0 and fpNum == 0) setupSeriesOutput(pars);
+		updateSeriesOutput(pars);
 	}
 	pars.outputFile.close();
 
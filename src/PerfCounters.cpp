@@ -0,0 +1,216 @@
+// Copyright Alan (AJ) Pryor, Jr. 2017
+// Transcribed from MATLAB code by Colin Ophus
+// Prismatic is distributed under the GNU General Public License (GPL)
+// If you use Prismatic, we kindly ask that you cite the following papers:
+
+// 1. Ophus, C.: A fast image simulation algorithm for scanning
+//    transmission electron microscopy. Advanced Structural and
+//    Chemical Imaging 3(1), 13 (2017)
+
+// 2. Pryor, Jr., A., Ophus, C., and Miao, J.: A Streaming Multi-GPU
+//    Implementation of Image Simulation Algorithms for Scanning
+//	  Transmission Electron Microscopy. arXiv:1706.08563 (2017)
+
+#include "PerfCounters.h"
+#include "ThreadPool.h"
+#include "ArrayAllocator.h"
+#include <chrono>
+#include <algorithm>
+#include <cstring>
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace Prismatic
+{
+namespace
+{
+const size_t numCounters = 4;
+std::atomic<size_t> lastSession(0);
+thread_local size_t attachedSession = 0;
+
+#if defined(__linux__)
+int openCounter(uint64_t config, int group)
+{
+	struct perf_event_attr attr;
+	std::memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.type = PERF_TYPE_HARDWARE;
+	attr.config = config;
+	attr.disabled = (group == -1); // the group starts when its leader is enabled
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+	attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+	return (int)syscall(__NR_perf_event_open, &attr, 0, -1, group, 0);
+}
+#endif
+} // namespace
+
+CounterValues &CounterValues::operator+=(const CounterValues &other)
+{
+	cycles += other.cycles;
+	instructions += other.instructions;
+	llcReferences += other.llcReferences;
+	llcMisses += other.llcMisses;
+	return *this;
+}
+
+CounterValues CounterValues::operator-(const CounterValues &other) const
+{
+	CounterValues d;
+	d.cycles = cycles - other.cycles;
+	d.instructions = instructions - other.instructions;
+	d.llcReferences = llcReferences - other.llcReferences;
+	d.llcMisses = llcMisses - other.llcMisses;
+	return d;
+}
+
+PerfCounters &PerfCounters::instance()
+{
+	return ThreadPool::instance().perfCounters();
+}
+
+PerfCounters::~PerfCounters()
+{
+	close();
+}
+
+bool PerfCounters::openThread()
+{
+	//caller holds lock. One group per thread: cycles leads, so all four are scheduled together
+#if defined(__linux__)
+	const uint64_t configs[numCounters] = {PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+										   PERF_COUNT_HW_CACHE_REFERENCES, PERF_COUNT_HW_CACHE_MISSES};
+	std::vector<int> group;
+	for (auto c = 0; c < numCounters; ++c)
+	{
+		int fd = openCounter(configs[c], group.empty() ? -1 : group[0]);
+		if (fd < 0)
+		{
+			for (int f : group)
+				::close(f);
+			return false;
+		}
+		group.push_back(fd);
+	}
+	ioctl(group[0], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+	ioctl(group[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+	leaders.push_back(group[0]);
+	fds.insert(fds.end(), group.begin(), group.end());
+	attachedSession = session;
+	return true;
+#else
+	return false;
+#endif
+}
+
+bool PerfCounters::open()
+{
+	std::lock_guard<std::mutex> gatekeeper(lock);
+	if (opened)
+		return true;
+	session = ++lastSession;
+	opened = openThread();
+	return opened;
+}
+
+void PerfCounters::close()
+{
+	std::lock_guard<std::mutex> gatekeeper(lock);
+#if defined(__linux__)
+	for (int f : fds)
+		::close(f);
+#endif
+	fds.clear();
+	leaders.clear();
+	opened = false;
+}
+
+void PerfCounters::attachThisThread()
+{
+	if (!isOpen() || attachedSession == session)
+		return;
+	std::lock_guard<std::mutex> gatekeeper(lock);
+	if (opened && attachedSession != session)
+		openThread();
+}
+
+CounterValues PerfCounters::read()
+{
+	CounterValues total;
+#if defined(__linux__)
+	std::lock_guard<std::mutex> gatekeeper(lock);
+	for (int leader : leaders)
+	{
+		// layout for PERF_FORMAT_GROUP with both times: nr, time_enabled, time_running, values[nr]
+		uint64_t buffer[3 + numCounters];
+		if (::read(leader, buffer, sizeof(buffer)) != sizeof(buffer) || buffer[0] != numCounters)
+			continue;
+		const double scale = buffer[2] > 0 ? (double)buffer[1] / buffer[2] : 0.0;
+		CounterValues v;
+		v.cycles = (uint64_t)(buffer[3] * scale);
+		v.instructions = (uint64_t)(buffer[4] * scale);
+		v.llcReferences = (uint64_t)(buffer[5] * scale);
+		v.llcMisses = (uint64_t)(buffer[6] * scale);
+		total += v;
+	}
+#endif
+	return total;
+}
+
+Roofline measureRoofline()
+{
+	//best of a few runs of two kernels on every pool worker: independent multiply-adds that the compiler
+	//vectorizes for the compute roof, and a stream triad over arrays much larger than cache for bandwidth
+	ThreadPool &pool = ThreadPool::instance();
+	const size_t numWorkers = std::max((size_t)1, pool.size());
+	const int numTrials = 3;
+	Roofline roof;
+
+	const size_t numLanes = 32;
+	const size_t iterations = 1 << 20;
+	std::vector<float> sinks(numWorkers, 0);
+	for (auto trial = 0; trial < numTrials; ++trial)
+	{
+		auto start = std::chrono::steady_clock::now();
+		pool.run(numWorkers, [&](size_t w) {
+			float acc[numLanes];
+			for (auto k = 0; k < numLanes; ++k)
+				acc[k] = 1.0f + k * 1e-3f + w * 1e-6f;
+			const float m = 0.999999f, a = 1e-7f;
+			for (auto it = 0; it < iterations; ++it)
+				for (auto k = 0; k < numLanes; ++k)
+					acc[k] = acc[k] * m + a;
+			float sum = 0;
+			for (auto k = 0; k < numLanes; ++k)
+				sum += acc[k];
+			sinks[w] = sum; // keep the loop from being optimized away
+		});
+		const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		roof.peakFlops = std::max(roof.peakFlops, 2.0 * numLanes * iterations * numWorkers / seconds);
+	}
+
+	const size_t n = 8 * 1024 * 1024;
+	std::vector<float, ArrayAllocator<float>> a(n), b(n), c(n);
+	parallelFill(a.begin(), a.end(), 0.0f);
+	parallelFill(b.begin(), b.end(), 1.0f);
+	parallelFill(c.begin(), c.end(), 2.0f);
+	const size_t chunk = (n + numWorkers - 1) / numWorkers;
+	for (auto trial = 0; trial < numTrials; ++trial)
+	{
+		auto start = std::chrono::steady_clock::now();
+		pool.run(numWorkers, [&](size_t w) {
+			const size_t first = std::min(n, w * chunk);
+			const size_t last = std::min(n, first + chunk);
+			for (auto i = first; i < last; ++i)
+				a[i] = b[i] + 0.5f * c[i];
+		});
+		const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		roof.peakBandwidth = std::max(roof.peakBandwidth, 3.0 * n * sizeof(float) / seconds);
+	}
+	return roof;
+}
+} // namespace Prismatic
@@ -0,0 +1,434 @@
+// Copyright Alan (AJ) Pryor, Jr. 2017
+// Transcribed from MATLAB code by Colin Ophus
+// Prismatic is distributed under the GNU General Public License (GPL)
+// If you use Prismatic, we kindly ask that you cite the following papers:
+
+// 1. Ophus, C.: A fast image simulation algorithm for scanning
+//    transmission electron microscopy. Advanced Structural and
+//    Chemical Imaging 3(1), 13 (2017)
+
+// 2. Pryor, Jr., A., Ophus, C., and Miao, J.: A Streaming Multi-GPU
+//    Implementation of Image Simulation Algorithms for Scanning
+//	  Transmission Electron Microscopy. arXiv:1706.08563 (2017)
+
+#include "ResourcePlanner.h"
+#include "atom.h"
+#include "params.h"
+#include <algorithm>
+#include <cmath>
+#include <complex>
+#include <fstream>
+#include <iomanip>
+#include <set>
+
+namespace Prismatic
+{
+namespace
+{
+// executable, FFTW plans, HDF5 caches and other allocations not modelled below
+const unsigned long long processOverhead = 16ull << 20;
+const size_t realBytes = sizeof(PRISMATIC_FLOAT_PRECISION);
+const size_t complexBytes = sizeof(std::complex<PRISMATIC_FLOAT_PRECISION>);
+
+unsigned long long fileBytes(const std::string &filename)
+{
+	std::ifstream f(filename, std::ios::binary | std::ios::ate);
+	return f ? (unsigned long long)f.tellg() : 0;
+}
+
+// the detector and beam counts below follow Parameters::calculateFileSize and PRISM02_calcSMatrix
+size_t numDetectors(const Metadata<PRISMATIC_FLOAT_PRECISION> &meta, const std::array<size_t, 2> &imageSize, double lambda)
+{
+	const double dpx = 1.0 / (imageSize[1] * meta.realspacePixelSize[1]);
+	const double dpy = 1.0 / (imageSize[0] * meta.realspacePixelSize[0]);
+	const double qmax = std::min(dpx * std::floor(imageSize[1] / 2), dpy * std::floor(imageSize[0] / 2)) / 2;
+	return (size_t)std::max(0.0, std::floor((qmax * lambda - meta.detectorAngleStep) / meta.detectorAngleStep));
+}
+
+size_t numBeams(const Metadata<PRISMATIC_FLOAT_PRECISION> &meta, const std::array<size_t, 2> &imageSize, double lambda)
+{
+	//lattice points of the interpolated grid inside the beam aperture, but no more than the antialiasing mask allows
+	const double alphaBeamMax = meta.maxProbeSemiangle() + 2.5 / 1000.0;
+	const double qx = alphaBeamMax / lambda * imageSize[1] * meta.realspacePixelSize[1] / meta.interpolationFactorX;
+	const double qy = alphaBeamMax / lambda * imageSize[0] * meta.realspacePixelSize[0] / meta.interpolationFactorY;
+	const double maskPoints = (double)imageSize[0] * imageSize[1] / (4.0 * meta.interpolationFactorX * meta.interpolationFactorY);
+	return (size_t)std::ceil(std::min(std::acos(-1) * qx * qy, maskPoints)) + 1;
+}
+
+size_t numTilts(const Metadata<PRISMATIC_FLOAT_PRECISION> &meta, const std::array<double, 2> &pixelSize, double lambda)
+{
+	//plane waves on the tilt grid, clamped to the antialiasing aperture like Parameters does
+	const double maxX = std::min((double)meta.maxXtilt, lambda / (4.0 * pixelSize[1]));
+	const double maxY = std::min((double)meta.maxYtilt, lambda / (4.0 * pixelSize[0]));
+	const double stepX = std::min((double)meta.xTiltStep, maxX);
+	const double stepY = std::min((double)meta.yTiltStep, maxY);
+	if (stepX <= 0 || stepY <= 0)
+		return 1;
+	if (meta.maxRtilt > 0)
+	{
+		const double outer = std::min((double)meta.maxRtilt, std::min(maxX, maxY));
+		const double inner = std::min((double)meta.minRtilt, outer);
+		return std::max((size_t)1, (size_t)std::ceil(std::acos(-1) * (outer * outer - inner * inner) / (stepX * stepY)));
+	}
+	const size_t nx = 2 * (size_t)std::floor(maxX / stepX) + 1;
+	const size_t ny = 2 * (size_t)std::floor(maxY / stepY) + 1;
+	const size_t innerX = meta.minXtilt > 0 ? 2 * (size_t)std::ceil(std::min((double)meta.minXtilt, maxX) / stepX) - 1 : 0;
+	const size_t innerY = meta.minYtilt > 0 ? 2 * (size_t)std::ceil(std::min((double)meta.minYtilt, maxY) / stepY) - 1 : 0;
+	return std::max((size_t)1, nx * ny - innerX * innerY);
+}
+
+size_t numDepthOutputs(const Metadata<PRISMATIC_FLOAT_PRECISION> &meta, size_t numPlanes)
+{
+	//output depths of a multislice run, as createStack counts them
+	if (meta.algorithm != Algorithm::Multislice)
+		return 1;
+	const size_t numSlices = meta.numSlices > 0 ? meta.numSlices : numPlanes;
+	const size_t zStartPlane = (size_t)std::ceil(meta.zStart / meta.sliceThickness);
+	size_t numLayers = (numPlanes + numSlices - 1) / numSlices;
+	if (zStartPlane > 0)
+		numLayers += (zStartPlane % numSlices == 0) - zStartPlane / numSlices;
+	return std::max((size_t)1, numLayers);
+}
+
+void buildStages(const Metadata<PRISMATIC_FLOAT_PRECISION> &meta, ResourcePlan &plan)
+{
+	const SimulationSize &s = plan.size;
+	const unsigned long long N = (unsigned long long)s.imageSize[0] * s.imageSize[1];
+	const unsigned long long Nreduce = N / (4 * meta.interpolationFactorX * meta.interpolationFactorY);
+	const size_t numThreads = std::max((size_t)1, meta.numThreads);
+	const size_t workerCap = plan.maxWorkerThreads > 0 ? std::min(numThreads, plan.maxWorkerThreads) : numThreads;
+	auto workersFor = [workerCap](size_t numJobs) { return std::max((size_t)1, std::min(workerCap, numJobs)); };
+	const double numFP = std::max((size_t)1, meta.numFP);
+	plan.stages.clear();
+
+	//PRISM01: atom coordinates, lookup table and potential slices, one slice or atom footprint per worker
+	const unsigned long long atoms = s.numAtoms * sizeof(atom);
+	const unsigned long long pot = s.numPlanes * N * realBytes;
+	const size_t xleng = (size_t)std::ceil(meta.potBound / (s.tiledCellDim[2] / s.imageSize[1]));
+	const size_t yleng = (size_t)std::ceil(meta.potBound / (s.tiledCellDim[1] / s.imageSize[0]));
+	const unsigned long long footprint = (2 * xleng + 1) * (2 * yleng + 1);
+	StagePlan potential = {"PRISM01_calcPotential", processOverhead + atoms + pot, 0, 0, 0, s.inputBytes};
+	if (meta.importPotential)
+	{
+		potential.name = "PRISM01_importPotential";
+		potential.workers = 1;
+		potential.ioBytes = s.inputBytes + pot;
+	}
+	else if (meta.potential3D)
+	{
+		const size_t zleng = (size_t)std::ceil(meta.potBound / (meta.sliceThickness / meta.zSampling));
+		const double planesPerAtom = std::ceil(2 * meta.potBound / meta.sliceThickness) + 1;
+		potential.sharedBytes += 6 * s.numAtoms * realBytes + s.numSpecies * 2 * zleng * footprint * complexBytes;
+		potential.workerBytes = 2 * footprint * complexBytes;
+		potential.workers = workersFor(s.numAtoms);
+		potential.flops = numFP * s.numAtoms * (2.0 * zleng * footprint * 8 + planesPerAtom * 2 * fftFlops((double)footprint));
+	}
+	else
+	{
+		potential.sharedBytes += 6 * s.numAtoms * realBytes + s.numSpecies * footprint * realBytes;
+		potential.workerBytes = N * realBytes;
+		potential.workers = workersFor(s.numPlanes);
+		potential.flops = numFP * s.numAtoms * footprint * 2.0;
+	}
+	plan.stages.push_back(potential);
+
+	//propagators, masks and coordinate grids set up by PRISM02 and Multislice
+	const unsigned long long grids = 2 * N * complexBytes + N * (sizeof(unsigned int) + 3 * realBytes);
+	const unsigned long long transmission = s.numPlanes * N * complexBytes;
+	const double propagateFlops = 2 * fftFlops((double)N) + 12.0 * N; // two FFTs and two complex products per plane
+
+	//series accumulators stay in RAM only within seriesMemoryBudget; mixed precision keeps every sum in double
+	const unsigned long long outputElements = s.numLayers * s.numProbes * s.numDetectors + (meta.saveDPC_CoM ? 2 * s.numProbes : 0);
+	const size_t sumBytes = meta.precision == Precision::Mixed ? sizeof(double) : realBytes;
+	const unsigned long long outputPerEntry = outputElements * realBytes;
+	const unsigned long long accumulators = s.numSeries > 1 ? s.numSeries * outputElements * sumBytes : 0;
+	const bool spill = accumulators > plan.seriesMemoryBudget;
+	const unsigned long long outputBytes = outputPerEntry + (meta.precision == Precision::Mixed ? outputElements * sumBytes : 0) + (spill ? 0 : accumulators);
+	const unsigned long long spillIO = spill ? (unsigned long long)(2 * numFP * accumulators) : 0;
+	const std::array<double, 2> pixelSize = {s.tiledCellDim[1] / s.imageSize[0], s.tiledCellDim[2] / s.imageSize[1]};
+	const unsigned long long outputFile = outputFileElements(meta, s.imageSize, pixelSize, s.lambda, s.numProbes, s.numPlanes, s.numSeries) * realBytes;
+
+	if (meta.algorithm == Algorithm::PRISM || meta.algorithm == Algorithm::HRTEM)
+	{
+		//PRISM02: transmission and the compact S-matrix, a batch of full size beams per worker
+		const unsigned long long Scompact = s.numBeams * (N / 4) * complexBytes;
+		const size_t workers = workersFor(s.numBeams);
+		const size_t batch = std::min(plan.batchSize, std::max((size_t)1, s.numBeams / workers));
+		StagePlan smatrix = {"PRISM02_calcSMatrix", processOverhead + atoms + pot + grids + transmission + Scompact,
+							 batch * N * complexBytes, workers, numFP * s.numBeams * s.numPlanes * propagateFlops, 0};
+		if (meta.importSMatrix)
+		{
+			smatrix.name = "PRISM02_importSMatrix";
+			smatrix.workerBytes = 0;
+			smatrix.workers = 1;
+			smatrix.flops = 0;
+			smatrix.ioBytes = Scompact;
+		}
+		if (meta.algorithm == Algorithm::HRTEM)
+			smatrix.ioBytes += outputFile;
+		plan.stages.push_back(smatrix);
+
+		if (meta.algorithm == Algorithm::PRISM)
+		{
+			//PRISM03: output arrays, and per worker one reduced probe per series entry computed at once
+			const size_t entriesPerPass = meta.seriesSinglePass ? s.numSeries : 1;
+			StagePlan output = {"PRISM03_calcOutput", smatrix.sharedBytes + outputBytes + entriesPerPass * Nreduce * complexBytes,
+								entriesPerPass * Nreduce * complexBytes + (meta.save4DOutput ? 2 : 1) * Nreduce * realBytes,
+								workersFor(s.numProbes),
+								numFP * s.numProbes * s.numSeries * (s.numBeams * Nreduce * 8.0 + fftFlops((double)Nreduce) + 4.0 * Nreduce),
+								outputFile + spillIO};
+			plan.stages.push_back(output);
+		}
+	}
+	else if (meta.algorithm == Algorithm::Multislice)
+	{
+		//one batch of full size probes per worker propagated through every plane
+		const size_t workers = workersFor(s.numProbes);
+		const size_t batch = std::min(plan.batchSize, std::max((size_t)1, s.numProbes / workers));
+		StagePlan output = {"Multislice_calcOutput", processOverhead + atoms + pot + grids + transmission + outputBytes,
+							batch * N * complexBytes + (meta.save4DOutput ? N / 4 * realBytes : 0), workers,
+							numFP * s.numSeries * s.numProbes * s.numPlanes * propagateFlops, outputFile + spillIO};
+		plan.stages.push_back(output);
+	}
+}
+} // namespace
+
+unsigned long long outputFileElements(const Metadata<PRISMATIC_FLOAT_PRECISION> &meta,
+									  const std::array<size_t, 2> &imageSize, const std::array<double, 2> &pixelSize,
+									  double lambda, size_t numProbes, size_t numPlanes, size_t numSeries)
+{
+	const size_t Ndet = numDetectors(meta, imageSize, lambda);
+	const unsigned long long Nreduce = (unsigned long long)imageSize[0] * imageSize[1] / 4; //the S-matrix and HRTEM image size
+	unsigned long long numElems = 0;
+	if (meta.save2DOutput)
+		numElems += numProbes;
+	if (meta.save3DOutput)
+		numElems += numProbes * Ndet;
+	if (meta.saveDPC_CoM)
+		numElems += 2 * numProbes;
+	if (meta.simSeries)
+		numElems *= std::max((size_t)1, numSeries); //one set of STEM outputs per series entry
+
+	if (meta.algorithm == Algorithm::Multislice)
+	{
+		if (meta.save4DOutput)
+			numElems += numProbes * Nreduce;
+		numElems *= numDepthOutputs(meta, numPlanes); //every output is written at each depth
+	}
+	else if (meta.algorithm == Algorithm::PRISM)
+	{
+		if (meta.save4DOutput)
+			numElems += numProbes * imageSize[0] * imageSize[1] / (4 * meta.interpolationFactorX * meta.interpolationFactorY);
+		if (meta.saveSMatrix)
+			numElems += numBeams(meta, imageSize, lambda) * Nreduce;
+	}
+	else if (meta.algorithm == Algorithm::HRTEM)
+	{
+		//no STEM outputs, one image per tilt: the summed intensity, or the complex wave of every frozen phonon
+		const unsigned long long image = numTilts(meta, pixelSize, lambda) * Nreduce;
+		numElems = meta.saveComplexOutputWave ? 2 * image * std::max((size_t)1, meta.numFP) : image;
+		if (meta.saveSMatrix)
+			numElems += 2 * image * std::max((size_t)1, meta.numFP);
+	}
+
+	if (meta.savePotentialSlices)
+		numElems += imageSize[0] * imageSize[1] * numPlanes;
+	return numElems;
+}
+
+SimulationSize estimateSimulationSize(const Metadata<PRISMATIC_FLOAT_PRECISION> &meta)
+{
+	//mirrors the grid setup of the Parameters constructor, PRISM01 and the probe setup of PRISM03/Multislice
+	SimulationSize s;
+	std::array<double, 3> cellDim = {meta.cellDim[0], meta.cellDim[1], meta.cellDim[2]};
+	if (meta.atoms)
+	{
+		std::set<size_t> species;
+		for (auto &a : *meta.atoms)
+			species.insert(a.species);
+		s.numAtoms = meta.atoms->size();
+		s.numSpecies = species.size();
+	}
+	else
+	{
+		if (!meta.userSpecifiedCelldims)
+			cellDim = peekDims_xyz(meta.filenameAtoms);
+		peekAtomCounts_xyz(meta.filenameAtoms, s.numAtoms, s.numSpecies);
+	}
+	s.numAtoms *= meta.tileX * meta.tileY * meta.tileZ;
+
+	s.tiledCellDim = cellDim;
+	s.tiledCellDim[2] *= meta.tileX;
+	s.tiledCellDim[1] *= meta.tileY;
+	s.tiledCellDim[0] *= meta.tileZ;
+
+	constexpr double m = 9.109383e-31;
+	constexpr double e = 1.602177e-19;
+	constexpr double c = 299792458;
+	constexpr double h = 6.62607e-34;
+	s.lambda = h / std::sqrt(2 * m * e * meta.E0) / std::sqrt(1 + e * meta.E0 / 2 / m / c / c) * 1e10;
+
+	const PRISMATIC_FLOAT_PRECISION f_x = 4 * meta.interpolationFactorX;
+	const PRISMATIC_FLOAT_PRECISION f_y = 4 * meta.interpolationFactorY;
+	s.imageSize[0] = simulationGridSize(s.tiledCellDim[1], meta.realspacePixelSize[0], f_y, meta.fftFriendlyGrid);
+	s.imageSize[1] = simulationGridSize(s.tiledCellDim[2], meta.realspacePixelSize[1], f_x, meta.fftFriendlyGrid);
+	const std::array<double, 2> pixelSize = {s.tiledCellDim[1] / s.imageSize[0], s.tiledCellDim[2] / s.imageSize[1]};
+
+	s.numPlanes = (size_t)std::ceil(s.tiledCellDim[0] / meta.sliceThickness);
+	s.numLayers = numDepthOutputs(meta, s.numPlanes);
+
+	double xMin = meta.scanWindowXMin, xMax = meta.scanWindowXMax;
+	double yMin = meta.scanWindowYMin, yMax = meta.scanWindowYMax;
+	if (meta.realSpaceWindow_x)
+	{
+		xMin = std::min((double)meta.scanWindowXMin_r, s.tiledCellDim[2]) / s.tiledCellDim[2];
+		xMax = std::min((double)meta.scanWindowXMax_r, s.tiledCellDim[2]) / s.tiledCellDim[2];
+	}
+	if (meta.realSpaceWindow_y)
+	{
+		yMin = std::min((double)meta.scanWindowYMin_r, s.tiledCellDim[1]) / s.tiledCellDim[1];
+		yMax = std::min((double)meta.scanWindowYMax_r, s.tiledCellDim[1]) / s.tiledCellDim[1];
+	}
+	size_t numXP = (size_t)std::floor((xMax - xMin) * s.tiledCellDim[2] / meta.probeStepX);
+	size_t numYP = (size_t)std::floor((yMax - yMin) * s.tiledCellDim[1] / meta.probeStepY);
+	if (meta.nyquistSampling)
+	{
+		numXP = (size_t)std::ceil(4 * (meta.probeSemiangle / s.lambda) * s.tiledCellDim[2]);
+		numYP = (size_t)std::ceil(4 * (meta.probeSemiangle / s.lambda) * s.tiledCellDim[1]);
+	}
+	s.numProbes = meta.arbitraryProbes ? meta.probes_x.size() : std::max((size_t)1, numXP * numYP);
+
+	s.numDetectors = numDetectors(meta, s.imageSize, s.lambda);
+	s.numBeams = 0;
+	if (meta.algorithm == Algorithm::PRISM)
+		s.numBeams = numBeams(meta, s.imageSize, s.lambda);
+	else if (meta.algorithm == Algorithm::HRTEM)
+		s.numBeams = numTilts(meta, pixelSize, s.lambda);
+
+	s.numSeries = 1;
+	if (meta.probeDefocus_step > 0)
+		s.numSeries = (size_t)std::floor((meta.probeDefocus_max - meta.probeDefocus_min) / meta.probeDefocus_step) + 1;
+	else if (meta.probeDefocus_sigma > 0)
+		s.numSeries = 9;
+	for (auto &vals : meta.seriesInputVals)
+		s.numSeries *= std::max((size_t)1, vals.size());
+
+	s.inputBytes = meta.atoms ? 0 : fileBytes(meta.filenameAtoms);
+	if (meta.importPotential || meta.importSMatrix || meta.importExtraPotential)
+		s.inputBytes += fileBytes(meta.importFile);
+	return s;
+}
+
+unsigned long long ResourcePlan::peakBytes() const
+{
+	unsigned long long peak = 0;
+	for (auto &s : stages)
+		peak = std::max(peak, s.peakBytes());
+	return peak;
+}
+
+double ResourcePlan::flops() const
+{
+	double total = 0;
+	for (auto &s : stages)
+		total += s.flops;
+	return total;
+}
+
+unsigned long long ResourcePlan::ioBytes() const
+{
+	unsigned long long total = 0;
+	for (auto &s : stages)
+		total += s.ioBytes;
+	return total;
+}
+
+ResourcePlan planResources(const Metadata<PRISMATIC_FLOAT_PRECISION> &meta, const SimulationSize &size)
+{
+	ResourcePlan plan;
+	plan.size = size;
+	plan.batchSize = std::max((size_t)1, meta.batchSizeTargetCPU);
+	plan.maxWorkerThreads = meta.maxWorkerThreads;
+	plan.seriesMemoryBudget = meta.seriesMemoryBudget;
+	plan.memoryBudget = meta.memoryBudget;
+	buildStages(meta, plan);
+	if (plan.memoryBudget == 0)
+	{
+		plan.fits = true;
+		return plan;
+	}
+
+	//cheapest first: smaller FFT batches, then series accumulators in a scratch file, then fewer workers
+	//(the threads they free are handed to FFTW by chooseExecutionPolicy)
+	while (plan.peakBytes() > plan.memoryBudget && plan.batchSize > 1)
+	{
+		plan.batchSize /= 2;
+		buildStages(meta, plan);
+	}
+	if (plan.peakBytes() > plan.memoryBudget && plan.seriesMemoryBudget > 0)
+	{
+		plan.seriesMemoryBudget = 0;
+		buildStages(meta, plan);
+	}
+	size_t workers = 0;
+	for (auto &s : plan.stages)
+		workers = std::max(workers, s.workers);
+	while (plan.peakBytes() > plan.memoryBudget && workers > 1)
+	{
+		plan.maxWorkerThreads = --workers;
+		buildStages(meta, plan);
+	}
+	plan.fits = plan.peakBytes() <= plan.memoryBudget;
+	return plan;
+}
+
+ResourcePlan planResources(const Metadata<PRISMATIC_FLOAT_PRECISION> &meta)
+{
+	return planResources(meta, estimateSimulationSize(meta));
+}
+
+void applyPlan(const ResourcePlan &plan, Metadata<PRISMATIC_FLOAT_PRECISION> &meta)
+{
+	meta.batchSizeTargetCPU = plan.batchSize;
+	meta.batchSizeCPU = plan.batchSize;
+	meta.maxWorkerThreads = plan.maxWorkerThreads;
+	meta.seriesMemoryBudget = plan.seriesMemoryBudget;
+}
+
+void ResourcePlan::print(std::ostream &out, const Roofline &roofline) const
+{
+	const double GB = 1e9, MB = 1e6;
+	out << "\nResource plan\n";
+	out << "image size " << size.imageSize[0] << " x " << size.imageSize[1] << ", " << size.numPlanes << " planes, "
+		<< size.numAtoms << " atoms, " << size.numProbes << " probes, " << size.numDetectors << " detector bins";
+	if (size.numBeams > 0)
+		out << ", " << size.numBeams << " beams";
+	if (size.numSeries > 1)
+		out << ", " << size.numSeries << " series entries";
+	out << '\n';
+	out << std::fixed << std::left << std::setw(28) << "stage" << std::right << std::setw(14) << "shared (GB)" << std::setw(16)
+		<< "per worker (MB)" << std::setw(9) << "workers" << std::setw(12) << "peak (GB)" << std::setw(12) << "GFLOP"
+		<< std::setw(10) << "I/O (GB)" << '\n';
+	for (auto &s : stages)
+	{
+		out << std::left << std::setw(28) << s.name << std::right << std::setprecision(3) << std::setw(14) << s.sharedBytes / GB
+			<< std::setw(16) << std::setprecision(1) << s.workerBytes / MB << std::setw(9) << s.workers << std::setw(12)
+			<< std::setprecision(3) << s.peakBytes() / GB << std::setw(12) << std::setprecision(1) << s.flops / 1e9
+			<< std::setw(10) << std::setprecision(3) << s.ioBytes / GB << '\n';
+	}
+	out << std::setprecision(3) << "Estimated peak memory (GB): " << peakBytes() / GB << '\n';
+	out << "Estimated work (GFLOP): " << std::setprecision(1) << flops() / 1e9 << ", I/O (GB): " << std::setprecision(3) << ioBytes() / GB << '\n';
+	if (roofline.peakFlops > 0)
+		out << "Run time lower bound at the measured peak of " << std::setprecision(1) << roofline.peakFlops / 1e9
+			<< " GFLOP/s (s): " << std::setprecision(2) << flops() / roofline.peakFlops << '\n';
+	if (memoryBudget > 0)
+	{
+		out << "Memory budget (GB): " << std::setprecision(3) << memoryBudget / GB << (fits ? "" : " -- cannot be met, the plan above is the smallest found") << '\n';
+		out << "Batch size " << batchSize << ", worker threads " << (maxWorkerThreads > 0 ? std::to_string(maxWorkerThreads) : std::string("unlimited"));
+		if (size.numSeries > 1)
+			out << ", series memory (GB) " << seriesMemoryBudget / GB;
+		out << '\n';
+	}
+	out << std::defaultfloat << std::flush;
+}
+} // namespace Prismatic
@@ -0,0 +1,67 @@
+// Copyright Alan (AJ) Pryor, Jr. 2017
+// Transcribed from MATLAB code by Colin Ophus
+// Prismatic is distributed under the GNU General Public License (GPL)
+// If you use Prismatic, we kindly ask that you cite the following papers:
+
+// 1. Ophus, C.: A fast image simulation algorithm for scanning
+//    transmission electron microscopy. Advanced Structural and
+//    Chemical Imaging 3(1), 13 (2017)
+
+// 2. Pryor, Jr., A., Ophus, C., and Miao, J.: A Streaming Multi-GPU
+//    Implementation of Image Simulation Algorithms for Scanning
+//	  Transmission Electron Microscopy. arXiv:1706.08563 (2017)
+
+#include "SimulationProgress.h"
+
+namespace Prismatic{
+
+void SimulationProgress::startFrozenPhonon(const size_t fpNum, const size_t numFP)
+{
+	checkCancelled();
+	this->fpNum = fpNum;
+	this->numFP = numFP;
+};
+
+void SimulationProgress::startStage(const std::string &stage, const size_t total)
+{
+	std::lock_guard<std::mutex> gatekeeper(lock);
+	this->stage = stage;
+	this->total = total;
+	done = 0;
+};
+
+void SimulationProgress::setDone(const size_t done)
+{
+	this->done = done;
+};
+
+SimulationProgress::Snapshot SimulationProgress::snapshot() const
+{
+	Snapshot snapshot;
+	{
+		std::lock_guard<std::mutex> gatekeeper(lock);
+		snapshot.stage = stage;
+		snapshot.done = done;
+		snapshot.total = total;
+	}
+	snapshot.fpNum = fpNum;
+	snapshot.numFP = numFP;
+	return snapshot;
+};
+
+void SimulationProgress::cancel()
+{
+	stop = true;
+};
+
+bool SimulationProgress::cancelled() const
+{
+	return stop;
+};
+
+void SimulationProgress::checkCancelled() const
+{
+	if (stop) throw SimulationCancelled();
+};
+
+} //namespace Prismatic
@@ -0,0 +1,97 @@
+// Copyright Alan (AJ) Pryor, Jr. 2017
+// Transcribed from MATLAB code by Colin Ophus
+// Prismatic is distributed under the GNU General Public License (GPL)
+// If you use Prismatic, we kindly ask that you cite the following papers:
+
+// 1. Ophus, C.: A fast image simulation algorithm for scanning
+//    transmission electron microscopy. Advanced Structural and
+//    Chemical Imaging 3(1), 13 (2017)
+
+// 2. Pryor, Jr., A., Ophus, C., and Miao, J.: A Streaming Multi-GPU
+//    Implementation of Image Simulation Algorithms for Scanning
+//	  Transmission Electron Microscopy. arXiv:1706.08563 (2017)
+
+#include "SimulationResults.h"
+#include <stdexcept>
+
+namespace Prismatic{
+
+size_t ResultArray::size() const
+{
+	size_t size = 1;
+	for (auto d : shape) size *= d;
+	return size;
+};
+
+void SimulationResults::add(const std::string &name, const std::vector<size_t> &shape, PRISMATIC_FLOAT_PRECISION *data, std::shared_ptr<void> owner)
+{
+	ResultArray result;
+	result.shape = shape;
+	result.data = data;
+	result.owner = owner;
+	std::lock_guard<std::mutex> gatekeeper(lock);
+	arrays[name] = result;
+};
+
+template <class T>
+void SimulationResults::accumulateBlock(const std::string &name, const std::array<size_t, 4> &dims,
+										const std::array<size_t, 4> &blockDims, const std::array<size_t, 4> &offset,
+										const T *block, const PRISMATIC_FLOAT_PRECISION numFP)
+{
+	std::lock_guard<std::mutex> gatekeeper(lock);
+	ResultArray &result = arrays[name];
+	std::shared_ptr<std::vector<T>> cube = std::static_pointer_cast<std::vector<T>>(result.owner);
+	if (!cube)
+	{
+		cube = std::make_shared<std::vector<T>>(dims[0] * dims[1] * dims[2] * dims[3], (T)0);
+		result.shape = std::vector<size_t>(dims.begin(), dims.end());
+		result.complex = sizeof(T) != sizeof(PRISMATIC_FLOAT_PRECISION);
+		result.data = reinterpret_cast<PRISMATIC_FLOAT_PRECISION *>(&(*cube)[0]);
+		result.owner = cube;
+	}
+
+	for (auto l = 0; l < blockDims[0]; l++)
+	{
+		for (auto k = 0; k < blockDims[1]; k++)
+		{
+			for (auto j = 0; j < blockDims[2]; j++)
+			{
+				T *dst = &(*cube)[(((l + offset[0]) * dims[1] + k + offset[1]) * dims[2] + j + offset[2]) * dims[3] + offset[3]];
+				const T *src = block + ((l * blockDims[1] + k) * blockDims[2] + j) * blockDims[3];
+				for (auto i = 0; i < blockDims[3]; i++) dst[i] += src[i] / numFP;
+			}
+		}
+	}
+};
+
+void SimulationResults::accumulateDatacube(const std::string &name, const std::array<size_t, 4> &dims,
+										   const std::array<size_t, 4> &blockDims, const std::array<size_t, 4> &offset,
+										   const PRISMATIC_FLOAT_PRECISION *block, const PRISMATIC_FLOAT_PRECISION numFP)
+{
+	accumulateBlock(name, dims, blockDims, offset, block, numFP);
+};
+
+void SimulationResults::accumulateDatacube(const std::string &name, const std::array<size_t, 4> &dims,
+										   const std::array<size_t, 4> &blockDims, const std::array<size_t, 4> &offset,
+										   const std::complex<PRISMATIC_FLOAT_PRECISION> *block, const PRISMATIC_FLOAT_PRECISION numFP)
+{
+	accumulateBlock(name, dims, blockDims, offset, block, numFP);
+};
+
+const ResultArray &SimulationResults::get(const std::string &name) const
+{
+	std::lock_guard<std::mutex> gatekeeper(lock);
+	auto result = arrays.find(name);
+	if (result == arrays.end()) throw std::domain_error("No simulation output called " + name);
+	return result->second;
+};
+
+std::vector<std::string> SimulationResults::names() const
+{
+	std::lock_guard<std::mutex> gatekeeper(lock);
+	std::vector<std::string> names;
+	for (auto &result : arrays) names.push_back(result.first);
+	return names;
+};
+
+} //namespace Prismatic
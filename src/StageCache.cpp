@@ -0,0 +1,194 @@
+// Copyright Alan (AJ) Pryor, Jr. 2017
+// Transcribed from MATLAB code by Colin Ophus
+// Prismatic is distributed under the GNU General Public License (GPL)
+// If you use Prismatic, we kindly ask that you cite the following papers:
+
+// 1. Ophus, C.: A fast image simulation algorithm for scanning
+//    transmission electron microscopy. Advanced Structural and
+//    Chemical Imaging 3(1), 13 (2017)
+
+// 2. Pryor, Jr., A., Ophus, C., and Miao, J.: A Streaming Multi-GPU
+//    Implementation of Image Simulation Algorithms for Scanning
+//	  Transmission Electron Microscopy. arXiv:1706.08563 (2017)
+
+#include "StageCache.h"
+#include "params.h"
+#include <cstdint>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+
+namespace Prismatic{
+
+namespace
+{
+// FNV-1a, enough to tell inputs apart; keys also spell out the scalar parameters
+class Hash
+{
+	public:
+	template <class T>
+	Hash &add(const T *data, const size_t count)
+	{
+		const unsigned char *bytes = reinterpret_cast<const unsigned char *>(data);
+		for (size_t i = 0; i < count * sizeof(T); ++i)
+		{
+			value ^= bytes[i];
+			value *= 1099511628211ull;
+		}
+		return *this;
+	}
+
+	template <class C>
+	Hash &addAll(const C &container)
+	{
+		return container.size() == 0 ? *this : add(&*container.begin(), container.size());
+	}
+
+	std::string str() const
+	{
+		std::ostringstream s;
+		s << std::hex << value;
+		return s.str();
+	}
+
+	private:
+	uint64_t value = 14695981039346656037ull;
+};
+
+std::string potentialKey(const Parameters<PRISMATIC_FLOAT_PRECISION> &pars)
+{
+	Hash atoms;
+	for (auto &a : pars.atoms)
+	{
+		const double fields[5] = {a.x, a.y, a.z, a.sigma, a.occ};
+		atoms.add(fields, 5).add(&a.species, 1);
+	}
+	const Metadata<PRISMATIC_FLOAT_PRECISION> &meta = pars.meta;
+	std::ostringstream key;
+	key.precision(17);
+	key << atoms.str() << ' ' << pars.tiledCellDim[0] << ' ' << pars.tiledCellDim[1] << ' ' << pars.tiledCellDim[2] << ' '
+		<< pars.imageSize[0] << 'x' << pars.imageSize[1] << ' ' << pars.pixelSize[0] << ' ' << pars.pixelSize[1] << ' '
+		<< meta.potBound << ' ' << meta.sliceThickness << ' ' << meta.potential3D << ' ' << meta.zSampling << ' '
+		<< meta.includeThermalEffects << ' ' << meta.includeOccupancy << ' ' << meta.importExtraPotential << ' ' << meta.importPotential;
+	// an imported potential is never stored, but the S-matrix built from it is, so key it by the data that was read
+	if (meta.importPotential)
+		key << ' ' << meta.importFile << ' ' << meta.importPath << ' ' << Hash().addAll(pars.pot).str();
+	// thermal displacements are drawn from the seed of this frozen phonon, so a new seed means a new configuration
+	if (meta.includeThermalEffects)
+		key << ' ' << meta.randomSeed;
+	if (meta.importExtraPotential)
+		key << ' ' << meta.importFile << ' ' << meta.importPath << ' ' << meta.extraPotentialFactor << ' ' << (int)meta.extraPotentialType;
+	return key.str();
+}
+
+std::string sMatrixKey(const Parameters<PRISMATIC_FLOAT_PRECISION> &pars)
+{
+	// the propagators and beam selection carry the energy, interpolation factors and tilts
+	Hash fill;
+	fill.addAll(pars.prop).addAll(pars.beamsIndex).addAll(pars.qxInd).addAll(pars.qyInd);
+	if (pars.meta.algorithm == Algorithm::HRTEM)
+		fill.addAll(pars.propBack);
+	std::ostringstream key;
+	key.precision(17);
+	key << potentialKey(pars) << ' ' << (int)pars.meta.algorithm << ' ' << pars.sigma << ' ' << pars.numberBeams << ' ' << fill.str();
+	return key.str();
+}
+} // namespace
+
+std::vector<atom> StageCache::readAtoms(const std::string &filename, std::array<double, 3> &dims)
+{
+	std::ifstream f(filename, std::ios::binary);
+	const std::string contents((std::istreambuf_iterator<char>(f)), std::istreambuf_iterator<char>());
+	const std::string version = std::to_string(contents.size()) + ":" + Hash().addAll(contents).str();
+
+	std::lock_guard<std::mutex> gatekeeper(lock);
+	auto known = atomFiles.find(filename);
+	if (known != atomFiles.end() && known->second.version == version)
+	{
+		++counts.atomsReused;
+		dims = known->second.dims;
+		return known->second.atoms;
+	}
+	AtomFile &file = atomFiles[filename];
+	file.atoms = readAtoms_xyz(filename);
+	file.dims = peekDims_xyz(filename);
+	file.version = version;
+	dims = file.dims;
+	return file.atoms;
+};
+
+StageCache::FrozenPhonon &StageCache::entry(const size_t fpNum)
+{
+	if (frozenPhonons.size() <= fpNum)
+		frozenPhonons.resize(fpNum + 1);
+	return frozenPhonons[fpNum];
+};
+
+bool StageCache::restorePotential(Parameters<PRISMATIC_FLOAT_PRECISION> &pars)
+{
+	const std::string key = potentialKey(pars);
+	std::lock_guard<std::mutex> gatekeeper(lock);
+	FrozenPhonon &fp = entry(pars.fpFlag);
+	if (fp.potentialKey != key)
+		return false;
+	pars.pot = fp.pot;
+	pars.numPlanes = fp.numPlanes;
+	pars.dzPot = fp.dzPot;
+	if (pars.meta.numSlices == 0)
+		pars.numSlices = pars.numPlanes;
+	++counts.potentialsReused;
+	return true;
+};
+
+void StageCache::storePotential(const Parameters<PRISMATIC_FLOAT_PRECISION> &pars)
+{
+	const std::string key = potentialKey(pars);
+	std::lock_guard<std::mutex> gatekeeper(lock);
+	FrozenPhonon &fp = entry(pars.fpFlag);
+	fp.potentialKey = key;
+	fp.pot = pars.pot;
+	fp.numPlanes = pars.numPlanes;
+	fp.dzPot = pars.dzPot;
+	// an S-matrix built from a different potential is stale
+	fp.sMatrixKey.clear();
+	fp.Scompact = ArrayND<3, std::vector<std::complex<PRISMATIC_FLOAT_PRECISION>>>();
+	++counts.potentialsComputed;
+};
+
+bool StageCache::restoreSMatrix(Parameters<PRISMATIC_FLOAT_PRECISION> &pars)
+{
+	const std::string key = sMatrixKey(pars);
+	std::lock_guard<std::mutex> gatekeeper(lock);
+	FrozenPhonon &fp = entry(pars.fpFlag);
+	if (fp.sMatrixKey != key)
+		return false;
+	pars.Scompact = fp.Scompact;
+	++counts.sMatricesReused;
+	return true;
+};
+
+void StageCache::storeSMatrix(const Parameters<PRISMATIC_FLOAT_PRECISION> &pars)
+{
+	const std::string key = sMatrixKey(pars);
+	std::lock_guard<std::mutex> gatekeeper(lock);
+	FrozenPhonon &fp = entry(pars.fpFlag);
+	fp.sMatrixKey = key;
+	fp.Scompact = pars.Scompact;
+	++counts.sMatricesComputed;
+};
+
+StageCache::Stats StageCache::stats() const
+{
+	std::lock_guard<std::mutex> gatekeeper(lock);
+	return counts;
+};
+
+void StageCache::clear()
+{
+	std::lock_guard<std::mutex> gatekeeper(lock);
+	atomFiles.clear();
+	frozenPhonons.clear();
+	counts = Stats();
+};
+
+} //namespace Prismatic
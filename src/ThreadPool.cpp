@@ -0,0 +1,315 @@
+// Copyright Alan (AJ) Pryor, Jr. 2017
+// Transcribed from MATLAB code by Colin Ophus
+// Prismatic is distributed under the GNU General Public License (GPL)
+// If you use Prismatic, we kindly ask that you cite the following papers:
+
+// 1. Ophus, C.: A fast image simulation algorithm for scanning
+//    transmission electron microscopy. Advanced Structural and
+//    Chemical Imaging 3(1), 13 (2017)
+
+// 2. Pryor, Jr., A., Ophus, C., and Miao, J.: A Streaming Multi-GPU
+//    Implementation of Image Simulation Algorithms for Scanning
+//	  Transmission Electron Microscopy. arXiv:1706.08563 (2017)
+
+#include "ThreadPool.h"
+#include "ArrayAllocator.h"
+#include "Instrumentation.h"
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <algorithm>
+#include <iostream>
+#include <stdexcept>
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace Prismatic
+{
+namespace
+{
+thread_local bool insidePool = false;
+thread_local ThreadPool *current = nullptr; // pool of the run this thread works for
+
+std::mutex leaseLock;
+bool sharedLeased = false; // guarded by leaseLock
+
+#if defined(__linux__)
+std::vector<int> parseCpuList(const std::string &list)
+{
+	//parse the kernel's cpulist format, e.g. "0-3,8-11"
+	std::vector<int> cpus;
+	std::stringstream ss(list);
+	std::string range;
+	while (std::getline(ss, range, ','))
+	{
+		if (range.empty() || range == "\n")
+			continue;
+		size_t dash = range.find('-');
+		int first = std::stoi(range.substr(0, dash));
+		int last = (dash == std::string::npos) ? first : std::stoi(range.substr(dash + 1));
+		for (int c = first; c <= last; ++c)
+			cpus.push_back(c);
+	}
+	return cpus;
+}
+#endif
+
+void pinnedCores(std::vector<int> &cpus, std::vector<size_t> &nodes, size_t &numNodes)
+{
+	//cores this process may run on, grouped by NUMA node in node order
+	cpus.clear();
+	nodes.clear();
+	numNodes = 1;
+#if defined(__linux__)
+	cpu_set_t allowed;
+	CPU_ZERO(&allowed);
+	if (sched_getaffinity(0, sizeof(cpu_set_t), &allowed) != 0)
+		return;
+
+	std::vector<bool> assigned(CPU_SETSIZE, false);
+	size_t node = 0;
+	for (size_t n = 0;; ++n)
+	{
+		std::ifstream f("/sys/devices/system/node/node" + std::to_string(n) + "/cpulist");
+		if (!f)
+			break;
+		std::string list;
+		std::getline(f, list);
+		bool any = false;
+		for (int c : parseCpuList(list))
+		{
+			if (c < CPU_SETSIZE && CPU_ISSET(c, &allowed) && !assigned[c])
+			{
+				cpus.push_back(c);
+				nodes.push_back(node);
+				assigned[c] = true;
+				any = true;
+			}
+		}
+		if (any)
+			++node;
+	}
+	numNodes = std::max((size_t)1, node);
+
+	//cores the kernel did not report a node for (e.g. no sysfs) go on the first node
+	for (int c = 0; c < CPU_SETSIZE; ++c)
+	{
+		if (CPU_ISSET(c, &allowed) && !assigned[c])
+		{
+			cpus.push_back(c);
+			nodes.push_back(0);
+		}
+	}
+#endif
+}
+} // namespace
+
+ThreadPool &ThreadPool::instance()
+{
+	static ThreadPool pool;
+	return current != nullptr ? *current : pool;
+}
+
+ThreadPool::Lease::Lease() : previous(current), shared(false)
+{
+	if (previous != nullptr)
+		return;
+	{
+		std::lock_guard<std::mutex> gatekeeper(leaseLock);
+		shared = !sharedLeased;
+		sharedLeased = true;
+	}
+	if (!shared)
+		own.reset(new ThreadPool);
+	current = shared ? &instance() : own.get();
+}
+
+ThreadPool::Lease::~Lease()
+{
+	current = previous;
+	if (shared)
+	{
+		std::lock_guard<std::mutex> gatekeeper(leaseLock);
+		sharedLeased = false;
+	}
+}
+
+ThreadPool::ThreadPool() : numWorkers(0), numNodes(1), pinned(false), task(nullptr), numTasks(0), generation(0), remaining(0), quit(false),
+						   policy(new ArrayAllocationPolicy), runProfiler(new Profiler), counters(new PerfCounters){};
+
+ThreadPool::~ThreadPool()
+{
+	stop();
+}
+
+ArrayAllocationPolicy &ThreadPool::allocationPolicy()
+{
+	return *policy;
+}
+
+Profiler &ThreadPool::profiler()
+{
+	return *runProfiler;
+}
+
+PerfCounters &ThreadPool::perfCounters()
+{
+	return *counters;
+}
+
+int ThreadPool::cpu(size_t worker) const
+{
+	return (pinned && worker < cpus.size()) ? cpus[worker] : -1;
+}
+
+size_t ThreadPool::numaNode(size_t worker) const
+{
+	return (pinned && worker < nodes.size()) ? nodes[worker] : 0;
+}
+
+void ThreadPool::configure(size_t numThreads, bool pin)
+{
+	if (insidePool)
+		throw std::logic_error("PRISM: ThreadPool cannot be reconfigured from one of its own tasks\n");
+	std::lock_guard<std::mutex> guard(runLock);
+	numThreads = std::max((size_t)1, numThreads);
+	if (numThreads == numWorkers && pin == pinned)
+		return;
+	stop();
+	start(numThreads, pin);
+}
+
+void ThreadPool::start(size_t numThreads, bool pin)
+{
+	quit = false;
+	pinned = false;
+	cpus.clear();
+	nodes.clear();
+	numNodes = 1;
+	if (pin)
+	{
+		std::vector<int> available;
+		std::vector<size_t> availableNodes;
+		pinnedCores(available, availableNodes, numNodes);
+		if (available.empty())
+		{
+			std::cout << "Warning: CPU pinning is not supported on this platform, worker threads will not be pinned" << std::endl;
+		}
+		else
+		{
+			if (numThreads > available.size())
+				std::cout << "Warning: more worker threads (" << numThreads << ") than available cores (" << available.size() << "), some cores will be shared" << std::endl;
+			for (auto t = 0; t < numThreads; ++t)
+			{
+				cpus.push_back(available[t % available.size()]);
+				nodes.push_back(availableNodes[t % available.size()]);
+			}
+			pinned = true;
+		}
+	}
+
+	numWorkers = numThreads;
+	workers.reserve(numThreads);
+	for (auto t = 0; t < numThreads; ++t)
+		workers.push_back(std::thread(&ThreadPool::workerLoop, this, (size_t)t, generation));
+}
+
+void ThreadPool::stop()
+{
+	{
+		std::lock_guard<std::mutex> gatekeeper(lock);
+		quit = true;
+	}
+	wake.notify_all();
+	for (auto &t : workers)
+		t.join();
+	workers.clear();
+	numWorkers = 0;
+}
+
+void ThreadPool::workerLoop(size_t id, size_t seen)
+{
+	insidePool = true;
+	current = this;
+#if defined(__linux__)
+	if (pinned)
+	{
+		cpu_set_t set;
+		CPU_ZERO(&set);
+		CPU_SET(cpus[id], &set);
+		pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &set);
+	}
+#endif
+
+	// seen is the job generation at start-up, so that jobs posted before this worker reaches the wait are not missed
+	std::unique_lock<std::mutex> gatekeeper(lock);
+	while (true)
+	{
+		wake.wait(gatekeeper, [&] { return quit || generation != seen; });
+		if (quit)
+			return;
+		seen = generation;
+		const std::function<void(size_t)> &f = *task;
+		const size_t n = numTasks;
+		const size_t stride = numWorkers;
+		gatekeeper.unlock();
+
+		const bool profiling = runProfiler->isEnabled();
+		if (profiling)
+			counters->attachThisThread();
+		const ProfileClock::time_point begin = profiling ? ProfileClock::now() : ProfileClock::time_point();
+		for (size_t t = id; t < n; t += stride)
+		{
+			try
+			{
+				f(t);
+			}
+			catch (...)
+			{
+				std::lock_guard<std::mutex> errorGuard(lock);
+				if (!error)
+					error = std::current_exception();
+			}
+		}
+		if (profiling)
+			runProfiler->addWorkerTask(id, begin, ProfileClock::now());
+
+		gatekeeper.lock();
+		if (--remaining == 0)
+			finished.notify_all();
+	}
+}
+
+void ThreadPool::run(size_t _numTasks, const std::function<void(size_t)> &_task)
+{
+	if (_numTasks == 0)
+		return;
+	if (insidePool || numWorkers == 0)
+	{
+		for (auto t = 0; t < _numTasks; ++t)
+			_task(t);
+		return;
+	}
+
+	std::lock_guard<std::mutex> guard(runLock);
+	const ProfileClock::time_point begin = ProfileClock::now();
+	std::unique_lock<std::mutex> gatekeeper(lock);
+	task = &_task;
+	numTasks = _numTasks;
+	remaining = numWorkers;
+	error = nullptr;
+	++generation;
+	wake.notify_all();
+	finished.wait(gatekeeper, [&] { return remaining == 0; });
+	task = nullptr;
+	runProfiler->addPoolRun(begin, ProfileClock::now());
+	if (error)
+	{
+		std::exception_ptr e = error;
+		error = nullptr;
+		std::rethrow_exception(e);
+	}
+}
+} // namespace Prismatic
@@ -18,17 +18,28 @@
 namespace Prismatic
 {
 WorkDispatcher::WorkDispatcher(size_t _current,
-							   size_t _stop) : current(_current),
-											   stop(_stop){};
+							   size_t _stop,
+							   SimulationProgress *_progress,
+							   const std::string &stage) : current(_current),
+														   stop(_stop),
+														   progress(_progress)
+{
+	if (progress)
+		progress->startStage(stage, stop - current);
+};
 
 bool WorkDispatcher::getWork(size_t &job_start, size_t &job_stop, size_t num_requested, size_t early_cpu_stop)
 {
 	std::lock_guard<std::mutex> gatekeeper(lock);
 	if (job_start >= stop | current >= early_cpu_stop)
 		return false; // all jobs done, terminate
+	if (progress && progress->cancelled())
+		return false;
 	job_start = current;
 	job_stop = std::min(stop, current + num_requested);
 	current = job_stop;
+	if (progress)
+		progress->setDone(current);
 	return true;
 }
 } // namespace Prismatic
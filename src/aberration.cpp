@@ -103,36 +103,174 @@ std::vector<aberration> readAberrations(const std::string &filename)
 	return aberrations;
 };
 
-Array2D<std::complex<PRISMATIC_FLOAT_PRECISION>> getChi(Array2D<PRISMATIC_FLOAT_PRECISION> &q,
-                                                        Array2D<PRISMATIC_FLOAT_PRECISION> &qTheta,
-                                                        PRISMATIC_FLOAT_PRECISION &lambda, 
-                                                        std::vector<aberration> &ab)
+void ChiEngine::setGrid(const Array2D<PRISMATIC_FLOAT_PRECISION> &_q,
+                        const Array2D<PRISMATIC_FLOAT_PRECISION> &_qTheta,
+                        const PRISMATIC_FLOAT_PRECISION &_lambda)
 {
+    bool sameGrid = (lambda == _lambda) &&
+                    (q.get_dimarr() == _q.get_dimarr()) && (qTheta.get_dimarr() == _qTheta.get_dimarr()) &&
+                    std::equal(q.begin(), q.end(), _q.begin()) &&
+                    std::equal(qTheta.begin(), qTheta.end(), _qTheta.begin());
+    if(sameGrid) return;
 
-    Array2D<std::complex<PRISMATIC_FLOAT_PRECISION>> chi = zeros_ND<2, std::complex<PRISMATIC_FLOAT_PRECISION>>({{q.get_dimj(), q.get_dimi()}});
+    clear();
+    q = _q;
+    qTheta = _qTheta;
+    lambda = _lambda;
+};
+
+void ChiEngine::clear()
+{
+    alphaPowers.clear();
+    cosBases.clear();
+    sinBases.clear();
+    terms.clear();
+    chi = Array2D<PRISMATIC_FLOAT_PRECISION>();
+    numIncrementalUpdates = 0;
+};
+
+const std::vector<PRISMATIC_FLOAT_PRECISION> &ChiEngine::alphaPower(const int k)
+{
+    //alpha^k from alpha^(k-1), so every power costs one multiply per pixel
+    auto it = alphaPowers.find(k);
+    if(it != alphaPowers.end()) return it->second;
+
+    std::vector<PRISMATIC_FLOAT_PRECISION> power(q.size());
+    if(k == 1)
+    {
+        for(auto j = 0; j < q.size(); j++) power[j] = lambda * q[j];
+    }
+    else
+    {
+        const std::vector<PRISMATIC_FLOAT_PRECISION> &lower = alphaPower(k - 1);
+        const std::vector<PRISMATIC_FLOAT_PRECISION> &alpha = alphaPower(1);
+        for(auto j = 0; j < q.size(); j++) power[j] = lower[j] * alpha[j];
+    }
+    return alphaPowers[k] = std::move(power);
+};
+
+const std::vector<PRISMATIC_FLOAT_PRECISION> &ChiEngine::cosBasis(const int m)
+{
+    //cos(m*theta) and sin(m*theta) by angle addition from the m-1 terms
+    auto it = cosBases.find(m);
+    if(it != cosBases.end()) return it->second;
+
+    std::vector<PRISMATIC_FLOAT_PRECISION> c(qTheta.size()), s(qTheta.size());
+    if(m == 1)
+    {
+        for(auto j = 0; j < qTheta.size(); j++)
+        {
+            c[j] = cos(qTheta[j]);
+            s[j] = sin(qTheta[j]);
+        }
+    }
+    else
+    {
+        const std::vector<PRISMATIC_FLOAT_PRECISION> &c1 = cosBasis(1);
+        const std::vector<PRISMATIC_FLOAT_PRECISION> &s1 = sinBases[1];
+        const std::vector<PRISMATIC_FLOAT_PRECISION> &cm = cosBasis(m - 1);
+        const std::vector<PRISMATIC_FLOAT_PRECISION> &sm = sinBases[m - 1];
+        for(auto j = 0; j < qTheta.size(); j++)
+        {
+            c[j] = cm[j] * c1[j] - sm[j] * s1[j];
+            s[j] = sm[j] * c1[j] + cm[j] * s1[j];
+        }
+    }
+    sinBases[m] = std::move(s);
+    return cosBases[m] = std::move(c);
+};
+
+const std::vector<PRISMATIC_FLOAT_PRECISION> &ChiEngine::sinBasis(const int m)
+{
+    cosBasis(m);
+    return sinBases[m];
+};
+
+void ChiEngine::addTerm(const term_key &key, const term_coef &coef)
+{
+    //chi += alpha^(n+1) * (a*cos(m*theta) + b*sin(m*theta))
+    const std::vector<PRISMATIC_FLOAT_PRECISION> &alpha_n = alphaPower(key.first + 1);
+    PRISMATIC_FLOAT_PRECISION *chi_ptr = &chi[0];
+    const size_t N = chi.size();
+    if(key.second == 0)
+    {
+        for(auto j = 0; j < N; j++) chi_ptr[j] += coef.first * alpha_n[j];
+    }
+    else
+    {
+        const std::vector<PRISMATIC_FLOAT_PRECISION> &c = cosBasis(key.second);
+        const std::vector<PRISMATIC_FLOAT_PRECISION> &s = sinBasis(key.second);
+        for(auto j = 0; j < N; j++) chi_ptr[j] += alpha_n[j] * (coef.first * c[j] + coef.second * s[j]);
+    }
+};
+
+const Array2D<PRISMATIC_FLOAT_PRECISION> &ChiEngine::evaluate(const std::vector<aberration> &ab)
+{
+    //cos(m*(theta - phi)) = cos(m*theta)cos(m*phi) + sin(m*theta)sin(m*phi), so every aberration is a
+    //weighted sum of two cached bases
     const PRISMATIC_FLOAT_PRECISION pi = acos(-1);
     PRISMATIC_FLOAT_PRECISION k = 2.0 * pi / lambda;
+    std::map<term_key, term_coef> newTerms;
     for(auto n = 0; n < ab.size(); n++)
     {
         PRISMATIC_FLOAT_PRECISION phi_rad = ab[n].phi * pi / 180.0;
         PRISMATIC_FLOAT_PRECISION pre_factor = k / (ab[n].n + 1) * ab[n].C_mag;
-        for(auto j = 0; j < chi.get_dimj(); j++)
+        term_coef &coef = newTerms[term_key(ab[n].n, ab[n].m)];
+        coef.first += pre_factor * cos(ab[n].m * phi_rad);
+        coef.second += pre_factor * sin(ab[n].m * phi_rad);
+    }
+
+    //collect the change of every term relative to the current chi
+    std::map<term_key, term_coef> deltas;
+    for(auto &t : newTerms) deltas[t.first] = t.second;
+    for(auto &t : terms)
+    {
+        term_coef &d = deltas[t.first];
+        d.first -= t.second.first;
+        d.second -= t.second.second;
+    }
+    for(auto it = deltas.begin(); it != deltas.end();)
+    {
+        if(it->second.first == 0 && it->second.second == 0)
         {
-            for(auto i = 0; i < chi.get_dimi(); i++)
-            {
-                PRISMATIC_FLOAT_PRECISION alpha = lambda * q.at(j,i);
-                PRISMATIC_FLOAT_PRECISION tmp = chi.at(j,i).real();
-                if (ab[n].m == 0) {
-                    tmp += pre_factor * pow(alpha, ab[n].n + 1);
-                }
-                else {
-                    tmp += pre_factor * pow(alpha, ab[n].n + 1) * cos(ab[n].m * (qTheta.at(j,i) - phi_rad));
-                }
-                chi.at(j,i).real(tmp);
-            }
+            it = deltas.erase(it);
+        }
+        else
+        {
+            ++it;
         }
     }
 
+    //rebuild from scratch if most terms changed, and now and then to bound accumulated rounding
+    bool rebuild = (chi.size() != q.size()) || (2 * deltas.size() > newTerms.size()) || (numIncrementalUpdates >= 32);
+    if(rebuild)
+    {
+        chi = zeros_ND<2, PRISMATIC_FLOAT_PRECISION>({{q.get_dimj(), q.get_dimi()}});
+        for(auto &t : newTerms) addTerm(t.first, t.second);
+        numIncrementalUpdates = 0;
+    }
+    else if(deltas.size() > 0)
+    {
+        for(auto &t : deltas) addTerm(t.first, t.second);
+        numIncrementalUpdates++;
+    }
+
+    terms = newTerms;
+    return chi;
+};
+
+Array2D<std::complex<PRISMATIC_FLOAT_PRECISION>> getChi(Array2D<PRISMATIC_FLOAT_PRECISION> &q,
+                                                        Array2D<PRISMATIC_FLOAT_PRECISION> &qTheta,
+                                                        PRISMATIC_FLOAT_PRECISION &lambda, 
+                                                        std::vector<aberration> &ab)
+{
+    ChiEngine engine;
+    engine.setGrid(q, qTheta, lambda);
+    const Array2D<PRISMATIC_FLOAT_PRECISION> &chi_real = engine.evaluate(ab);
+
+    Array2D<std::complex<PRISMATIC_FLOAT_PRECISION>> chi = zeros_ND<2, std::complex<PRISMATIC_FLOAT_PRECISION>>({{q.get_dimj(), q.get_dimi()}});
+    for(auto j = 0; j < chi.size(); j++) chi[j].real(chi_real[j]);
+
     return chi;
 
 };
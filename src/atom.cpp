@@ -207,6 +207,32 @@ std::array<double, 3> peekDims_xyz(const std::string &filename)
 	return {c, b, a};
 }
 
+void peekAtomCounts_xyz(const std::string &filename, size_t &numAtoms, size_t &numSpecies)
+{
+	//same line structure as readAtoms_xyz, but only the species column of each line is parsed
+	std::ifstream f(filename);
+	if (!f)
+		throw std::runtime_error("Unable to open file.\n");
+	std::string line;
+	if (!std::getline(f, line) || !std::getline(f, line))
+		throw std::runtime_error("Error reading file header.\n");
+	std::vector<bool> seen(NUM_SPECIES_KIRKLAND + 1, false);
+	numAtoms = numSpecies = 0;
+	while (std::getline(f, line))
+	{
+		const size_t first = line.find_first_not_of(" \n\t");
+		if (first == std::string::npos || line.find_last_not_of(" \n\t") - first + 1 <= 3)
+			break;
+		++numAtoms;
+		const size_t species = strtoul(line.c_str() + first, NULL, 10);
+		if (species <= NUM_SPECIES_KIRKLAND && !seen[species])
+		{
+			seen[species] = true;
+			++numSpecies;
+		}
+	}
+}
+
 std::string getLowercaseExtension(const std::string filename)
 {
 	std::string::size_type idx;
@@ -29,12 +29,6 @@
 #endif //PRISMATIC_ENABLE_GPU
 namespace Prismatic
 {
-entry_func execute_plan;
-ms_output_func buildMultisliceOutput;
-prism_output_func buildPRISMOutput;
-format_output_func formatOutput_CPU;
-fill_Scompact_func fill_Scompact;
-
 #ifdef PRISMATIC_ENABLE_GPU
 template <class T>
 StreamingMode transferMethodAutoChooser(Prismatic::Metadata<T> &meta)
@@ -54,8 +48,8 @@ StreamingMode transferMethodAutoChooser(Prismatic::Metadata<T> &meta)
 	T f_x = 4 * meta.interpolationFactorX;
 	T f_y = 4 * meta.interpolationFactorY;
 	Array1D<size_t> imageSize({{(size_t)(meta.cellDim[1] * meta.tileY), (size_t)(meta.cellDim[2] * meta.tileX)}}, {{2}});
-	imageSize[0] = (size_t)std::max((PRISMATIC_FLOAT_PRECISION)4.0, (f_y * round(((T)imageSize[0]) / meta.realspacePixelSize[0] / f_y)));
-	imageSize[1] = (size_t)std::max((PRISMATIC_FLOAT_PRECISION)4.0, (f_x * round(((T)imageSize[1]) / meta.realspacePixelSize[1] / f_x)));
+	imageSize[0] = simulationGridSize((T)imageSize[0], meta.realspacePixelSize[0], f_y, meta.fftFriendlyGrid);
+	imageSize[1] = simulationGridSize((T)imageSize[1], meta.realspacePixelSize[1], f_x, meta.fftFriendlyGrid);
 
 	size_t estimatedPotentialSize = (meta.cellDim[0] * meta.tileZ / meta.sliceThickness) * imageSize[0] * imageSize[1] *
 									sizeof(std::complex<PRISMATIC_FLOAT_PRECISION>);
@@ -189,95 +183,76 @@ StreamingMode transferMethodAutoChooser(Prismatic::Metadata<T> &meta)
 	return Prismatic::StreamingMode::SingleXfer;
 #endif //PRISMATIC_ENABLE_GPU
 }
-format_output_func_GPU formatOutput_GPU;
-
 #endif
-void configure(Metadata<PRISMATIC_FLOAT_PRECISION> &meta)
+ExecutionPlan executionPlan(const Metadata<PRISMATIC_FLOAT_PRECISION> &meta)
 {
-	// std::cout << "Formatting" << std::endl;
-	formatOutput_CPU = formatOutput_CPU_integrate;
+	ExecutionPlan plan;
+	plan.formatOutput_CPU = formatOutput_CPU_integrate;
 #ifdef PRISMATIC_ENABLE_GPU
-	formatOutput_GPU = formatOutput_GPU_integrate;
-#endif
+	plan.formatOutput_GPU = formatOutput_GPU_integrate;
+	StreamingMode transferMode = meta.transferMode;
+	if (transferMode == Prismatic::StreamingMode::Auto)
+	{
+		Metadata<PRISMATIC_FLOAT_PRECISION> resolved = meta;
+		transferMode = transferMethodAutoChooser(resolved);
+	}
+	const bool streaming = transferMode == Prismatic::StreamingMode::Stream;
+#endif //PRISMATIC_ENABLE_GPU
 	if (meta.algorithm == Algorithm::PRISM)
 	{
-		std::cout << "Execution plan: PRISM\n";
-		execute_plan = PRISM_entry;
+		plan.execute_plan = PRISM_entry;
 #ifdef PRISMATIC_ENABLE_GPU
-		if (meta.transferMode == Prismatic::StreamingMode::Auto)
-		{
-			meta.transferMode = transferMethodAutoChooser(meta);
-		}
-		std::cout << "Using GPU codes" << '\n';
-		if (meta.transferMode == Prismatic::StreamingMode::Stream)
-		{
-			cout << "Using streaming method\n";
-			fill_Scompact = fill_Scompact_GPU_streaming;
-			buildPRISMOutput = buildPRISMOutput_GPU_streaming;
-		}
-		else
-		{
-			cout << "Using single transfer method\n";
-			fill_Scompact = fill_Scompact_GPU_singlexfer;
-			buildPRISMOutput = buildPRISMOutput_GPU_singlexfer;
-		}
-
+		plan.fill_Scompact = streaming ? fill_Scompact_GPU_streaming : fill_Scompact_GPU_singlexfer;
+		plan.buildPRISMOutput = streaming ? buildPRISMOutput_GPU_streaming : buildPRISMOutput_GPU_singlexfer;
 #else
-		fill_Scompact = fill_Scompact_CPUOnly;
-		buildPRISMOutput = buildPRISMOutput_CPUOnly;
+		plan.fill_Scompact = fill_Scompact_CPUOnly;
+		plan.buildPRISMOutput = buildPRISMOutput_CPUOnly;
+		plan.buildPRISMOutput_series = buildPRISMOutput_series_CPUOnly;
 #endif //PRISMATIC_ENABLE_GPU
 	}
 	else if (meta.algorithm == Algorithm::Multislice)
 	{
-		std::cout << "Execution plan: Multislice\n";
-		execute_plan = Multislice_entry;
+		plan.execute_plan = Multislice_entry;
 #ifdef PRISMATIC_ENABLE_GPU
-		std::cout << "Using GPU codes" << '\n';
-		if (meta.transferMode == Prismatic::StreamingMode::Auto)
-		{
-			meta.transferMode = transferMethodAutoChooser(meta);
-		}
-		if (meta.transferMode == Prismatic::StreamingMode::Stream)
-		{
-			cout << "Using streaming method\n";
-			buildMultisliceOutput = buildMultisliceOutput_GPU_streaming;
-		}
-		else
-		{
-			cout << "Using single transfer method\n";
-			buildMultisliceOutput = buildMultisliceOutput_GPU_singlexfer;
-		}
-
+		plan.buildMultisliceOutput = streaming ? buildMultisliceOutput_GPU_streaming : buildMultisliceOutput_GPU_singlexfer;
 #else
-		buildMultisliceOutput = buildMultisliceOutput_CPUOnly;
+		plan.buildMultisliceOutput = buildMultisliceOutput_CPUOnly;
 #endif //PRISMATIC_ENABLE_GPU
 	}
 	else if (meta.algorithm == Algorithm::HRTEM)
 	{
-		std::cout <<"Execution plan: HRTEM\n";
-		execute_plan = HRTEM_entry;
+		plan.execute_plan = HRTEM_entry;
 #ifdef PRISMATIC_ENABLE_GPU
-		std::cout << "Using GPU codes" << '\n';
-		if (meta.transferMode == Prismatic::StreamingMode::Auto)
-		{
-			meta.transferMode = transferMethodAutoChooser(meta);
-		}
-		if (meta.transferMode == Prismatic::StreamingMode::Stream)
-		{
-			cout << "Using streaming method\n";
-			fill_Scompact = fill_Scompact_GPU_streaming;
-		}
-		else
-		{
-			cout << "Using single transfer method\n";
-			fill_Scompact = fill_Scompact_GPU_singlexfer;
-		}
+		plan.fill_Scompact = streaming ? fill_Scompact_GPU_streaming : fill_Scompact_GPU_singlexfer;
 #else
-		std::cout << "Using CPU codes" << '\n';
-		fill_Scompact = fill_Scompact_CPUOnly;
-
+		plan.fill_Scompact = fill_Scompact_CPUOnly;
 #endif //PRISMATIC_ENABLE_GPU
 	}
+	return plan;
+}
 
+void configure(Metadata<PRISMATIC_FLOAT_PRECISION> &meta)
+{
+	setFFTBackend(meta.fftBackend);
+	if (meta.algorithm == Algorithm::PRISM)
+		std::cout << "Execution plan: PRISM\n";
+	else if (meta.algorithm == Algorithm::Multislice)
+		std::cout << "Execution plan: Multislice\n";
+	else if (meta.algorithm == Algorithm::HRTEM)
+		std::cout << "Execution plan: HRTEM\n";
+#ifdef PRISMATIC_ENABLE_GPU
+	if (meta.transferMode == Prismatic::StreamingMode::Auto)
+	{
+		meta.transferMode = transferMethodAutoChooser(meta);
+	}
+	std::cout << "Using GPU codes" << '\n';
+	if (meta.transferMode == Prismatic::StreamingMode::Stream)
+		cout << "Using streaming method\n";
+	else
+		cout << "Using single transfer method\n";
+#else
+	if (meta.algorithm == Algorithm::HRTEM)
+		std::cout << "Using CPU codes" << '\n';
+#endif //PRISMATIC_ENABLE_GPU
 }
 } // namespace Prismatic
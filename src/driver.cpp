@@ -20,23 +20,10 @@
 using namespace std;
 int main(int argc, const char **argv)
 {
-	Prismatic::Metadata<PRISMATIC_FLOAT_PRECISION> meta;
-
-	// parse command line options
-	if (!Prismatic::parseInputs(meta, argc, &argv))
-		return 1;
-
-	Prismatic::printHeader();
-
-	//	Prismatic::printTime();
-
-	// print metadata
-	//	meta.toString();
-
-	// execute simulation
-	Prismatic::go(meta);
-
-	//	Prismatic::printTime();
-
-	return 0;
+#ifdef PRISMATIC_ENABLE_RUNTIME_PRECISION
+	// both engines are linked in, so the precision has to be known before either parses the options
+	if (Prismatic::requestedPrecision(argc, argv) == Prismatic::Precision::Double)
+		return PrismaticDouble::runCLI(argc, argv);
+#endif //PRISMATIC_ENABLE_RUNTIME_PRECISION
+	return Prismatic::runCLI(argc, argv);
 }
@@ -2,12 +2,17 @@
 #include "params.h"
 #include "fileIO.h"
 #include "utility.h"
+#include "ArrayView.h"
+#include "ThreadPool.h"
 #include <mutex>
+#include <thread>
+#include <algorithm>
 
 namespace Prismatic{
 
 void setupOutputFile(Parameters<PRISMATIC_FLOAT_PRECISION> &pars)
 {
+	ScopedTimer timer("setupOutputFile");
 	//create main groups
 	H5::Group simulation(pars.outputFile.createGroup("/4DSTEM_simulation"));
 
@@ -148,7 +153,7 @@ void setup4DOutput(Parameters<PRISMATIC_FLOAT_PRECISION> &pars)
 	const H5std_string re_str("r"); //using h5py default configuration
 	const H5std_string im_str("i");
 	complex_type.insertMember(re_str, 0, PFP_TYPE);
-	complex_type.insertMember(im_str, 4, PFP_TYPE);
+	complex_type.insertMember(im_str, sizeof(PRISMATIC_FLOAT_PRECISION), PFP_TYPE);
 
 	for (auto n = 0; n < pars.numLayers; n++)
 	{
@@ -414,7 +419,7 @@ void setupSMatrixOutput(Parameters<PRISMATIC_FLOAT_PRECISION> &pars, const int F
 	const H5std_string re_str("r"); //using h5py default configuration
 	const H5std_string im_str("i");
 	complex_type.insertMember(re_str, 0, PFP_TYPE);
-	complex_type.insertMember(im_str, 4, PFP_TYPE);
+	complex_type.insertMember(im_str, sizeof(PRISMATIC_FLOAT_PRECISION), PFP_TYPE);
 
 	H5::Group smatrix_group(realslices.createGroup(base_name.c_str()));
 
@@ -475,7 +480,7 @@ void setupHRTEMOutput(Parameters<PRISMATIC_FLOAT_PRECISION> &pars)
 	const H5std_string re_str("r"); //using h5py default configuration
 	const H5std_string im_str("i");
 	complex_type.insertMember(re_str, 0, PFP_TYPE);
-	complex_type.insertMember(im_str, 4, PFP_TYPE);
+	complex_type.insertMember(im_str, sizeof(PRISMATIC_FLOAT_PRECISION), PFP_TYPE);
 
 	std::string basename = "HRTEM";
 	if(pars.meta.saveComplexOutputWave) basename += "_fp" + getDigitString(pars.meta.fpNum);
@@ -702,7 +707,7 @@ void setupProbeOutput(Parameters<PRISMATIC_FLOAT_PRECISION> &pars)
 	const H5std_string re_str("r"); //using h5py default configuration
 	const H5std_string im_str("i");
 	complex_type.insertMember(re_str, 0, PFP_TYPE);
-	complex_type.insertMember(im_str, 4, PFP_TYPE);
+	complex_type.insertMember(im_str, sizeof(PRISMATIC_FLOAT_PRECISION), PFP_TYPE);
 
 	//create slice group
     std::string group_name = (pars.meta.saveProbeComplex) ? "probe_complex" : "probe";
@@ -845,23 +850,8 @@ void savePotentialSlices(Parameters<PRISMATIC_FLOAT_PRECISION> &pars)
 	writeScalarAttribute(dim2, "units", "[Å]");
 	writeScalarAttribute(dim3, "units", "[Å]");
 
-	//create dataset
-	//first, in potential array and re-stride
-	hsize_t dataDims[3] = {pars.imageSize[1], pars.imageSize[0], pars.numPlanes};
-
-	Array3D<PRISMATIC_FLOAT_PRECISION> tmp = zeros_ND<3, PRISMATIC_FLOAT_PRECISION>({{pars.pot.get_dimi(), pars.pot.get_dimj(), pars.pot.get_dimk()}});
-	for(auto i = 0; i < pars.pot.get_dimi(); i++)
-	{
-		for(auto j = 0; j < pars.pot.get_dimj(); j++)
-		{
-			for(auto k = 0; k < pars.pot.get_dimk(); k++)
-			{
-				tmp.at(i,j,k) = pars.pot.at(k,j,i);
-			}
-		}
-	}
-	
-	writeRealDataSet_inOrder(ppotential, "data", &tmp[0], dataDims, 3);
+	//create dataset from the potential array, transposed as HDF5 order is reversed
+	writeRealDataSet_inOrder(ppotential, "data", view(pars.pot).permute({{2, 1, 0}}));
 
 	dim1.close();
 	dim2.close();
@@ -881,20 +871,18 @@ void saveHRTEM(Parameters<PRISMATIC_FLOAT_PRECISION> &pars,
 	
 	if(pars.meta.saveComplexOutputWave)
 	{
-		Array3D<std::complex<PRISMATIC_FLOAT_PRECISION>> output_buffer = zeros_ND<3, std::complex<PRISMATIC_FLOAT_PRECISION>>({{pars.Scompact.get_dimi(), pars.Scompact.get_dimj(), pars.numberBeams}});
-		PRISMATIC_FLOAT_PRECISION scale = pars.Scompact.get_dimi()*pars.Scompact.get_dimj();
-		for(auto i = 0; i < pars.Scompact.get_dimi(); i++)
-		{
-			for(auto j = 0; j < pars.Scompact.get_dimj(); j++)
+		//scale S matrix to mean value and restride, one plane of the output at a time
+		const PRISMATIC_FLOAT_PRECISION scale = pars.Scompact.get_dimi()*pars.Scompact.get_dimj();
+		ArrayView<3, const std::complex<PRISMATIC_FLOAT_PRECISION>> S = view(pars.Scompact).permute({{2, 1, 0}});
+		writeComplexDataSet_byPlane(hrtem_group, "data", mdims, [&](size_t i, std::complex<PRISMATIC_FLOAT_PRECISION> *plane) {
+			for(hsize_t j = 0; j < mdims[1]; j++)
 			{
-				for(auto k = 0; k < pars.Scompact.get_dimk(); k++)
+				for(hsize_t k = 0; k < mdims[2]; k++)
 				{
-					//scale S matrix to mean value and restride
-					output_buffer.at(i,j,k) = pars.Scompact.at(pars.HRTEMbeamOrder[k],j,i)*scale;
+					*plane++ = S.at(i, j, pars.HRTEMbeamOrder[k])*scale;
 				}
 			}
-		}
-		writeComplexDataSet_inOrder(hrtem_group, "data", &output_buffer[0], mdims, 3);
+		});
 	}
 	else
 	{
@@ -906,32 +894,21 @@ void saveHRTEM(Parameters<PRISMATIC_FLOAT_PRECISION> &pars,
 
 void saveSTEM(Parameters<PRISMATIC_FLOAT_PRECISION> &pars)
 {
+	ScopedTimer timer("saveSTEM");
+	//output and DPC_CoM are accumulated as [layer, x, y, det], which matches the on-disk layout,
+	//so each depth is written straight out of the accumulation buffer
 	pars.outputFile = H5::H5File(pars.meta.filenameOutput.c_str(), H5F_ACC_RDWR);
 	if (pars.meta.save3DOutput)
 	{
 		setupVDOutput(pars);
 		hsize_t mdims[3] = {pars.numXprobes, pars.numYprobes, pars.Ndet};
-		size_t strides = mdims[0]*mdims[1]*mdims[2];
-		std::vector<size_t> order = {0,1,2};
 		for (auto j = 0; j < pars.numLayers; j++)
 		{
 			std::string nameString;
 			nameString = "4DSTEM_simulation/data/realslices/virtual_detector_depth" + getDigitString(j);
 			nameString = nameString + pars.currentTag;
 			H5::Group dataGroup = pars.outputFile.openGroup(nameString);
-			//manual restride is faster
-			Array3D<PRISMATIC_FLOAT_PRECISION> tmp_array = zeros_ND<3, PRISMATIC_FLOAT_PRECISION>({{pars.net_output.get_dimj(), pars.net_output.get_dimk(), pars.net_output.get_dimi()}});
-			for(auto ii = 0; ii < pars.net_output.get_dimi(); ii++) //over detector
-			{
-				for(auto jj = 0; jj < pars.net_output.get_dimj(); jj++) //over x
-				{
-					for(auto kk = 0; kk < pars.net_output.get_dimk(); kk++) //over y
-					{
-						tmp_array.at(jj,kk,ii) = pars.net_output.at(j,kk,jj,ii);
-					}
-				}
-			}
-			writeRealDataSet_inOrder(dataGroup, "data", &tmp_array[0], mdims, 3);
+			writeRealDataSet_inOrder(dataGroup, "data", &pars.net_output.at(j, 0, 0, 0), mdims, 3);
 			dataGroup.close();
 		}
 	}
@@ -941,7 +918,6 @@ void saveSTEM(Parameters<PRISMATIC_FLOAT_PRECISION> &pars)
 		size_t lower = std::max((size_t)0, (size_t)(pars.meta.integrationAngleMin / pars.meta.detectorAngleStep));
 		size_t upper = std::min(pars.detectorAngles.size(), (size_t)(pars.meta.integrationAngleMax / pars.meta.detectorAngleStep));
 		setup2DOutput(pars);
-		std::vector<size_t> order = {0,1};
 		hsize_t mdims[2] = {pars.numXprobes, pars.numYprobes};
 		for (auto j = 0; j < pars.numLayers; j++)
 		{
@@ -949,21 +925,15 @@ void saveSTEM(Parameters<PRISMATIC_FLOAT_PRECISION> &pars)
 			nameString += pars.currentTag;
 			H5::Group dataGroup = pars.outputFile.openGroup(nameString.c_str());
 
-			Array2D<PRISMATIC_FLOAT_PRECISION> prism_image = zeros_ND<2, PRISMATIC_FLOAT_PRECISION>(
-				{{pars.net_output.get_dimj(), pars.net_output.get_dimk()}});
-
-			for (auto y = 0; y < pars.net_output.get_dimk(); ++y)
-			{
-				for (auto x = 0; x < pars.net_output.get_dimj(); ++x)
-				{
-					for (auto b = lower; b < upper; ++b)
-					{
-						prism_image.at(x, y) += pars.net_output.at(j, y, x, b);
-					}
-				}
-			}
+			Array2D<PRISMATIC_FLOAT_PRECISION> prism_image = integrateAnnularDetector(pars.net_output, j, lower, upper, pars.meta.numThreads);
 			writeRealDataSet_inOrder(dataGroup, "data", &prism_image[0], mdims, 2);
 			dataGroup.close();
+			if (pars.meta.results)
+			{
+				auto image = std::make_shared<Array2D<PRISMATIC_FLOAT_PRECISION>>(std::move(prism_image));
+				pars.meta.results->add("annular_detector_depth" + getDigitString(j) + pars.currentTag,
+									   {pars.numXprobes, pars.numYprobes}, &(*image)[0], image);
+			}
 		}
 	}
 
@@ -973,29 +943,62 @@ void saveSTEM(Parameters<PRISMATIC_FLOAT_PRECISION> &pars)
 		hsize_t mdims[3] = {pars.numXprobes, pars.numYprobes, 2};
 		for (auto j = 0; j < pars.numLayers; j++)
 		{
-			Array3D<PRISMATIC_FLOAT_PRECISION> DPC_image = zeros_ND<3, PRISMATIC_FLOAT_PRECISION>(
-				{{pars.numXprobes, pars.numYprobes, 2}});
-				
-			for(auto ii = 0; ii < pars.numXprobes; ii++)
-			{
-				for(auto jj = 0; jj < pars.numYprobes; jj++)
-				{
-					DPC_image.at(ii,jj,0) = pars.net_DPC_CoM.at(j,jj,ii,0);
-					DPC_image.at(ii,jj,1) = pars.net_DPC_CoM.at(j,jj,ii,1);
-				}
-			}
 			std::string nameString = "4DSTEM_simulation/data/realslices/DPC_CoM_depth" + getDigitString(j);
 			nameString += pars.currentTag;
 			H5::Group dataGroup = pars.outputFile.openGroup(nameString.c_str());
-			
-			writeRealDataSet_inOrder(dataGroup, "data", &DPC_image[0], mdims, 3);
+			writeRealDataSet_inOrder(dataGroup, "data", &pars.net_DPC_CoM.at(j, 0, 0, 0), mdims, 3);
 			dataGroup.close();
 		}
 	}
 
+	//the averages are not used once they are written (a series retrieves the next tag into fresh arrays),
+	//so the results take over their buffers instead of copying them
+	if (pars.meta.results && pars.meta.save3DOutput)
+	{
+		auto stack = std::make_shared<Array4D<PRISMATIC_FLOAT_PRECISION>>(std::move(pars.net_output));
+		for (auto j = 0; j < pars.numLayers; j++)
+			pars.meta.results->add("virtual_detector_depth" + getDigitString(j) + pars.currentTag,
+								   {pars.numXprobes, pars.numYprobes, pars.Ndet}, &stack->at(j, 0, 0, 0), stack);
+	}
+	if (pars.meta.results && pars.meta.saveDPC_CoM)
+	{
+		auto stack = std::make_shared<Array4D<PRISMATIC_FLOAT_PRECISION>>(std::move(pars.net_DPC_CoM));
+		for (auto j = 0; j < pars.numLayers; j++)
+			pars.meta.results->add("DPC_CoM_depth" + getDigitString(j) + pars.currentTag,
+								   {pars.numXprobes, pars.numYprobes, 2}, &stack->at(j, 0, 0, 0), stack);
+	}
+
 	pars.outputFile.close();
 };
 
+Array2D<PRISMATIC_FLOAT_PRECISION> integrateAnnularDetector(Array4D<PRISMATIC_FLOAT_PRECISION> &stack,
+															const size_t layer,
+															const size_t lower,
+															const size_t upper,
+															const size_t numThreads)
+{
+	//sum detector bins [lower, upper) of one depth of a [layer, x, y, det] stack into an [x, y] image
+	const size_t numPixels = stack.get_dimk() * stack.get_dimj();
+	const size_t Ndet = stack.get_dimi();
+	Array2D<PRISMATIC_FLOAT_PRECISION> image = zeros_ND<2, PRISMATIC_FLOAT_PRECISION>({{stack.get_dimk(), stack.get_dimj()}});
+	const PRISMATIC_FLOAT_PRECISION *src = &stack.at(layer, 0, 0, 0);
+
+	const size_t numWorkers = std::max((size_t)1, std::min(numThreads, numPixels));
+	const size_t chunk = (numPixels + numWorkers - 1) / numWorkers;
+	ThreadPool::instance().run(numWorkers, [&](size_t t) {
+		const size_t start = t * chunk;
+		const size_t stop = std::min(numPixels, start + chunk);
+		for (auto p = start; p < stop; ++p)
+		{
+			PRISMATIC_FLOAT_PRECISION sum = 0;
+			const PRISMATIC_FLOAT_PRECISION *bins = src + p * Ndet;
+			for (auto b = lower; b < upper; ++b) sum += bins[b];
+			image[p] = sum;
+		}
+	});
+	return image;
+};
+
 void save_qArr(Parameters<PRISMATIC_FLOAT_PRECISION> &pars)
 {
 	//create group and write data all at once
@@ -1209,6 +1212,7 @@ std::string getDigitString(int digit)
 
 void writeMetadata(Parameters<PRISMATIC_FLOAT_PRECISION> &pars)
 {
+	ScopedTimer timer("writeMetadata");
 	//set up group
 	H5::Group metadata = pars.outputFile.openGroup("4DSTEM_simulation/metadata/metadata_0/original");
 	H5::Group sim_params = metadata.createGroup("simulation_parameters");
@@ -1426,7 +1430,6 @@ void writeMetadata(Parameters<PRISMATIC_FLOAT_PRECISION> &pars)
 		//series vals will be NxM vector of vectors
 		//N is the number of keys
 		//M is the product of the number of unique values in each keys
-		//current implementation only allows series vals with CC series
 		//loop through each key and write an attribute vector for that
 
 		size_t num_vals = pars.meta.seriesVals[0].size();
@@ -1548,6 +1551,85 @@ Array4D<PRISMATIC_FLOAT_PRECISION> readDataSet4D_keepOrder(const std::string &fi
 	return data;
 };
 
+std::vector<size_t> readDataSetDims(const std::string &filename, const std::string &dataPath)
+{
+	H5::H5File input = H5::H5File(filename.c_str(), H5F_ACC_RDONLY);
+	H5::DataSet dataset = input.openDataSet(dataPath.c_str());
+	H5::DataSpace dataspace = dataset.getSpace();
+
+	std::vector<hsize_t> dims_out(dataspace.getSimpleExtentNdims());
+	dataspace.getSimpleExtentDims(dims_out.data(), NULL);
+
+	dataspace.close();
+	dataset.close();
+	input.close();
+	return std::vector<size_t>(dims_out.begin(), dims_out.end());
+};
+
+namespace {
+H5::CompType complexType()
+{
+	H5::CompType complex_type = H5::CompType(sizeof(complex_float_t));
+	const H5std_string re_str("r"); //using h5py default configuration
+	const H5std_string im_str("i");
+	complex_type.insertMember(re_str, 0, PFP_TYPE);
+	complex_type.insertMember(im_str, sizeof(PRISMATIC_FLOAT_PRECISION), PFP_TYPE);
+	return complex_type;
+}
+
+template <class T>
+void readDataSetPlanes(const ArrayView<3, T> &data, const std::string &filename, const std::string &dataPath, const H5::DataType &type)
+{
+	H5::H5File input = H5::H5File(filename.c_str(), H5F_ACC_RDONLY);
+	H5::DataSet dataset = input.openDataSet(dataPath.c_str());
+	H5::DataSpace dataspace = dataset.getSpace();
+
+	hsize_t dims_out[3];
+	if (dataspace.getSimpleExtentNdims() != 3)
+		throw std::runtime_error("PRISM: " + dataPath + " is not a 3D dataset\n");
+	dataspace.getSimpleExtentDims(dims_out, NULL);
+	for (size_t d = 0; d < 3; d++)
+	{
+		if (dims_out[d] != data.get_dimarr()[d])
+			throw std::runtime_error("PRISM: dimensions of " + dataPath + " do not match the array it is read into\n");
+	}
+
+	//read a plane at a time and scatter it through the view; hyperslabs cannot reorder the dimensions
+	hsize_t plane_dims[3] = {1, dims_out[1], dims_out[2]};
+	H5::DataSpace mspace(3, plane_dims);
+	std::vector<T> plane(dims_out[1] * dims_out[2]);
+	for (hsize_t l = 0; l < dims_out[0] && !plane.empty(); l++)
+	{
+		hsize_t offset[3] = {l, 0, 0};
+		dataspace.selectHyperslab(H5S_SELECT_SET, plane_dims, offset);
+		dataset.read(&plane[0], type, mspace, dataspace);
+		auto src = plane.begin();
+		for (hsize_t j = 0; j < dims_out[1]; j++)
+			for (hsize_t i = 0; i < dims_out[2]; i++)
+				data.at(l, j, i) = *src++;
+	}
+
+	mspace.close();
+	dataspace.close();
+	dataset.close();
+	input.close();
+}
+} //namespace
+
+void readRealDataSet_inOrder(const ArrayView<3, PRISMATIC_FLOAT_PRECISION> &data,
+						const std::string &filename,
+						const std::string &dataPath)
+{
+	readDataSetPlanes(data, filename, dataPath, PFP_TYPE);
+};
+
+void readComplexDataSet_inOrder(const ArrayView<3, std::complex<PRISMATIC_FLOAT_PRECISION>> &data,
+						const std::string &filename,
+						const std::string &dataPath)
+{
+	readDataSetPlanes(data, filename, dataPath, complexType());
+};
+
 void readAttribute(const std::string &filename, const std::string &groupPath, const std::string &attr, PRISMATIC_FLOAT_PRECISION &val)
 {
 	//read an attribute from a group into val
@@ -1646,7 +1728,7 @@ void writeComplexDataSet(H5::Group group, const std::string &dsetname,
 	const H5std_string re_str("r"); //using h5py default configuration
 	const H5std_string im_str("i");
 	complex_type.insertMember(re_str, 0, PFP_TYPE);
-	complex_type.insertMember(im_str, 4, PFP_TYPE);
+	complex_type.insertMember(im_str, sizeof(PRISMATIC_FLOAT_PRECISION), PFP_TYPE);
 
 	//create dataset and write
 	H5::DataSpace mspace(rank, mdims);
@@ -1686,7 +1768,7 @@ void writeComplexDataSet_inOrder(H5::Group group, const std::string &dsetname,
 	const H5std_string re_str("r"); //using h5py default configuration
 	const H5std_string im_str("i");
 	complex_type.insertMember(re_str, 0, PFP_TYPE);
-	complex_type.insertMember(im_str, 4, PFP_TYPE);
+	complex_type.insertMember(im_str, sizeof(PRISMATIC_FLOAT_PRECISION), PFP_TYPE);
 
 	//create dataset and write
 	H5::DataSpace mspace(rank, mdims);
@@ -1775,6 +1857,89 @@ void writeRealDataSet_inOrder(H5::Group group,
 	real_dset.close();
 };
 
+namespace {
+template <class T>
+void writeDataSetPlanes(H5::Group &group, const std::string &dsetname, const hsize_t *mdims,
+						const std::function<void(size_t, T *)> &fillPlane, const H5::DataType &type)
+{
+	H5::DataSet dset;
+	if(group.nameExists(dsetname.c_str()))
+	{
+		dset = group.openDataSet(dsetname.c_str());
+	}
+	else
+	{
+		H5::DataSpace dspace(3, mdims);
+		dset = group.createDataSet(dsetname.c_str(), type, dspace);
+		dspace.close();
+	}
+
+	hsize_t plane_dims[3] = {1, mdims[1], mdims[2]};
+	H5::DataSpace mspace(3, plane_dims);
+	H5::DataSpace fspace = dset.getSpace();
+	std::vector<T> plane(mdims[1] * mdims[2]);
+	for(hsize_t l = 0; l < mdims[0] && !plane.empty(); l++)
+	{
+		fillPlane(l, &plane[0]);
+		hsize_t offset[3] = {l, 0, 0};
+		fspace.selectHyperslab(H5S_SELECT_SET, plane_dims, offset);
+		dset.write(&plane[0], type, mspace, fspace);
+	}
+
+	fspace.close();
+	mspace.close();
+	dset.close();
+}
+
+template <class T>
+std::function<void(size_t, T *)> gatherPlane(const ArrayView<3, const T> &data)
+{
+	return [data](size_t l, T *plane) {
+		for(size_t j = 0; j < data.get_dimj(); j++)
+			for(size_t i = 0; i < data.get_dimi(); i++)
+				*plane++ = data.at(l, j, i);
+	};
+}
+} //namespace
+
+void writeRealDataSet_byPlane(H5::Group group,
+						const std::string &dsetname,
+						const hsize_t *mdims,
+						const std::function<void(size_t, PRISMATIC_FLOAT_PRECISION *)> &fillPlane)
+{
+	writeDataSetPlanes(group, dsetname, mdims, fillPlane, PFP_TYPE);
+};
+
+void writeComplexDataSet_byPlane(H5::Group group,
+						const std::string &dsetname,
+						const hsize_t *mdims,
+						const std::function<void(size_t, std::complex<PRISMATIC_FLOAT_PRECISION> *)> &fillPlane)
+{
+	writeDataSetPlanes(group, dsetname, mdims, fillPlane, complexType());
+};
+
+void writeRealDataSet_inOrder(H5::Group group,
+						const std::string &dsetname,
+						const ArrayView<3, const PRISMATIC_FLOAT_PRECISION> &data)
+{
+	hsize_t mdims[3] = {data.get_dimk(), data.get_dimj(), data.get_dimi()};
+	if(data.isContiguous())
+		writeRealDataSet_inOrder(group, dsetname, data.data(), mdims, 3);
+	else
+		writeRealDataSet_byPlane(group, dsetname, mdims, gatherPlane(data));
+};
+
+void writeComplexDataSet_inOrder(H5::Group group,
+						const std::string &dsetname,
+						const ArrayView<3, const std::complex<PRISMATIC_FLOAT_PRECISION>> &data)
+{
+	hsize_t mdims[3] = {data.get_dimk(), data.get_dimj(), data.get_dimi()};
+	if(data.isContiguous())
+		writeComplexDataSet_inOrder(group, dsetname, data.data(), mdims, 3);
+	else
+		writeComplexDataSet_byPlane(group, dsetname, mdims, gatherPlane(data));
+};
+
 void writeScalarAttribute(H5::H5Object &object, const std::string &name, const int &data)
 {
 	H5::DataSpace attr_dataspace(H5S_SCALAR);
@@ -2045,6 +2210,66 @@ void CCseriesSG(H5::H5File &file)
 	configureSupergroup(CC_series, firstGroup, sgdims, sgdims_name, sgdims_units);
 }
 
+void seriesSG(Parameters<PRISMATIC_FLOAT_PRECISION> &pars)
+{
+	//the virtual detector is the only output gathered into series supergroups
+	if(!pars.meta.save3DOutput) return;
+
+	//plain defocus series keep their own supergroup layout
+	if(pars.meta.seriesTags[0].compare(0, 3, "_df") == 0)
+	{
+		CCseriesSG(pars.outputFile);
+		return;
+	}
+
+	H5::Group supergroups = pars.outputFile.openGroup("4DSTEM_simulation/data/supergroups");
+	H5::Group series = supergroups.createGroup("vd_series");
+	H5::Group realslices = pars.outputFile.openGroup("4DSTEM_simulation/data/realslices");
+	std::string basename = "virtual_detector_depth0000";
+
+	//every key is one supergroup dimension, holding its distinct values in order of appearance
+	size_t numKeys = pars.meta.seriesKeys.size();
+	size_t numEntries = pars.meta.seriesTags.size();
+	std::vector<std::vector<PRISMATIC_FLOAT_PRECISION>> sgdims(numKeys);
+	std::vector<std::vector<size_t>> indices(numEntries, std::vector<size_t>(numKeys));
+	std::vector<H5::DataSet> datasets;
+	for(auto i = 0; i < numEntries; i++)
+	{
+		for(auto k = 0; k < numKeys; k++)
+		{
+			PRISMATIC_FLOAT_PRECISION val = pars.meta.seriesVals[k][i];
+			auto pos = std::find(sgdims[k].begin(), sgdims[k].end(), val);
+			if(pos == sgdims[k].end()) pos = sgdims[k].insert(sgdims[k].end(), val);
+			indices[i][k] = pos - sgdims[k].begin();
+		}
+		H5::Group tmp_group = realslices.openGroup(basename + pars.meta.seriesTags[i]);
+		datasets.push_back(tmp_group.openDataSet("data"));
+	}
+
+	writeVirtualDataSet(series, "supergroup", datasets, indices);
+
+	std::vector<std::string> sgdims_units;
+	for(auto k = 0; k < numKeys; k++)
+	{
+		const std::string &key = pars.meta.seriesKeys[k];
+		if(key == "probeSemiangle" || key == "probeXtilt" || key == "probeYtilt")
+		{
+			sgdims_units.push_back("[rad]");
+		}
+		else if(key.compare(0, 3, "phi") == 0)
+		{
+			sgdims_units.push_back("[deg]");
+		}
+		else
+		{
+			sgdims_units.push_back("[Å]");
+		}
+	}
+
+	H5::Group firstGroup = realslices.openGroup(basename + pars.meta.seriesTags[0]);
+	configureSupergroup(series, firstGroup, sgdims, pars.meta.seriesKeys, sgdims_units);
+}
+
 std::string reducedDataSetName(std::string &fullPath)
 {
 	size_t index = fullPath.find_last_of("/");
@@ -2221,80 +2446,4 @@ hsize_t* restrideElements_subset(std::vector<size_t> &dims, std::vector<size_t>
 	return coords;	
 };
 
-void createScratchFile(Parameters<PRISMATIC_FLOAT_PRECISION> &pars)
-{
-	//TODO: decide home directory for windows
-	pars.scratchFile = H5::H5File("prismatic_scratch.h5", H5F_ACC_TRUNC);
-	H5::Group scratchGroup = pars.scratchFile.createGroup("scratch");
-
-	//initialize datasets
-	hsize_t mdims[4] = {pars.output.get_diml(), pars.output.get_dimk(), pars.output.get_dimj(), pars.output.get_dimi()};
-	H5::DataSpace mspace(4,mdims);
-	for(auto i = 0; i < pars.meta.seriesTags.size(); i++)
-	{
-		scratchGroup.createDataSet(pars.meta.seriesTags[i].c_str(), PFP_TYPE, mspace);
-			
-	}
-
-	if(pars.meta.saveDPC_CoM)
-	{
-		hsize_t mdims_dpc[4] = {pars.DPC_CoM.get_diml(), pars.DPC_CoM.get_dimk(), pars.DPC_CoM.get_dimj(), pars.DPC_CoM.get_dimi()};
-		H5::DataSpace mspace_dpc(4,mdims_dpc);
-		for(auto i = 0; i < pars.meta.seriesTags.size(); i++)
-		{
-			std::string current_name = pars.meta.seriesTags[i]+"_DPC";
-			scratchGroup.createDataSet(current_name.c_str(), PFP_TYPE, mspace_dpc);
-				
-		}
-	}
-	scratchGroup.close();
-};
-
-void removeScratchFile(Parameters<PRISMATIC_FLOAT_PRECISION> &pars)
-{
-	//TODO: make better decision about where scratch file is written
-	// and save name as a member of pars
-	pars.scratchFile.close();
-	if( remove( "prismatic_scratch.h5" ) != 0 )
-        perror( "Error deleting scratch file" );
-    else
-        puts( "Scratch file successfully deleted" );
-};
-
-void updateScratchData(Parameters<PRISMATIC_FLOAT_PRECISION> &pars)
-{
-	//for series simulations, need to update the 3D output array independently with a read-add-write process
-	Array4D<PRISMATIC_FLOAT_PRECISION> tmp_buffer(pars.output);
-	std::string currentName = pars.currentTag;
-
-	std::cout << "Reading scratch dataset " << currentName << " from " <<  "prismatic_scratch.h5" << std::endl;
-	readRealDataSet_inOrder(tmp_buffer, "prismatic_scratch.h5", "scratch/"+currentName);
-	for(auto i = 0; i < pars.output.size(); i++) tmp_buffer[i] += pars.output[i];
-
-	H5::Group scratch = pars.scratchFile.openGroup("scratch");
-	hsize_t mdims[4] = {pars.output.get_diml(), pars.output.get_dimk(), pars.output.get_dimj(), pars.output.get_dimi()};
-	std::cout << "Writing scratch dataset " << currentName << " to " <<  "prismatic_scratch.h5" << std::endl;
-	writeRealDataSet_inOrder(scratch, currentName, &tmp_buffer[0], mdims, 4);
-
-	if(pars.meta.saveDPC_CoM)
-	{
-		Array4D<PRISMATIC_FLOAT_PRECISION> dpc_buffer(pars.DPC_CoM);
-		currentName += "_DPC";
-		std::cout << "Reading scratch dataset " << currentName << " from " <<  "prismatic_scratch.h5" << std::endl;
-		readRealDataSet_inOrder(dpc_buffer, "prismatic_scratch.h5", "scratch/"+currentName);
-		for(auto i = 0; i < pars.DPC_CoM.size(); i++) dpc_buffer[i] += pars.DPC_CoM[i];
-
-		H5::Group scratch = pars.scratchFile.openGroup("scratch");
-		hsize_t mdims_dpc[4] = {pars.DPC_CoM.get_diml(), pars.DPC_CoM.get_dimk(), pars.DPC_CoM.get_dimj(), pars.DPC_CoM.get_dimi()};
-
-		std::cout << "Writing scratch dataset " << currentName << " to " <<  "prismatic_scratch.h5" << std::endl;
-
-		writeRealDataSet_inOrder(scratch, currentName, &dpc_buffer[0], mdims_dpc, 4);
-
-	}
-	scratch.close();
-
-};
-
-
 } //namespace Prismatic
\ No newline at end of file
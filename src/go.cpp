@@ -23,16 +23,86 @@
 #include "params.h"
 #include "go.h"
 #include "parseInput.h"
+#include "Instrumentation.h"
+#include "ResourcePlanner.h"
+#include "FFTBackend.h"
 
 namespace Prismatic
 {
 void go(Metadata<PRISMATIC_FLOAT_PRECISION> meta)
 {
+	// the worker threads, allocation policy and profiler of this run, apart from those of any run overlapping it
+	ThreadPool::Lease lease;
+
+	// estimate memory and work from the metadata alone, and fit the run into the memory budget
+	if (meta.planOnly || meta.memoryBudget > 0)
+	{
+		ResourcePlan plan;
+		try
+		{
+			plan = planResources(meta);
+		}
+		catch (const std::exception &e)
+		{
+			std::cout << "Prismatic: Error planning resources for " << meta.filenameAtoms << std::endl;
+			std::cout << e.what();
+			throw;
+		}
+		Roofline roofline;
+		if (meta.planOnly)
+		{
+			ThreadPool::instance().configure(meta.numThreads, meta.pinThreads);
+			roofline = measureRoofline();
+		}
+		plan.print(std::cout, roofline);
+		if (meta.planOnly)
+			return;
+		if (!plan.fits)
+			throw std::runtime_error("Simulation does not fit within the memory budget.");
+		applyPlan(plan, meta);
+	}
+
 	// configure simulation behavior
 	Prismatic::configure(meta);
 
 	// execute simulation
-	Prismatic::execute_plan(meta);
+	const bool profiling = meta.profile || meta.saveTrace || meta.perfCounters;
+	if (meta.perfCounters && !PerfCounters::instance().open())
+		std::cout << "Warning: hardware performance counters are unavailable (no PMU access or perf_event_paranoid too high), reporting FLOP/s only" << std::endl;
+	Roofline roofline;
+	if (meta.perfCounters)
+	{
+		ThreadPool::instance().configure(meta.numThreads, meta.pinThreads);
+		roofline = measureRoofline();
+	}
+	if (profiling)
+	{
+		Profiler::instance().start(meta.saveTrace);
+		Profiler::instance().setRoofline(roofline);
+	}
+	{
+		ScopedTimer timer("simulation");
+		try
+		{
+			executionPlan(meta).execute_plan(meta);
+		}
+		catch (...)
+		{
+			fftBackend().clearPlans();
+			throw;
+		}
+	}
+	// drop the cached plans so they do not pile up over many runs; FFTW keeps what it measured, so replanning is quick
+	fftBackend().clearPlans();
+	if (profiling)
+	{
+		Profiler::instance().stop();
+		PerfCounters::instance().close();
+		if (meta.profile || meta.perfCounters)
+			Profiler::instance().printSummary(std::cout);
+		if (meta.saveTrace)
+			Profiler::instance().writeTrace(traceFilename(meta.filenameOutput));
+	}
 
 #ifdef _WIN32
 	char *appdata = getenv("APPDATA");
@@ -42,4 +112,19 @@ void go(Metadata<PRISMATIC_FLOAT_PRECISION> meta)
 	Prismatic::writeParamFile(meta, std::string(appdata) + "/prismatic_gui_params.txt");
 #endif //_WIN32
 }
+
+int runCLI(int argc, const char **argv)
+{
+	Metadata<PRISMATIC_FLOAT_PRECISION> meta;
+
+	// parse command line options
+	if (!parseInputs(meta, argc, &argv))
+		return 1;
+
+	printHeader();
+
+	// execute simulation
+	go(meta);
+	return 0;
+}
 } // namespace Prismatic
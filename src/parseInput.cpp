@@ -27,6 +27,7 @@
 #include "atom.h"
 #include "probe.h"
 #include "aberration.h"
+#include "utility.h"
 
 namespace Prismatic
 {
@@ -117,9 +118,25 @@ void printHelp()
               << "* --probe-pos (-pos) filename : filename containing list of arbitrary probe positions. If set, runs custom list of probe positions; data are returned in order of list. See www.prism-em.com/about for details \n"
               << "* --aberrations (-aber) filename : filename containing list of arbitrary aberrations. See README.md for details \n"
               << "* --max-filesize size : Maximum output file size in gigabytes that Prismatic will be allowed to generate. Default is 2 Gigabytes. \n"
+              << "* --series-memory size : Memory in gigabytes available for accumulating simulation series outputs. Larger series are accumulated in a memory mapped scratch file. Default is " << defaults.seriesMemoryBudget / 1e9 << " Gigabytes. \n"
+              << "* --memory-budget size : Memory in gigabytes the simulation must fit in. Batch size, worker threads and series spilling are chosen to fit it, and the simulation stops if it cannot (default: no limit). \n"
+              << "* --plan-only (-plan) bool : Print the estimated memory, work and I/O of each stage, and the choices made for --memory-budget, then exit without loading atoms or simulating (default: Off).\n"
+              << "* --autotune (-at) bool : Time a few worker counts and batch sizes for the batched FFTs the first time a grid size is simulated on a machine, and use the fastest. Choices are kept for later runs (default: Off).\n"
+              << "* --autotune-cache filename : File the tuned choices are kept in (default: prismatic_autotune.txt in $HOME, or in %APPDATA% on Windows, falling back to the working directory).\n"
+              << "* --fft-grid (-fg) bool : Round the simulation grid to the nearest size whose FFTs are fast (only factors 2, 3, 5 and 7 besides 4 * interpolation factor) and adjust the pixel size to match (default: Off).\n"
+              << "* --precision (-pr) name : single, double or mixed. Mixed propagates waves in single precision and accumulates detector outputs and frozen phonon sums in double. Double precision is available in double precision builds and builds configured with PRISMATIC_ENABLE_RUNTIME_PRECISION (default: the build precision).\n"
+              << "* --fft-backend name : Library used for the CPU FFTs, fftw or pocketfft. PocketFFT is only available in builds configured with PRISMATIC_ENABLE_POCKETFFT (default: fftw).\n"
+              << "* --scratch-dir path : Directory for scratch files (default: TMPDIR, or /tmp if unset). \n"
               << "* --probe-defocus-sigma (-dfs) sigma: Run a simulation series over a range of 9 defocii, up to +- 2 sigma in steps 0.5 sigma (in angstroms).\n"
               << "* --probe-defocus-range (-dfr) min max step : Run a simulation series over a range of defocus values, from min to max in step size of step. All input units in Angstroms. \n"
-              << "* --matrix-refocus (-mrf) bool : Use matrix refocusing in PRISM simulation (default: Off).\n";
+              << "* --series (-ser) key min max step : Add a simulation series axis over the parameter key, from min to max in step size of step. Keys are probeDefocus, C3, C5 (Angstroms), probeSemiangle, probeXtilt, probeYtilt (mrad), or any aberration as C<n><m> (Angstroms) and phi<n><m> (degrees). Several axes are combined on a grid. \n"
+              << "* --matrix-refocus (-mrf) bool : Use matrix refocusing in PRISM simulation (default: Off).\n"
+              << "* --series-single-pass (-ssp) bool : Compute all entries of a PRISM simulation series in a single pass over the probe positions, when the series only changes the probe (default: On).\n"
+              << "* --huge-pages (-hp) bool : Back large arrays with transparent huge pages where the OS supports it (default: Off).\n"
+              << "* --pin-threads (-pin) bool : Pin CPU worker threads to cores, filling one NUMA node before the next (default: Off).\n"
+              << "* --profile (-prof) bool : Print the time spent in each stage, worker busy/idle time, lock waits and peak memory (default: Off).\n"
+              << "* --trace (-trace) bool : Write a Chrome trace (.trace.json) of the stages next to the output file (default: Off).\n"
+              << "* --perf-counters (-perf) bool : Add hardware counters (Linux perf events) and FLOP/s against a measured roofline to the --profile summary (default: Off).\n";
 }
 
 // string white-space trimming utility functions courtesy of https://stackoverflow.com/questions/216823/whats-the-best-way-to-trim-stdstring
@@ -314,6 +331,18 @@ bool writeParamFile(Metadata<PRISMATIC_FLOAT_PRECISION> &meta,
         }
     }
     f << "--nyquist-sampling:"<< meta.nyquistSampling <<"\n";
+    f << "--series-memory:" << meta.seriesMemoryBudget / 1e9 << "\n";
+    if (meta.memoryBudget > 0)
+        f << "--memory-budget:" << meta.memoryBudget / 1e9 << "\n";
+    f << "--autotune:" << meta.autotune << "\n";
+    if (meta.autotuneCache.size() > 0)
+        f << "--autotune-cache:" << meta.autotuneCache << "\n";
+    f << "--fft-grid:" << meta.fftFriendlyGrid << "\n";
+    f << "--fft-backend:" << fftBackendName(meta.fftBackend) << "\n";
+    if (meta.precision == Precision::Mixed)
+        f << "--precision:" << precisionName(meta.precision) << "\n";
+    if (meta.scratchDirectory.size() > 0)
+        f << "--scratch-dir:" << meta.scratchDirectory << "\n";
 
 #ifdef PRISMATIC_ENABLE_GPU
     if (meta.alsoDoCPUWork)
@@ -1691,6 +1720,212 @@ bool parse_maxFile(Metadata<PRISMATIC_FLOAT_PRECISION> &meta,
     return true;
 };
 
+bool parse_seriesMemory(Metadata<PRISMATIC_FLOAT_PRECISION> &meta,
+              int &argc, const char ***argv)
+{
+    if (argc < 2)
+    {
+        cout << "No memory size provided for --series-memory (syntax is --series-memory size)\n";
+        return false;
+    }
+    if ((meta.seriesMemoryBudget = (PRISMATIC_FLOAT_PRECISION)atof((*argv)[1]) * 1e9) == 0)
+    {
+        cout << "Invalid value \"" << (*argv)[1] << "\" provided for series memory (syntax is --series-memory size)\n";
+        return false;
+    }
+    argc -= 2;
+    argv[0] += 2;
+    return true;
+};
+
+bool parse_memoryBudget(Metadata<PRISMATIC_FLOAT_PRECISION> &meta,
+              int &argc, const char ***argv)
+{
+    if (argc < 2)
+    {
+        cout << "No memory size provided for --memory-budget (syntax is --memory-budget size)\n";
+        return false;
+    }
+    if ((meta.memoryBudget = (PRISMATIC_FLOAT_PRECISION)atof((*argv)[1]) * 1e9) == 0)
+    {
+        cout << "Invalid value \"" << (*argv)[1] << "\" provided for memory budget (syntax is --memory-budget size)\n";
+        return false;
+    }
+    argc -= 2;
+    argv[0] += 2;
+    return true;
+};
+
+bool parse_planOnly(Metadata<PRISMATIC_FLOAT_PRECISION> &meta,
+              int &argc, const char ***argv)
+{
+    if (argc < 2)
+    {
+        cout << "No value provided for -plan (syntax is -plan bool)\n";
+        return false;
+    }
+    meta.planOnly = std::string((*argv)[1]) == "0" ? false : true;
+    argc -= 2;
+    argv[0] += 2;
+    return true;
+};
+
+bool parse_autotune(Metadata<PRISMATIC_FLOAT_PRECISION> &meta,
+              int &argc, const char ***argv)
+{
+    if (argc < 2)
+    {
+        cout << "No value provided for -at (syntax is -at bool)\n";
+        return false;
+    }
+    meta.autotune = std::string((*argv)[1]) == "0" ? false : true;
+    argc -= 2;
+    argv[0] += 2;
+    return true;
+};
+
+bool parse_autotuneCache(Metadata<PRISMATIC_FLOAT_PRECISION> &meta,
+              int &argc, const char ***argv)
+{
+    if (argc < 2)
+    {
+        cout << "No filename provided for --autotune-cache (syntax is --autotune-cache filename)\n";
+        return false;
+    }
+    meta.autotuneCache = std::string((*argv)[1]);
+    argc -= 2;
+    argv[0] += 2;
+    return true;
+};
+
+bool parse_fftGrid(Metadata<PRISMATIC_FLOAT_PRECISION> &meta,
+              int &argc, const char ***argv)
+{
+    if (argc < 2)
+    {
+        cout << "No value provided for -fg (syntax is -fg bool)\n";
+        return false;
+    }
+    meta.fftFriendlyGrid = std::string((*argv)[1]) == "0" ? false : true;
+    argc -= 2;
+    argv[0] += 2;
+    return true;
+};
+
+bool precisionFromName(const std::string &name, Precision &precision)
+{
+    if (name == "single" || name == "float")
+        precision = Precision::Single;
+    else if (name == "double")
+        precision = Precision::Double;
+    else if (name == "mixed")
+        precision = Precision::Mixed;
+    else
+        return false;
+    return true;
+}
+
+bool precisionAvailable(const Precision precision)
+{
+    //mixed precision only changes how sums are kept, so every engine runs it
+    const bool doubleBuild = sizeof(PRISMATIC_FLOAT_PRECISION) == sizeof(double);
+#ifdef PRISMATIC_ENABLE_RUNTIME_PRECISION
+    return precision != Precision::Single || !doubleBuild;
+#else
+    return precision == Precision::Mixed || (precision == Precision::Double) == doubleBuild;
+#endif //PRISMATIC_ENABLE_RUNTIME_PRECISION
+}
+
+bool parse_precision(Metadata<PRISMATIC_FLOAT_PRECISION> &meta,
+              int &argc, const char ***argv)
+{
+    if (argc < 2)
+    {
+        cout << "No precision provided for -pr (syntax is -pr single|double|mixed)\n";
+        return false;
+    }
+    if (!precisionFromName((*argv)[1], meta.precision))
+    {
+        cout << "Unknown precision " << (*argv)[1] << ", expected single, double or mixed\n";
+        return false;
+    }
+    if (!precisionAvailable(meta.precision))
+    {
+        cout << "This build of Prismatic cannot run in " << (*argv)[1] << " precision; configure it with PRISMATIC_ENABLE_RUNTIME_PRECISION to have both\n";
+        return false;
+    }
+    argc -= 2;
+    argv[0] += 2;
+    return true;
+};
+
+Precision requestedPrecision(int argc, const char **argv)
+{
+    //later options override earlier ones, as they do when parsing
+    Precision precision = sizeof(PRISMATIC_FLOAT_PRECISION) == sizeof(double) ? Precision::Double : Precision::Single;
+    for (int a = 1; a + 1 < argc; ++a)
+    {
+        const std::string option = argv[a];
+        if (option == "--precision" || option == "-pr")
+        {
+            precisionFromName(argv[a + 1], precision);
+        }
+        else if (option == "--param-file" || option == "-pf")
+        {
+            std::ifstream f(argv[a + 1]);
+            std::string line;
+            while (std::getline(f, line))
+            {
+                line = trim(line);
+                const size_t colon_pos = line.find(':');
+                if (colon_pos == line.npos)
+                    continue;
+                const std::string name = trim(line.substr(0, colon_pos));
+                if (name == "--precision" || name == "-pr")
+                    precisionFromName(trim(line.substr(colon_pos + 1)), precision);
+            }
+        }
+    }
+    return precision;
+}
+
+bool parse_fftBackend(Metadata<PRISMATIC_FLOAT_PRECISION> &meta,
+              int &argc, const char ***argv)
+{
+    if (argc < 2)
+    {
+        cout << "No backend provided for --fft-backend (syntax is --fft-backend name)\n";
+        return false;
+    }
+    if (!parseFFTBackend((*argv)[1], meta.fftBackend))
+    {
+        cout << "Unknown FFT backend " << (*argv)[1] << ", expected fftw or pocketfft\n";
+        return false;
+    }
+    if (!fftBackendAvailable(meta.fftBackend))
+    {
+        cout << "FFT backend " << (*argv)[1] << " was not enabled when Prismatic was built\n";
+        return false;
+    }
+    argc -= 2;
+    argv[0] += 2;
+    return true;
+};
+
+bool parse_scratchDir(Metadata<PRISMATIC_FLOAT_PRECISION> &meta,
+              int &argc, const char ***argv)
+{
+    if (argc < 2)
+    {
+        cout << "No directory provided for --scratch-dir (syntax is --scratch-dir path)\n";
+        return false;
+    }
+    meta.scratchDirectory = std::string((*argv)[1]);
+    argc -= 2;
+    argv[0] += 2;
+    return true;
+};
+
 bool parse_dfs(Metadata<PRISMATIC_FLOAT_PRECISION> &meta,
               int &argc, const char ***argv)
 {
@@ -1740,6 +1975,49 @@ bool parse_dfr(Metadata<PRISMATIC_FLOAT_PRECISION> &meta,
     return true;
 };
 
+bool parse_series(Metadata<PRISMATIC_FLOAT_PRECISION> &meta,
+              int &argc, const char ***argv)
+{
+    if (argc < 5)
+    {
+        cout << "Not enough values provided for --series (syntax is -ser key min max step)\n";
+        return false;
+    }
+    std::string key = std::string((*argv)[1]);
+    if (!validSeriesKey(key))
+    {
+        cout << "Invalid series key \"" << key << "\" (valid keys are probeDefocus, C3, C5, probeSemiangle, probeXtilt, probeYtilt, C<n><m>, phi<n><m>)\n";
+        return false;
+    }
+
+    PRISMATIC_FLOAT_PRECISION minval, maxval, step;
+    minval = (PRISMATIC_FLOAT_PRECISION)atof((*argv)[2]);
+    maxval = (PRISMATIC_FLOAT_PRECISION)atof((*argv)[3]);
+    if ((step = (PRISMATIC_FLOAT_PRECISION)atof((*argv)[4])) <= 0)
+    {
+        cout << "Invalid value \"" << (*argv)[4] << "\" provided for step (syntax is -ser key min max step)\n";
+        return false;
+    }
+    if (maxval < minval)
+    {
+        cout << "Maximum series value " << maxval << " is less than miminum value " << minval << ". Check inputs\n";
+        return false;
+    }
+
+    //angles are input in mrad
+    PRISMATIC_FLOAT_PRECISION scale = (key == "probeSemiangle" || key == "probeXtilt" || key == "probeYtilt") ? 0.001 : 1.0;
+    std::vector<PRISMATIC_FLOAT_PRECISION> vals;
+    size_t numVals = (size_t) std::floor((maxval - minval) / step + 1e-4) + 1;
+    for (auto i = 0; i < numVals; i++) vals.push_back((minval + i * step) * scale);
+
+    meta.seriesInputKeys.push_back(key);
+    meta.seriesInputVals.push_back(vals);
+    meta.simSeries = true;
+    argc -= 5;
+    argv[0] += 5;
+    return true;
+};
+
 bool parse_3DPZ(Metadata<PRISMATIC_FLOAT_PRECISION> &meta,
               int &argc, const char ***argv)
 {
@@ -1772,6 +2050,90 @@ bool parse_mrf(Metadata<PRISMATIC_FLOAT_PRECISION> &meta,
     return true;
 };
 
+bool parse_ssp(Metadata<PRISMATIC_FLOAT_PRECISION> &meta,
+              int &argc, const char ***argv)
+{
+    if (argc < 2)
+    {
+        cout << "No value provided for -ssp (syntax is -ssp bool)\n";
+        return false;
+    }
+    meta.seriesSinglePass = std::string((*argv)[1]) == "0" ? false : true;
+    argc -= 2;
+    argv[0] += 2;
+    return true;
+};
+
+bool parse_hp(Metadata<PRISMATIC_FLOAT_PRECISION> &meta,
+              int &argc, const char ***argv)
+{
+    if (argc < 2)
+    {
+        cout << "No value provided for -hp (syntax is -hp bool)\n";
+        return false;
+    }
+    meta.hugePages = std::string((*argv)[1]) == "0" ? false : true;
+    argc -= 2;
+    argv[0] += 2;
+    return true;
+};
+
+bool parse_pin(Metadata<PRISMATIC_FLOAT_PRECISION> &meta,
+              int &argc, const char ***argv)
+{
+    if (argc < 2)
+    {
+        cout << "No value provided for -pin (syntax is -pin bool)\n";
+        return false;
+    }
+    meta.pinThreads = std::string((*argv)[1]) == "0" ? false : true;
+    argc -= 2;
+    argv[0] += 2;
+    return true;
+};
+
+bool parse_prof(Metadata<PRISMATIC_FLOAT_PRECISION> &meta,
+              int &argc, const char ***argv)
+{
+    if (argc < 2)
+    {
+        cout << "No value provided for -prof (syntax is -prof bool)\n";
+        return false;
+    }
+    meta.profile = std::string((*argv)[1]) == "0" ? false : true;
+    argc -= 2;
+    argv[0] += 2;
+    return true;
+};
+
+bool parse_trace(Metadata<PRISMATIC_FLOAT_PRECISION> &meta,
+              int &argc, const char ***argv)
+{
+    if (argc < 2)
+    {
+        cout << "No value provided for -trace (syntax is -trace bool)\n";
+        return false;
+    }
+    meta.saveTrace = std::string((*argv)[1]) == "0" ? false : true;
+    argc -= 2;
+    argv[0] += 2;
+    return true;
+};
+
+bool parse_perf(Metadata<PRISMATIC_FLOAT_PRECISION> &meta,
+              int &argc, const char ***argv)
+{
+    if (argc < 2)
+    {
+        cout << "No value provided for -perf (syntax is -perf bool)\n";
+        return false;
+    }
+    meta.perfCounters = std::string((*argv)[1]) == "0" ? false : true;
+    argc -= 2;
+    argv[0] += 2;
+    return true;
+};
+
 bool parse_aber(Metadata<PRISMATIC_FLOAT_PRECISION> &meta,
              int &argc, const char ***argv)
 {
@@ -1895,11 +2257,27 @@ static std::map<std::string, parseFunction> parser{
     {"--tilt-offset-tem", parse_tot}, {"-tot", parse_tot},
     {"--probe-pos", parse_pos}, {"-pos", parse_pos},
     {"--max-filesize", parse_maxFile},
+    {"--series-memory", parse_seriesMemory},
+    {"--memory-budget", parse_memoryBudget},
+    {"--plan-only", parse_planOnly}, {"-plan", parse_planOnly},
+    {"--autotune", parse_autotune}, {"-at", parse_autotune},
+    {"--autotune-cache", parse_autotuneCache},
+    {"--fft-grid", parse_fftGrid}, {"-fg", parse_fftGrid},
+    {"--precision", parse_precision}, {"-pr", parse_precision},
+    {"--fft-backend", parse_fftBackend},
+    {"--scratch-dir", parse_scratchDir},
     {"--probe-defocus-sigma", parse_dfs}, {"-dfs", parse_dfs},
     {"--probe-defocus-range", parse_dfr}, {"-dfr", parse_dfr},
+    {"--series", parse_series}, {"-ser", parse_series},
     {"--save-smatrix", parse_sm}, {"-sm", parse_sm},
     {"--3Dpotential-zsampling", parse_3DPZ}, {"-3DPZ", parse_3DPZ},
     {"--matrix-refocus", parse_mrf}, {"-mrf", parse_mrf},
+    {"--series-single-pass", parse_ssp}, {"-ssp", parse_ssp},
+    {"--huge-pages", parse_hp}, {"-hp", parse_hp},
+    {"--pin-threads", parse_pin}, {"-pin", parse_pin},
+    {"--profile", parse_prof}, {"-prof", parse_prof},
+    {"--trace", parse_trace}, {"-trace", parse_trace},
+    {"--perf-counters", parse_perf}, {"-perf", parse_perf},
     {"--aberrations", parse_aber}, {"-aber", parse_aber},
     {"--save-complex", parse_com}, {"-com", parse_com},
     {"--save-probe", parse_probe}, {"-probe", parse_probe},
@@ -83,8 +83,8 @@ Array2D<PRISMATIC_FLOAT_PRECISION> projPot(const size_t &Z,
 	}
 	ArrayND<1, std::vector<PRISMATIC_FLOAT_PRECISION>> sub(sub_data, {{sub_data.size()}});
 
-	std::pair<Array2D<PRISMATIC_FLOAT_PRECISION>, Array2D<PRISMATIC_FLOAT_PRECISION>> meshx = meshgrid(xr, sub * dx);
-	std::pair<Array2D<PRISMATIC_FLOAT_PRECISION>, Array2D<PRISMATIC_FLOAT_PRECISION>> meshy = meshgrid(yr, sub * dy);
+	std::pair<Array2D<PRISMATIC_FLOAT_PRECISION>, Array2D<PRISMATIC_FLOAT_PRECISION>> meshx = meshgrid(xr, Array1D<PRISMATIC_FLOAT_PRECISION>(sub * dx));
+	std::pair<Array2D<PRISMATIC_FLOAT_PRECISION>, Array2D<PRISMATIC_FLOAT_PRECISION>> meshy = meshgrid(yr, Array1D<PRISMATIC_FLOAT_PRECISION>(sub * dy));
 
 	ArrayND<1, std::vector<PRISMATIC_FLOAT_PRECISION>> xv = zeros_ND<1, PRISMATIC_FLOAT_PRECISION>({{meshx.first.size()}});
 	ArrayND<1, std::vector<PRISMATIC_FLOAT_PRECISION>> yv = zeros_ND<1, PRISMATIC_FLOAT_PRECISION>({{meshy.first.size()}});
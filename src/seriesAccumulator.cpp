@@ -0,0 +1,199 @@
+// Copyright Alan (AJ) Pryor, Jr. 2017
+// Transcribed from MATLAB code by Colin Ophus
+// Prismatic is distributed under the GNU General Public License (GPL)
+// If you use Prismatic, we kindly ask that you cite the following papers:
+
+// 1. Ophus, C.: A fast image simulation algorithm for scanning
+//    transmission electron microscopy. Advanced Structural and
+//    Chemical Imaging 3(1), 13 (2017)
+
+// 2. Pryor, Jr., A., Ophus, C., and Miao, J.: A Streaming Multi-GPU
+//    Implementation of Image Simulation Algorithms for Scanning
+//	  Transmission Electron Microscopy. arXiv:1706.08563 (2017)
+
+#include "seriesAccumulator.h"
+#include <iostream>
+#include <stdexcept>
+#include <cstdlib>
+#include <cstdio>
+#include <algorithm>
+#ifndef _WIN32
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#endif
+
+namespace Prismatic{
+
+struct SeriesAccumulator::Storage
+{
+	std::array<size_t, 4> dims_output;
+	std::array<size_t, 4> dims_DPC;
+	size_t size_output;
+	size_t size_DPC;
+	std::map<std::string, size_t> offsets; //start of each tag's accumulator, in elements
+	std::vector<double> memory;
+	char *data = nullptr;
+	size_t numBytes = 0;
+	bool mapped = false;
+	bool doubleSums = false; //elements are doubles rather than PRISMATIC_FLOAT_PRECISION
+
+	template <class T>
+	void add(const size_t offset, const T *src, const size_t count)
+	{
+		if (doubleSums)
+		{
+			double *dst = reinterpret_cast<double *>(data) + offset;
+			for (auto i = 0; i < count; i++) dst[i] += src[i];
+		}
+		else
+		{
+			PRISMATIC_FLOAT_PRECISION *dst = reinterpret_cast<PRISMATIC_FLOAT_PRECISION *>(data) + offset;
+			for (auto i = 0; i < count; i++) dst[i] += src[i];
+		}
+	};
+
+	template <class T>
+	std::vector<T> copy(const size_t offset, const size_t count) const
+	{
+		if (doubleSums)
+		{
+			const double *src = reinterpret_cast<const double *>(data) + offset;
+			return std::vector<T>(src, src + count);
+		}
+		const PRISMATIC_FLOAT_PRECISION *src = reinterpret_cast<const PRISMATIC_FLOAT_PRECISION *>(data) + offset;
+		return std::vector<T>(src, src + count);
+	};
+
+	~Storage()
+	{
+#ifndef _WIN32
+		if (mapped) munmap(data, numBytes);
+#endif
+	};
+};
+
+std::string getScratchDirectory(const std::string &scratchDirectory)
+{
+	if (scratchDirectory.size() > 0) return scratchDirectory;
+#ifdef _WIN32
+	const char *tmp = std::getenv("TEMP");
+	return (tmp == NULL) ? "." : std::string(tmp);
+#else
+	const char *tmp = std::getenv("TMPDIR");
+	return (tmp == NULL) ? "/tmp" : std::string(tmp);
+#endif
+};
+
+void SeriesAccumulator::allocate(const std::vector<std::string> &tags,
+								 const std::array<size_t, 4> &dims_output,
+								 const std::array<size_t, 4> &dims_DPC,
+								 const unsigned long long int memoryBudget,
+								 const std::string &scratchDirectory,
+								 const bool doubleSums)
+{
+	storage = std::make_shared<Storage>();
+	storage->doubleSums = doubleSums;
+	storage->dims_output = dims_output;
+	storage->dims_DPC = dims_DPC;
+	storage->size_output = dims_output[0] * dims_output[1] * dims_output[2] * dims_output[3];
+	storage->size_DPC = dims_DPC[0] * dims_DPC[1] * dims_DPC[2] * dims_DPC[3];
+
+	const size_t stride = storage->size_output + storage->size_DPC;
+	for (auto i = 0; i < tags.size(); i++) storage->offsets[tags[i]] = i * stride;
+	const size_t numElements = std::max((size_t)1, tags.size() * stride);
+	storage->numBytes = numElements * (doubleSums ? sizeof(double) : sizeof(PRISMATIC_FLOAT_PRECISION));
+	const size_t numDoubles = (storage->numBytes + sizeof(double) - 1) / sizeof(double);
+
+	if (storage->numBytes <= memoryBudget)
+	{
+		storage->memory.resize(numDoubles, 0);
+		storage->data = reinterpret_cast<char *>(&storage->memory[0]);
+		return;
+	}
+
+#ifdef _WIN32
+	std::cout << "Series output exceeds the memory budget but memory mapping is not supported on this platform; accumulating in memory" << std::endl;
+	storage->memory.resize(numDoubles, 0);
+	storage->data = reinterpret_cast<char *>(&storage->memory[0]);
+#else
+	//the scratch file is unlinked as soon as it is mapped, so concurrent jobs never share a path and nothing is left behind on exit
+	std::string pathTemplate = getScratchDirectory(scratchDirectory) + "/prismatic_series_XXXXXX";
+	std::vector<char> path(pathTemplate.begin(), pathTemplate.end());
+	path.push_back('\0');
+	int fd = mkstemp(&path[0]);
+	if (fd < 0) throw std::runtime_error("Unable to create series scratch file in " + getScratchDirectory(scratchDirectory));
+	unlink(&path[0]);
+
+	if (ftruncate(fd, storage->numBytes) != 0)
+	{
+		close(fd);
+		throw std::runtime_error("Unable to reserve space for series scratch file.");
+	}
+	void *map = mmap(NULL, storage->numBytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED) throw std::runtime_error("Unable to memory map series scratch file.");
+
+	storage->data = static_cast<char *>(map);
+	storage->mapped = true;
+	std::cout << "Series output (" << storage->numBytes / 1e9 << " Gb) exceeds memory budget; accumulating in memory mapped scratch file" << std::endl;
+#endif
+};
+
+size_t SeriesAccumulator::slot(const std::string &tag)
+{
+	if (!storage) throw std::runtime_error("Series accumulator used before allocation.");
+	auto entry = storage->offsets.find(tag);
+	if (entry == storage->offsets.end()) throw std::domain_error("No series accumulator for tag " + tag);
+	return entry->second;
+};
+
+void SeriesAccumulator::accumulate(const std::string &tag, const stack_type &output)
+{
+	const size_t offset = slot(tag);
+	if (output.get_dimarr() != storage->dims_output) throw std::domain_error("Output dimensions do not match series accumulator.");
+	storage->add(offset, &*output.begin(), storage->size_output);
+};
+
+void SeriesAccumulator::accumulate(const std::string &tag, const stack_type &output, const stack_type &DPC_CoM)
+{
+	accumulate(tag, output);
+	const size_t offset = slot(tag) + storage->size_output;
+	if (DPC_CoM.get_dimarr() != storage->dims_DPC) throw std::domain_error("DPC dimensions do not match series accumulator.");
+	storage->add(offset, &*DPC_CoM.begin(), storage->size_DPC);
+};
+
+template <class T>
+void SeriesAccumulator::retrieve(const std::string &tag, ArrayND<4, std::vector<T>> &output)
+{
+	output = ArrayND<4, std::vector<T>>(storage->copy<T>(slot(tag), storage->size_output), storage->dims_output);
+};
+
+template <class T>
+void SeriesAccumulator::retrieve(const std::string &tag, ArrayND<4, std::vector<T>> &output, ArrayND<4, std::vector<T>> &DPC_CoM)
+{
+	retrieve(tag, output);
+	DPC_CoM = ArrayND<4, std::vector<T>>(storage->copy<T>(slot(tag) + storage->size_output, storage->size_DPC), storage->dims_DPC);
+};
+
+template void SeriesAccumulator::retrieve<float>(const std::string &, ArrayND<4, std::vector<float>> &);
+template void SeriesAccumulator::retrieve<double>(const std::string &, ArrayND<4, std::vector<double>> &);
+template void SeriesAccumulator::retrieve<float>(const std::string &, ArrayND<4, std::vector<float>> &, ArrayND<4, std::vector<float>> &);
+template void SeriesAccumulator::retrieve<double>(const std::string &, ArrayND<4, std::vector<double>> &, ArrayND<4, std::vector<double>> &);
+
+void SeriesAccumulator::release()
+{
+	storage.reset();
+};
+
+bool SeriesAccumulator::isAllocated() const
+{
+	return (bool)storage;
+};
+
+bool SeriesAccumulator::isMapped() const
+{
+	return storage && storage->mapped;
+};
+
+} //namespace Prismatic
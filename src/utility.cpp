@@ -15,6 +15,7 @@
 #include <complex>
 #include "defines.h"
 #include "configure.h"
+#include "Instrumentation.h"
 #include <string>
 #include <stdio.h>
 #ifdef _WIN32
@@ -24,7 +25,10 @@
 #include <unistd.h>
 #endif
 #include <thread>
+#include <functional>
 #include <map>
+#include <algorithm>
+#include <cctype>
 
 namespace Prismatic
 {
@@ -49,18 +53,10 @@ upsamplePRISMProbe(Prismatic::Array2D<std::complex<PRISMATIC_FLOAT_PRECISION>> p
 							(dimi + ((i - ncx + xs) % dimi)) % dimi) = probe.at(j, i);
 		}
 	}
-	std::unique_lock<std::mutex> gatekeeper(fftw_plan_lock);
-	PRISMATIC_FFTW_PLAN plan = PRISMATIC_FFTW_PLAN_DFT_2D(buffer_probe.get_dimj(), buffer_probe.get_dimi(),
-														  reinterpret_cast<PRISMATIC_FFTW_COMPLEX *>(&buffer_probe[0]),
-														  reinterpret_cast<PRISMATIC_FFTW_COMPLEX *>(&buffer_probe[0]),
-														  FFTW_FORWARD, FFTW_ESTIMATE);
-	gatekeeper.unlock();
+	FFTPlan plan = planFFT2D(buffer_probe.get_dimj(), buffer_probe.get_dimi(), &buffer_probe[0], &buffer_probe[0], FFTDirection::Forward);
 	realspace_probe = buffer_probe;
-	PRISMATIC_FFTW_EXECUTE(plan);
+	plan.execute();
 	kspace_probe = buffer_probe;
-	gatekeeper.lock();
-	PRISMATIC_FFTW_DESTROY_PLAN(plan);
-	gatekeeper.unlock();
 	return std::make_pair(realspace_probe, kspace_probe);
 }
 
@@ -168,16 +164,193 @@ int testExist(const std::string &filename)
 	return answer;
 }
 
-void updateSeriesParams(Parameters<PRISMATIC_FLOAT_PRECISION> &pars, size_t iter)
+bool parseAberrationKey(const std::string &key, int &n, int &m, bool &isAngle)
 {
+	//aberration keys are C<n><m> for magnitudes and phi<n><m> for angles, e.g. C12 or phi23
+	std::string indices;
+	if(key.size() == 3 && key[0] == 'C')
+	{
+		isAngle = false;
+		indices = key.substr(1);
+	}
+	else if(key.size() == 5 && key.compare(0, 3, "phi") == 0)
+	{
+		isAngle = true;
+		indices = key.substr(3);
+	}
+	else
+	{
+		return false;
+	}
+
+	if(!isdigit(indices[0]) || !isdigit(indices[1])) return false;
+	n = indices[0] - '0';
+	m = indices[1] - '0';
+
+	//same basis set restrictions as updateAberrations
+	return (n + 1 >= m) && ((m + n) % 2 == 1);
+};
 
-    //right now this assumes only CC series
-	std::map<std::string, PRISMATIC_FLOAT_PRECISION*> valMap{{"probeDefocus", &pars.meta.probeDefocus}};
+bool validSeriesKey(const std::string &key)
+{
+	const std::vector<std::string> namedKeys = {"probeDefocus", "C3", "C5", "probeSemiangle", "probeXtilt", "probeYtilt"};
+	if(std::find(namedKeys.begin(), namedKeys.end(), key) != namedKeys.end()) return true;
+
+	int n, m;
+	bool isAngle;
+	return parseAberrationKey(key, n, m, isAngle);
+};
+
+bool seriesKeyChangesProbeOnly(const std::string &key)
+{
+	//tilts also move the probe focus and the detector coordinates, everything else only enters the initial probe
+	return (key != "probeXtilt") && (key != "probeYtilt");
+};
+
+void updateSeriesParams(Parameters<PRISMATIC_FLOAT_PRECISION> &pars, size_t iter)
+{
+	std::map<std::string, PRISMATIC_FLOAT_PRECISION*> valMap{{"probeDefocus", &pars.meta.probeDefocus},
+															{"C10", &pars.meta.probeDefocus},
+															{"C3", &pars.meta.C3},
+															{"C30", &pars.meta.C3},
+															{"C5", &pars.meta.C5},
+															{"C50", &pars.meta.C5},
+															{"probeSemiangle", &pars.meta.probeSemiangle},
+															{"probeXtilt", &pars.meta.probeXtilt},
+															{"probeYtilt", &pars.meta.probeYtilt}};
     pars.currentTag = pars.meta.seriesTags[iter];
 	for(auto i = 0; i < pars.meta.seriesKeys.size(); i++)
 	{
-		PRISMATIC_FLOAT_PRECISION* val_ptr = valMap[pars.meta.seriesKeys[i]];
-		*val_ptr = pars.meta.seriesVals[i][iter];
+		const std::string &key = pars.meta.seriesKeys[i];
+		PRISMATIC_FLOAT_PRECISION val = pars.meta.seriesVals[i][iter];
+		if(valMap.count(key))
+		{
+			*valMap[key] = val;
+			continue;
+		}
+
+		//remaining keys are arbitrary aberrations, which are added to the aberration list if not yet present
+		int n, m;
+		bool isAngle;
+		if(!parseAberrationKey(key, n, m, isAngle))
+		{
+			throw std::domain_error("Invalid series key " + key + ".\n");
+		}
+
+		auto ab = std::find(pars.meta.aberrations.begin(), pars.meta.aberrations.end(), aberration{n, m, 0.0, 0.0});
+		if(ab == pars.meta.aberrations.end())
+		{
+			pars.meta.aberrations.push_back(aberration{n, m, 0.0, 0.0});
+			ab = pars.meta.aberrations.end() - 1;
+		}
+		if(isAngle)
+		{
+			ab->phi = val;
+		}
+		else
+		{
+			ab->C_mag = val;
+		}
+	}
+
+	pars.xTiltShift = -pars.zTotal * tan(pars.meta.probeXtilt);
+	pars.yTiltShift = -pars.zTotal * tan(pars.meta.probeYtilt);
+};
+
+void setupSeriesOutput(Parameters<PRISMATIC_FLOAT_PRECISION> &pars)
+{
+	//one accumulator per series entry, sized from the output stacks of the first calculation
+	std::array<size_t, 4> dims_DPC = {0, 0, 0, 0};
+	if(pars.meta.saveDPC_CoM) dims_DPC = pars.DPC_CoM.get_dimarr();
+	pars.seriesOutput.allocate(pars.meta.seriesTags, pars.output.get_dimarr(), dims_DPC,
+							   pars.meta.seriesMemoryBudget, pars.meta.scratchDirectory,
+							   pars.meta.precision == Precision::Mixed);
+};
+
+void updateSeriesOutput(Parameters<PRISMATIC_FLOAT_PRECISION> &pars)
+{
+	if(pars.meta.saveDPC_CoM)
+	{
+		pars.seriesOutput.accumulate(pars.currentTag, pars.output, pars.DPC_CoM);
+	}
+	else
+	{
+		pars.seriesOutput.accumulate(pars.currentTag, pars.output);
+	}
+};
+
+void readSeriesOutput(Parameters<PRISMATIC_FLOAT_PRECISION> &pars)
+{
+	if(pars.meta.precision == Precision::Mixed)
+	{
+		if(pars.meta.saveDPC_CoM)
+		{
+			pars.seriesOutput.retrieve(pars.currentTag, pars.net_output_sum, pars.net_DPC_CoM_sum);
+		}
+		else
+		{
+			pars.seriesOutput.retrieve(pars.currentTag, pars.net_output_sum);
+		}
+	}
+	else if(pars.meta.saveDPC_CoM)
+	{
+		pars.seriesOutput.retrieve(pars.currentTag, pars.net_output, pars.net_DPC_CoM);
+	}
+	else
+	{
+		pars.seriesOutput.retrieve(pars.currentTag, pars.net_output);
+	}
+};
+
+void accumulateFrozenPhonon(Parameters<PRISMATIC_FLOAT_PRECISION> &pars, size_t fpNum)
+{
+	if(pars.meta.precision == Precision::Mixed)
+	{
+		if(fpNum == 0)
+		{
+			pars.net_output_sum = zeros_ND<4, double>(pars.output.get_dimarr());
+			if (pars.meta.saveDPC_CoM) pars.net_DPC_CoM_sum = zeros_ND<4, double>(pars.DPC_CoM.get_dimarr());
+		}
+		std::transform(pars.output.begin(), pars.output.end(), pars.net_output_sum.begin(), pars.net_output_sum.begin(), std::plus<double>());
+		if (pars.meta.saveDPC_CoM)
+			std::transform(pars.DPC_CoM.begin(), pars.DPC_CoM.end(), pars.net_DPC_CoM_sum.begin(), pars.net_DPC_CoM_sum.begin(), std::plus<double>());
+	}
+	else if(fpNum >= 1)
+	{
+		pars.net_output += pars.output;
+		if (pars.meta.saveDPC_CoM) pars.net_DPC_CoM += pars.DPC_CoM;
+	}
+	else
+	{
+		pars.net_output = pars.output;
+		if (pars.meta.saveDPC_CoM) pars.net_DPC_CoM = pars.DPC_CoM;
+	}
+};
+
+void averageFrozenPhonons(Parameters<PRISMATIC_FLOAT_PRECISION> &pars)
+{
+	if(pars.meta.precision == Precision::Mixed)
+	{
+		//only the averages are rounded to the output precision
+		pars.net_output = zeros_ND<4, PRISMATIC_FLOAT_PRECISION>(pars.net_output_sum.get_dimarr());
+		std::transform(pars.net_output_sum.begin(), pars.net_output_sum.end(), pars.net_output.begin(),
+					   [&](const double sum) { return (PRISMATIC_FLOAT_PRECISION)(sum / pars.meta.numFP); });
+		if (pars.meta.saveDPC_CoM)
+		{
+			pars.net_DPC_CoM = zeros_ND<4, PRISMATIC_FLOAT_PRECISION>(pars.net_DPC_CoM_sum.get_dimarr());
+			std::transform(pars.net_DPC_CoM_sum.begin(), pars.net_DPC_CoM_sum.end(), pars.net_DPC_CoM.begin(),
+						   [&](const double sum) { return (PRISMATIC_FLOAT_PRECISION)(sum / pars.meta.numFP); });
+		}
+		return;
+	}
+
+	for (auto &i : pars.net_output)
+		i /= pars.meta.numFP;
+
+	if (pars.meta.saveDPC_CoM)
+	{
+		for (auto &j : pars.net_DPC_CoM)
+			j /= pars.meta.numFP; //since squared intensities are used to calculate DPC_CoM, this is incoherent averaging
 	}
 };
 
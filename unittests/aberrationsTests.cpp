@@ -195,8 +195,8 @@ BOOST_AUTO_TEST_CASE(parser)
     PRISMATIC_FLOAT_PRECISION tol = 0.0001;
     BOOST_TEST(abberations[0].m == 1);
     BOOST_TEST(abberations[0].n == 2);
-    BOOST_TEST(std::abs(abberations[0].mag - 3.14) < tol);
-    BOOST_TEST(std::abs(abberations[0].angle - 23) < tol);
+    BOOST_TEST(std::abs(abberations[0].C_mag - 3.14) < tol);
+    BOOST_TEST(std::abs(abberations[0].phi - 23) < tol);
 
 };
 
@@ -299,6 +299,67 @@ BOOST_AUTO_TEST_CASE(abb1)
     writeRealDataSet(group, "qtheta", &qTheta[0], mdims, 2, order);
 };
 
+BOOST_AUTO_TEST_CASE(chiEngine)
+{
+    //cached evaluation should match the direct sum of the aberration terms, also after incremental updates
+    size_t imsize = 128;
+    PRISMATIC_FLOAT_PRECISION pixelSize = 0.25;
+    Array1D<PRISMATIC_FLOAT_PRECISION> qx = makeFourierCoords(imsize, pixelSize);
+    Array1D<PRISMATIC_FLOAT_PRECISION> qy = makeFourierCoords(imsize, pixelSize);
+    std::pair< Array2D<PRISMATIC_FLOAT_PRECISION>, Array2D<PRISMATIC_FLOAT_PRECISION> > mesh = meshgrid(qy,qx);
+    Array2D<PRISMATIC_FLOAT_PRECISION> q1(mesh.first);
+    Array2D<PRISMATIC_FLOAT_PRECISION> qTheta(mesh.first);
+    for(auto i = 0; i < q1.size(); i++)
+    {
+        q1[i] = sqrt(mesh.first[i]*mesh.first[i] + mesh.second[i]*mesh.second[i]);
+        qTheta[i] = atan2(mesh.first[i], mesh.second[i]);
+    }
+    PRISMATIC_FLOAT_PRECISION lambda = 0.0418;
+
+    std::vector<aberration> ab = {{1, 0, 50.0, 0.0}, {1, 2, 20.0, 30.0}, {2, 1, 500.0, 10.0}, {3, 0, 1e4, 0.0}, {5, 4, 1e5, 15.0}};
+
+    auto directChi = [&](const std::vector<aberration> &ab, size_t idx){
+        double pi = std::acos(-1);
+        double alpha = lambda * q1[idx];
+        double chi = 0.0;
+        for(auto &a : ab) chi += 2.0 * pi / lambda / (a.n + 1) * a.C_mag * pow(alpha, a.n + 1) * cos(a.m * (qTheta[idx] - a.phi * pi / 180.0));
+        return chi;
+    };
+
+    auto maxError = [&](const Array2D<PRISMATIC_FLOAT_PRECISION> &chi, const std::vector<aberration> &ab){
+        double err = 0.0;
+        double maxVal = 0.0;
+        for(auto i = 0; i < chi.size(); i++)
+        {
+            if(q1[i] > 1.0) continue;
+            double ref = directChi(ab, i);
+            err = std::max(err, std::abs(chi[i] - ref));
+            maxVal = std::max(maxVal, std::abs(ref));
+        }
+        return err / maxVal;
+    };
+
+    ChiEngine engine;
+    engine.setGrid(q1, qTheta, lambda);
+    BOOST_TEST(maxError(engine.evaluate(ab), ab) < 1e-4);
+
+    //a defocus series only changes one term
+    for(auto df = 0; df < 40; df++)
+    {
+        ab[0].C_mag = -100.0 + 5.0 * df;
+        BOOST_TEST(maxError(engine.evaluate(ab), ab) < 1e-4);
+    }
+
+    ab.pop_back();
+    BOOST_TEST(maxError(engine.evaluate(ab), ab) < 1e-4);
+
+    Array2D<std::complex<PRISMATIC_FLOAT_PRECISION>> chi_c = getChi(q1, qTheta, lambda, ab);
+    Array2D<PRISMATIC_FLOAT_PRECISION> chi_r = engine.evaluate(ab);
+    PRISMATIC_FLOAT_PRECISION diff = 0.0;
+    for(auto i = 0; i < chi_c.size(); i++) diff = std::max(diff, std::abs(chi_c[i].real() - chi_r[i]));
+    BOOST_TEST(diff < 1e-3);
+};
+
 BOOST_AUTO_TEST_SUITE_END();
 
 }
\ No newline at end of file
@@ -10,7 +10,9 @@
 #include <random>
 #include "fileIO.h"
 #include "H5Cpp.h"
+#include "WorkDispatcher.h"
 #include <thread>
+#include <atomic>
 
 namespace Prismatic{
 
@@ -1474,6 +1476,461 @@ BOOST_AUTO_TEST_CASE(hdfStride)
     removeFile(fname);
 }
 
+BOOST_AUTO_TEST_CASE(annularIntegration)
+{
+    //stack is stored as [layer, x, y, det]; compare threaded reduction against a direct sum
+    const size_t Nl = 2; const size_t Nx = 7; const size_t Ny = 5; const size_t Ndet = 11;
+    Array4D<PRISMATIC_FLOAT_PRECISION> stack = zeros_ND<4, PRISMATIC_FLOAT_PRECISION>({{Nl, Nx, Ny, Ndet}});
+    for(auto i = 0; i < stack.size(); i++) stack[i] = i % 13;
+
+    const size_t lower = 2; const size_t upper = 9;
+    for(auto l = 0; l < Nl; l++)
+    {
+        Array2D<PRISMATIC_FLOAT_PRECISION> refImage = zeros_ND<2, PRISMATIC_FLOAT_PRECISION>({{Nx, Ny}});
+        for(auto x = 0; x < Nx; x++)
+        {
+            for(auto y = 0; y < Ny; y++)
+            {
+                for(auto b = lower; b < upper; b++) refImage.at(x,y) += stack.at(l,x,y,b);
+            }
+        }
+
+        Array2D<PRISMATIC_FLOAT_PRECISION> testImage = integrateAnnularDetector(stack, l, lower, upper, 3);
+        BOOST_TEST(testImage.get_dimj() == Nx);
+        BOOST_TEST(testImage.get_dimi() == Ny);
+        BOOST_TEST(compareValues(refImage, testImage) < 0.001);
+    }
+}
+
+BOOST_FIXTURE_TEST_CASE(inMemoryResults, basicSim)
+{
+    //outputs kept in memory match what is written to the output file, including the frozen phonon average of the 4D output
+    meta.filenameOutput = "../unittests/outputs/inMemoryResults.h5";
+    meta.algorithm = Algorithm::Multislice;
+    meta.potential3D = false;
+    meta.savePotentialSlices = false;
+    meta.includeThermalEffects = 1;
+    meta.numFP = 2;
+    meta.tileX = 1;
+    meta.tileY = 1;
+    meta.results = std::make_shared<SimulationResults>(true);
+
+    divertOutput(pos, fd, logPath);
+    std::cout << "\n###### BEGIN TEST CASE: inMemoryResults #######\n";
+    go(meta);
+    std::cout << "######## END TEST CASE: inMemoryResults #######\n";
+    revertOutput(fd, pos);
+
+    std::vector<std::string> names = {"virtual_detector_depth0000", "annular_detector_depth0000", "DPC_CoM_depth0000"};
+    std::vector<std::string> paths = {"realslices/virtual_detector_depth0000", "realslices/annular_detector_depth0000",
+                                      "realslices/DPC_CoM_depth0000"};
+    for(auto n = 0; n < names.size(); n++)
+    {
+        const ResultArray &result = meta.results->get(names[n]);
+        Array3D<PRISMATIC_FLOAT_PRECISION> ref;
+        if(result.shape.size() == 2)
+        {
+            Array2D<PRISMATIC_FLOAT_PRECISION> ref2D;
+            readRealDataSet_inOrder(ref2D, meta.filenameOutput, "4DSTEM_simulation/data/" + paths[n] + "/data");
+            ref = zeros_ND<3, PRISMATIC_FLOAT_PRECISION>({{1, ref2D.get_dimj(), ref2D.get_dimi()}});
+            std::copy(ref2D.begin(), ref2D.end(), ref.begin());
+        }
+        else
+        {
+            readRealDataSet_inOrder(ref, meta.filenameOutput, "4DSTEM_simulation/data/" + paths[n] + "/data");
+        }
+        BOOST_TEST(result.size() == ref.size());
+        BOOST_TEST(!result.complex);
+        BOOST_TEST(std::equal(ref.begin(), ref.end(), result.data));
+    }
+
+    const ResultArray &cube = meta.results->get("CBED_array_depth0000");
+    Array4D<PRISMATIC_FLOAT_PRECISION> refCube;
+    readRealDataSet_inOrder(refCube, meta.filenameOutput, "4DSTEM_simulation/data/datacubes/CBED_array_depth0000/data");
+    BOOST_TEST(cube.shape.size() == 4);
+    BOOST_TEST(cube.size() == refCube.size());
+    PRISMATIC_FLOAT_PRECISION error = 0;
+    for(auto i = 0; i < refCube.size(); i++) error = std::max(error, std::abs(refCube[i] - cube.data[i]));
+    BOOST_TEST(error < 1e-6);
+    BOOST_CHECK_THROW(meta.results->get("potential_fp0000"), std::domain_error);
+
+    removeFile(meta.filenameOutput);
+}
+
+BOOST_FIXTURE_TEST_CASE(progressAndCancel, basicSim)
+{
+    //a finished run reports its last stage complete; a cancelled one stops handing out work and throws
+    meta.filenameOutput = "../unittests/outputs/progressAndCancel.h5";
+    meta.algorithm = Algorithm::Multislice;
+    meta.potential3D = false;
+    meta.savePotentialSlices = false;
+    meta.numFP = 2;
+    meta.tileX = 1;
+    meta.tileY = 1;
+    meta.progress = std::make_shared<SimulationProgress>();
+
+    divertOutput(pos, fd, logPath);
+    std::cout << "\n###### BEGIN TEST CASE: progressAndCancel #######\n";
+    go(meta);
+    std::cout << "######## END TEST CASE: progressAndCancel #######\n";
+    revertOutput(fd, pos);
+
+    SimulationProgress::Snapshot snapshot = meta.progress->snapshot();
+    BOOST_TEST(snapshot.stage == "probe positions");
+    BOOST_TEST(snapshot.total > 0);
+    BOOST_TEST(snapshot.done == snapshot.total);
+    BOOST_TEST(snapshot.fpNum == 1);
+    BOOST_TEST(snapshot.numFP == 2);
+
+    meta.progress->cancel();
+    size_t start = 0, stop = 0;
+    WorkDispatcher dispatcher(0, 10, meta.progress.get(), "jobs");
+    BOOST_TEST(!dispatcher.getWork(start, stop));
+    BOOST_TEST(meta.progress->snapshot().done == 0);
+    BOOST_CHECK_THROW(go(meta), SimulationCancelled);
+
+    removeFile(meta.filenameOutput);
+}
+
+BOOST_FIXTURE_TEST_CASE(overlappingRuns, basicSim)
+{
+    //runs started together on separate threads, with different algorithms and settings, match the same runs made in turn
+    meta.potential3D = false;
+    meta.savePotentialSlices = false;
+    meta.save4DOutput = false;
+    meta.includeThermalEffects = false;
+    meta.numFP = 1;
+    meta.tileX = 1;
+    meta.tileY = 1;
+
+    Metadata<PRISMATIC_FLOAT_PRECISION> prism = meta;
+    prism.filenameOutput = "../unittests/outputs/overlappingPRISM.h5";
+    prism.algorithm = Algorithm::PRISM;
+    prism.numThreads = 2;
+    prism.profile = true;
+    Metadata<PRISMATIC_FLOAT_PRECISION> multislice = meta;
+    multislice.filenameOutput = "../unittests/outputs/overlappingMultislice.h5";
+    multislice.algorithm = Algorithm::Multislice;
+    multislice.numThreads = 3;
+    multislice.hugePages = true;
+
+    std::vector<Metadata<PRISMATIC_FLOAT_PRECISION>> runs = {prism, multislice, prism, multislice};
+    for (auto &run : runs)
+        run.results = std::make_shared<SimulationResults>();
+
+    divertOutput(pos, fd, logPath);
+    std::cout << "\n###### BEGIN TEST CASE: overlappingRuns #######\n";
+    go(runs[0]);
+    go(runs[1]);
+    std::string error;
+    std::mutex errorLock;
+    std::vector<std::thread> threads;
+    for (auto r = 2; r < 4; r++)
+    {
+        threads.push_back(std::thread([&runs, &error, &errorLock, r]() {
+            try
+            {
+                go(runs[r]);
+            }
+            catch (const std::exception &e)
+            {
+                std::lock_guard<std::mutex> gatekeeper(errorLock);
+                error = e.what();
+            }
+        }));
+    }
+    for (auto &t : threads)
+        t.join();
+    std::cout << "######## END TEST CASE: overlappingRuns #######\n";
+    revertOutput(fd, pos);
+
+    BOOST_TEST(error.empty());
+    for (auto r = 0; r < 2; r++)
+    {
+        const ResultArray &inTurn = runs[r].results->get("virtual_detector_depth0000");
+        const ResultArray &together = runs[r + 2].results->get("virtual_detector_depth0000");
+        BOOST_TEST(inTurn.size() == together.size());
+        PRISMATIC_FLOAT_PRECISION difference = 0;
+        for(auto i = 0; i < inTurn.size(); i++) difference = std::max(difference, std::abs(inTurn.data[i] - together.data[i]));
+        BOOST_TEST(difference < 1e-6);
+    }
+
+    removeFile(prism.filenameOutput);
+    removeFile(multislice.filenameOutput);
+}
+
+BOOST_FIXTURE_TEST_CASE(stageCacheReuse, basicSim)
+{
+    //a run that only changes the probe reuses the atoms, potential and S-matrix and matches a run from scratch
+    meta.filenameOutput = "../unittests/outputs/stageCacheReuse.h5";
+    meta.algorithm = Algorithm::PRISM;
+    meta.potential3D = false;
+    meta.savePotentialSlices = false;
+    meta.includeThermalEffects = false;
+    meta.numFP = 1;
+    meta.tileX = 1;
+    meta.tileY = 1;
+    meta.stageCache = std::make_shared<StageCache>();
+
+    divertOutput(pos, fd, logPath);
+    std::cout << "\n###### BEGIN TEST CASE: stageCacheReuse #######\n";
+    go(meta);
+    meta.probeDefocus = 50.0;
+    meta.results = std::make_shared<SimulationResults>();
+    go(meta);
+    Metadata<PRISMATIC_FLOAT_PRECISION> fresh = meta;
+    fresh.stageCache.reset();
+    fresh.results = std::make_shared<SimulationResults>();
+    go(fresh);
+    std::cout << "######## END TEST CASE: stageCacheReuse #######\n";
+    revertOutput(fd, pos);
+
+    StageCache::Stats stats = meta.stageCache->stats();
+    BOOST_TEST(stats.atomsReused == 1);
+    BOOST_TEST(stats.potentialsComputed == 1);
+    BOOST_TEST(stats.potentialsReused == 1);
+    BOOST_TEST(stats.sMatricesComputed == 1);
+    BOOST_TEST(stats.sMatricesReused == 1);
+
+    const ResultArray &cached = meta.results->get("virtual_detector_depth0000");
+    const ResultArray &reference = fresh.results->get("virtual_detector_depth0000");
+    BOOST_TEST(cached.size() == reference.size());
+    PRISMATIC_FLOAT_PRECISION error = 0;
+    for(auto i = 0; i < reference.size(); i++) error = std::max(error, std::abs(reference.data[i] - cached.data[i]));
+    BOOST_TEST(error < 1e-6);
+
+    //finer slicing invalidates both stages
+    meta.sliceThickness /= 2;
+    divertOutput(pos, fd, logPath);
+    go(meta);
+    revertOutput(fd, pos);
+    stats = meta.stageCache->stats();
+    BOOST_TEST(stats.potentialsComputed == 2);
+    BOOST_TEST(stats.sMatricesComputed == 2);
+    BOOST_TEST(stats.sMatricesReused == 1);
+
+    removeFile(meta.filenameOutput);
+}
+
+BOOST_FIXTURE_TEST_CASE(stageCacheSeeds, basicSim)
+{
+    //with thermal effects, the same seed reuses the displaced potential and S-matrix, a new seed draws new ones
+    meta.filenameOutput = "../unittests/outputs/stageCacheSeeds.h5";
+    meta.algorithm = Algorithm::PRISM;
+    meta.potential3D = false;
+    meta.savePotentialSlices = false;
+    meta.includeThermalEffects = true;
+    meta.numFP = 1;
+    meta.tileX = 1;
+    meta.tileY = 1;
+    meta.realspacePixelSize[0] = 0.05; //fine enough that the displacements move atoms off their pixels
+    meta.realspacePixelSize[1] = 0.05;
+    meta.rng = boost::ranlux3(1);
+    meta.stageCache = std::make_shared<StageCache>();
+
+    Metadata<PRISMATIC_FLOAT_PRECISION> same = meta;
+    same.results = std::make_shared<SimulationResults>();
+    Metadata<PRISMATIC_FLOAT_PRECISION> reseeded = meta;
+    reseeded.rng = boost::ranlux3(2);
+    reseeded.results = std::make_shared<SimulationResults>();
+    meta.results = std::make_shared<SimulationResults>();
+
+    divertOutput(pos, fd, logPath);
+    std::cout << "\n###### BEGIN TEST CASE: stageCacheSeeds #######\n";
+    go(meta);
+    go(same);
+    StageCache::Stats stats = meta.stageCache->stats();
+    go(reseeded);
+    std::cout << "######## END TEST CASE: stageCacheSeeds #######\n";
+    revertOutput(fd, pos);
+
+    BOOST_TEST(stats.potentialsComputed == 1);
+    BOOST_TEST(stats.potentialsReused == 1);
+    BOOST_TEST(stats.sMatricesReused == 1);
+    stats = meta.stageCache->stats();
+    BOOST_TEST(stats.potentialsComputed == 2);
+    BOOST_TEST(stats.sMatricesComputed == 2);
+
+    const ResultArray &first = meta.results->get("virtual_detector_depth0000");
+    const ResultArray &repeated = same.results->get("virtual_detector_depth0000");
+    const ResultArray &displaced = reseeded.results->get("virtual_detector_depth0000");
+    PRISMATIC_FLOAT_PRECISION repeatError = 0;
+    PRISMATIC_FLOAT_PRECISION reseedChange = 0;
+    for(auto i = 0; i < first.size(); i++)
+    {
+        repeatError = std::max(repeatError, std::abs(first.data[i] - repeated.data[i]));
+        reseedChange = std::max(reseedChange, std::abs(first.data[i] - displaced.data[i]));
+    }
+    BOOST_TEST(repeatError == 0);
+    BOOST_TEST(reseedChange > 1e-6);
+
+    removeFile(meta.filenameOutput);
+}
+
+BOOST_FIXTURE_TEST_CASE(stageCacheCancel, basicSim)
+{
+    //a run cancelled while computing the S-matrix keeps nothing half filled, so a rerun matches a run from scratch
+    meta.filenameOutput = "../unittests/outputs/stageCacheCancel.h5";
+    meta.algorithm = Algorithm::PRISM;
+    meta.potential3D = false;
+    meta.savePotentialSlices = false;
+    meta.save4DOutput = false;
+    meta.includeThermalEffects = false;
+    meta.numFP = 1;
+    meta.numThreads = 1;
+    meta.tileX = 1;
+    meta.tileY = 1;
+    meta.realspacePixelSize[0] = 0.1;
+    meta.realspacePixelSize[1] = 0.1;
+    meta.stageCache = std::make_shared<StageCache>();
+    meta.progress = std::make_shared<SimulationProgress>();
+
+    std::shared_ptr<SimulationProgress> progress = meta.progress;
+    std::atomic<bool> finished(false);
+    std::thread watcher([progress, &finished]() {
+        while (!finished && progress->snapshot().stage != "plane waves")
+            std::this_thread::yield();
+        progress->cancel();
+    });
+
+    divertOutput(pos, fd, logPath);
+    std::cout << "\n###### BEGIN TEST CASE: stageCacheCancel #######\n";
+    bool cancelled = false;
+    try
+    {
+        go(meta);
+    }
+    catch (const SimulationCancelled &)
+    {
+        cancelled = true;
+    }
+    finished = true;
+    watcher.join();
+
+    meta.progress = std::make_shared<SimulationProgress>();
+    meta.results = std::make_shared<SimulationResults>();
+    go(meta);
+    Metadata<PRISMATIC_FLOAT_PRECISION> fresh = meta;
+    fresh.stageCache.reset();
+    fresh.results = std::make_shared<SimulationResults>();
+    go(fresh);
+    std::cout << "######## END TEST CASE: stageCacheCancel #######\n";
+    revertOutput(fd, pos);
+
+    BOOST_TEST(cancelled);
+    StageCache::Stats stats = meta.stageCache->stats();
+    BOOST_TEST(stats.potentialsComputed == 1);
+    BOOST_TEST(stats.potentialsReused == 1);
+    BOOST_TEST(stats.sMatricesComputed == 1);
+    BOOST_TEST(stats.sMatricesReused == 0);
+
+    const ResultArray &rerun = meta.results->get("virtual_detector_depth0000");
+    const ResultArray &reference = fresh.results->get("virtual_detector_depth0000");
+    BOOST_TEST(rerun.size() == reference.size());
+    PRISMATIC_FLOAT_PRECISION error = 0;
+    for(auto i = 0; i < reference.size(); i++) error = std::max(error, std::abs(reference.data[i] - rerun.data[i]));
+    BOOST_TEST(error < 1e-6);
+
+    removeFile(meta.filenameOutput);
+}
+
+BOOST_FIXTURE_TEST_CASE(stageCacheImport, basicSim)
+{
+    //an imported potential gets its own S-matrix, not the one cached for the potential of the same atoms
+    meta.filenameOutput = "../unittests/outputs/stageCacheImportSource.h5";
+    meta.algorithm = Algorithm::PRISM;
+    meta.potential3D = false;
+    meta.savePotentialSlices = true;
+    meta.includeThermalEffects = true;
+    meta.numFP = 1;
+    meta.tileX = 1;
+    meta.tileY = 1;
+    meta.realspacePixelSize[0] = 0.05; //fine enough that the displacements move atoms off their pixels
+    meta.realspacePixelSize[1] = 0.05;
+
+    Metadata<PRISMATIC_FLOAT_PRECISION> cached = meta;
+    cached.filenameOutput = "../unittests/outputs/stageCacheImport.h5";
+    cached.savePotentialSlices = false;
+    cached.includeThermalEffects = false;
+    cached.stageCache = std::make_shared<StageCache>();
+    cached.results = std::make_shared<SimulationResults>();
+
+    divertOutput(pos, fd, logPath);
+    std::cout << "\n###### BEGIN TEST CASE: stageCacheImport #######\n";
+    go(meta);
+    go(cached);
+    std::shared_ptr<SimulationResults> computed = cached.results;
+    cached.importPotential = true;
+    cached.importFile = meta.filenameOutput;
+    cached.importPath = "4DSTEM_simulation/data/realslices/ppotential_fp0000/data";
+    cached.results = std::make_shared<SimulationResults>();
+    go(cached);
+    Metadata<PRISMATIC_FLOAT_PRECISION> fresh = cached;
+    fresh.stageCache.reset();
+    fresh.results = std::make_shared<SimulationResults>();
+    go(fresh);
+    std::cout << "######## END TEST CASE: stageCacheImport #######\n";
+    revertOutput(fd, pos);
+
+    StageCache::Stats stats = cached.stageCache->stats();
+    BOOST_TEST(stats.sMatricesComputed == 2);
+    BOOST_TEST(stats.sMatricesReused == 0);
+
+    const ResultArray &undisplaced = computed->get("virtual_detector_depth0000");
+    const ResultArray &imported = cached.results->get("virtual_detector_depth0000");
+    const ResultArray &reference = fresh.results->get("virtual_detector_depth0000");
+    PRISMATIC_FLOAT_PRECISION error = 0;
+    PRISMATIC_FLOAT_PRECISION change = 0;
+    for(auto i = 0; i < reference.size(); i++)
+    {
+        error = std::max(error, std::abs(reference.data[i] - imported.data[i]));
+        change = std::max(change, std::abs(undisplaced.data[i] - imported.data[i]));
+    }
+    BOOST_TEST(error < 1e-6);
+    BOOST_TEST(change > 1e-6);
+
+    removeFile(meta.filenameOutput);
+    removeFile(cached.filenameOutput);
+}
+
+BOOST_FIXTURE_TEST_CASE(inMemoryAtoms, basicSim)
+{
+    //atoms handed over in memory simulate the same as the file they came from, which is not read again
+    meta.filenameOutput = "../unittests/outputs/inMemoryAtoms.h5";
+    meta.algorithm = Algorithm::Multislice;
+    meta.potential3D = false;
+    meta.savePotentialSlices = false;
+    meta.includeThermalEffects = false;
+    meta.numFP = 1;
+    meta.tileX = 1;
+    meta.tileY = 1;
+    meta.results = std::make_shared<SimulationResults>();
+
+    Metadata<PRISMATIC_FLOAT_PRECISION> memory = meta;
+    std::array<double, 3> dims = peekDims_xyz(meta.filenameAtoms);
+    memory.atoms = std::make_shared<std::vector<atom>>(readAtoms_xyz(meta.filenameAtoms));
+    for(auto i = 0; i < 3; i++) memory.cellDim[i] = dims[i];
+    memory.userSpecifiedCelldims = true;
+    memory.filenameAtoms = "../unittests/outputs/missing.xyz";
+    memory.results = std::make_shared<SimulationResults>();
+
+    divertOutput(pos, fd, logPath);
+    std::cout << "\n###### BEGIN TEST CASE: inMemoryAtoms #######\n";
+    go(meta);
+    go(memory);
+    std::cout << "######## END TEST CASE: inMemoryAtoms #######\n";
+    revertOutput(fd, pos);
+
+    const ResultArray &fromFile = meta.results->get("virtual_detector_depth0000");
+    const ResultArray &fromMemory = memory.results->get("virtual_detector_depth0000");
+    BOOST_TEST(fromFile.size() == fromMemory.size());
+    PRISMATIC_FLOAT_PRECISION error = 0;
+    for(auto i = 0; i < fromFile.size(); i++) error = std::max(error, std::abs(fromFile.data[i] - fromMemory.data[i]));
+    BOOST_TEST(error < 1e-6);
+
+    removeFile(meta.filenameOutput);
+}
+
 BOOST_FIXTURE_TEST_CASE(fileSizeCheck, basicSim)
 {
     meta.filenameOutput = "../unittests/outputs/fileSizeCheck.h5";
@@ -11,6 +11,7 @@
 #include "fileIO.h"
 #include "utility.h"
 #include "probe.h"
+#include "PRISM03_calcOutput.h"
 
 namespace Prismatic{
 
@@ -210,6 +211,61 @@ BOOST_AUTO_TEST_CASE(parser)
 
 }
 
+BOOST_FIXTURE_TEST_CASE(probeShifts_P, basicSim)
+{
+    //shifts from the separable tables of a grid scan, and the direct ones of arbitrary probes, match the exponential
+    const PRISMATIC_FLOAT_PRECISION pi = std::acos(-1);
+    const std::complex<PRISMATIC_FLOAT_PRECISION> i(0, 1);
+    pars.qxaReduce = zeros_ND<2, PRISMATIC_FLOAT_PRECISION>({{3, 4}});
+    pars.qyaReduce = zeros_ND<2, PRISMATIC_FLOAT_PRECISION>({{3, 4}});
+    for(auto j = 0; j < 3; j++)
+    {
+        for(auto k = 0; k < 4; k++)
+        {
+            pars.qxaReduce.at(j, k) = 0.13 * k - 0.2;
+            pars.qyaReduce.at(j, k) = 0.17 * j - 0.25;
+        }
+    }
+    const long beams[5][2] = {{0, 0}, {1, 3}, {2, 1}, {2, 2}, {0, 3}};
+    pars.beamsIndex = {0, 1, 2, 3, 4};
+    pars.xyBeams = zeros_ND<2, long>({{5, 2}});
+    for(auto a4 = 0; a4 < 5; a4++)
+    {
+        pars.xyBeams.at(a4, 0) = beams[a4][0];
+        pars.xyBeams.at(a4, 1) = beams[a4][1];
+    }
+    pars.xTiltShift = 0.3;
+    pars.yTiltShift = -0.4;
+    pars.xp = Array1D<PRISMATIC_FLOAT_PRECISION>({0.0, 0.7, 3.1, 12.4}, {{4}});
+
+    for(auto arbitrary : {false, true})
+    {
+        pars.meta.arbitraryProbes = arbitrary;
+        pars.yp = arbitrary ? Array1D<PRISMATIC_FLOAT_PRECISION>({0.2, 1.5, 9.9, 4.0}, {{4}})
+                            : Array1D<PRISMATIC_FLOAT_PRECISION>({0.2, 1.5, 9.9}, {{3}});
+        setupPhaseShifts(pars);
+        BOOST_TEST((pars.xPhaseShifts.size() == 0) == arbitrary);
+
+        PRISMATIC_FLOAT_PRECISION err = 0;
+        for(auto ay = 0; ay < pars.yp.size(); ay++)
+        {
+            for(auto ax = 0; ax < pars.xp.size(); ax++)
+            {
+                if(arbitrary && ax != ay) continue;
+                for(auto a4 = 0; a4 < 5; a4++)
+                {
+                    const PRISMATIC_FLOAT_PRECISION qx = pars.qxaReduce.at(beams[a4][0], beams[a4][1]);
+                    const PRISMATIC_FLOAT_PRECISION qy = pars.qyaReduce.at(beams[a4][0], beams[a4][1]);
+                    const std::complex<PRISMATIC_FLOAT_PRECISION> direct =
+                        exp(-2 * pi * i * (qx * (pars.xp[ax] + pars.xTiltShift) + qy * (pars.yp[ay] + pars.yTiltShift)));
+                    err = std::max(err, std::abs(probePhaseShift(pars, ay, ax, a4) - direct));
+                }
+            }
+        }
+        BOOST_TEST(err < 1e-4);
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END();
 
 } //namespace Prismatic
\ No newline at end of file
@@ -7,6 +7,18 @@
 #include "utility.h"
 #include "fileIO.h"
 #include "pprocess.h"
+#include "ThreadPool.h"
+#include "ExecutionPolicy.h"
+#include "Instrumentation.h"
+#include "ResourcePlanner.h"
+#include "Autotuner.h"
+#include "PRISM01_calcPotential.h"
+#include "PRISM02_calcSMatrix.h"
+#include "configure.h"
+#include <sstream>
+#include <fstream>
+#include <mutex>
+#include <thread>
 #include "ioTests.h"
 
 namespace Prismatic{
@@ -234,6 +246,594 @@ BOOST_AUTO_TEST_CASE(downsample)
     BOOST_TEST(smallArr.get_dimj() == Ty);
 }
 
+BOOST_AUTO_TEST_CASE(scratchBuffers)
+{
+    //shifting into a reused scratch array should match the allocating version and keep its storage
+    int seed = 10101;
+    std::default_random_engine de(seed);
+    Array2D<PRISMATIC_FLOAT_PRECISION> testArr = zeros_ND<2,PRISMATIC_FLOAT_PRECISION>({{6,9}});
+    assignRandomValues(testArr, de);
+
+    Array2D<PRISMATIC_FLOAT_PRECISION> shifted = fftshift2(testArr);
+    Array2D<PRISMATIC_FLOAT_PRECISION> &scratch = scratchArray<2,PRISMATIC_FLOAT_PRECISION>(SCRATCH_FORMAT);
+    fftshift2_flip(testArr, scratch);
+    BOOST_TEST(scratch.get_dimj() == testArr.get_dimi());
+    BOOST_TEST(scratch.get_dimi() == testArr.get_dimj());
+
+    PRISMATIC_FLOAT_PRECISION err = 0.0;
+    for(auto j = 0; j < testArr.get_dimj(); j++)
+    {
+        for(auto i = 0; i < testArr.get_dimi(); i++) err += std::abs(shifted.at(j,i) - scratch.at(i,j));
+    }
+    BOOST_TEST(err == 0.0);
+
+    const PRISMATIC_FLOAT_PRECISION *storage = &scratch[0];
+    assignRandomValues(testArr, de);
+    fftshift2_flip(testArr, scratchArray<2,PRISMATIC_FLOAT_PRECISION>(SCRATCH_FORMAT));
+    const PRISMATIC_FLOAT_PRECISION *reused = &scratchArray<2,PRISMATIC_FLOAT_PRECISION>(SCRATCH_FORMAT)[0];
+    BOOST_TEST(reused == storage);
+    const PRISMATIC_FLOAT_PRECISION *resized = &scratchArray<2,PRISMATIC_FLOAT_PRECISION>(SCRATCH_FORMAT, {{6,9}})[0];
+    BOOST_TEST(resized != storage);
+}
+
+BOOST_AUTO_TEST_CASE(expressionTemplates)
+{
+    //chained arithmetic is evaluated lazily in one pass and should match elementwise evaluation
+    int seed = 10101;
+    std::default_random_engine de(seed);
+    Array2D<PRISMATIC_FLOAT_PRECISION> a = zeros_ND<2,PRISMATIC_FLOAT_PRECISION>({{5,7}});
+    Array2D<PRISMATIC_FLOAT_PRECISION> b = zeros_ND<2,PRISMATIC_FLOAT_PRECISION>({{5,7}});
+    assignRandomValues(a, de);
+    assignRandomValues(b, de);
+    for(auto &i : b) i += 1.0;
+
+    Array2D<PRISMATIC_FLOAT_PRECISION> c = (a + b) * a / b - 2.0;
+    Array2D<PRISMATIC_FLOAT_PRECISION> d = 1.0 - 0.5 * a;
+    BOOST_TEST(c.get_dimarr() == a.get_dimarr());
+
+    PRISMATIC_FLOAT_PRECISION err = 0.0;
+    for(auto i = 0; i < a.size(); i++)
+    {
+        err += std::abs(c[i] - ((a[i] + b[i]) * a[i] / b[i] - 2.0));
+        err += std::abs(d[i] - (1.0 - 0.5 * a[i]));
+    }
+    BOOST_TEST(err < 1e-5);
+
+    //assigning to an array of the same shape reuses its storage, even when it appears in the expression
+    const PRISMATIC_FLOAT_PRECISION *storage = &c[0];
+    Array2D<PRISMATIC_FLOAT_PRECISION> ref = c * 3.0 + a;
+    c = c * 3.0 + a;
+    BOOST_TEST(&c[0] == storage);
+    err = 0.0;
+    for(auto i = 0; i < c.size(); i++) err += std::abs(c[i] - ref[i]);
+    BOOST_TEST(err == 0.0);
+
+    c += a * b;
+    err = 0.0;
+    for(auto i = 0; i < c.size(); i++) err += std::abs(c[i] - (ref[i] + a[i] * b[i]));
+    BOOST_TEST(err < 1e-5);
+
+    //complex arrays with real scalars
+    Array1D<std::complex<PRISMATIC_FLOAT_PRECISION>> z = zeros_ND<1,std::complex<PRISMATIC_FLOAT_PRECISION>>({{3}});
+    z[0] = {1.0, 2.0};
+    Array1D<std::complex<PRISMATIC_FLOAT_PRECISION>> zz = z * 2.0 + z;
+    BOOST_TEST(std::abs(zz[0] - std::complex<PRISMATIC_FLOAT_PRECISION>(3.0, 6.0)) < 1e-5);
+}
+
+BOOST_AUTO_TEST_CASE(arrayViews)
+{
+    //views share storage with the array; slices and transposes index the same elements without copying
+    int seed = 10101;
+    std::default_random_engine de(seed);
+    Array3D<PRISMATIC_FLOAT_PRECISION> testArr = zeros_ND<3,PRISMATIC_FLOAT_PRECISION>({{3,5,7}});
+    assignRandomValues(testArr, de);
+
+    ArrayView<3, PRISMATIC_FLOAT_PRECISION> full = view(testArr);
+    BOOST_TEST(full.isContiguous());
+    BOOST_TEST(full.data() == &testArr[0]);
+
+    ArrayView<2, PRISMATIC_FLOAT_PRECISION> slice = full.slice(1, 2);
+    BOOST_TEST(!slice.isContiguous());
+    BOOST_TEST(slice.get_dimj() == 3);
+    BOOST_TEST(slice.get_dimi() == 7);
+    slice.at(1, 4) = -1.0;
+    BOOST_TEST(testArr.at(1, 2, 4) == -1.0);
+
+    ArrayView<3, PRISMATIC_FLOAT_PRECISION> transposed = full.permute({{2, 1, 0}});
+    Array3D<PRISMATIC_FLOAT_PRECISION> restrided = transposed.copy();
+    std::array<size_t, 3> tdims = {7, 5, 3};
+    BOOST_TEST(restrided.get_dimarr() == tdims);
+
+    PRISMATIC_FLOAT_PRECISION err = 0.0;
+    for(auto k = 0; k < testArr.get_dimk(); k++)
+    {
+        for(auto j = 0; j < testArr.get_dimj(); j++)
+        {
+            for(auto i = 0; i < testArr.get_dimi(); i++)
+            {
+                err += std::abs(testArr.at(k,j,i) - restrided.at(i,j,k));
+                err += std::abs(testArr.at(k,j,i) - transposed.at(i,j,k));
+            }
+        }
+    }
+    BOOST_TEST(err == 0.0);
+
+    std::array<size_t, 3> start = {1,1,2};
+    std::array<size_t, 3> stop = {3,4,6};
+    ArrayView<3, PRISMATIC_FLOAT_PRECISION> block = full.subview(start, stop);
+    BOOST_TEST(block.size() == 24);
+    BOOST_TEST(&block.at(0,0,0) == &testArr.at(1,1,2));
+    BOOST_TEST(&block.at(1,2,3) == &testArr.at(2,3,5));
+
+    ArrayView<2, PRISMATIC_FLOAT_PRECISION> layer = full.slice(0, 1);
+    BOOST_TEST(layer.isContiguous());
+    BOOST_TEST(layer.data() == &testArr.at(1,0,0));
+}
+
+BOOST_AUTO_TEST_CASE(alignedAllocation)
+{
+    //large arrays are filled by several threads; check alignment and that every chunk is filled
+    ThreadPool::instance().configure(4);
+    Array3D<std::complex<PRISMATIC_FLOAT_PRECISION>> big = zeros_ND<3, std::complex<PRISMATIC_FLOAT_PRECISION>>({{9,256,256}});
+    Array2D<PRISMATIC_FLOAT_PRECISION> small = ones_ND<2, PRISMATIC_FLOAT_PRECISION>({{3,5}});
+    Array3D<PRISMATIC_FLOAT_PRECISION> bigOnes = ones_ND<3, PRISMATIC_FLOAT_PRECISION>({{9,512,256}});
+
+    BOOST_TEST((size_t)&big[0] % 64 == 0);
+    BOOST_TEST((size_t)&small[0] % 64 == 0);
+    BOOST_TEST((size_t)&bigOnes[0] % 64 == 0);
+
+    PRISMATIC_FLOAT_PRECISION err = 0.0;
+    for(auto i = 0; i < big.size(); i++) err += std::abs(big[i]);
+    for(auto i = 0; i < small.size(); i++) err += std::abs(small[i] - 1);
+    for(auto i = 0; i < bigOnes.size(); i++) err += std::abs(bigOnes[i] - 1);
+    BOOST_TEST(err == 0.0);
+
+    //copies keep the aligned storage
+    Array2D<PRISMATIC_FLOAT_PRECISION> copied(std::vector<PRISMATIC_FLOAT_PRECISION>(15, 2.0), {{3,5}});
+    Array2D<PRISMATIC_FLOAT_PRECISION> summed = copied + small;
+    BOOST_TEST((size_t)&summed[0] % 64 == 0);
+    BOOST_TEST(summed.at(2,4) == 3.0);
+}
+
+BOOST_AUTO_TEST_CASE(threadPool)
+{
+    ThreadPool &pool = ThreadPool::instance();
+    pool.configure(3);
+    BOOST_TEST(pool.size() == 3);
+
+    //every task runs exactly once, task t on worker t % size
+    std::vector<size_t> counts(10, 0);
+    std::vector<std::thread::id> ids(10);
+    pool.run(10, [&](size_t t) {
+        counts[t]++;
+        ids[t] = std::this_thread::get_id();
+    });
+    size_t missed = 0;
+    for (auto &c : counts) missed += (c != 1);
+    BOOST_TEST(missed == 0);
+    BOOST_TEST((ids[0] == ids[3] && ids[3] == ids[9]));
+    BOOST_TEST((ids[0] != ids[1] && ids[1] != ids[2]));
+    BOOST_TEST((ids[0] != std::this_thread::get_id()));
+
+    //workers persist between runs
+    std::thread::id first;
+    pool.run(1, [&](size_t t) { first = std::this_thread::get_id(); });
+    BOOST_TEST((first == ids[0]));
+
+    //nested runs execute inline on the calling worker
+    std::vector<size_t> nested(3, 0);
+    pool.run(3, [&](size_t t) {
+        pool.run(4, [&](size_t s) { nested[t] += s; });
+    });
+    BOOST_TEST(nested[0] == 6);
+    BOOST_TEST(nested[2] == 6);
+
+    //exceptions are passed on to the caller
+    bool caught = false;
+    try
+    {
+        pool.run(3, [](size_t t) { if (t == 2) throw std::runtime_error("task failed"); });
+    }
+    catch (const std::runtime_error &e)
+    {
+        caught = true;
+    }
+    BOOST_TEST(caught);
+
+    //pinning either binds every worker to a core or leaves the pool unpinned
+    pool.configure(2, true);
+    BOOST_TEST(pool.size() == 2);
+    if (pool.isPinned())
+    {
+        BOOST_TEST(pool.cpu(0) >= 0);
+        BOOST_TEST(pool.numaNode(1) < pool.numNumaNodes());
+    }
+    pool.configure(1);
+}
+
+BOOST_AUTO_TEST_CASE(threadPoolLease)
+{
+    //the first run gets the process-wide pool, a run overlapping it a private one with its own settings
+    ThreadPool &shared = ThreadPool::instance();
+    ThreadPool::Lease lease;
+    BOOST_TEST((&ThreadPool::instance() == &shared));
+    shared.configure(2);
+    arrayAllocationPolicy().hugePages = true;
+
+    ThreadPool *other = nullptr;
+    ThreadPool *otherWorker = nullptr;
+    size_t otherSize = 0;
+    bool otherHugePages = true;
+    std::thread overlapping([&]() {
+        ThreadPool::Lease inner;
+        other = &ThreadPool::instance();
+        other->configure(3);
+        otherSize = other->size();
+        otherHugePages = arrayAllocationPolicy().hugePages;
+        other->run(1, [&](size_t) { otherWorker = &ThreadPool::instance(); });
+    });
+    overlapping.join();
+
+    BOOST_TEST((other != &shared));
+    BOOST_TEST((otherWorker == other));
+    BOOST_TEST(otherSize == 3);
+    BOOST_TEST(!otherHugePages);
+    BOOST_TEST(shared.size() == 2);
+    BOOST_TEST(arrayAllocationPolicy().hugePages);
+
+    //a nested lease keeps the pool of the outer one
+    {
+        ThreadPool::Lease nested;
+        BOOST_TEST((&ThreadPool::instance() == &shared));
+    }
+    arrayAllocationPolicy().hugePages = false;
+    shared.configure(1);
+}
+
+BOOST_AUTO_TEST_CASE(executionPolicy)
+{
+    //plenty of jobs: all threads work on jobs with serial FFTs
+    ExecutionPolicy policy = chooseExecutionPolicy(8, 1000, 1024*1024);
+    BOOST_TEST(policy.outerThreads == 8);
+    BOOST_TEST(policy.fftThreads == 1);
+
+    //few jobs on a large grid: leftover threads go to FFTW
+    policy = chooseExecutionPolicy(8, 2, 1024*1024);
+    BOOST_TEST(policy.outerThreads == 2);
+    BOOST_TEST(policy.fftThreads == 4);
+
+    policy = chooseExecutionPolicy(8, 1, 1024*1024);
+    BOOST_TEST(policy.outerThreads == 1);
+    BOOST_TEST(policy.fftThreads == 8);
+
+    //few jobs on a small grid: threaded FFTs do not pay off
+    policy = chooseExecutionPolicy(8, 1, 64*64);
+    BOOST_TEST(policy.outerThreads == 1);
+    BOOST_TEST(policy.fftThreads == 1);
+
+    policy = chooseExecutionPolicy(0, 0, 64*64);
+    BOOST_TEST(policy.outerThreads == 1);
+    BOOST_TEST(policy.fftThreads == 1);
+}
+
+BOOST_AUTO_TEST_CASE(profiler)
+{
+    Profiler &profiler = Profiler::instance();
+    std::mutex m;
+
+    //nothing is recorded while disabled
+    {
+        ScopedTimer timer("unprofiledStage");
+    }
+
+    profiler.start(true);
+    {
+        ScopedTimer outer("outerStage");
+        {
+            ScopedTimer inner("innerStage");
+            std::unique_lock<std::mutex> gatekeeper = profiledLock(m, "testLock");
+            BOOST_TEST(gatekeeper.owns_lock());
+            gatekeeper.unlock();
+            profiledRelock(gatekeeper, "testLock");
+            BOOST_TEST(gatekeeper.owns_lock());
+        }
+        ThreadPool::instance().configure(2);
+        ThreadPool::instance().run(4, [](size_t) {});
+    }
+    profiler.stop();
+    BOOST_TEST(Profiler::peakRSS() > 0);
+
+    std::ostringstream summary;
+    profiler.printSummary(summary);
+    const std::string s = summary.str();
+    BOOST_TEST(s.find("unprofiledStage") == std::string::npos);
+    BOOST_TEST(s.find("outerStage") < s.find("  innerStage"));
+    BOOST_TEST(s.find("testLock") != std::string::npos);
+    BOOST_TEST(s.find("worker 1") != std::string::npos);
+
+    BOOST_TEST(traceFilename("dir.v1/out.h5") == "dir.v1/out.trace.json");
+    BOOST_TEST(traceFilename("dir.v1/out") == "dir.v1/out.trace.json");
+    profiler.writeTrace("../unittests/outputs/profilerTest.trace.json");
+    std::ifstream trace("../unittests/outputs/profilerTest.trace.json");
+    std::string contents((std::istreambuf_iterator<char>(trace)), std::istreambuf_iterator<char>());
+    BOOST_TEST(contents.find("\"innerStage\"") != std::string::npos);
+    BOOST_TEST(contents.find("\"ph\":\"X\"") != std::string::npos);
+    std::remove("../unittests/outputs/profilerTest.trace.json");
+    ThreadPool::instance().configure(1);
+}
+
+BOOST_AUTO_TEST_CASE(perfCounters)
+{
+    BOOST_TEST(fftFlops(1024) == 5.0 * 1024 * 10);
+    BOOST_TEST(fftFlops(1) == 0);
+
+    ThreadPool::instance().configure(2);
+    Roofline roof = measureRoofline();
+    BOOST_TEST(roof.peakFlops > 0);
+    BOOST_TEST(roof.peakBandwidth > 0);
+
+    //counters need a PMU and permission, which CI machines and VMs often lack
+    PerfCounters &counters = PerfCounters::instance();
+    if (counters.open())
+    {
+        CounterValues before = counters.read();
+        volatile double x = 0;
+        for (auto i = 0; i < 1000000; ++i)
+            x += i;
+        CounterValues work = counters.read() - before;
+        BOOST_TEST(work.cycles > 0);
+        BOOST_TEST(work.instructions > 0);
+        counters.close();
+    }
+    BOOST_TEST(!counters.isOpen());
+    ThreadPool::instance().configure(1);
+}
+
+BOOST_AUTO_TEST_CASE(resourcePlanner)
+{
+    Metadata<PRISMATIC_FLOAT_PRECISION> meta;
+    meta.filenameAtoms = "../unittests/pfiles/center_Au.xyz";
+    meta.algorithm = Algorithm::PRISM;
+    meta.potential3D = false;
+    meta.interpolationFactorX = meta.interpolationFactorY = 2;
+    meta.numThreads = 2;
+    meta.batchSizeTargetCPU = 4;
+
+    //the estimated dimensions agree with what the simulation sets up
+    SimulationSize size = estimateSimulationSize(meta);
+    Parameters<PRISMATIC_FLOAT_PRECISION> pars(meta);
+    configure(pars.meta);
+    BOOST_TEST(size.imageSize[0] == pars.imageSize[0]);
+    BOOST_TEST(size.imageSize[1] == pars.imageSize[1]);
+    BOOST_TEST(size.numAtoms == pars.atoms.size());
+    PRISM01_calcPotential(pars);
+    BOOST_TEST(size.numPlanes == pars.numPlanes);
+    PRISM02_calcSMatrix(pars);
+    BOOST_TEST(std::abs((double)size.numBeams - pars.numberBeams) <= 0.25 * pars.numberBeams);
+
+    //without a budget the plan keeps the requested settings
+    ResourcePlan plan = planResources(meta, size);
+    BOOST_TEST(plan.fits);
+    BOOST_TEST(plan.batchSize == 4);
+    BOOST_TEST(plan.maxWorkerThreads == 0);
+    BOOST_TEST(plan.stages.size() == 3);
+    BOOST_TEST(plan.peakBytes() >= size.numBeams * pars.imageSize[0] * pars.imageSize[1] / 4 * sizeof(std::complex<PRISMATIC_FLOAT_PRECISION>));
+
+    //a budget just below the peak is met by giving up batching and workers, never by exceeding it
+    meta.memoryBudget = plan.peakBytes() - 1;
+    ResourcePlan fitted = planResources(meta, size);
+    BOOST_TEST(fitted.fits);
+    BOOST_TEST(fitted.peakBytes() <= meta.memoryBudget);
+    BOOST_TEST((fitted.batchSize < 4 || fitted.maxWorkerThreads > 0));
+    applyPlan(fitted, meta);
+    BOOST_TEST(meta.batchSizeTargetCPU == fitted.batchSize);
+
+    meta.memoryBudget = 1;
+    BOOST_TEST(!planResources(meta, size).fits);
+
+    std::stringstream out;
+    fitted.print(out);
+    BOOST_TEST(out.str().find("PRISM02_calcSMatrix") != std::string::npos);
+    ThreadPool::instance().configure(1);
+}
+
+BOOST_AUTO_TEST_CASE(outputFileSize)
+{
+    //HRTEM writes one image per tilt, multislice every output at each depth
+    Metadata<PRISMATIC_FLOAT_PRECISION> meta;
+    meta.filenameAtoms = "../unittests/pfiles/center_Au.xyz";
+    meta.savePotentialSlices = false;
+    meta.algorithm = Algorithm::HRTEM;
+    meta.maxXtilt = meta.maxYtilt = 2.0 / 1000;
+    meta.xTiltStep = meta.yTiltStep = 1.0 / 1000;
+    meta.numFP = 2;
+    meta.saveComplexOutputWave = false;
+    SimulationSize size = estimateSimulationSize(meta);
+    const std::array<double, 2> pixelSize = {size.tiledCellDim[1] / size.imageSize[0], size.tiledCellDim[2] / size.imageSize[1]};
+    const unsigned long long image = size.imageSize[0] * size.imageSize[1] / 4;
+    BOOST_TEST(size.numBeams > 1);
+    BOOST_TEST(outputFileElements(meta, size.imageSize, pixelSize, size.lambda, size.numProbes, size.numPlanes, 1) == size.numBeams * image);
+    meta.saveComplexOutputWave = true;
+    BOOST_TEST(outputFileElements(meta, size.imageSize, pixelSize, size.lambda, size.numProbes, size.numPlanes, 1) == 4 * size.numBeams * image);
+
+    meta.algorithm = Algorithm::Multislice;
+    meta.save4DOutput = true;
+    meta.numSlices = 0;
+    size = estimateSimulationSize(meta);
+    const unsigned long long oneDepth = outputFileElements(meta, size.imageSize, pixelSize, size.lambda, size.numProbes, size.numPlanes, 1);
+    meta.numSlices = (size.numPlanes + 2) / 3;
+    size = estimateSimulationSize(meta);
+    BOOST_TEST(size.numLayers == 3);
+    BOOST_TEST(outputFileElements(meta, size.imageSize, pixelSize, size.lambda, size.numProbes, size.numPlanes, 1) == 3 * oneDepth);
+}
+
+BOOST_AUTO_TEST_CASE(autotuner)
+{
+    const std::string cacheFile = "../unittests/outputs/autotuneTest.txt";
+    std::remove(cacheFile.c_str());
+
+    //the first tuning times candidates and records the winner
+    BatchTuning tuning = tuneBatchedFFT(48, 40, 2, cacheFile);
+    BOOST_TEST(tuning.seconds > 0);
+    BOOST_TEST(tuning.workers == 2); // too small a grid to give threads to FFTW
+    BOOST_TEST(tuning.batchSize >= 1);
+    BOOST_TEST(tuning.batchSize <= maxTunedBatchSize);
+    std::ifstream cache(cacheFile);
+    std::string line;
+    BOOST_TEST((bool)std::getline(cache, line));
+    BOOST_TEST(line.find("48x40") != std::string::npos);
+
+    //stages are kept within the job count and the planned batch size
+    Metadata<PRISMATIC_FLOAT_PRECISION> meta;
+    meta.numThreads = 2;
+    meta.autotuneCache = cacheFile;
+    ExecutionPolicy policy;
+    size_t batchSize;
+    autotuneBatch(meta, 48, 40, 1, policy, batchSize);
+    BOOST_TEST(policy.outerThreads == 1);
+    BOOST_TEST(batchSize == 1);
+    autotuneBatch(meta, 48, 40, 1000, policy, batchSize);
+    BOOST_TEST(batchSize == tuning.batchSize);
+    meta.memoryBudget = 1e9;
+    meta.batchSizeTargetCPU = 1;
+    autotuneBatch(meta, 48, 40, 1000, policy, batchSize);
+    BOOST_TEST(batchSize == 1);
+
+    std::remove(cacheFile.c_str());
+    ThreadPool::instance().configure(1);
+}
+
+BOOST_AUTO_TEST_CASE(fftFriendlyGrid)
+{
+    BOOST_TEST(isFFTFriendly(1));
+    BOOST_TEST(isFFTFriendly(2 * 3 * 5 * 7 * 8));
+    BOOST_TEST(!isFFTFriendly(11));
+    BOOST_TEST(!isFFTFriendly(133));
+
+    //133 multiples of 8 would be nearest, but 133 = 7 * 19 so 135 = 27 * 5 is taken instead
+    BOOST_TEST(simulationGridSize(106.4, 0.1, 8, false) == 1064);
+    BOOST_TEST(simulationGridSize(106.4, 0.1, 8, true) == 1080);
+    BOOST_TEST(simulationGridSize(1, 1, 8, true) == 8);
+    BOOST_TEST(simulationGridSize(0.1, 1, 4, true) == 4);
+
+    Metadata<PRISMATIC_FLOAT_PRECISION> meta;
+    meta.filenameAtoms = "../unittests/pfiles/center_Au.xyz";
+    meta.interpolationFactorX = meta.interpolationFactorY = 2;
+    meta.fftFriendlyGrid = true;
+    Parameters<PRISMATIC_FLOAT_PRECISION> pars(meta);
+    for (auto i = 0; i < 2; ++i)
+    {
+        BOOST_TEST(pars.imageSize[i] % 8 == 0);
+        BOOST_TEST(isFFTFriendly(pars.imageSize[i] / 8));
+        BOOST_TEST(std::abs(pars.pixelSize[i] * pars.imageSize[i] - pars.tiledCellDim[i + 1]) < 1e-3);
+    }
+    BOOST_TEST(estimateSimulationSize(meta).imageSize[0] == pars.imageSize[0]);
+}
+
+BOOST_AUTO_TEST_CASE(fftBackends)
+{
+    typedef std::complex<PRISMATIC_FLOAT_PRECISION> complex_t;
+    const size_t Ny = 12, Nx = 10, N = Ny * Nx, howmany = 3, Nh = Nx / 2 + 1;
+    std::mt19937 gen(17);
+    std::uniform_real_distribution<PRISMATIC_FLOAT_PRECISION> dist(-1, 1);
+    Array1D<complex_t> x = zeros_ND<1, complex_t>({{N * howmany}});
+    for (auto &v : x) v = complex_t(dist(gen), dist(gen));
+
+    //measured planning must leave the arrays alone, and repeated requests come from the cache
+    Array1D<complex_t> y = x;
+    FFTPlan forward = planFFT2D(Ny, Nx, &y[0], &y[0], FFTDirection::Forward, 1, FFTEffort::Measure, howmany);
+    const size_t cached = fftBackend().numCachedPlans();
+    FFTPlan inverse = planFFT2D(Ny, Nx, &y[0], &y[0], FFTDirection::Inverse, 1, FFTEffort::Measure, howmany);
+    planFFT2D(Ny, Nx, &y[0], &y[0], FFTDirection::Forward, 1, FFTEffort::Measure, howmany);
+    BOOST_TEST(fftBackend().numCachedPlans() == cached + 1);
+    PRISMATIC_FLOAT_PRECISION error = 0;
+    for (auto j = 0; j < y.size(); ++j) error = std::max(error, std::abs(y[j] - x[j]));
+    BOOST_TEST(error == 0);
+
+    //a batched transform matches one transform per array, and the inverse undoes it up to a factor N
+    forward.execute();
+    Array1D<complex_t> single = zeros_ND<1, complex_t>({{N}});
+    std::copy(&x[N], &x[2 * N], single.begin());
+    planFFT2D(Ny, Nx, &single[0], &single[0], FFTDirection::Forward).execute();
+    error = 0;
+    for (auto j = 0; j < N; ++j) error = std::max(error, std::abs(single[j] - y[N + j]));
+    BOOST_TEST(error < 1e-4);
+    inverse.execute();
+    error = 0;
+    for (auto j = 0; j < y.size(); ++j) error = std::max(error, std::abs(y[j] / (PRISMATIC_FLOAT_PRECISION)N - x[j]));
+    BOOST_TEST(error < 1e-5);
+
+    //real transforms agree with the complex transform of the same real array on the half they keep
+    Array1D<PRISMATIC_FLOAT_PRECISION> r = zeros_ND<1, PRISMATIC_FLOAT_PRECISION>({{N}});
+    Array1D<PRISMATIC_FLOAT_PRECISION> rBack = zeros_ND<1, PRISMATIC_FLOAT_PRECISION>({{N}});
+    Array1D<complex_t> rc = zeros_ND<1, complex_t>({{N}});
+    Array1D<complex_t> half = zeros_ND<1, complex_t>({{Ny * Nh}});
+    for (auto j = 0; j < N; ++j) rc[j] = r[j] = dist(gen);
+    planFFT2D(Ny, Nx, &rc[0], &rc[0], FFTDirection::Forward).execute();
+    planFFT2D_r2c(Ny, Nx, &r[0], &half[0]).execute();
+    error = 0;
+    for (auto j = 0; j < Ny; ++j)
+        for (auto i = 0; i < Nh; ++i) error = std::max(error, std::abs(half[j * Nh + i] - rc[j * Nx + i]));
+    BOOST_TEST(error < 1e-4);
+    planFFT2D_c2r(Ny, Nx, &half[0], &rBack[0]).execute();
+    error = 0;
+    for (auto j = 0; j < N; ++j) error = std::max(error, std::abs(rBack[j] / N - r[j]));
+    BOOST_TEST(error < 1e-5);
+    BOOST_CHECK_THROW(fftBackend().plan(FFTShape{Ny, Nx, 1, FFTKind::RealToComplex, FFTDirection::Forward, 1, FFTEffort::Estimate},
+                                        &half[0], &half[0]), std::runtime_error);
+
+    FFTBackendType type;
+    BOOST_TEST(parseFFTBackend("pocketfft", type));
+    BOOST_TEST((type == FFTBackendType::PocketFFT));
+    BOOST_TEST(!parseFFTBackend("mkl", type));
+    BOOST_TEST(fftBackendAvailable(FFTBackendType::FFTW));
+    BOOST_TEST(std::string(fftBackend().name()) == "fftw");
+    if (!fftBackendAvailable(FFTBackendType::PocketFFT))
+        BOOST_CHECK_THROW(setFFTBackend(FFTBackendType::PocketFFT), std::runtime_error);
+}
+
+BOOST_AUTO_TEST_CASE(mixedPrecisionSums)
+{
+    //many small intensities in one detector bin lose precision when summed in single precision
+    const size_t N = 1 << 20;
+    std::vector<PRISMATIC_FLOAT_PRECISION> intensity(N, (PRISMATIC_FLOAT_PRECISION)0.1);
+    std::vector<PRISMATIC_FLOAT_PRECISION> alphaInd(N, 1);
+    std::vector<PRISMATIC_FLOAT_PRECISION> qx(N), qy(N);
+    for (auto p = 0; p < N; ++p)
+    {
+        qx[p] = (PRISMATIC_FLOAT_PRECISION)(p % 7) - 3;
+        qy[p] = (PRISMATIC_FLOAT_PRECISION)(p % 5) - 2;
+    }
+    alphaInd[0] = 3; // past Ndet, so dropped
+    double exact = 0;
+    for (auto p = 1; p < N; ++p) exact += intensity[p];
+
+    std::vector<PRISMATIC_FLOAT_PRECISION> bins(2, 0), mixedBins(2, 0);
+    binDetector(&intensity[0], &alphaInd[0], N, 2, &bins[0], false);
+    binDetector(&intensity[0], &alphaInd[0], N, 2, &mixedBins[0], true);
+    BOOST_TEST(std::abs(mixedBins[0] - exact) / exact < 1e-6);
+    BOOST_TEST(std::abs(mixedBins[0] - exact) <= std::abs(bins[0] - exact));
+    BOOST_TEST(mixedBins[1] == 0);
+
+    //the single precision path is the original loop, so results do not change unless mixed precision is asked for
+    PRISMATIC_FLOAT_PRECISION reference = 0;
+    for (auto p = 1; p < N; ++p) reference += intensity[p];
+    BOOST_TEST(bins[0] == reference);
+
+    double exactCom[2] = {0, 0};
+    double intensitySum = 0;
+    for (auto p = 0; p < N; ++p)
+    {
+        exactCom[0] += (double)qx[p] * intensity[p];
+        exactCom[1] += (double)qy[p] * intensity[p];
+        intensitySum += intensity[p];
+    }
+    PRISMATIC_FLOAT_PRECISION com[2] = {0, 0};
+    centerOfMass(&intensity[0], &qx[0], &qy[0], N, com, true);
+    BOOST_TEST(std::abs(com[0] - exactCom[0] / intensitySum) < 1e-6);
+    BOOST_TEST(std::abs(com[1] - exactCom[1] / intensitySum) < 1e-6);
+}
+
 BOOST_AUTO_TEST_SUITE_END();
 
 } //namespace Prismatic
\ No newline at end of file
@@ -9,9 +9,10 @@
 #include <random>
 #include "fileIO.h"
 #include "H5Cpp.h"
-#include "fftw3.h"
+#include "FFTBackend.h"
 #include "ioTests.h"
 #include "utility.h"
+#include "PRISM02_calcSMatrix.h"
 
 namespace Prismatic{
 
@@ -158,6 +159,60 @@ BOOST_FIXTURE_TEST_CASE(matrixRefocus, basicSim)
     removeFile(fname_p);
 }
 
+BOOST_AUTO_TEST_CASE(refocus_batch)
+{
+    //batched in place refocus should match a per beam application of the propagator and be reversible
+    Parameters<PRISMATIC_FLOAT_PRECISION> pars;
+    size_t Ny = 12;
+    size_t Nx = 10;
+    size_t numBeams = 7;
+    pars.meta.numThreads = 3;
+    pars.lambda = 0.025;
+    pars.qyInd = zeros_ND<1, size_t>({{Ny}});
+    pars.qxInd = zeros_ND<1, size_t>({{Nx}});
+    pars.qxaOutput = zeros_ND<2, PRISMATIC_FLOAT_PRECISION>({{Ny, Nx}});
+    pars.qyaOutput = zeros_ND<2, PRISMATIC_FLOAT_PRECISION>({{Ny, Nx}});
+    for(auto y = 0; y < Ny; y++)
+    {
+        for(auto x = 0; x < Nx; x++)
+        {
+            pars.qxaOutput.at(y, x) = 0.1 * x;
+            pars.qyaOutput.at(y, x) = 0.1 * y;
+        }
+    }
+
+    std::default_random_engine de(1);
+    std::normal_distribution<PRISMATIC_FLOAT_PRECISION> randn(0, 1);
+    pars.Scompact = zeros_ND<3, std::complex<PRISMATIC_FLOAT_PRECISION>>({{numBeams, Ny, Nx}});
+    for(auto &s : pars.Scompact) s = std::complex<PRISMATIC_FLOAT_PRECISION>(randn(de), randn(de));
+    Array3D<std::complex<PRISMATIC_FLOAT_PRECISION>> Sref = pars.Scompact;
+
+    pars.sMatrix_defocus = 0.0;
+    pars.meta.probeDefocus = 50.0;
+    refocus(pars);
+
+    //reference for a single beam with an unbatched transform
+    size_t beam = 5;
+    Array2D<std::complex<PRISMATIC_FLOAT_PRECISION>> psi = zeros_ND<2, std::complex<PRISMATIC_FLOAT_PRECISION>>({{Ny, Nx}});
+    std::copy(&Sref.at(beam, 0, 0), &Sref.at(beam, 0, 0) + Ny * Nx, psi.begin());
+    FFTPlan plan_forward = planFFT2D(Ny, Nx, &psi[0], &psi[0], FFTDirection::Forward);
+    FFTPlan plan_inverse = planFFT2D(Ny, Nx, &psi[0], &psi[0], FFTDirection::Inverse);
+    plan_forward.execute();
+    for(auto j = 0; j < psi.size(); j++) psi[j] *= pars.propRefocus[j];
+    plan_inverse.execute();
+
+    PRISMATIC_FLOAT_PRECISION error = 0.0;
+    for(auto j = 0; j < psi.size(); j++) error += std::abs(psi[j] / (PRISMATIC_FLOAT_PRECISION) psi.size() - pars.Scompact[beam * Ny * Nx + j]);
+    BOOST_TEST(error / psi.size() < 1e-5);
+
+    //refocusing back to the original defocus recovers the input
+    pars.meta.probeDefocus = 0.0;
+    refocus(pars);
+    error = 0.0;
+    for(auto j = 0; j < Sref.size(); j++) error += std::abs(Sref[j] - pars.Scompact[j]);
+    BOOST_TEST(error / Sref.size() < 1e-5);
+}
+
 BOOST_AUTO_TEST_CASE(boolstream)
 {
     bool check = true;
@@ -8,9 +8,11 @@
 #include "params.h"
 #include <stdio.h>
 #include <random>
+#include <numeric>
 #include "fileIO.h"
 #include "utility.h"
 #include "parseInput.h"
+#include "seriesAccumulator.h"
 
 namespace Prismatic{
 
@@ -171,6 +173,56 @@ BOOST_FIXTURE_TEST_CASE(CC_series_P, basicSim)
     removeFile(meta.filenameOutput);
 }
 
+BOOST_FIXTURE_TEST_CASE(CC_series_singlePass, basicSim)
+{
+    //single pass and per-entry PRISM series should produce the same outputs
+    meta.algorithm = Algorithm::PRISM;
+    meta.simSeries = true;
+    meta.seriesVals = {{-10.0, 0.0, 10.0}};
+    meta.seriesKeys = {"probeDefocus"};
+    meta.seriesTags = {"_df0000", "_df0001", "_df0002"};
+    meta.save3DOutput = true;
+    meta.save2DOutput = false;
+    meta.save4DOutput = false;
+    meta.savePotentialSlices = false;
+    meta.saveDPC_CoM = true;
+    meta.probeStepX = 1;
+    meta.probeStepY = 1;
+
+    std::string fname_ref = "../unittests/outputs/CC_series_ref.h5";
+    std::string fname_test = "../unittests/outputs/CC_series_singlePass.h5";
+
+    divertOutput(pos, fd, logPath);
+    std::cout << "\n######## BEGIN TEST CASE: CC_series_singlePass ##########\n";
+    meta.seriesSinglePass = false;
+    meta.filenameOutput = fname_ref;
+    go(meta);
+    meta.seriesSinglePass = true;
+    meta.filenameOutput = fname_test;
+    go(meta);
+    std::cout << "########## END TEST CASE: CC_series_singlePass ##########\n";
+    revertOutput(fd, pos);
+
+    for(auto i = 0; i < meta.seriesTags.size(); i++)
+    {
+        std::string path_3D = "4DSTEM_simulation/data/realslices/virtual_detector_depth0000" + meta.seriesTags[i] + "/data";
+        std::string path_DPC = "4DSTEM_simulation/data/realslices/DPC_CoM_depth0000" + meta.seriesTags[i] + "/data";
+        Array3D<PRISMATIC_FLOAT_PRECISION> ref, test;
+        readRealDataSet_inOrder(ref, fname_ref, path_3D);
+        readRealDataSet_inOrder(test, fname_test, path_3D);
+        PRISMATIC_FLOAT_PRECISION refSum = std::accumulate(ref.begin(), ref.end(), (PRISMATIC_FLOAT_PRECISION)0.0);
+        BOOST_TEST(refSum > 0);
+        BOOST_TEST(compareValues(ref, test) / (refSum / ref.size()) < 0.001);
+
+        readRealDataSet_inOrder(ref, fname_ref, path_DPC);
+        readRealDataSet_inOrder(test, fname_test, path_DPC);
+        BOOST_TEST(compareValues(ref, test) < 0.001);
+    }
+
+    removeFile(fname_ref);
+    removeFile(fname_test);
+}
+
 BOOST_FIXTURE_TEST_CASE(CC_series_virtual, basicSim)
 {
     meta.simSeries = true;
@@ -218,6 +270,177 @@ BOOST_FIXTURE_TEST_CASE(CC_series_virtual, basicSim)
     removeFile(meta.filenameOutput);
 }
 
+BOOST_FIXTURE_TEST_CASE(aberration_series, basicSim)
+{
+    //series over an arbitrary aberration and the probe semiangle, expanded on a 2x2 grid
+    meta.algorithm = Algorithm::PRISM;
+    meta.simSeries = true;
+    meta.seriesInputKeys = {"C12", "probeSemiangle"};
+    meta.seriesInputVals = {{0.0, 200.0}, {0.015, 0.020}};
+    meta.filenameOutput = "../unittests/outputs/aberration_series.h5";
+    meta.save3DOutput = true;
+    meta.save2DOutput = false;
+    meta.save4DOutput = false;
+    meta.savePotentialSlices = false;
+    meta.saveDPC_CoM = false;
+    meta.probeStepX = 1;
+    meta.probeStepY = 1;
+
+    Parameters<PRISMATIC_FLOAT_PRECISION> series_pars(meta);
+    std::vector<std::string> tags = {"_series0000", "_series0001", "_series0002", "_series0003"};
+    BOOST_TEST(series_pars.meta.seriesTags == tags);
+    std::vector<PRISMATIC_FLOAT_PRECISION> C12_vals = {0.0, 0.0, 200.0, 200.0};
+    BOOST_TEST(series_pars.meta.seriesVals[0] == C12_vals);
+
+    divertOutput(pos, fd, logPath);
+    std::cout << "\n######## BEGIN TEST CASE: aberration_series ##########\n";
+    go(meta);
+    std::cout << "########## END TEST CASE: aberration_series ##########\n";
+    revertOutput(fd, pos);
+
+    //entries with and without C12 should differ at the same semiangle
+    std::string basename = "4DSTEM_simulation/data/realslices/virtual_detector_depth0000";
+    Array3D<PRISMATIC_FLOAT_PRECISION> vd_0, vd_2;
+    readRealDataSet_inOrder(vd_0, meta.filenameOutput, basename + tags[0] + "/data");
+    readRealDataSet_inOrder(vd_2, meta.filenameOutput, basename + tags[2] + "/data");
+    PRISMATIC_FLOAT_PRECISION refSum = std::accumulate(vd_0.begin(), vd_0.end(), (PRISMATIC_FLOAT_PRECISION)0.0);
+    BOOST_TEST(compareValues(vd_0, vd_2) / (refSum / vd_0.size()) > 0.001);
+
+    //supergroup carries one dimension per series key
+    H5::H5File output = H5::H5File(meta.filenameOutput.c_str(), H5F_ACC_RDONLY);
+    H5::DataSet sg = output.openDataSet("4DSTEM_simulation/data/supergroups/vd_series/supergroup");
+    H5::DataSpace sg_space = sg.getSpace();
+    BOOST_TEST(sg_space.getSimpleExtentNdims() == 5);
+    hsize_t dims[5], vd_dims[3];
+    sg_space.getSimpleExtentDims(dims, NULL);
+    output.openDataSet(basename + tags[0] + "/data").getSpace().getSimpleExtentDims(vd_dims, NULL);
+    for(auto i = 0; i < 3; i++) BOOST_TEST(dims[i] == vd_dims[i]);
+    BOOST_TEST(dims[3] == 2);
+    BOOST_TEST(dims[4] == 2);
+    output.close();
+
+    removeFile(meta.filenameOutput);
+}
+
+BOOST_FIXTURE_TEST_CASE(semiangle_series, basicSim)
+{
+    //a semiangle above the base one still gets all of its beams from the shared S-matrix
+    meta.algorithm = Algorithm::PRISM;
+    meta.simSeries = true;
+    meta.probeSemiangle = 0.020;
+    meta.seriesInputKeys = {"probeSemiangle"};
+    meta.seriesInputVals = {{0.020, 0.030}};
+    meta.filenameOutput = "../unittests/outputs/semiangle_series.h5";
+    meta.save3DOutput = true;
+    meta.save2DOutput = false;
+    meta.save4DOutput = false;
+    meta.savePotentialSlices = false;
+    meta.saveDPC_CoM = false;
+    meta.probeStepX = 1;
+    meta.probeStepY = 1;
+
+    Metadata<PRISMATIC_FLOAT_PRECISION> single = meta;
+    single.simSeries = false;
+    single.seriesInputKeys = {};
+    single.seriesInputVals = {};
+    single.probeSemiangle = 0.030;
+    single.filenameOutput = "../unittests/outputs/semiangle_single.h5";
+
+    divertOutput(pos, fd, logPath);
+    std::cout << "\n######## BEGIN TEST CASE: semiangle_series ##########\n";
+    go(meta);
+    go(single);
+    std::cout << "########## END TEST CASE: semiangle_series ##########\n";
+    revertOutput(fd, pos);
+
+    std::string basename = "4DSTEM_simulation/data/realslices/virtual_detector_depth0000";
+    Array3D<PRISMATIC_FLOAT_PRECISION> vd_series, vd_single;
+    readRealDataSet_inOrder(vd_series, meta.filenameOutput, basename + "_series0001/data");
+    readRealDataSet_inOrder(vd_single, single.filenameOutput, basename + "/data");
+    PRISMATIC_FLOAT_PRECISION refSum = std::accumulate(vd_single.begin(), vd_single.end(), (PRISMATIC_FLOAT_PRECISION)0.0);
+    BOOST_TEST(compareValues(vd_series, vd_single) / (refSum / vd_single.size()) < 1e-4);
+
+    removeFile(meta.filenameOutput);
+    removeFile(single.filenameOutput);
+}
+
+BOOST_AUTO_TEST_CASE(seriesAccumulator)
+{
+    //accumulate the same data in RAM and through a memory mapped scratch file
+    std::vector<std::string> tags = {"_df0000", "_df0001", "_df0002"};
+    std::array<size_t, 4> dims = {2, 5, 3, 7};
+    std::array<size_t, 4> dims_DPC = {2, 5, 3, 2};
+    Array4D<PRISMATIC_FLOAT_PRECISION> output = zeros_ND<4, PRISMATIC_FLOAT_PRECISION>(dims);
+    Array4D<PRISMATIC_FLOAT_PRECISION> DPC_CoM = zeros_ND<4, PRISMATIC_FLOAT_PRECISION>(dims_DPC);
+    for(auto i = 0; i < output.size(); i++) output[i] = i;
+    for(auto i = 0; i < DPC_CoM.size(); i++) DPC_CoM[i] = -1.0*i;
+
+    SeriesAccumulator inMemory;
+    SeriesAccumulator mapped;
+    inMemory.allocate(tags, dims, dims_DPC, 1e9, "");
+    mapped.allocate(tags, dims, dims_DPC, 0, "");
+    BOOST_TEST(!inMemory.isMapped());
+    BOOST_TEST(mapped.isMapped());
+
+    for(auto fp = 0; fp < 3; fp++)
+    {
+        for(auto t = 0; t < tags.size(); t++)
+        {
+            Array4D<PRISMATIC_FLOAT_PRECISION> scaled = output*(PRISMATIC_FLOAT_PRECISION)(t+1);
+            inMemory.accumulate(tags[t], scaled, DPC_CoM);
+            mapped.accumulate(tags[t], scaled, DPC_CoM);
+        }
+    }
+
+    for(auto t = 0; t < tags.size(); t++)
+    {
+        Array4D<PRISMATIC_FLOAT_PRECISION> ref = output*(PRISMATIC_FLOAT_PRECISION)(3*(t+1));
+        Array4D<PRISMATIC_FLOAT_PRECISION> ref_DPC = DPC_CoM*(PRISMATIC_FLOAT_PRECISION)3;
+        Array4D<PRISMATIC_FLOAT_PRECISION> test, test_DPC;
+        inMemory.retrieve(tags[t], test, test_DPC);
+        BOOST_TEST(compareValues(ref, test) < 0.001);
+        BOOST_TEST(compareValues(ref_DPC, test_DPC) < 0.001);
+
+        mapped.retrieve(tags[t], test, test_DPC);
+        BOOST_TEST(compareValues(ref, test) < 0.001);
+        BOOST_TEST(compareValues(ref_DPC, test_DPC) < 0.001);
+    }
+
+    mapped.release();
+    BOOST_TEST(!mapped.isAllocated());
+}
+
+BOOST_AUTO_TEST_CASE(seriesAccumulatorDoubleSums)
+{
+    //mixed precision keeps the sums in double, in RAM and in the scratch file
+    std::vector<std::string> tags = {"_df0000", "_df0001"};
+    std::array<size_t, 4> dims = {1, 3, 2, 4};
+    std::array<size_t, 4> dims_DPC = {1, 3, 2, 2};
+    Array4D<PRISMATIC_FLOAT_PRECISION> output = zeros_ND<4, PRISMATIC_FLOAT_PRECISION>(dims);
+    Array4D<PRISMATIC_FLOAT_PRECISION> DPC_CoM = zeros_ND<4, PRISMATIC_FLOAT_PRECISION>(dims_DPC);
+    for(auto i = 0; i < output.size(); i++) output[i] = 1 + (PRISMATIC_FLOAT_PRECISION)1e-7 * i;
+    for(auto i = 0; i < DPC_CoM.size(); i++) DPC_CoM[i] = -0.1;
+
+    for(auto budget : {1e9, 0.0})
+    {
+        SeriesAccumulator sums;
+        sums.allocate(tags, dims, dims_DPC, budget, "", true);
+        BOOST_TEST(sums.isMapped() == (budget == 0));
+        for(auto fp = 0; fp < 1000; fp++) sums.accumulate(tags[1], output, DPC_CoM);
+
+        SeriesAccumulator::sum_type test, test_DPC;
+        sums.retrieve(tags[1], test, test_DPC);
+        BOOST_TEST((test.get_dimarr() == dims));
+        for(auto i = 0; i < output.size(); i++) BOOST_TEST(std::abs(test[i] - 1000.0 * output[i]) < 1e-9);
+        for(auto i = 0; i < DPC_CoM.size(); i++) BOOST_TEST(std::abs(test_DPC[i] - 1000.0 * DPC_CoM[i]) < 1e-9);
+
+        //the other tag is untouched, and can be read at output precision
+        Array4D<PRISMATIC_FLOAT_PRECISION> other;
+        sums.retrieve(tags[0], other);
+        BOOST_TEST(*std::max_element(other.begin(), other.end()) == 0);
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END();
 
 } //namespace Prismatic
\ No newline at end of file